@@ -479,6 +479,13 @@ CacheVC::set_http_info(CacheHTTPInfo *ainfo)
     f.allow_empty_doc = 0;
   alternate.copy_shallow(ainfo);
   ainfo->clear();
+  // readers waiting for this alternate can now choose this writer
+  if (od && od->readers.head) {
+    EThread *t = this_ethread();
+    CACHE_TRY_LOCK(lock, vol->mutex, t);
+    if (lock)
+      od->wake_readers(t);
+  }
 }
 #endif
 
@@ -3046,6 +3053,7 @@ register_cache_stats(RecRawStatBlock *rsb, const char *prefix)
   REG_INT("frags_per_doc.3+", cache_three_plus_plus_fragment_document_count_stat);
   REG_INT("read_busy.success", cache_read_busy_success_stat);
   REG_INT("read_busy.failure", cache_read_busy_failure_stat);
+  REG_INT("read_busy.wait", cache_read_busy_wait_stat);
   REG_INT("write_bytes_stat", cache_write_bytes_stat);
   REG_INT("vector_marshals", cache_hdr_vector_marshal_stat);
   REG_INT("hdr_marshals", cache_hdr_marshal_stat);
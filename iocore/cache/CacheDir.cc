@@ -53,11 +53,6 @@ Dir empty_dir;
 
 // OpenDir
 
-OpenDir::OpenDir()
-{
-  SET_HANDLER(&OpenDir::signal_readers);
-}
-
 /*
    If allow_if_writers is false, open_write fails if there are other writers.
    max_writers sets the maximum number of concurrent writers that are
@@ -101,43 +96,17 @@ OpenDir::open_write(CacheVC *cont, int allow_if_writers, int max_writers)
   return 1;
 }
 
-int
-OpenDir::signal_readers(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
-{
-  Queue<CacheVC, Link_CacheVC_opendir_link> newly_delayed_readers;
-  EThread *t = mutex->thread_holding;
-  CacheVC *c = NULL;
-  while ((c = delayed_readers.dequeue())) {
-    CACHE_TRY_LOCK(lock, c->mutex, t);
-    if (lock) {
-      c->f.open_read_timeout = 0;
-      c->handleEvent(EVENT_IMMEDIATE, 0);
-      continue;
-    }
-    newly_delayed_readers.push(c);
-  }
-  if (newly_delayed_readers.head) {
-    delayed_readers = newly_delayed_readers;
-    EThread *t1 = newly_delayed_readers.head->mutex->thread_holding;
-    if (!t1)
-      t1 = mutex->thread_holding;
-    t1->schedule_in(this, HRTIME_MSECONDS(cache_config_mutex_retry_delay));
-  }
-  return 0;
-}
-
 int
 OpenDir::close_write(CacheVC *cont)
 {
   ink_assert(cont->vol->mutex->thread_holding == this_ethread());
   cont->od->writers.remove(cont);
   cont->od->num_writers--;
+  cont->od->wake_readers(cont->vol->mutex->thread_holding);
   if (!cont->od->writers.head) {
     unsigned int h = cont->first_key.word(0);
     int b = h % OPEN_DIR_BUCKETS;
     bucket[b].remove(cont->od);
-    delayed_readers.append(cont->od->readers);
-    signal_readers(0, 0);
     cont->od->vector.clear();
     THREAD_FREE(cont->od, openDirEntryAllocator, cont->mutex->thread_holding);
   }
@@ -156,17 +125,42 @@ OpenDir::open_read(INK_MD5 *key)
   return NULL;
 }
 
+// Park a reader until a writer of this entry sets its http info,
+// writes a fragment or leaves.  The reader still schedules its own
+// retry, which picks things up if the wakeup cannot take its lock.
+// The list and CacheVC::wait_od are protected by the vol lock.
 int
-OpenDirEntry::wait(CacheVC *cont, int msec)
+OpenDirEntry::wait(CacheVC *cont)
 {
   ink_assert(cont->vol->mutex->thread_holding == this_ethread());
-  cont->f.open_read_timeout = 1;
-  ink_assert(!cont->trigger);
-  cont->trigger = cont->vol->mutex->thread_holding->schedule_in_local(cont, HRTIME_MSECONDS(msec));
+  ink_assert(!cont->wait_od);
+  if (!cont->f.waited_for_writer) {
+    cont->f.waited_for_writer = 1;
+    ProxyMutex *mutex = cont->mutex;
+    Vol *vol = cont->vol;
+    CACHE_INCREMENT_DYN_STAT(cache_read_busy_wait_stat);
+  }
   readers.push(cont);
+  cont->wait_od = this;
   return EVENT_CONT;
 }
 
+void
+OpenDirEntry::wake_readers(EThread *t)
+{
+  CacheVC *c;
+
+  while ((c = readers.pop())) {
+    c->wait_od = NULL;
+    CACHE_TRY_LOCK(lock, c->mutex, t);
+    if (lock && c->trigger) {
+      EThread *et = c->trigger->ethread;
+      c->trigger->cancel_action();
+      c->trigger = et->schedule_imm_signal(c);
+    }
+  }
+}
+
 //
 // Cache Directory
 //
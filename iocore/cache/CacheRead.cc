@@ -294,12 +294,23 @@ CacheVC::openReadFromWriter(int event, Event * e)
   return openReadFromWriterFailure(CACHE_EVENT_OPEN_READ_FAILED, (Event *) -err);
 #else
   if (_action.cancelled) {
+    if (wait_od) {
+      CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
+      if (!lock)
+        VC_SCHED_LOCK_RETRY();
+      wait_od->readers.remove(this);
+      wait_od = NULL;
+    }
     od = NULL; // only open for read so no need to close
     return free_CacheVC(this);
   }
   CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
   if (!lock)
     VC_SCHED_LOCK_RETRY();
+  if (wait_od) {
+    wait_od->readers.remove(this);
+    wait_od = NULL;
+  }
   od = vol->open_read(&first_key); // recheck in case the lock failed
   if (!od) {
     MUTEX_RELEASE(lock);
@@ -308,6 +319,7 @@ CacheVC::openReadFromWriter(int event, Event * e)
     return openReadStartHead(event, e);
   } else
     ink_assert(od == vol->open_read(&first_key));
+  OpenDirEntry *cod = od;
   if (!write_vc) {
     int ret = openReadChooseWriter(event, e);
     if (ret < 0) {
@@ -320,6 +332,7 @@ CacheVC::openReadFromWriter(int event, Event * e)
       return openReadStartHead(event, e);
     } else if (ret == EVENT_CONT) {
       ink_assert(!write_vc);
+      cod->wait(this);
       VC_SCHED_WRITER_RETRY();
     } else
       ink_assert(write_vc);
@@ -334,9 +347,6 @@ CacheVC::openReadFromWriter(int event, Event * e)
       return openReadStartHead(event, e);
     }
   }
-#ifdef HTTP_CACHE
-  OpenDirEntry *cod = od;
-#endif
   od = NULL;
   // someone is currently writing the document
   if (write_vc->closed < 0) {
@@ -356,6 +366,7 @@ CacheVC::openReadFromWriter(int event, Event * e)
     DDebug("cache_read_agg",
           "%p: key: %X writer: closed:%d, fragment:%d, retry: %d",
           this, first_key.word(1), write_vc->closed, write_vc->fragment, writer_lock_retry);
+    cod->wait(this);
     VC_SCHED_WRITER_RETRY();
   }
 
@@ -1329,6 +1329,8 @@ CacheVC::openWriteWriteDone(int event, Event *e)
     DDebug("cache_insert", "WriteDone: %X, %X, %d", key.word(0), first_key.word(0), write_len);
     blocks = iobufferblock_skip(blocks, &offset, &length, write_len);
     next_CacheKey(&key, &key);
+    if (od && od->readers.head)
+      od->wake_readers(mutex->thread_holding);
   }
   if (closed)
     return die();
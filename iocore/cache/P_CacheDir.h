@@ -254,7 +254,7 @@ LINK_FORWARD_DECLARATION(CacheVC, opendir_link) // forward declaration
 struct OpenDirEntry
 {
   DLL<CacheVC, Link_CacheVC_opendir_link> writers;       // list of all the current writers
-  DLL<CacheVC, Link_CacheVC_opendir_link> readers;         // list of all the current readers - not used
+  DLL<CacheVC, Link_CacheVC_opendir_link> readers;         // readers waiting for a writer to make progress
   CacheHTTPInfoVector vector;   // Vector for the http document. Each writer
                                 // maintains a pointer to this vector and
                                 // writes it down to disk.
@@ -271,7 +271,8 @@ struct OpenDirEntry
 
   LINK(OpenDirEntry, link);
 
-  int wait(CacheVC *c, int msec);
+  int wait(CacheVC *c);
+  void wake_readers(EThread *t);
 
   bool has_multiple_writers()
   {
@@ -281,15 +282,11 @@ struct OpenDirEntry
 
 struct OpenDir: public Continuation
 {
-  Queue<CacheVC, Link_CacheVC_opendir_link> delayed_readers;
   DLL<OpenDirEntry> bucket[OPEN_DIR_BUCKETS];
 
   int open_write(CacheVC *c, int allow_if_writers, int max_writers);
   int close_write(CacheVC *c);
   OpenDirEntry *open_read(INK_MD5 *key);
-  int signal_readers(int event, Event *e);
-
-  OpenDir();
 };
 
 struct CacheSync: public Continuation
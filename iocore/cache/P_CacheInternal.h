@@ -157,6 +157,7 @@ enum
   cache_three_plus_plus_fragment_document_count_stat,
   cache_read_busy_success_stat,
   cache_read_busy_failure_stat,
+  cache_read_busy_wait_stat,
   cache_gc_bytes_evacuated_stat,
   cache_gc_frags_evacuated_stat,
   cache_write_bytes_stat,
@@ -460,6 +461,7 @@ struct CacheVC: public CacheVConnection
   int fragment;
   int scan_msec_delay;
   CacheVC *write_vc;
+  OpenDirEntry *wait_od;          // entry whose readers list we are on
   char *hostname;
   int host_len;
   int header_to_write_len;
@@ -486,7 +488,7 @@ struct CacheVC: public CacheVConnection
       unsigned int update:1;
       unsigned int remove:1;
       unsigned int remove_aborted_writers:1;
-      unsigned int open_read_timeout:1; // UNUSED
+      unsigned int waited_for_writer:1; // counted in read_busy.wait
       unsigned int data_done:1;
       unsigned int read_from_writer_called:1;
       unsigned int not_from_ram_cache:1;        // entire object was from ram cache
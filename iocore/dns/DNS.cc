@@ -46,6 +46,9 @@ int dns_failover_number = DEFAULT_FAILOVER_NUMBER;
 int dns_failover_period = DEFAULT_FAILOVER_PERIOD;
 int dns_failover_try_period = DEFAULT_FAILOVER_TRY_PERIOD;
 int dns_max_dns_in_flight = MAX_DNS_IN_FLIGHT;
+int dns_connections_per_server = 1;
+int dns_tcp_retry_truncated = 1;
+int dns_edns0_buffer_size = 0;
 int dns_validate_qname = 0;
 unsigned int dns_handler_initialized = 0;
 int dns_ns_rr = 0;
@@ -181,6 +184,13 @@ DNSProcessor::start(int, size_t stacksize) {
   REC_ReadConfigStringAlloc(dns_local_ipv6, "proxy.config.dns.local_ipv6");
   REC_ReadConfigStringAlloc(dns_resolv_conf, "proxy.config.dns.resolv_conf");
   REC_EstablishStaticConfigInt32(dns_thread, "proxy.config.dns.dedicated_thread");
+  REC_ReadConfigInt32(dns_connections_per_server, "proxy.config.dns.connections_per_server");
+  REC_EstablishStaticConfigInt32(dns_tcp_retry_truncated, "proxy.config.dns.tcp_retry_truncated");
+  REC_EstablishStaticConfigInt32(dns_edns0_buffer_size, "proxy.config.dns.edns0_buffer_size");
+  if (dns_connections_per_server < 1)
+    dns_connections_per_server = 1;
+  else if (dns_connections_per_server > MAX_DNS_CONNECTIONS_PER_NAMED)
+    dns_connections_per_server = MAX_DNS_CONNECTIONS_PER_NAMED;
 
   if (dns_thread > 0) {
     // TODO: Hmmm, should we just get a single thread some other way?
@@ -366,16 +376,8 @@ DNSEntry::init(const char *x, int len, int qtype_arg, Continuation* acont,
   action = acont;
   submit_thread = acont->mutex->thread_holding;
 
-#ifdef SPLIT_DNS
-  if (SplitDNSConfig::gsplit_dns_enabled) {
-    dnsH = opt.handler ? opt.handler : dnsProcessor.handler;
-  } else {
-    dnsH = dnsProcessor.handler;
-  }
-#else
-  INK_NOWARN(adnsH);
-  dnsH = dnsProcessor.handler;
-#endif // SPLIT_DNS
+  // Only SplitDNS and the tests pick a handler of their own.
+  dnsH = opt.handler ? opt.handler : dnsProcessor.handler;
 
   dnsH->txn_lookup_timeout = opt.timeout;
 
@@ -427,6 +429,7 @@ DNSHandler::open_con(sockaddr const* target, bool failed, int icon)
     con[icon].eio.stop();
     con[icon].close();
   }
+  tcp_close(icon);
 
   if (con[icon].connect(
       target, DNSConnection::Options()
@@ -454,6 +457,170 @@ DNSHandler::open_con(sockaddr const* target, bool failed, int icon)
       Debug("dns", "opening connection %s SUCCEEDED for %d", ip_text, icon);
     }
   }
+
+  // Additional source ports for the same nameserver.  These are best
+  // effort, send_con() skips any that did not open.
+  for (int i = 0; i < MAX_DNS_CONNECTIONS_PER_NAMED - 1; i++) {
+    DNSConnection *c = &spread_con[icon][i];
+
+    if (c->fd != NO_FD) {
+      c->eio.stop();
+      c->close();
+    }
+    if (i + 1 >= dns_connections_per_server)
+      continue;
+    if (c->connect(target, DNSConnection::Options()
+                   .setNonBlockingConnect(true)
+                   .setNonBlockingIo(true)
+                   .setUseTcp(false)
+                   .setBindRandomPort(true)
+                   .setLocalIpv6(&local_ipv6.sa)
+                   .setLocalIpv4(&local_ipv4.sa)) < 0) {
+      Debug("dns", "opening additional connection %d to %s FAILED for %d", i + 1, ip_text, icon);
+    } else if (c->eio.start(pd, c, EVENTIO_READ) < 0) {
+      Error("[iocore_dns] open_con: Failed to add %d server to epoll list\n", icon);
+      c->close();
+    } else
+      c->num = icon;
+  }
+  next_con[icon] = 0;
+}
+
+/**
+  Send @a query on the TCP connection to nameserver @a ndx, opening it
+  if needed.  The connection stays open and carries any number of
+  queries, answers are matched by query id in whatever order they come.
+
+  @return 1 if sent, 0 if the connection is not up yet, -1 on failure.
+
+*/
+int
+DNSHandler::tcp_send(int ndx, char *query, int len)
+{
+  DNSConnection *c = &tcp_con[ndx];
+  char buf[2 + MAX_DNS_PACKET_LEN];
+
+  if (c->fd == NO_FD) {
+    if (con[ndx].fd == NO_FD)
+      return -1;
+    if (c->connect(&con[ndx].ip.sa, DNSConnection::Options()
+                   .setNonBlockingConnect(true)
+                   .setNonBlockingIo(true)
+                   .setUseTcp(true)
+                   .setBindRandomPort(false)
+                   .setLocalIpv6(&local_ipv6.sa)
+                   .setLocalIpv4(&local_ipv4.sa)) < 0) {
+      Debug("dns", "opening TCP connection to nameserver %d FAILED", ndx);
+      return -1;
+    }
+    c->tcp = true;
+    c->tcp_opened = ink_get_hrtime();
+    // Writable means the connect finished, wake up to send.
+    if (c->eio.start(get_PollDescriptor(dnsProcessor.thread), c, EVENTIO_READ | EVENTIO_WRITE) < 0) {
+      Error("[iocore_dns] tcp_send: Failed to add %d server to epoll list\n", ndx);
+      c->close();
+      return -1;
+    }
+  }
+
+  buf[0] = (len >> 8) & 0xff;
+  buf[1] = len & 0xff;
+  memcpy(buf + 2, query, len);
+  int s = socketManager.send(c->fd, buf, len + 2, 0);
+  if (s == -EAGAIN || s == -ENOTCONN)
+    return 0;
+  if (s != len + 2) {
+    Debug("dns", "TCP send to nameserver %d failed: %d", ndx, s);
+    tcp_close(ndx);
+    return -1;
+  }
+  DNS_INCREMENT_DYN_STAT(dns_tcp_queries_stat);
+  if (c->tcp_queries++)
+    DNS_INCREMENT_DYN_STAT(dns_tcp_reused_stat);
+  return 1;
+}
+
+/** Read whatever complete answers the TCP connection @a dnsc has. */
+void
+DNSHandler::tcp_recv(DNSConnection *dnsc)
+{
+  while (dnsc->fd != NO_FD) {
+    int res;
+
+    if (dnsc->tcp_len < 0)
+      res = socketManager.recv(dnsc->fd, dnsc->tcp_prefix + dnsc->tcp_got, 2 - dnsc->tcp_got, 0);
+    else
+      res = socketManager.recv(dnsc->fd, dnsc->tcp_reply->buf + dnsc->tcp_got, dnsc->tcp_len - dnsc->tcp_got, 0);
+
+    if (res == -EAGAIN || res == -ENOTCONN)
+      return;
+    if (res <= 0) {
+      Debug("dns", "TCP connection to nameserver %d closed: %d", dnsc->num, res);
+      tcp_close(dnsc->num);
+      return;
+    }
+
+    dnsc->tcp_got += res;
+    if (dnsc->tcp_len < 0) {
+      if (dnsc->tcp_got < 2)
+        continue;
+      dnsc->tcp_len = (dnsc->tcp_prefix[0] << 8) | dnsc->tcp_prefix[1];
+      dnsc->tcp_got = 0;
+      if (dnsc->tcp_len < HFIXEDSZ || dnsc->tcp_len > MAX_DNS_PACKET_LEN) {
+        Debug("dns", "bad TCP answer length %d from nameserver %d", dnsc->tcp_len, dnsc->num);
+        tcp_close(dnsc->num);
+        return;
+      }
+      if (!dnsc->tcp_reply)
+        dnsc->tcp_reply = dnsBufAllocator.alloc();
+    } else if (dnsc->tcp_got == dnsc->tcp_len) {
+      HostEnt *buf = dnsc->tcp_reply;
+      int len = dnsc->tcp_len;
+
+      dnsc->tcp_reply = NULL;
+      dnsc->tcp_len = -1;
+      dnsc->tcp_got = 0;
+      recv_one(dnsc, buf, len);
+    }
+  }
+}
+
+/** Close the TCP connection to @a ndx, and go back to UDP for what was on it. */
+void
+DNSHandler::tcp_close(int ndx)
+{
+  DNSConnection *c = &tcp_con[ndx];
+
+  if (c->fd != NO_FD) {
+    c->eio.stop();
+    c->close();
+  }
+  for (DNSEntry *e = entries.head; e; e = (DNSEntry *) e->link.next) {
+    if (e->use_tcp && e->which_ns == ndx) {
+      e->use_tcp = false;
+      if (e->written_flag) {
+        e->written_flag = false;
+        --in_flight;
+        DNS_DECREMENT_DYN_STAT(dns_in_flight_stat);
+      }
+    }
+  }
+}
+
+/** Pick the socket for the next query to nameserver @a ndx. */
+DNSConnection *
+DNSHandler::send_con(int ndx)
+{
+  for (int i = 0; i < dns_connections_per_server; i++) {
+    int j = next_con[ndx];
+
+    next_con[ndx] = (j + 1) % dns_connections_per_server;
+    if (!j)
+      return &con[ndx];
+    if (spread_con[ndx][j - 1].fd != NO_FD)
+      return &spread_con[ndx][j - 1];
+  }
+  return &con[ndx];
 }
 
 void
@@ -732,19 +899,51 @@ DNSHandler::recv_dns(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
   ip_text_buffer ipbuff1, ipbuff2;
 
   while ((dnsc = (DNSConnection *) triggered.dequeue())) {
-    while (1) {
-      IpEndpoint from_ip;
-      socklen_t from_length = sizeof(from_ip);
-
-      if (!hostent_cache)
-        hostent_cache = dnsBufAllocator.alloc();
-      HostEnt *buf = hostent_cache;
+    if (dnsc->tcp) {
+      tcp_recv(dnsc);
+      continue;
+    }
 
-      int res = socketManager.recvfrom(dnsc->fd, buf->buf, MAX_DNS_PACKET_LEN, 0, &from_ip.sa, &from_length);
+    while (1) {
+      IpEndpoint from_ip[DNS_RECV_BATCH];
+      int size[DNS_RECV_BATCH];
+      int n = 0;
+
+      for (int i = 0; i < DNS_RECV_BATCH; i++)
+        if (!hostent_cache[i])
+          hostent_cache[i] = dnsBufAllocator.alloc();
+
+#ifdef MSG_WAITFORONE
+      // Drain up to a batch of datagrams with one system call.
+      struct mmsghdr msgs[DNS_RECV_BATCH];
+      struct iovec iov[DNS_RECV_BATCH];
+
+      memset(msgs, 0, sizeof(msgs));
+      for (int i = 0; i < DNS_RECV_BATCH; i++) {
+        iov[i].iov_base = hostent_cache[i]->buf;
+        iov[i].iov_len = MAX_DNS_PACKET_LEN;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from_ip[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from_ip[i]);
+      }
+      int res = socketManager.recvmmsg(dnsc->fd, msgs, DNS_RECV_BATCH, 0);
+      for (n = 0; n < res; n++)
+        size[n] = msgs[n].msg_len;
+#else
+      socklen_t from_length = sizeof(from_ip[0]);
+      int res = socketManager.recvfrom(dnsc->fd, hostent_cache[0]->buf, MAX_DNS_PACKET_LEN, 0,
+                                       &from_ip[0].sa, &from_length);
+      if (res >= 0) {
+        size[0] = res;
+        n = 1;
+      }
+#endif
 
-      if (res == -EAGAIN)
+      // The socket is edge triggered, so read until it is empty.
+      if (res == -EAGAIN || (res == 0 && !n))
         break;
-      if (res <= 0) {
+      if (res < 0) {
         Debug("dns", "named error: %d", res);
         if (dns_ns_rr)
           rr_failure(dnsc->num);
@@ -752,47 +951,69 @@ DNSHandler::recv_dns(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
           failover();
         break;
       }
+      if (n > 1)
+        DNS_SUM_DYN_STAT(dns_batched_responses_stat, n);
 
-      // verify that this response came from the correct server
-      if (!ats_ip_addr_eq(&dnsc->ip.sa, &from_ip.sa)) {
-        Warning("unexpected DNS response from %s (expected %s)",
-          ats_ip_ntop(&from_ip.sa, ipbuff1, sizeof ipbuff1),
-          ats_ip_ntop(&dnsc->ip.sa, ipbuff2, sizeof ipbuff2)
-        );
-        continue;
-      }
-      hostent_cache = 0;
-      buf->packet_size = res;
-      Debug("dns", "received packet size = %d", res);
-      if (dns_ns_rr) {
-        Debug("dns", "round-robin: nameserver %d DNS response code = %d", dnsc->num, get_rcode(buf));
-        if (good_rcode(buf->buf)) {
-          received_one(dnsc->num);
-          if (ns_down[dnsc->num]) {
-            Warning("connection to DNS server %s restored",
-              ats_ip_ntop(&m_res->nsaddr_list[dnsc->num].sa, ipbuff1, sizeof ipbuff1)
-            );
-            ns_down[dnsc->num] = 0;
-          }
+      for (int i = 0; i < n; i++) {
+        HostEnt *buf = hostent_cache[i];
+        int res = size[i];
+
+        // An empty datagram has no answer in it, but the rest of the batch may.
+        if (res <= 0) {
+          Debug("dns", "ignoring empty DNS response");
+          continue;
         }
-      } else {
-        if (!dnsc->num) {
-          Debug("dns", "primary DNS response code = %d", get_rcode(buf));
-          if (good_rcode(buf->buf)) {
-            if (name_server)
-              recover();
-            else
-              received_one(name_server);
-          }
+
+        // verify that this response came from the correct server
+        if (!ats_ip_addr_eq(&dnsc->ip.sa, &from_ip[i].sa)) {
+          Warning("unexpected DNS response from %s (expected %s)",
+            ats_ip_ntop(&from_ip[i].sa, ipbuff1, sizeof ipbuff1),
+            ats_ip_ntop(&dnsc->ip.sa, ipbuff2, sizeof ipbuff2)
+          );
+          continue;
         }
+        hostent_cache[i] = 0;
+        recv_one(dnsc, buf, res);
       }
-      Ptr<HostEnt> protect_hostent = make_ptr(buf);
-      if (dns_process(this, buf, res)) {
-        if (dnsc->num == name_server)
+    }
+  }
+}
+
+/** Handle one response datagram @a buf of @a res bytes from @a dnsc. */
+void
+DNSHandler::recv_one(DNSConnection *dnsc, HostEnt *buf, int res)
+{
+  ip_text_buffer ipbuff1;
+
+  buf->packet_size = res;
+  Debug("dns", "received packet size = %d", res);
+  if (dns_ns_rr) {
+    Debug("dns", "round-robin: nameserver %d DNS response code = %d", dnsc->num, get_rcode(buf));
+    if (good_rcode(buf->buf)) {
+      received_one(dnsc->num);
+      if (ns_down[dnsc->num]) {
+        Warning("connection to DNS server %s restored",
+          ats_ip_ntop(&m_res->nsaddr_list[dnsc->num].sa, ipbuff1, sizeof ipbuff1)
+        );
+        ns_down[dnsc->num] = 0;
+      }
+    }
+  } else {
+    if (!dnsc->num) {
+      Debug("dns", "primary DNS response code = %d", get_rcode(buf));
+      if (good_rcode(buf->buf)) {
+        if (name_server)
+          recover();
+        else
           received_one(name_server);
       }
     }
   }
+  Ptr<HostEnt> protect_hostent = make_ptr(buf);
+  if (dns_process(this, buf, res)) {
+    if (dnsc->num == name_server)
+      received_one(name_server);
+  }
 }
 
 /** Main event for the DNSHandler. Attempt to read from and write to named. */
@@ -837,6 +1058,17 @@ DNSHandler::mainEvent(int event, Event *e)
       try_primary_named(true);
   }
 
+  // Give up on TCP connections that don't come up; the queries waiting on
+  // them go back to UDP.
+  for (int i = 0; i < MAX_NAMED; i++) {
+    DNSConnection *c = &tcp_con[i];
+
+    if (c->fd != NO_FD && !c->tcp_queries && ink_get_hrtime() - c->tcp_opened > HRTIME_SECONDS(dns_timeout)) {
+      Debug("dns", "TCP connection to nameserver %d timed out", i);
+      tcp_close(i);
+    }
+  }
+
   if (entries.head)
     write_dns(this);
 
@@ -947,6 +1179,17 @@ DNSHandler::get_query_id()
   return q2;
 }
 
+/** Time out @a e after the lookup timeout. */
+static inline void
+schedule_timeout(DNSHandler *h, DNSEntry *e)
+{
+  if (h->txn_lookup_timeout) {
+    e->timeout = h->mutex->thread_holding->schedule_in(e, HRTIME_MSECONDS(h->txn_lookup_timeout));      //this is in msec
+  } else {
+    e->timeout = h->mutex->thread_holding->schedule_in(e, HRTIME_SECONDS(dns_timeout));
+  }
+}
+
 /**
   Construct and Write the request for a single entry (using send(3N)).
 
@@ -969,6 +1212,19 @@ write_dns_event(DNSHandler *h, DNSEntry *e)
     return true;
   }
 
+  // Advertise a larger UDP buffer with an EDNS0 OPT record (RFC 6891).
+  if (dns_edns0_buffer_size && !e->no_edns && r + 11 <= MAX_DNS_PACKET_LEN) {
+    unsigned char *opt = (unsigned char *) blob._b + r;
+    int size = dns_edns0_buffer_size < MAX_DNS_PACKET_LEN ? dns_edns0_buffer_size : MAX_DNS_PACKET_LEN;
+
+    memset(opt, 0, 11);
+    opt[2] = ns_t_opt;          // root name, then TYPE OPT
+    opt[3] = (size >> 8) & 0xff;
+    opt[4] = size & 0xff;       // CLASS is the payload size, TTL and RDLEN are 0
+    blob._h.arcount = htons(ntohs(blob._h.arcount) + 1);
+    r += 11;
+  }
+
   uint16_t i = h->get_query_id();
   blob._h.id = htons(i);
   if (e->id[dns_retries - e->retries] >= 0) {
@@ -976,23 +1232,45 @@ write_dns_event(DNSHandler *h, DNSEntry *e)
     h->release_query_id(e->id[dns_retries - e->retries]);
   }
   e->id[dns_retries - e->retries] = i;
-  Debug("dns", "send query (qtype=%d) for %s to fd %d", e->qtype, e->qname, h->con[h->name_server].fd);
+  int ns = h->name_server;
+
+  if (e->use_tcp) {
+    // Truncated over UDP, ask the same nameserver again over TCP.
+    ns = e->which_ns;
+    Debug("dns", "send query (qtype=%d) for %s to nameserver %d over TCP", e->qtype, e->qname, ns);
+    int t = h->tcp_send(ns, blob._b, r);
+    if (!t) {
+      // Connecting, sent on a later pass. Time out as if it had been sent,
+      // so a nameserver that drops the connect can't hold the query up.
+      if (!e->timeout)
+        schedule_timeout(h, e);
+      return true;
+    }
+    if (t < 0) {
+      e->use_tcp = false;
+      ns = h->name_server;
+    }
+  }
 
-  int s = socketManager.send(h->con[h->name_server].fd, blob._b, r, 0);
-  if (s != r) {
-    Debug("dns", "send() failed: qname = %s, %d != %d, nameserver= %d", e->qname, s, r, h->name_server);
-    // changed if condition from 'r < 0' to 's < 0' - 8/2001 pas
-    if (s < 0) {
-      if (dns_ns_rr)
-        h->rr_failure(h->name_server);
-      else
-        h->failover();
+  if (!e->use_tcp) {
+    Debug("dns", "send query (qtype=%d) for %s to nameserver %d", e->qtype, e->qname, ns);
+
+    int s = socketManager.send(h->send_con(ns)->fd, blob._b, r, 0);
+    if (s != r) {
+      Debug("dns", "send() failed: qname = %s, %d != %d, nameserver= %d", e->qname, s, r, ns);
+      // changed if condition from 'r < 0' to 's < 0' - 8/2001 pas
+      if (s < 0) {
+        if (dns_ns_rr)
+          h->rr_failure(ns);
+        else
+          h->failover();
+      }
+      return false;
     }
-    return false;
   }
 
   e->written_flag = true;
-  e->which_ns = h->name_server;
+  e->which_ns = ns;
   e->once_written_flag = true;
   ++h->in_flight;
   DNS_INCREMENT_DYN_STAT(dns_in_flight_stat);
@@ -1001,15 +1279,11 @@ write_dns_event(DNSHandler *h, DNSEntry *e)
 
   if (e->timeout)
     e->timeout->cancel();
+  schedule_timeout(h, e);
 
-  if (h->txn_lookup_timeout) {
-    e->timeout = h->mutex->thread_holding->schedule_in(e, HRTIME_MSECONDS(h->txn_lookup_timeout));      //this is in msec
-  } else {
-    e->timeout = h->mutex->thread_holding->schedule_in(e, HRTIME_SECONDS(dns_timeout));
-  }
-
-  Debug("dns", "sent qname = %s, id = %u, nameserver = %d", e->qname, e->id[dns_retries - e->retries], h->name_server);
-  h->sent_one();
+  Debug("dns", "sent qname = %s, id = %u, nameserver = %d", e->qname, e->id[dns_retries - e->retries], ns);
+  if (!e->use_tcp)
+    h->sent_one();
   return true;
 }
 
@@ -1076,6 +1350,9 @@ DNSEntry::mainEvent(int event, Event *e)
       --(dnsH->in_flight);
       DNS_DECREMENT_DYN_STAT(dns_in_flight_stat);
     }
+    // Nothing came back over TCP, so ask over UDP again. tcp_tried is set,
+    // so a truncated answer is now taken as it is.
+    use_tcp = false;
     timeout = NULL;
     dns_result(dnsH, this, result_ent, true);
     return EVENT_DONE;
@@ -1311,6 +1588,24 @@ dns_process(DNSHandler *handler, HostEnt *buf, int len)
 
   DNS_SUM_DYN_STAT(dns_response_time_stat, ink_get_hrtime() - e->send_time);
 
+  // A truncated answer goes out again over TCP, once; write_dns() sends it
+  // after this read pass.
+  if (h->tc) {
+    DNS_INCREMENT_DYN_STAT(dns_truncated_responses_stat);
+    if (dns_tcp_retry_truncated && !e->tcp_tried) {
+      Debug("dns", "truncated answer for [%s], retrying over TCP", e->qname);
+      e->use_tcp = e->tcp_tried = true;
+      return true;
+    }
+  }
+  // A server without EDNS0 rejects the OPT record, ask again without it.
+  if (h->rcode == FORMERR && dns_edns0_buffer_size && !e->no_edns) {
+    Debug("dns", "FORMERR for [%s], retrying without EDNS0", e->qname);
+    DNS_INCREMENT_DYN_STAT(dns_edns0_fallbacks_stat);
+    e->no_edns = true;
+    return true;
+  }
+
   if (h->rcode != NOERROR || !h->ancount) {
     Debug("dns", "received rcode = %d", h->rcode);
     switch (h->rcode) {
@@ -1663,6 +1958,26 @@ ink_dns_init(ModuleVersion v)
                      "proxy.process.dns.in_flight",
                      RECD_INT, RECP_NON_PERSISTENT, (int) dns_in_flight_stat, RecRawStatSyncSum);
 
+  RecRegisterRawStat(dns_rsb, RECT_PROCESS,
+                     "proxy.process.dns.batched_responses",
+                     RECD_INT, RECP_NULL, (int) dns_batched_responses_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(dns_rsb, RECT_PROCESS,
+                     "proxy.process.dns.truncated_responses",
+                     RECD_INT, RECP_NULL, (int) dns_truncated_responses_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(dns_rsb, RECT_PROCESS,
+                     "proxy.process.dns.tcp_queries",
+                     RECD_INT, RECP_NULL, (int) dns_tcp_queries_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(dns_rsb, RECT_PROCESS,
+                     "proxy.process.dns.tcp_reused",
+                     RECD_INT, RECP_NULL, (int) dns_tcp_reused_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(dns_rsb, RECT_PROCESS,
+                     "proxy.process.dns.edns0_fallbacks",
+                     RECD_INT, RECP_NULL, (int) dns_edns0_fallbacks_stat, RecRawStatSyncSum);
+
 }
 
 
@@ -1726,4 +2041,441 @@ REGRESSION_TEST(DNS) (RegressionTest *t, int atype, int *pstatus) {
                              HRTIME_SECONDS(1));
 }
 
+// A nameserver for the tests, on its own thread, that answers every
+// query with DNS_STUB_ADDR so that lookups never leave the host.  It also
+// takes queries over TCP on the same port, unless it is started with
+// @a blackhole, which makes it drop every TCP connect.  Names starting with
+// "tc." are truncated over UDP, and names starting with "noedns." get
+// FORMERR if the query has an EDNS0 record.
+#define DNS_STUB_ADDR 0x7f000002 // 127.0.0.2
+#define DNS_STUB_CONNS 4
+
+struct DNSStubServer
+{
+  int fd;
+  int tcp_fd;
+  int filler;                   // fills the accept queue of a blackhole
+  int conns[DNS_STUB_CONNS];
+  IpEndpoint ip;
+  volatile bool stop;
+  volatile int queries;         // over UDP
+  volatile int edns_queries;    // over UDP, with an EDNS0 record
+  volatile int tcp_queries;
+  volatile int tcp_accepts;
+  ink_thread tid;
+};
+
+// Turn the query in @a buf into an answer in place.  Returns the length of
+// the answer, or 0 if there is nothing to answer.
+static int
+dns_stub_answer(DNSStubServer *s, unsigned char *buf, int len, int size, bool tcp)
+{
+  static const unsigned char answer[] = {
+    0xc0, HFIXEDSZ,             // name: the one in the question
+    0, T_A, 0, C_IN,
+    0, 0, 0x0e, 0x10,           // TTL
+    0, 4,
+    (DNS_STUB_ADDR >> 24) & 0xff, (DNS_STUB_ADDR >> 16) & 0xff, (DNS_STUB_ADDR >> 8) & 0xff, DNS_STUB_ADDR & 0xff
+  };
+  HEADER *h = (HEADER *) buf;
+  unsigned char *name = buf + HFIXEDSZ;
+  unsigned char *p = name;
+  bool edns;
+
+  if (len < HFIXEDSZ || h->qr || ntohs(h->qdcount) != 1)
+    return 0;
+  while (p < buf + len && *p)
+    p += *p + 1;
+  p += 1 + QFIXEDSZ;
+  if (p > buf + len || p + sizeof(answer) > buf + size)
+    return 0;
+
+  edns = h->arcount != 0;
+  if (tcp)
+    ink_atomic_increment(&s->tcp_queries, 1);
+  else if (edns)
+    ink_atomic_increment(&s->edns_queries, 1);
+
+  h->qr = 1;
+  h->ra = 1;
+  h->rcode = NOERROR;
+  h->ancount = 0;
+  h->nscount = 0;
+  h->arcount = 0;               // drops any EDNS0 OPT record
+  if (!tcp && name[0] == 2 && !memcmp(name + 1, "tc", 2))
+    h->tc = 1;                  // the answer is still there, like a partial one
+  if (edns && name[0] == 6 && !memcmp(name + 1, "noedns", 6)) {
+    h->rcode = FORMERR;
+    return p - buf;
+  }
+  h->ancount = htons(1);
+  memcpy(p, answer, sizeof(answer));
+  return p + sizeof(answer) - buf;
+}
+
+// Answer one length prefixed query on the TCP connection @a fd.
+static bool
+dns_stub_serve_tcp(DNSStubServer *s, int fd)
+{
+  unsigned char buf[2 + MAX_DNS_PACKET_LEN];
+  int len;
+
+  if (recv(fd, buf, 2, MSG_WAITALL) != 2)
+    return false;
+  len = (buf[0] << 8) | buf[1];
+  if (len > MAX_DNS_PACKET_LEN || recv(fd, buf + 2, len, MSG_WAITALL) != len)
+    return false;
+  if ((len = dns_stub_answer(s, buf + 2, len, MAX_DNS_PACKET_LEN, true)) > 0) {
+    buf[0] = (len >> 8) & 0xff;
+    buf[1] = len & 0xff;
+    return send(fd, buf, len + 2, 0) == len + 2;
+  }
+  return true;
+}
+
+static void *
+dns_stub_serve(void *arg)
+{
+  DNSStubServer *s = (DNSStubServer *) arg;
+  unsigned char buf[MAX_DNS_PACKET_LEN];
+  IpEndpoint from;
+
+  while (!s->stop) {
+    struct pollfd pfd[2 + DNS_STUB_CONNS];
+
+    pfd[0].fd = s->fd;
+    pfd[1].fd = s->filler < 0 ? s->tcp_fd : -1;
+    for (int i = 0; i < DNS_STUB_CONNS; i++)
+      pfd[2 + i].fd = s->conns[i];
+    for (int i = 0; i < 2 + DNS_STUB_CONNS; i++)
+      pfd[i].events = POLLIN;
+    if (poll(pfd, countof(pfd), 50) <= 0)
+      continue;                 // timed out, check whether to stop
+
+    if (pfd[0].revents & POLLIN) {
+      socklen_t from_len = sizeof(from);
+      int n = recvfrom(s->fd, buf, sizeof(buf), 0, &from.sa, &from_len);
+
+      if (n > 0) {
+        ink_atomic_increment(&s->queries, 1);
+        if ((n = dns_stub_answer(s, buf, n, sizeof(buf), false)) > 0)
+          sendto(s->fd, buf, n, 0, &from.sa, from_len);
+      }
+    }
+    if (pfd[1].revents & POLLIN) {
+      int fd = accept(s->tcp_fd, NULL, NULL);
+      int i = 0;
+
+      while (i < DNS_STUB_CONNS && s->conns[i] >= 0)
+        ++i;
+      if (fd >= 0 && i < DNS_STUB_CONNS) {
+        s->conns[i] = fd;
+        ink_atomic_increment(&s->tcp_accepts, 1);
+      } else if (fd >= 0) {
+        close(fd);
+      }
+    }
+    for (int i = 0; i < DNS_STUB_CONNS; i++) {
+      if (pfd[2 + i].fd >= 0 && (pfd[2 + i].revents & (POLLIN | POLLHUP)) && !dns_stub_serve_tcp(s, s->conns[i])) {
+        close(s->conns[i]);
+        s->conns[i] = -1;
+      }
+    }
+  }
+  return NULL;
+}
+
+static bool
+dns_stub_start(DNSStubServer *s, bool blackhole = false)
+{
+  socklen_t len = sizeof(s->ip);
+
+  s->stop = false;
+  s->queries = s->edns_queries = s->tcp_queries = s->tcp_accepts = 0;
+  for (int i = 0; i < DNS_STUB_CONNS; i++)
+    s->conns[i] = -1;
+  ats_ip4_set(&s->ip, htonl(INADDR_LOOPBACK));
+  s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  s->tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+  s->filler = -1;
+  if (s->fd < 0 || s->tcp_fd < 0 ||
+      bind(s->fd, &s->ip.sa, sizeof(s->ip.sin)) < 0 || getsockname(s->fd, &s->ip.sa, &len) < 0 ||
+      bind(s->tcp_fd, &s->ip.sa, sizeof(s->ip.sin)) < 0 || listen(s->tcp_fd, blackhole ? 0 : DNS_STUB_CONNS) < 0) {
+    if (s->fd >= 0)
+      close(s->fd);
+    if (s->tcp_fd >= 0)
+      close(s->tcp_fd);
+    return false;
+  }
+  // With its accept queue full and nothing accepting, the kernel drops
+  // the SYN of every other connect.
+  if (blackhole) {
+    if ((s->filler = socket(AF_INET, SOCK_STREAM, 0)) < 0 || connect(s->filler, &s->ip.sa, sizeof(s->ip.sin)) < 0) {
+      if (s->filler >= 0)
+        close(s->filler);
+      close(s->tcp_fd);
+      close(s->fd);
+      return false;
+    }
+  }
+  s->tid = ink_thread_create(dns_stub_serve, s);
+  return true;
+}
+
+static void
+dns_stub_stop(DNSStubServer *s)
+{
+  s->stop = true;
+  ink_thread_join(s->tid);
+  for (int i = 0; i < DNS_STUB_CONNS; i++)
+    if (s->conns[i] >= 0)
+      close(s->conns[i]);
+  if (s->filler >= 0)
+    close(s->filler);
+  close(s->tcp_fd);
+  close(s->fd);
+}
+
+// A handler of its own that sends queries only to the stub server, set up
+// the way SplitDNS sets up the handlers for its nameservers.
+static DNSHandler *
+dns_stub_handler(DNSStubServer *s)
+{
+  DNSHandler *h = NEW(new DNSHandler);
+  ink_res_state res = NEW(new ts_imp_res_state);
+
+  memset(res, 0, sizeof(ts_imp_res_state));
+  ink_res_init(res, &s->ip, 1, NULL, NULL, NULL);
+  h->m_res = res;
+  h->mutex = dnsProcessor.thread->mutex;
+  h->options = res->options;
+  ats_ip_copy(&h->ip, &s->ip);
+  SET_CONTINUATION_HANDLER(h, &DNSHandler::startEvent_sdns);
+  dnsProcessor.thread->schedule_imm(h);
+  return h;
+}
+
+// Checks that truncated answers are asked for again over one TCP
+// connection that is kept open, that a server that rejects EDNS0 is asked
+// again without it, and that a truncated answer is taken as it is, within
+// the lookup timeout, when the TCP connect goes unanswered.
+struct DNSFallbackContinuation: public Continuation
+{
+  RegressionTest *test;
+  int *status;
+  DNSStubServer *stub;
+  DNSHandler *stub_handler;
+  DNSStubServer *blackhole;
+  DNSHandler *blackhole_handler;
+  int step;
+  int failed;
+  int saved_edns0_buffer_size;
+  int saved_timeout;
+  ink_hrtime run;
+  ink_hrtime start;
+
+  void lookup(const char *prefix, DNSHandler *h)
+  {
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s.f%" PRId64 ".dnsfallback.test", prefix, run);
+    dnsProcessor.gethostbyname(this, name, DNSProcessor::Options().setHostResStyle(HOST_RES_IPV4_ONLY).setHandler(h));
+  }
+
+  void check(bool ok, const char *what)
+  {
+    if (!ok) {
+      rprintf(test, "%s\n", what);
+      ++failed;
+    }
+  }
+
+  int mainEvent(int /* event ATS_UNUSED */, void *data)
+  {
+    HostEnt *he = (HostEnt *) data;
+    bool answered = step && he && he->ent.h_addr_list[0] && *(uint32_t *) he->ent.h_addr_list[0] == htonl(DNS_STUB_ADDR);
+
+    switch (step++) {
+    case 0:
+      saved_edns0_buffer_size = dns_edns0_buffer_size;
+      dns_edns0_buffer_size = 0;
+      lookup("tc.a", stub_handler);
+      return EVENT_CONT;
+    case 1:
+      check(answered, "truncated answer was not asked for again");
+      check(stub->tcp_queries == 1, "truncated answer was not asked for over TCP");
+      lookup("tc.b", stub_handler);
+      return EVENT_CONT;
+    case 2:
+      check(answered, "second truncated answer was not asked for again");
+      check(stub->tcp_queries == 2 && stub->tcp_accepts == 1, "second truncated answer did not reuse the TCP connection");
+      dns_edns0_buffer_size = 1232;
+      lookup("noedns", stub_handler);
+      return EVENT_CONT;
+    case 3:
+      check(answered, "FORMERR to EDNS0 was not asked for again without it");
+      check(stub->edns_queries == 1, "EDNS0 record was not sent exactly once");
+      dns_edns0_buffer_size = saved_edns0_buffer_size;
+      saved_timeout = dns_timeout;
+      dns_timeout = 1;
+      start = ink_get_hrtime_internal();
+      lookup("tc.c", blackhole_handler);
+      return EVENT_CONT;
+    default:
+      dns_timeout = saved_timeout;
+      check(answered, "truncated answer was not taken after the TCP connect timed out");
+      check(ink_get_hrtime_internal() - start < HRTIME_SECONDS(10), "unanswered TCP connect held the lookup up");
+      dns_stub_stop(stub);
+      dns_stub_stop(blackhole);
+      delete stub;
+      delete blackhole;
+      *status = failed ? REGRESSION_TEST_FAILED : REGRESSION_TEST_PASSED;
+      delete this;
+      return EVENT_DONE;
+    }
+  }
+
+  DNSFallbackContinuation(RegressionTest *t, int *astatus, DNSStubServer *s, DNSStubServer *b)
+    : Continuation(new_ProxyMutex()), test(t), status(astatus), stub(s), stub_handler(dns_stub_handler(s)),
+      blackhole(b), blackhole_handler(dns_stub_handler(b)), step(0), failed(0), saved_edns0_buffer_size(0),
+      saved_timeout(0), run(ink_get_hrtime_internal()), start(0) {
+    SET_HANDLER(&DNSFallbackContinuation::mainEvent);
+  }
+};
+
+REGRESSION_TEST(DNS_Fallback) (RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus) {
+  DNSStubServer *stub = NEW(new DNSStubServer);
+  DNSStubServer *blackhole = NEW(new DNSStubServer);
+
+  if (!dns_stub_start(stub)) {
+    rprintf(t, "failed to start the stub nameserver\n");
+    delete stub;
+    delete blackhole;
+    *pstatus = REGRESSION_TEST_FAILED;
+    return;
+  }
+  if (!dns_stub_start(blackhole, true)) {
+    rprintf(t, "failed to start the blackhole nameserver\n");
+    dns_stub_stop(stub);
+    delete stub;
+    delete blackhole;
+    *pstatus = REGRESSION_TEST_FAILED;
+    return;
+  }
+  eventProcessor.schedule_in(NEW(new DNSFallbackContinuation(t, pstatus, stub, blackhole)), HRTIME_SECONDS(1));
+}
+
+// Resolves a run of distinct names through the stub server, keeping a
+// window of them in flight, and checks that every one is answered.  Also
+// reports queries per second and latency percentiles, which measure the
+// resolver rather than the network.
+#define DNS_LOAD_QUERIES 1000
+#define DNS_LOAD_WINDOW 64
+
+struct DNSLoadContinuation;
+
+struct DNSLoadQuery: public Continuation
+{
+  DNSLoadContinuation *load;
+  ink_hrtime start;
+
+  int mainEvent(int event, HostEnt *he);
+
+  DNSLoadQuery(DNSLoadContinuation *l, ProxyMutex *m)
+    : Continuation(m), load(l), start(0) {
+    SET_HANDLER(&DNSLoadQuery::mainEvent);
+  }
+};
+
+struct DNSLoadContinuation: public Continuation
+{
+  RegressionTest *test;
+  int *status;
+  DNSStubServer *stub;
+  DNSHandler *stub_handler;
+  int sent;
+  int done;
+  int answered;
+  ink_hrtime run;
+  ink_hrtime start;
+  ink_hrtime latency[DNS_LOAD_QUERIES];
+
+  void send()
+  {
+    char name[64];
+    DNSLoadQuery *q = NEW(new DNSLoadQuery(this, mutex));
+
+    snprintf(name, sizeof(name), "l%d-%" PRId64 ".dnsload.test", sent++, run);
+    q->start = ink_get_hrtime_internal();
+    dnsProcessor.gethostbyname(q, name, DNSProcessor::Options().setHostResStyle(HOST_RES_IPV4_ONLY).setHandler(stub_handler));
+  }
+
+  int startEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
+  {
+    start = run = ink_get_hrtime_internal();
+    while (sent < DNS_LOAD_WINDOW)
+      send();
+    return EVENT_DONE;
+  }
+
+  static int cmp_latency(const void *a, const void *b)
+  {
+    ink_hrtime x = *(ink_hrtime const *)a, y = *(ink_hrtime const *)b;
+    return x < y ? -1 : (x > y);
+  }
+
+  void finished(ink_hrtime sent_at, HostEnt *he)
+  {
+    latency[done++] = ink_get_hrtime_internal() - sent_at;
+    if (he && he->ent.h_addr_list[0] && *(uint32_t *) he->ent.h_addr_list[0] == htonl(DNS_STUB_ADDR))
+      ++answered;
+    if (sent < DNS_LOAD_QUERIES)
+      send();
+    if (done < DNS_LOAD_QUERIES)
+      return;
+
+    ink_hrtime elapsed = ink_get_hrtime_internal() - start;
+    dns_stub_stop(stub);
+    qsort(latency, DNS_LOAD_QUERIES, sizeof(ink_hrtime), cmp_latency);
+    // rprintf() only knows %s and %d.
+    rprintf(test, "%d lookups (%d answered, %d queries) in %d msecs, %d per second\n", DNS_LOAD_QUERIES, answered,
+            stub->queries, (int)ink_hrtime_to_msec(elapsed), (int)(DNS_LOAD_QUERIES * HRTIME_SECOND / (elapsed ? elapsed : 1)));
+    rprintf(test, "latency usecs p50 %d p99 %d max %d\n", (int)ink_hrtime_to_usec(latency[DNS_LOAD_QUERIES / 2]),
+            (int)ink_hrtime_to_usec(latency[DNS_LOAD_QUERIES * 99 / 100]),
+            (int)ink_hrtime_to_usec(latency[DNS_LOAD_QUERIES - 1]));
+    if (answered == DNS_LOAD_QUERIES && stub->queries >= DNS_LOAD_QUERIES)
+      *status = REGRESSION_TEST_PASSED;
+    else
+      *status = REGRESSION_TEST_FAILED;
+    delete stub;
+    delete this;
+  }
+
+  DNSLoadContinuation(RegressionTest *t, int *astatus, DNSStubServer *s, DNSHandler *h)
+    : Continuation(new_ProxyMutex()), test(t), status(astatus), stub(s), stub_handler(h), sent(0), done(0), answered(0),
+      run(0), start(0) {
+    SET_HANDLER(&DNSLoadContinuation::startEvent);
+  }
+};
+
+int
+DNSLoadQuery::mainEvent(int /* event ATS_UNUSED */, HostEnt *he)
+{
+  load->finished(start, he);
+  delete this;
+  return EVENT_DONE;
+}
+
+REGRESSION_TEST(DNS_Load) (RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus) {
+  DNSStubServer *stub = NEW(new DNSStubServer);
+
+  if (!dns_stub_start(stub)) {
+    rprintf(t, "failed to start the stub nameserver\n");
+    delete stub;
+    *pstatus = REGRESSION_TEST_FAILED;
+    return;
+  }
+  eventProcessor.schedule_in(NEW(new DNSLoadContinuation(t, pstatus, stub, dns_stub_handler(stub))), HRTIME_SECONDS(1));
+}
+
 #endif
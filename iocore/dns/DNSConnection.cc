@@ -48,7 +48,8 @@ DNSConnection::Options const DNSConnection::DEFAULT_OPTIONS;
 //
 
 DNSConnection::DNSConnection():
-  fd(NO_FD), num(0), generator((uint32_t)((uintptr_t)time(NULL) ^ (uintptr_t) this)), handler(NULL)
+  fd(NO_FD), num(0), generator((uint32_t)((uintptr_t)time(NULL) ^ (uintptr_t) this)), handler(NULL),
+  tcp(false), tcp_reply(NULL), tcp_len(-1), tcp_got(0), tcp_queries(0), tcp_opened(0)
 {
   memset(&ip, 0, sizeof(ip));
 }
@@ -61,6 +62,15 @@ DNSConnection::~DNSConnection()
 int
 DNSConnection::close()
 {
+  if (tcp_reply) {
+    tcp_reply->free();
+    tcp_reply = NULL;
+  }
+  tcp_len = -1;
+  tcp_got = 0;
+  tcp_queries = 0;
+  tcp_opened = 0;
+
   // don't close any of the standards
   if (fd >= 2) {
     int fd_save = fd;
@@ -75,7 +85,12 @@ DNSConnection::close()
 void
 DNSConnection::trigger()
 {
-  handler->triggered.enqueue(this);
+  // Read the responses now, not on the next DNS_PERIOD tick; under a
+  // burst the socket buffer can overflow within one period.
+  if (!handler->triggered.head)
+    this_ethread()->schedule_imm_local(handler);
+  if (!handler->triggered.in(this))
+    handler->triggered.enqueue(this);
 }
 
 int
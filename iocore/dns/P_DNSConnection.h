@@ -37,6 +37,7 @@
 // Connection
 //
 struct DNSHandler;
+struct HostEnt;
 
 struct DNSConnection {
   /// Options for connecting.
@@ -80,6 +81,16 @@ struct DNSConnection {
   InkRand generator;
   DNSHandler* handler;
 
+  /// TCP only: the answer being read, its length from the 2 byte prefix
+  /// (-1 until the prefix is in), and how many bytes have been read.
+  bool tcp;
+  HostEnt *tcp_reply;
+  int tcp_len;
+  int tcp_got;
+  unsigned char tcp_prefix[2];
+  int tcp_queries; ///< Queries sent since the connection opened.
+  ink_hrtime tcp_opened; ///< When the connect started.
+
   int connect(sockaddr const* addr, Options const& opt = DEFAULT_OPTIONS);
 /*
               bool non_blocking_connect = NON_BLOCKING_CONNECT,
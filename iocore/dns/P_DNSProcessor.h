@@ -46,6 +46,10 @@
 #define DEFAULT_DNS_SEARCH           1
 #define FAILOVER_SOON_RETRY          5
 #define NO_NAMESERVER_SELECTED       -1
+// UDP sockets (source ports) that queries to one nameserver rotate over
+#define MAX_DNS_CONNECTIONS_PER_NAMED 16
+// Datagrams read by one recvmmsg() call
+#define DNS_RECV_BATCH               16
 
 //
 // Config
@@ -57,6 +61,9 @@ extern int dns_failover_number;
 extern int dns_failover_period;
 extern int dns_failover_try_period;
 extern int dns_max_dns_in_flight;
+extern int dns_connections_per_server;
+extern int dns_tcp_retry_truncated;
+extern int dns_edns0_buffer_size;
 extern unsigned int dns_sequence_number;
 
 //
@@ -102,6 +109,11 @@ enum DNS_Stats
   dns_max_retries_exceeded_stat,
   dns_sequence_number_stat,
   dns_in_flight_stat,
+  dns_batched_responses_stat,
+  dns_truncated_responses_stat,
+  dns_tcp_queries_stat,
+  dns_tcp_reused_stat,
+  dns_edns0_fallbacks_stat,
   DNS_Stat_Count
 };
 
@@ -165,6 +177,9 @@ struct DNSEntry: public Continuation
   bool written_flag;
   bool once_written_flag;
   bool last;
+  bool use_tcp;      ///< Send on the nameserver's TCP connection.
+  bool tcp_tried;    ///< Accept a truncated answer, TCP was already tried.
+  bool no_edns;      ///< The nameserver rejected EDNS0.
   LINK(DNSEntry, dup_link);
   Que(DNSEntry, dup_link) dups;
 
@@ -180,7 +195,8 @@ struct DNSEntry: public Continuation
        host_res_style(HOST_RES_NONE),
        retries(DEFAULT_DNS_RETRIES),
        which_ns(NO_NAMESERVER_SELECTED), submit_time(0), send_time(0), qname_len(0), domains(0),
-       timeout(0), result_ent(0), dnsH(0), written_flag(false), once_written_flag(false), last(false)
+       timeout(0), result_ent(0), dnsH(0), written_flag(false), once_written_flag(false), last(false),
+       use_tcp(false), tcp_tried(false), no_edns(false)
   {
     for (int i = 0; i < MAX_DNS_RETRIES; i++)
       id[i] = -1;
@@ -207,13 +223,18 @@ struct DNSHandler: public Continuation
   int ifd[MAX_NAMED];
   int n_con;
   DNSConnection con[MAX_NAMED];
+  /// Additional sockets to each nameserver, queries rotate over these and @c con.
+  DNSConnection spread_con[MAX_NAMED][MAX_DNS_CONNECTIONS_PER_NAMED - 1];
+  int next_con[MAX_NAMED];
+  /// Persistent TCP connection to each nameserver, for truncated answers.
+  DNSConnection tcp_con[MAX_NAMED];
   int options;
   Queue<DNSEntry> entries;
   Queue<DNSConnection> triggered;
   int in_flight;
   int name_server;
   int in_write_dns;
-  HostEnt *hostent_cache;
+  HostEnt *hostent_cache[DNS_RECV_BATCH];
 
   int ns_down[MAX_NAMED];
   int failover_number[MAX_NAMED];
@@ -260,11 +281,16 @@ struct DNSHandler: public Continuation
   }
 
   void recv_dns(int event, Event *e);
+  void recv_one(DNSConnection *dnsc, HostEnt *buf, int res);
   int startEvent(int event, Event *e);
   int startEvent_sdns(int event, Event *e);
   int mainEvent(int event, Event *e);
 
   void open_con(sockaddr const* addr, bool failed = false, int icon = 0);
+  DNSConnection *send_con(int ndx);
+  int tcp_send(int ndx, char *query, int len);
+  void tcp_recv(DNSConnection *dnsc);
+  void tcp_close(int ndx);
   void failover();
   void rr_failure(int ndx);
   void recover();
@@ -295,7 +321,7 @@ private:
 
 TS_INLINE DNSHandler::DNSHandler()
  : Continuation(NULL), n_con(0), options(0), in_flight(0), name_server(0), in_write_dns(0),
-  hostent_cache(0), last_primary_retry(0), last_primary_reopen(0),
+  last_primary_retry(0), last_primary_reopen(0),
   m_res(0), txn_lookup_timeout(0), generator((uint32_t)((uintptr_t)time(NULL) ^ (uintptr_t)this))
 {
   ats_ip_invalidate(&ip);
@@ -306,7 +332,13 @@ TS_INLINE DNSHandler::DNSHandler()
     crossed_failover_number[i] = 0;
     ns_down[i] = 1;
     con[i].handler = this;
+    next_con[i] = 0;
+    for (int j = 0; j < MAX_DNS_CONNECTIONS_PER_NAMED - 1; j++)
+      spread_con[i][j].handler = this;
+    tcp_con[i].handler = this;
+    tcp_con[i].num = i;
   }
+  memset(hostent_cache, 0, sizeof(hostent_cache));
   memset(&qid_in_flight, 0, sizeof(qid_in_flight));  
   SET_HANDLER(&DNSHandler::startEvent);
   Debug("net_epoll", "inline DNSHandler::DNSHandler()");
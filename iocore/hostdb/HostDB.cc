@@ -57,6 +57,9 @@ unsigned int hostdb_ip_stale_interval = HOST_DB_IP_STALE;
 unsigned int hostdb_ip_timeout_interval = HOST_DB_IP_TIMEOUT;
 unsigned int hostdb_ip_fail_timeout_interval = HOST_DB_IP_FAIL_TIMEOUT;
 unsigned int hostdb_serve_stale_but_revalidate = 0;
+unsigned int hostdb_prefetch_before = 0;
+unsigned int hostdb_prefetch_min_hits = 4;
+int hostdb_read_cache_size = 16384;
 char hostdb_filename[PATH_NAME_MAX + 1] = DEFAULT_HOST_DB_FILENAME;
 int hostdb_size = DEFAULT_HOST_DB_SIZE;
 int hostdb_sync_frequency = 120;
@@ -203,6 +206,124 @@ HostDBCache::HostDBCache()
 }
 
 
+void
+HostDBReadCache::init(int size)
+{
+  int n = 1;
+
+  if (size <= 0)
+    return;
+  while (n * 2 <= size)
+    n *= 2;
+  slots = (Slot *)ats_calloc(n, sizeof(Slot));
+  mask = n - 1;
+}
+
+bool
+HostDBReadCache::get(uint64_t md5_high, HostDBInfo *out)
+{
+  if (!slots)
+    return false;
+
+  Slot *s = slots + (md5_high & mask);
+  uint32_t seq = s->seq;
+
+  if (seq & 1)
+    return false;
+  __sync_synchronize();
+  *out = s->info;
+  __sync_synchronize();
+  if (s->seq != seq || !out->full || out->md5_high != md5_high)
+    return false;
+  // Stop writing the line once the count is more than the entry can hold.
+  if (s->hits < (1 << HOST_DB_HITS_BITS))
+    ink_atomic_increment(&s->hits, 1);
+  return true;
+}
+
+HostDBReadCache::Slot *
+HostDBReadCache::lock_slot(uint64_t md5_high, uint32_t *seq)
+{
+  if (!slots)
+    return NULL;
+
+  Slot *s = slots + (md5_high & mask);
+
+  // Spin; the other writer only holds the slot for a copy, and skipping
+  // the slot could leave a copy behind that should have been dropped.
+  do {
+    *seq = s->seq;
+  } while ((*seq & 1) || !ink_atomic_cas(&s->seq, *seq, *seq + 1));
+  __sync_synchronize();
+  return s;
+}
+
+void
+HostDBReadCache::unlock_slot(Slot *s, uint32_t seq)
+{
+  __sync_synchronize();
+  s->seq = seq + 2;
+}
+
+void
+HostDBReadCache::update(HostDBInfo const *r)
+{
+  uint32_t seq;
+  Slot *s = lock_slot(r->md5_high, &seq);
+
+  if (s) {
+    if (s->info.md5_high != r->md5_high)
+      s->hits = 0;
+    if (cacheable(r))
+      s->info = *r;
+    else if (s->info.md5_high == r->md5_high)
+      s->info.full = 0;
+    unlock_slot(s, seq);
+  }
+}
+
+void
+HostDBReadCache::remove(uint64_t md5_high)
+{
+  uint32_t seq;
+  Slot *s = lock_slot(md5_high, &seq);
+
+  if (s) {
+    if (s->info.md5_high == md5_high)
+      s->info.full = 0;
+    unlock_slot(s, seq);
+  }
+}
+
+unsigned int
+HostDBReadCache::take_hits(uint64_t md5_high)
+{
+  uint32_t seq;
+  unsigned int hits = 0;
+  Slot *s = lock_slot(md5_high, &seq);
+
+  if (s) {
+    if (s->info.md5_high == md5_high)
+      hits = ink_atomic_swap(&s->hits, 0U);
+    unlock_slot(s, seq);
+  }
+  return hits;
+}
+
+void
+HostDBReadCache::clear()
+{
+  for (uint64_t i = 0; slots && i <= mask; i++) {
+    uint32_t seq;
+    Slot *s = lock_slot(i, &seq);
+
+    s->info.full = 0;
+    s->hits = 0;
+    unlock_slot(s, seq);
+  }
+}
+
+
 int
 HostDBCache::rebuild_callout(HostDBInfo * e, RebuildMC & r)
 {
@@ -451,6 +572,9 @@ HostDBProcessor::start(int, size_t)
   if (hostDB.start(0) < 0)
     return -1;
 
+  REC_ReadConfigInt32(hostdb_read_cache_size, "proxy.config.hostdb.read_cache_size");
+  hostDB.read_cache.init(hostdb_read_cache_size);
+
 #ifdef NON_MODULAR
   if (auto_clear_hostdb_flag)
     hostDB.clear();
@@ -478,6 +602,8 @@ HostDBProcessor::start(int, size_t)
   REC_EstablishStaticConfigInt32U(hostdb_ip_stale_interval, "proxy.config.hostdb.verify_after");
   REC_EstablishStaticConfigInt32U(hostdb_ip_fail_timeout_interval, "proxy.config.hostdb.fail.timeout");
   REC_EstablishStaticConfigInt32U(hostdb_serve_stale_but_revalidate, "proxy.config.hostdb.serve_stale_for");
+  REC_EstablishStaticConfigInt32U(hostdb_prefetch_before, "proxy.config.hostdb.prefetch_before");
+  REC_EstablishStaticConfigInt32U(hostdb_prefetch_min_hits, "proxy.config.hostdb.prefetch_min_hits");
   REC_EstablishStaticConfigInt32(hostdb_sync_frequency, "proxy.config.cache.hostdb.sync_frequency");
 
   //
@@ -588,6 +714,8 @@ reply_to_cont(Continuation * cont, HostDBInfo * ar, bool is_srv = false)
 
     if (!r->full)
       goto Ldelete;
+    // The callback may have marked the host down.
+    hostDB.read_cache.update(r);
     return true;
   }
 Lerror:
@@ -626,6 +754,29 @@ db_mark_for(sockaddr const* ip) {
   return ats_is_ip6(ip) ? HOSTDB_MARK_IPV6 : HOSTDB_MARK_IPV4;
 }
 
+// Start a lookup that will replace @a r, unless one is already pending.
+// The caller holds the bucket lock, which also covers the pending queue.
+static bool
+refresh_in_background(HostDBMD5 const& md5, HostDBInfo *r)
+{
+  if (!md5.host_name || is_dotted_form_hostname(md5.host_name))
+    return false;
+
+  INK_MD5 hash = md5.hash;
+  Queue<HostDBContinuation> &q = hostDB.pending_dns_for_hash(hash);
+  for (HostDBContinuation *c = q.head; c; c = (HostDBContinuation *) c->link.next) {
+    if (hash == c->md5.hash)
+      return false;
+  }
+
+  HostDBContinuation *c = hostDBContAllocator.alloc();
+  HostDBContinuation::Options copt;
+  copt.host_res_style = host_res_style_for(r->ip());
+  c->init(md5, copt);
+  c->do_dns();
+  return true;
+}
+
 HostDBInfo *
 probe(ProxyMutex *mutex, HostDBMD5 const& md5, bool ignore_timeout)
 {
@@ -636,6 +787,7 @@ probe(ProxyMutex *mutex, HostDBMD5 const& md5, bool ignore_timeout)
     Debug("hostdb", "probe %.*s %" PRIx64 " %d [ignore_timeout = %d]",
           md5.host_len, md5.host_name, folded_md5, !!r, ignore_timeout);
     if (r && md5.hash[1] == r->md5_high) {
+      bool serve_stale = false;
 
       // Check for timeout (fail probe)
       //
@@ -648,10 +800,13 @@ probe(ProxyMutex *mutex, HostDBMD5 const& md5, bool ignore_timeout)
           Debug("hostdb", "fail timeout %u", r->ip_interval());
           return NULL;
         }
-      } else if (!ignore_timeout && r->is_ip_timeout() && !r->serve_stale_but_revalidate()) {
-        Debug("hostdb", "timeout %u %u %u", r->ip_interval(), r->ip_timestamp, r->ip_timeout_interval);
-        HOSTDB_INCREMENT_DYN_STAT(hostdb_ttl_expires_stat);
-        return NULL;
+      } else if (!ignore_timeout && r->is_ip_timeout()) {
+        if (!r->serve_stale_but_revalidate()) {
+          Debug("hostdb", "timeout %u %u %u", r->ip_interval(), r->ip_timestamp, r->ip_timeout_interval);
+          HOSTDB_INCREMENT_DYN_STAT(hostdb_ttl_expires_stat);
+          return NULL;
+        }
+        serve_stale = true;
       }
 //error conditions
       if (r->reverse_dns && !r->hostname()) {
@@ -664,23 +819,35 @@ probe(ProxyMutex *mutex, HostDBMD5 const& md5, bool ignore_timeout)
         hostDB.delete_block(r);
         return NULL;
       }
+      // Count the hits served from the read cache too.
+      hostDB.hits_callout(r);
+      // We are beyond our TTL but we choose to serve for another N seconds
+      // [hostdb_serve_stale_but_revalidate seconds].  The entry is left
+      // expired, so it is replaced by the one background lookup rather
+      // than extended if that lookup is slow.
+      if (serve_stale) {
+        Debug("hostdb", "expired %u %u %u, serving it while refreshing it", r->ip_interval(),
+              r->ip_timestamp, r->ip_timeout_interval);
+        HOSTDB_INCREMENT_DYN_STAT(hostdb_total_serve_stale_stat);
+        refresh_in_background(md5, r);
+      }
       // Check for stale (revalidate offline if we are the owner)
-      // -or-
-      // we are beyond our TTL but we choose to serve for another N seconds [hostdb_serve_stale_but_revalidate seconds]
-      if ((!ignore_timeout && r->is_ip_stale()
+      else if (!ignore_timeout && r->is_ip_stale()
 #ifdef NON_MODULAR
            && !cluster_machine_at_depth(master_hash(md5.hash))
 #endif
-           && !r->reverse_dns) || (r->is_ip_timeout() && r->serve_stale_but_revalidate())) {
+           && !r->reverse_dns) {
         Debug("hostdb", "stale %u %u %u, using it and refreshing it", r->ip_interval(),
               r->ip_timestamp, r->ip_timeout_interval);
         r->refresh_ip();
-        if (!is_dotted_form_hostname(md5.host_name)) {
-          HostDBContinuation *c = hostDBContAllocator.alloc();
-          HostDBContinuation::Options copt;
-          copt.host_res_style = host_res_style_for(r->ip());
-          c->init(md5, copt);
-          c->do_dns();
+        refresh_in_background(md5, r);
+      }
+      // Refresh popular entries shortly before they expire, so they never do.
+      else if (!ignore_timeout && hostdb_prefetch_before && !r->failed() && !r->reverse_dns &&
+               r->hits >= hostdb_prefetch_min_hits && r->ip_time_remaining() <= (int) hostdb_prefetch_before) {
+        if (refresh_in_background(md5, r)) {
+          Debug("hostdb", "prefetch %u %u %u", r->ip_interval(), r->ip_timestamp, r->ip_timeout_interval);
+          HOSTDB_INCREMENT_DYN_STAT(hostdb_total_prefetches_stat);
         }
       }
 
@@ -709,6 +876,7 @@ HostDBContinuation::insert(unsigned int attl)
   HostDBInfo *old_r = hostDB.lookup_block(folded_md5, 3);
   if (old_r)
     hostDB.delete_block(old_r);
+  hostDB.read_cache.remove(md5.hash[1]);
   HostDBInfo *r = hostDB.insert_block(folded_md5, NULL, 0);
   r->md5_high = md5.hash[1];
   if (attl > HOST_DB_MAX_TTL)
@@ -721,6 +889,16 @@ HostDBContinuation::insert(unsigned int attl)
 }
 
 
+// Whether a lookup can be answered from the read cache copy @a r.  Anything
+// probe() would act on (expiry, verify_after, prefetch) goes to the
+// locked path instead.
+static inline bool
+read_cache_fresh(HostDBInfo *r)
+{
+  return HostDBReadCache::cacheable(r) && !r->is_ip_timeout() && !r->is_ip_stale() &&
+    !(hostdb_prefetch_before && r->ip_time_remaining() <= (int) hostdb_prefetch_before);
+}
+
 //
 // Get an entry by either name or IP
 //
@@ -968,7 +1146,19 @@ HostDBProcessor::getbyname_imm(Continuation * cont, process_hostdb_info_pfn proc
 #endif // SPLIT_DNS
   md5.refresh();
 
-  // Attempt to find the result in-line, for level 1 hits
+  // Try the read cache, which needs no lock, then a level 1 probe for
+  // an immediate result.
+  if (!force_dns) {
+    HostDBInfo copy;
+    if (hostDB.read_cache.get(md5.hash[1], &copy) && read_cache_fresh(&copy)) {
+      Debug("hostdb", "read cache answer for %.*s", md5.host_len, md5.host_name);
+      HOSTDB_INCREMENT_DYN_STAT(hostdb_total_hits_stat);
+      HOSTDB_INCREMENT_DYN_STAT(hostdb_read_cache_hits_stat);
+      (cont->*process_hostdb_info) (&copy);
+      return ACTION_RESULT_DONE;
+    }
+  }
+
   if (!force_dns) {
     bool loop;
     do {
@@ -988,6 +1178,8 @@ HostDBProcessor::getbyname_imm(Continuation * cont, process_hostdb_info_pfn proc
             Debug("hostdb", "immediate answer for %.*s", md5.host_len, md5.host_name);
             HOSTDB_INCREMENT_DYN_STAT(hostdb_total_hits_stat);
             (cont->*process_hostdb_info) (r);
+            if (read_cache_fresh(r))
+              hostDB.read_cache.update(r);
             return ACTION_RESULT_DONE;
           }
           md5.refresh(); // Update for retry.
@@ -1074,8 +1266,10 @@ HostDBProcessor::setby(const char *hostname, int len, sockaddr const* ip, HostDB
 
   if (lock) {
     HostDBInfo *r = probe(mutex, md5, false);
-    if (r)
+    if (r) {
       do_setby(r, app, hostname, md5.ip);
+      hostDB.read_cache.update(r);
+    }
     return;
   }
   // Create a continuation to do a deaper probe in the background
@@ -1117,8 +1311,10 @@ HostDBContinuation::setbyEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUS
 {
   HostDBInfo *r = probe(mutex, md5, false);
 
-  if (r)
+  if (r) {
     do_setby(r, &app, md5.host_name, md5.ip, is_srv());
+    hostDB.read_cache.update(r);
+  }
 
   hostdb_cont_free(this);
   return EVENT_DONE;
@@ -1434,6 +1630,17 @@ HostDBContinuation::dnsEvent(int event, HostEnt * e)
     if (old_r)
       old_info = *old_r;
     HostDBRoundRobin *old_rr_data = old_r ? old_r->rr() : NULL;
+
+    // A failed background refresh, whether of a stale, expired or
+    // prefetched entry, leaves the old answer in place; the next lookup
+    // that wants a refresh tries again.
+    if (failed && !action.continuation && old_r && !old_r->failed()) {
+      Debug("hostdb", "refresh of %s failed, keeping the old entry", md5.host_name);
+      HOSTDB_INCREMENT_DYN_STAT(hostdb_stale_kept_on_failure_stat);
+      remove_trigger_pending_dns();
+      hostdb_cont_free(this);
+      return EVENT_DONE;
+    }
 #ifdef DEBUG
     if (old_rr_data) {
       for (int i = 0; i < old_rr_data->rrcount; ++i) {
@@ -2463,6 +2670,155 @@ run_HostDBTest()
     eventProcessor.schedule_imm(new HostDBTestReverse, ET_CACHE);
   }
 }
+
+struct ReadCacheBench
+{
+  HostDBReadCache *cache;
+  ink_mutex *lock;     // NULL reads the cache, else a locked lookup
+  HostDBInfo *table;
+  int entries;
+  int loops;
+  int found;
+};
+
+static void *
+read_cache_bench(void *arg)
+{
+  ReadCacheBench *b = (ReadCacheBench *)arg;
+  HostDBInfo copy;
+
+  for (int i = 0; i < b->loops; i++) {
+    HostDBInfo *r = b->table + (i % b->entries);
+    if (b->lock) {
+      ink_mutex_acquire(b->lock);
+      copy = *r;
+      ink_mutex_release(b->lock);
+      b->found++;
+    } else if (b->cache->get(r->md5_high, &copy))
+      b->found++;
+  }
+  return NULL;
+}
+
+struct ReadCacheHolder
+{
+  HostDBReadCache::Slot *slot;
+};
+
+// Stands in for a writer that has the slot, and lets go after a while.
+static void *
+read_cache_hold(void *arg)
+{
+  ReadCacheHolder *h = (ReadCacheHolder *)arg;
+
+  usleep(10000);
+  __sync_synchronize();
+  h->slot->seq++;
+  return NULL;
+}
+
+REGRESSION_TEST(HostDB_ReadCache) (RegressionTest *t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  const int entries = 1024, loops = 200000;
+  HostDBReadCache cache;
+  HostDBInfo *table = (HostDBInfo *)ats_calloc(entries, sizeof(HostDBInfo));
+  HostDBInfo copy;
+  int status = REGRESSION_TEST_PASSED;
+
+  cache.init(entries * 4);
+  for (int i = 0; i < entries; i++) {
+    table[i].full = 1;
+    table[i].md5_high = ((uint64_t)i << 32) | i;
+    ats_ip4_set(table[i].ip(), htonl(0x0a000000 | i));
+    cache.update(table + i);
+  }
+
+  if (!cache.get(table[7].md5_high, &copy) || !ats_ip_addr_eq(copy.ip(), table[7].ip()))
+    status = REGRESSION_TEST_FAILED;
+  cache.remove(table[7].md5_high);
+  if (cache.get(table[7].md5_high, &copy))
+    status = REGRESSION_TEST_FAILED;
+  table[8].round_robin = 1;
+  cache.update(table + 8);
+  if (cache.get(table[8].md5_high, &copy))
+    status = REGRESSION_TEST_FAILED;
+  table[8].round_robin = 0;
+  cache.update(table + 8);
+  cache.update(table + 7);
+  if (cache.get(table[7].md5_high ^ 1, &copy))
+    status = REGRESSION_TEST_FAILED;
+
+  // A remove that finds the slot held by another writer waits for it
+  // rather than leaving the copy behind.
+  ReadCacheHolder holder;
+  holder.slot = cache.slots + (table[9].md5_high & cache.mask);
+  holder.slot->seq++;
+  ink_thread holder_tid = ink_thread_create(read_cache_hold, &holder);
+  cache.remove(table[9].md5_high);
+  ink_thread_join(holder_tid);
+  if (cache.get(table[9].md5_high, &copy))
+    status = REGRESSION_TEST_FAILED;
+  cache.update(table + 9);
+
+  // Hits served from a slot are kept for the entry until it takes them,
+  // and a slot reused for another entry starts over.
+  for (int i = 0; i < 3; i++)
+    cache.get(table[10].md5_high, &copy);
+  if (cache.take_hits(table[10].md5_high) != 3 || cache.take_hits(table[10].md5_high))
+    status = REGRESSION_TEST_FAILED;
+  for (int i = 0; i < 100; i++)
+    cache.get(table[10].md5_high, &copy);
+  if (cache.take_hits(table[10].md5_high) < (unsigned int) (1 << HOST_DB_HITS_BITS) - 1)
+    status = REGRESSION_TEST_FAILED;
+  cache.get(table[10].md5_high, &copy);
+  if (cache.take_hits(table[10].md5_high ^ 1))
+    status = REGRESSION_TEST_FAILED;
+  copy = table[10];
+  copy.md5_high ^= (uint64_t)1 << 40;
+  cache.update(&copy);
+  if (cache.take_hits(copy.md5_high))
+    status = REGRESSION_TEST_FAILED;
+  cache.update(table + 10);
+
+  // Compare against a single lock around the table, which is what every
+  // lookup for names in one partition contends on.
+  ink_mutex lock;
+  ink_mutex_init(&lock, "HostDB_ReadCache");
+  for (int nthreads = 1; nthreads <= 64; nthreads *= 4) {
+    for (int locked = 0; locked < 2; locked++) {
+      ReadCacheBench b[64];
+      ink_thread tid[64];
+      ink_hrtime start = ink_get_hrtime_internal();
+      int found = 0;
+
+      for (int i = 0; i < nthreads; i++) {
+        b[i].cache = &cache;
+        b[i].lock = locked ? &lock : NULL;
+        b[i].table = table;
+        b[i].entries = entries;
+        b[i].loops = loops;
+        b[i].found = 0;
+        tid[i] = ink_thread_create(read_cache_bench, b + i);
+      }
+      for (int i = 0; i < nthreads; i++) {
+        ink_thread_join(tid[i]);
+        found += b[i].found;
+      }
+
+      ink_hrtime elapsed = ink_get_hrtime_internal() - start;
+      // rprintf() only knows %s and %d.
+      rprintf(t, "%d threads %s: %d lookups in %d usecs\n", nthreads, locked ? "locked" : "read cache",
+              nthreads * loops, (int)ink_hrtime_to_usec(elapsed));
+      if (found != nthreads * loops)
+        status = REGRESSION_TEST_FAILED;
+    }
+  }
+  ink_mutex_destroy(&lock);
+
+  ats_free(cache.slots);
+  ats_free(table);
+  *pstatus = status;
+}
 #endif
 
 
@@ -2512,5 +2868,21 @@ ink_hostdb_init(ModuleVersion v)
   RecRegisterRawStat(hostdb_rsb, RECT_PROCESS,
                      "proxy.process.hostdb.bytes", RECD_INT, RECP_NULL, (int) hostdb_bytes_stat, RecRawStatSyncCount);
 
+  RecRegisterRawStat(hostdb_rsb, RECT_PROCESS,
+                     "proxy.process.hostdb.total_serve_stale",
+                     RECD_INT, RECP_NULL, (int) hostdb_total_serve_stale_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(hostdb_rsb, RECT_PROCESS,
+                     "proxy.process.hostdb.total_prefetches",
+                     RECD_INT, RECP_NULL, (int) hostdb_total_prefetches_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(hostdb_rsb, RECT_PROCESS,
+                     "proxy.process.hostdb.stale_kept_on_failure",
+                     RECD_INT, RECP_NULL, (int) hostdb_stale_kept_on_failure_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(hostdb_rsb, RECT_PROCESS,
+                     "proxy.process.hostdb.read_cache_hits",
+                     RECD_INT, RECP_NULL, (int) hostdb_read_cache_hits_stat, RecRawStatSyncSum);
+
   ts_host_res_global_init();
 }
@@ -487,6 +487,7 @@ MultiCacheBase::clear()
   heap_used[1] = 8;
   heap_halfspace = 0;
   *mapped_header = *(MultiCacheHeader *) this;
+  clear_callout();
 }
 
 void
@@ -494,6 +495,7 @@ MultiCacheBase::clear_but_heap()
 {
   memset(data, 0, totalelements * elementsize);
   *mapped_header = *(MultiCacheHeader *) this;
+  clear_callout();
 }
 
 int
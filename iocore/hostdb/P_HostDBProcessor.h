@@ -49,6 +49,9 @@ extern int hostdb_ttl_mode;
 
 extern unsigned int hostdb_current_interval;
 extern unsigned int hostdb_ip_stale_interval;
+extern unsigned int hostdb_prefetch_before;
+extern unsigned int hostdb_prefetch_min_hits;
+extern int hostdb_read_cache_size;
 extern unsigned int hostdb_ip_timeout_interval;
 extern unsigned int hostdb_ip_fail_timeout_interval;
 extern int hostdb_size;
@@ -158,6 +161,10 @@ enum HostDB_Stats
   hostdb_ttl_expires_stat,      // D == TTL Expires
   hostdb_re_dns_on_reload_stat,
   hostdb_bytes_stat,
+  hostdb_total_serve_stale_stat,        // expired entries served while refreshing
+  hostdb_total_prefetches_stat,         // refreshes started before expiry
+  hostdb_stale_kept_on_failure_stat,    // failed refreshes that left the old entry
+  hostdb_read_cache_hits_stat,          // lookups answered without the partition lock
   HostDB_Stat_Count
 };
 
@@ -194,6 +201,56 @@ RecSetRawStatCount(hostdb_rsb, _x, _count);
   RecIncrRawStatSum(hostdb_rsb, _t, (int) _s, -1);
 
 
+//
+// HostDBReadCache (Private)
+//
+// Copies of single address entries that getbyname_imm() can read
+// without the partition lock.  A slot is indexed and keyed by the
+// entry's md5_high.  Readers check a sequence count, which is odd while
+// a writer has the slot, and retry on the locked path if it moved.
+// Writers hold the partition lock of the entry they write, so only
+// entries with different keys contend for a slot, and a writer that
+// finds the slot busy spins until it is free.
+//
+// Hits served from a slot are counted there, up to what the entry can
+// hold, and added to the entry's own count when it is next probed or
+// compared for eviction.
+//
+struct HostDBReadCache
+{
+  struct Slot
+  {
+    volatile uint32_t seq;
+    volatile uint32_t hits;
+    HostDBInfo info;
+  };
+
+  Slot *slots;
+  uint64_t mask;
+
+  HostDBReadCache() : slots(NULL), mask(0) { }
+
+  /// Allocate @a size slots, rounded down to a power of 2. 0 disables the cache.
+  void init(int size);
+  /// Copy the entry for @a md5_high into @a out.
+  bool get(uint64_t md5_high, HostDBInfo *out);
+  /// Store a copy of @a r if it can be served from here, otherwise drop any copy.
+  void update(HostDBInfo const *r);
+  void remove(uint64_t md5_high);
+  void clear();
+  /// Return and reset the hits served for @a md5_high.
+  unsigned int take_hits(uint64_t md5_high);
+
+  static bool cacheable(HostDBInfo const *r)
+  {
+    return r->full && !r->round_robin && !r->is_srv && !r->reverse_dns && ats_is_ip(r->ip());
+  }
+
+private:
+  Slot *lock_slot(uint64_t md5_high, uint32_t *seq);
+  void unlock_slot(Slot *s, uint32_t seq);
+};
+
 //
 // HostDBCache (Private)
 //
@@ -212,6 +269,30 @@ struct HostDBCache: public MultiCache<HostDBInfo>
 
   Queue<HostDBContinuation, Continuation::Link_link> pending_dns[MULTI_CACHE_PARTITIONS];
   Queue<HostDBContinuation, Continuation::Link_link> &pending_dns_for_hash(INK_MD5 & md5);
+
+  // Entries leave the database here, when insert_block() reuses their
+  // slot, or when the data is cleared; the read cache drops its copy
+  // each time.
+  void delete_block(HostDBInfo *r)
+  {
+    read_cache.remove(r->md5_high);
+    MultiCache<HostDBInfo>::delete_block(r);
+  }
+  void evict_callout(HostDBInfo *r)
+  {
+    read_cache.remove(r->md5_high);
+  }
+  void clear_callout()
+  {
+    read_cache.clear();
+  }
+  void hits_callout(HostDBInfo *r)
+  {
+    unsigned int hits = r->hits + read_cache.take_hits(r->md5_high);
+    r->hits = hits < (unsigned int) max_hits ? hits : max_hits;
+  }
+
+  HostDBReadCache read_cache;
   HostDBCache();
 };
 
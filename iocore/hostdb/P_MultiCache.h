@@ -279,6 +279,10 @@ struct MultiCacheBase: public MultiCacheHeader
   void reset();
   void clear();                 // this zeros the data
   void clear_but_heap();
+  // called after the data has been zeroed
+  virtual void clear_callout()
+  {
+  }
 
   virtual MultiCacheBase *dup()
   {
@@ -433,6 +437,18 @@ template<class C> struct MultiCache: public MultiCacheBase
     (void) r;
   }
 
+  // called before insert_block() overwrites another entry
+  virtual void evict_callout(C * c)
+  {
+    (void) c;
+  }
+
+  // called before insert_block() compares the hits of entries
+  virtual void hits_callout(C * c)
+  {
+    (void) c;
+  }
+
   //
   // template operations
   //
@@ -491,13 +507,17 @@ template<class C> inline C * MultiCache<C>::insert_block(uint64_t folded_md5, C
     }
     if (tag == block->tag())
       goto Lfound;
-    hits += block->hits;
   }
   if (empty) {
     block = empty;
     goto Lfound;
   }
 
+  for (block = b; block < b + elements[level]; block++) {
+    hits_callout(block);
+    hits += block->hits;
+  }
+
   {
     C *best = NULL;
     int again = 1;
@@ -524,6 +544,8 @@ template<class C> inline C * MultiCache<C>::insert_block(uint64_t folded_md5, C
   }
 
 Lfound:
+  if (!block->is_empty() && block->tag() != tag)
+    evict_callout(block);
   if (new_block) {
     *block = *new_block;
     int *hop = new_block->heap_offset_ptr();
@@ -111,6 +111,101 @@ register_net_stats()
   RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.net.inactivity_cop_lock_acquire_failure",
                      RECD_INT, RECP_NULL, (int) inactivity_cop_lock_acquire_failure_stat,
                      RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_handshakes",
+                     RECD_INT, RECP_NULL, (int) ssl_handshakes_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_handshakes_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_handshake_time",
+                     RECD_INT, RECP_NULL, (int) ssl_handshake_time_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_handshake_time_stat);
+
+  // Handshake latency histogram, one counter per bucket. Each bucket counts
+  // the server handshakes that completed within its bound and above the
+  // bound of the previous bucket.
+  static const char *handshake_time_buckets[] = {
+    "500us", "1ms", "2ms", "5ms", "10ms", "50ms", "100ms", "over"
+  };
+  for (int i = 0; i < (int) countof(handshake_time_buckets); ++i) {
+    char name[64];
+
+    snprintf(name, sizeof(name), "proxy.process.ssl.handshake_time.%s", handshake_time_buckets[i]);
+    RecRegisterRawStat(net_rsb, RECT_PROCESS, name, RECD_INT, RECP_NULL, (int) ssl_handshake_time_500us_stat + i,
+                       RecRawStatSyncSum);
+    NET_CLEAR_DYN_STAT(ssl_handshake_time_500us_stat + i);
+  }
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.handshake_offloads",
+                     RECD_INT, RECP_NULL, (int) ssl_handshake_offloads_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_handshake_offloads_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.handshake_offload_wait",
+                     RECD_INT, RECP_NULL, (int) ssl_handshake_offload_wait_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_handshake_offload_wait_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_resumed_handshakes",
+                     RECD_INT, RECP_NULL, (int) ssl_resumed_handshakes_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_resumed_handshakes_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.session_cache_hit",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_hit_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_session_cache_hit_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.session_cache_miss",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_miss_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_session_cache_miss_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.session_cache_new_session",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_new_session_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_session_cache_new_session_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.session_cache_eviction",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_eviction_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_session_cache_eviction_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.session_cache_lock_contention",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_lock_contention_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_session_cache_lock_contention_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_tickets_created",
+                     RECD_INT, RECP_NULL, (int) ssl_tickets_created_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_tickets_created_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_tickets_verified",
+                     RECD_INT, RECP_NULL, (int) ssl_tickets_verified_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_tickets_verified_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_tickets_renewed",
+                     RECD_INT, RECP_NULL, (int) ssl_tickets_renewed_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_tickets_renewed_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_tickets_not_found",
+                     RECD_INT, RECP_NULL, (int) ssl_tickets_not_found_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_tickets_not_found_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_ktls_send",
+                     RECD_INT, RECP_NULL, (int) ssl_ktls_send_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_ktls_send_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_ktls_send_fallbacks",
+                     RECD_INT, RECP_NULL, (int) ssl_ktls_send_fallback_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_ktls_send_fallback_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_ocsp_stapled",
+                     RECD_INT, RECP_NULL, (int) ssl_ocsp_stapled_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_ocsp_stapled_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_ocsp_refreshes",
+                     RECD_INT, RECP_NULL, (int) ssl_ocsp_refresh_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_ocsp_refresh_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_ocsp_refresh_failures",
+                     RECD_INT, RECP_NULL, (int) ssl_ocsp_refresh_failure_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_ocsp_refresh_failure_stat);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS, "proxy.process.ssl.total_lazy_context_loads",
+                     RECD_INT, RECP_NULL, (int) ssl_lazy_context_load_stat, RecRawStatSyncSum);
+  NET_CLEAR_DYN_STAT(ssl_lazy_context_load_stat);
 }
 
 void
@@ -0,0 +1,896 @@
+/** @file
+
+  OCSP stapling for server certificates
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "ink_config.h"
+#include "P_Net.h"
+#include "P_SSLConfig.h"
+#include "P_OCSPStapling.h"
+#include "I_Layout.h"
+#include "I_Tasks.h"
+#include "TextBuffer.h"
+#include "ts/TestBox.h"
+
+#include <netdb.h>
+
+#if HAVE_OPENSSL_OCSP_STAPLING
+#include <openssl/ocsp.h>
+#include <openssl/x509v3.h>
+#endif
+
+// Without stapling, every new client has to ask the certificate's OCSP
+// responder whether the certificate is still good before it trusts us. We
+// ask instead, once per certificate, and send the signed answer along with
+// the certificate. Responses are fetched and refreshed by a continuation on
+// a task thread, so only the in memory copy is ever touched by the network
+// threads.
+
+// The largest OCSP response we accept from a responder.
+#define SSL_STAPLING_MAX_RESPONSE (128 * 1024)
+
+// How far the clocks of the responder and us may disagree, in seconds.
+#define SSL_STAPLING_CLOCK_SKEW 300
+
+// How long one round of updates may keep the task thread busy, in seconds.
+// Whatever is left over is fetched in the next round.
+#define SSL_STAPLING_MAX_UPDATE_TIME 5
+
+static inline void
+ssl_stapling_stat(int stat)
+{
+  EThread * ethread = this_ethread();
+
+  if (ethread) {
+    RecIncrRawStatSum(net_rsb, ethread, stat, 1);
+  }
+}
+
+// Find the body of a HTTP response if its status is 200.
+static const char *
+ssl_stapling_http_body(const char * response, size_t len, size_t * body_len)
+{
+  const char * end = response + len;
+  const char * body;
+  int status = 0;
+
+  if (len < 12 || strncmp(response, "HTTP/1.", 7) != 0 || response[8] != ' ') {
+    return NULL;
+  }
+
+  for (const char * p = response + 9; p < response + 12; ++p) {
+    if (!ParseRules::is_digit(*p)) {
+      return NULL;
+    }
+    status = status * 10 + (*p - '0');
+  }
+
+  if (status != 200) {
+    return NULL;
+  }
+
+  for (body = response; body + 4 <= end; ++body) {
+    if (memcmp(body, "\r\n\r\n", 4) == 0) {
+      *body_len = end - (body + 4);
+      return body + 4;
+    }
+  }
+
+  return NULL;
+}
+
+#if HAVE_OPENSSL_OCSP_STAPLING
+
+struct SSLStaplingInfo
+{
+  SSLStaplingInfo()
+    : cid(NULL), uri(NULL), cache_path(NULL), cache_loaded(false), der(NULL), der_len(0), refresh_time(0), expire_time(0) {
+    ink_mutex_init(&mutex, "SSLStaplingInfo");
+  }
+
+  ~SSLStaplingInfo() {
+    OCSP_CERTID_free(cid);
+    ats_free(uri);
+    ats_free(cache_path);
+    ats_free(der);
+    ink_mutex_destroy(&mutex);
+  }
+
+  OCSP_CERTID *   cid;
+  char *          uri;
+  char *          cache_path;     // where the response is saved, if anywhere
+
+  // The current response, protected by the mutex.
+  ink_mutex       mutex;
+  bool            cache_loaded;   // the saved response has been read
+  unsigned char * der;
+  int             der_len;
+  time_t          refresh_time;   // when to fetch a new response
+  time_t          expire_time;    // when to stop stapling this one
+};
+
+static int ssl_stapling_index = -1;
+
+static void
+ssl_stapling_info_free(void * /* parent ATS_UNUSED */, void * ptr, CRYPTO_EX_DATA * /* ad ATS_UNUSED */,
+                       int /* idx ATS_UNUSED */, long /* argl ATS_UNUSED */, void * /* argp ATS_UNUSED */)
+{
+  delete (SSLStaplingInfo *)ptr;
+}
+
+// Check that resp is a good response for the certificate of info, and work
+// out until when it can be stapled.
+static bool
+ssl_stapling_check_response(const SSLStaplingInfo * info, OCSP_RESPONSE * resp, time_t cache_timeout, time_t * expire)
+{
+  OCSP_BASICRESP *        bs;
+  int                     status, reason;
+  ASN1_GENERALIZEDTIME *  revtime;
+  ASN1_GENERALIZEDTIME *  thisupd;
+  ASN1_GENERALIZEDTIME *  nextupd;
+  bool                    ok = false;
+
+  if (OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+    Debug("ssl_ocsp", "OCSP responder %s failed with status %d", info->uri, (int)OCSP_response_status(resp));
+    return false;
+  }
+
+  if ((bs = OCSP_response_get1_basic(resp)) == NULL) {
+    return false;
+  }
+
+  // Responses that don't know the certificate are of no use to a client.
+  if (OCSP_resp_find_status(bs, info->cid, &status, &reason, &revtime, &thisupd, &nextupd) &&
+      status != V_OCSP_CERTSTATUS_UNKNOWN &&
+      OCSP_check_validity(thisupd, nextupd, SSL_STAPLING_CLOCK_SKEW, -1)) {
+    int days = 0, secs = 0;
+
+    *expire = time(NULL) + cache_timeout;
+    if (nextupd && ASN1_TIME_diff(&days, &secs, NULL, nextupd)) {
+      *expire = time(NULL) + days * 86400 + secs;
+    }
+    ok = true;
+  } else {
+    Debug("ssl_ocsp", "OCSP response from %s is not valid for the certificate", info->uri);
+  }
+
+  OCSP_BASICRESP_free(bs);
+  return ok;
+}
+
+// Make resp the response to staple.
+static void
+ssl_stapling_set_response(SSLStaplingInfo * info, OCSP_RESPONSE * resp, time_t refresh, time_t expire)
+{
+  int len = i2d_OCSP_RESPONSE(resp, NULL);
+  unsigned char * der;
+  unsigned char * p;
+
+  if (len <= 0) {
+    return;
+  }
+
+  p = der = (unsigned char *)ats_malloc(len);
+  i2d_OCSP_RESPONSE(resp, &p);
+
+  ink_mutex_acquire(&info->mutex);
+  ats_free(info->der);
+  info->der = der;
+  info->der_len = len;
+  info->refresh_time = refresh;
+  info->expire_time = expire;
+  ink_mutex_release(&info->mutex);
+}
+
+// Load the response saved by an earlier run, so that stapling can start
+// before the responder has been asked.
+static void
+ssl_stapling_load_response(SSLStaplingInfo * info, time_t cache_timeout)
+{
+  textBuffer      buf(4096);
+  struct stat     sb;
+  int             fd;
+  OCSP_RESPONSE * resp;
+  time_t          expire;
+
+  if ((fd = open(info->cache_path, O_RDONLY)) < 0) {
+    return;
+  }
+
+  while (buf.rawReadFromFile(fd) > 0)
+    ;
+
+  if (fstat(fd, &sb) == 0) {
+    const unsigned char * p = (const unsigned char *)buf.bufPtr();
+
+    if ((resp = d2i_OCSP_RESPONSE(NULL, &p, buf.spaceUsed())) != NULL) {
+      if (ssl_stapling_check_response(info, resp, cache_timeout, &expire)) {
+        ssl_stapling_set_response(info, resp, sb.st_mtime + cache_timeout, expire);
+        Debug("ssl_ocsp", "loaded OCSP response from %s", info->cache_path);
+      }
+      OCSP_RESPONSE_free(resp);
+    }
+  }
+
+  close(fd);
+}
+
+// Save the current response for the next restart.
+static void
+ssl_stapling_save_response(SSLStaplingInfo * info)
+{
+  size_t  tmplen = strlen(info->cache_path) + 5;
+  char *  tmppath = (char *)alloca(tmplen);
+  int     fd;
+  bool    ok;
+
+  snprintf(tmppath, tmplen, "%s.tmp", info->cache_path);
+  if ((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    Warning("failed to save OCSP response to %s: %s", tmppath, strerror(errno));
+    return;
+  }
+
+  ink_mutex_acquire(&info->mutex);
+  ok = write(fd, info->der, info->der_len) == info->der_len;
+  ink_mutex_release(&info->mutex);
+
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmppath, info->cache_path) != 0) {
+    Warning("failed to save OCSP response to %s: %s", info->cache_path, strerror(errno));
+    unlink(tmppath);
+  }
+}
+
+// POST an OCSP request to a responder and read its answer. This blocks, so
+// it must only ever run on a task thread.
+static OCSP_RESPONSE *
+ssl_stapling_query(const char * uri, OCSP_CERTID * cid, int timeout)
+{
+  char *            host = NULL;
+  char *            port = NULL;
+  char *            path = NULL;
+  int               use_ssl = 0;
+  OCSP_REQUEST *    req = NULL;
+  OCSP_RESPONSE *   resp = NULL;
+  unsigned char *   body = NULL;
+  int               body_len;
+  struct addrinfo   hints;
+  struct addrinfo * ai = NULL;
+  int               fd = -1;
+  textBuffer        request(1024);
+  textBuffer        response(4096);
+
+  if (!OCSP_parse_url(uri, &host, &port, &path, &use_ssl)) {
+    Warning("invalid OCSP responder URL '%s'", uri);
+    goto done;
+  }
+
+  if (use_ssl) {
+    Warning("OCSP responder %s uses https, which is not supported", uri);
+    goto done;
+  }
+
+  req = OCSP_REQUEST_new();
+  if (!req || !OCSP_request_add0_id(req, OCSP_CERTID_dup(cid))) {
+    goto done;
+  }
+
+  if ((body_len = i2d_OCSP_REQUEST(req, &body)) <= 0) {
+    goto done;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &ai) != 0 || ai == NULL) {
+    Warning("failed to resolve OCSP responder %s", host);
+    goto done;
+  }
+
+  if ((fd = socket(ai->ai_family, SOCK_STREAM, 0)) < 0) {
+    goto done;
+  }
+
+  {
+    struct timeval tv = { timeout, 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+
+  if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+    Warning("failed to connect to OCSP responder %s: %s", uri, strerror(errno));
+    goto done;
+  }
+
+  {
+    char header[1024];
+    int  len = snprintf(header, sizeof(header), "POST %s HTTP/1.0\r\nHost: %s\r\n"
+                        "Content-Type: application/ocsp-request\r\nContent-Length: %d\r\n\r\n", path, host, body_len);
+
+    if (len <= 0 || len >= (int)sizeof(header)) {
+      goto done;
+    }
+    request.copyFrom(header, len);
+    request.copyFrom(body, body_len);
+  }
+
+  if (write(fd, request.bufPtr(), request.spaceUsed()) != request.spaceUsed()) {
+    Warning("failed to send OCSP request to %s: %s", uri, strerror(errno));
+    goto done;
+  }
+
+  for (;;) {
+    int n = response.rawReadFromFile(fd);
+
+    if (n == 0) {
+      break;
+    }
+    if (n < 0 || response.spaceUsed() > SSL_STAPLING_MAX_RESPONSE) {
+      Warning("failed to read OCSP response from %s: %s", uri, n < 0 ? strerror(errno) : "response too large");
+      goto done;
+    }
+  }
+
+  {
+    size_t len;
+    const unsigned char * p = (const unsigned char *)ssl_stapling_http_body(response.bufPtr(), response.spaceUsed(), &len);
+
+    if (p == NULL || (resp = d2i_OCSP_RESPONSE(NULL, &p, len)) == NULL) {
+      Warning("invalid OCSP response from %s", uri);
+    }
+  }
+
+done:
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (ai) {
+    freeaddrinfo(ai);
+  }
+  OPENSSL_free(body);
+  OCSP_REQUEST_free(req);
+  OPENSSL_free(host);
+  OPENSSL_free(port);
+  OPENSSL_free(path);
+  return resp;
+}
+
+// Fetch a new response for the context's certificate if it is due.
+static void
+ssl_stapling_refresh(SSL_CTX * ctx, const SSLConfigParams * params)
+{
+  SSLStaplingInfo * info = (SSLStaplingInfo *)SSL_CTX_get_ex_data(ctx, ssl_stapling_index);
+  OCSP_RESPONSE *   resp;
+  time_t            now = time(NULL);
+  time_t            expire;
+  bool              load;
+  bool              due;
+
+  if (info == NULL) {
+    return;
+  }
+
+  // The saved response is read here rather than when the context is
+  // created, which for lazily loaded certificates is on a network thread.
+  ink_mutex_acquire(&info->mutex);
+  load = info->cache_path && !info->cache_loaded;
+  info->cache_loaded = true;
+  ink_mutex_release(&info->mutex);
+
+  if (load) {
+    ssl_stapling_load_response(info, params->ssl_ocsp_cache_timeout);
+  }
+
+  ink_mutex_acquire(&info->mutex);
+  due = now >= info->refresh_time;
+  ink_mutex_release(&info->mutex);
+
+  if (!due) {
+    return;
+  }
+
+  Debug("ssl_ocsp", "fetching OCSP response from %s", info->uri);
+  resp = ssl_stapling_query(info->uri, info->cid, params->ssl_ocsp_request_timeout);
+  if (resp && ssl_stapling_check_response(info, resp, params->ssl_ocsp_cache_timeout, &expire)) {
+    ssl_stapling_set_response(info, resp, now + params->ssl_ocsp_cache_timeout, expire);
+    if (info->cache_path) {
+      ssl_stapling_save_response(info);
+    }
+    ssl_stapling_stat(ssl_ocsp_refresh_stat);
+  } else {
+    // Keep stapling the old response until it expires, and try again on
+    // the next update.
+    ssl_stapling_stat(ssl_ocsp_refresh_failure_stat);
+  }
+
+  OCSP_RESPONSE_free(resp);
+}
+
+static int
+ssl_stapling_callback(SSL * ssl, void * /* arg ATS_UNUSED */)
+{
+  SSLStaplingInfo * info = (SSLStaplingInfo *)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ssl_stapling_index);
+  unsigned char *   der = NULL;
+  int               len = 0;
+
+  if (info == NULL) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  ink_mutex_acquire(&info->mutex);
+  if (info->der && time(NULL) < info->expire_time) {
+    len = info->der_len;
+    der = (unsigned char *)OPENSSL_malloc(len);
+    memcpy(der, info->der, len);
+  }
+  ink_mutex_release(&info->mutex);
+
+  if (der == NULL) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  // OpenSSL frees the response when it is done with it.
+  SSL_set_tlsext_status_ocsp_resp(ssl, der, len);
+  ssl_stapling_stat(ssl_ocsp_stapled_stat);
+  return SSL_TLSEXT_ERR_OK;
+}
+
+// Find the certificate that issued cert, from the chain of ctx or its
+// certificate store.
+static X509 *
+ssl_stapling_get_issuer(SSL_CTX * ctx, X509 * cert)
+{
+  STACK_OF(X509) *  chain = NULL;
+  X509_STORE_CTX *  store_ctx;
+  X509 *            issuer = NULL;
+
+  SSL_CTX_get_extra_chain_certs(ctx, &chain);
+  for (int i = 0; chain && i < sk_X509_num(chain); ++i) {
+    X509 * x = sk_X509_value(chain, i);
+
+    if (X509_check_issued(x, cert) == X509_V_OK) {
+      X509_up_ref(x);
+      return x;
+    }
+  }
+
+  if ((store_ctx = X509_STORE_CTX_new()) != NULL) {
+    if (X509_STORE_CTX_init(store_ctx, SSL_CTX_get_cert_store(ctx), NULL, NULL)) {
+      if (X509_STORE_CTX_get1_issuer(&issuer, store_ctx, cert) <= 0) {
+        issuer = NULL;
+      }
+    }
+    X509_STORE_CTX_free(store_ctx);
+  }
+
+  return issuer;
+}
+
+void
+SSLStaplingInitialize()
+{
+  if (ssl_stapling_index < 0) {
+    ssl_stapling_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, ssl_stapling_info_free);
+  }
+}
+
+bool
+SSLStaplingInitCertificate(SSL_CTX * ctx, const SSLConfigParams * params)
+{
+  X509 *            cert = SSL_CTX_get0_certificate(ctx);
+  X509 *            issuer;
+  SSLStaplingInfo * info;
+  char *            subject;
+
+  if (cert == NULL) {
+    return false;
+  }
+
+  subject = X509_NAME_oneline(X509_get_subject_name(cert), NULL, 0);
+
+  if ((issuer = ssl_stapling_get_issuer(ctx, cert)) == NULL) {
+    Warning("not stapling OCSP responses for %s, its issuer certificate is not in the certificate chain", subject);
+    OPENSSL_free(subject);
+    return false;
+  }
+
+  info = NEW(new SSLStaplingInfo());
+  info->cid = OCSP_cert_to_id(NULL, cert, issuer);
+  X509_free(issuer);
+
+  if (params->ssl_ocsp_responder) {
+    info->uri = ats_strdup(params->ssl_ocsp_responder);
+  } else {
+    STACK_OF(OPENSSL_STRING) * uris = X509_get1_ocsp(cert);
+
+    if (uris && sk_OPENSSL_STRING_num(uris) > 0) {
+      info->uri = ats_strdup(sk_OPENSSL_STRING_value(uris, 0));
+    }
+    X509_email_free(uris);
+  }
+
+  if (info->cid == NULL || info->uri == NULL) {
+    Warning("not stapling OCSP responses for %s, it has no OCSP responder", subject);
+    OPENSSL_free(subject);
+    delete info;
+    return false;
+  }
+
+  if (params->ssl_ocsp_response_path) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int  mdlen;
+    char          name[EVP_MAX_MD_SIZE * 2 + sizeof(".ocsp")];
+
+    X509_digest(cert, EVP_sha1(), md, &mdlen);
+    for (unsigned i = 0; i < mdlen; ++i) {
+      snprintf(name + i * 2, 3, "%02x", md[i]);
+    }
+    strcpy(name + mdlen * 2, ".ocsp");
+
+    info->cache_path = Layout::relative_to(params->ssl_ocsp_response_path, name);
+  }
+
+  SSL_CTX_set_ex_data(ctx, ssl_stapling_index, info);
+  SSL_CTX_set_tlsext_status_cb(ctx, ssl_stapling_callback);
+
+  Debug("ssl_ocsp", "stapling OCSP responses from %s for %s", info->uri, subject);
+  OPENSSL_free(subject);
+  return true;
+}
+
+// Refreshes the OCSP responses of all the certificates in use.
+struct SSLStaplingUpdater : public Continuation
+{
+  SSLStaplingUpdater() : Continuation(new_ProxyMutex()), next(0) {
+    SET_HANDLER(&SSLStaplingUpdater::updateEvent);
+  }
+
+  int updateEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */) {
+    SSLConfig::scoped_config params;
+    SSLCertificateConfig::scoped_config lookup;
+    Vec<SSL_CTX *> contexts;
+    ink_hrtime deadline = ink_get_hrtime() + HRTIME_SECONDS(SSL_STAPLING_MAX_UPDATE_TIME);
+    unsigned start, done;
+
+    lookup->getContexts(contexts);
+    start = contexts.count() ? next % contexts.count() : 0;
+
+    // Each fetch blocks for up to the request timeout, so stop once the
+    // round has run out of time and start the next one where this one
+    // stopped. Otherwise a few dead responders would starve the rest.
+    for (done = 0; done < contexts.count() && ink_get_hrtime() < deadline; ++done) {
+      ssl_stapling_refresh(contexts[(start + done) % contexts.count()], params);
+    }
+    next = start + done;
+
+    for (unsigned i = 0; i < contexts.count(); ++i) {
+      SSL_CTX_free(contexts[i]);
+    }
+
+    return EVENT_CONT;
+  }
+
+  unsigned next;  // where the next round starts
+};
+
+// Gets a response for a single context that was created after startup.
+struct SSLStaplingContextRefresh : public Continuation
+{
+  explicit SSLStaplingContextRefresh(SSL_CTX * c) : Continuation(new_ProxyMutex()), ctx(c) {
+    SET_HANDLER(&SSLStaplingContextRefresh::refreshEvent);
+  }
+
+  int refreshEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */) {
+    SSLConfig::scoped_config params;
+
+    ssl_stapling_refresh(ctx, params);
+    SSL_CTX_free(ctx);
+    delete this;
+    return EVENT_DONE;
+  }
+
+  SSL_CTX * ctx;
+};
+
+void
+SSLStaplingRefreshContext(SSL_CTX * ctx)
+{
+  if (SSL_CTX_get_ex_data(ctx, ssl_stapling_index) == NULL) {
+    return;
+  }
+
+  SSL_CTX_up_ref(ctx);
+  eventProcessor.schedule_imm(NEW(new SSLStaplingContextRefresh(ctx)), ET_TASK);
+}
+
+void
+SSLStaplingStartup(const SSLConfigParams * params)
+{
+  if (!params->ssl_ocsp_enabled) {
+    return;
+  }
+
+  SSLStaplingUpdater * updater = NEW(new SSLStaplingUpdater());
+
+  eventProcessor.schedule_imm(updater, ET_TASK);
+  eventProcessor.schedule_every(updater, HRTIME_SECONDS(params->ssl_ocsp_update_period), ET_TASK);
+}
+
+#else /* HAVE_OPENSSL_OCSP_STAPLING */
+
+void
+SSLStaplingInitialize()
+{
+}
+
+bool
+SSLStaplingInitCertificate(SSL_CTX * /* ctx ATS_UNUSED */, const SSLConfigParams * /* params ATS_UNUSED */)
+{
+  return false;
+}
+
+void
+SSLStaplingRefreshContext(SSL_CTX * /* ctx ATS_UNUSED */)
+{
+}
+
+void
+SSLStaplingStartup(const SSLConfigParams * params)
+{
+  if (params->ssl_ocsp_enabled) {
+    Warning("this OpenSSL library does not support OCSP stapling, ignoring proxy.config.ssl.ocsp.enabled");
+  }
+}
+
+#endif /* HAVE_OPENSSL_OCSP_STAPLING */
+
+#if TS_HAS_TESTS
+
+REGRESSION_TEST(SSLStaplingHttpBody)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  const char * ok = "HTTP/1.0 200 OK\r\nContent-Type: application/ocsp-response\r\n\r\nDER";
+  const char * fail = "HTTP/1.1 404 Not Found\r\n\r\nDER";
+  const char * partial = "HTTP/1.0 200 OK\r\nContent-Type: application/ocsp-response\r\n";
+  const char * body;
+  size_t len = 0;
+
+  box = REGRESSION_TEST_PASSED;
+
+  body = ssl_stapling_http_body(ok, strlen(ok), &len);
+  box.check(body != NULL && len == 3 && memcmp(body, "DER", 3) == 0, "body of a 200 response is found");
+  box.check(ssl_stapling_http_body(fail, strlen(fail), &len) == NULL, "non 200 responses are rejected");
+  box.check(ssl_stapling_http_body(partial, strlen(partial), &len) == NULL, "responses without a body are rejected");
+  box.check(ssl_stapling_http_body("garbage", 7, &len) == NULL, "garbage is rejected");
+}
+
+#if HAVE_OPENSSL_OCSP_STAPLING
+
+// A key and certificate for the tests, signed by the issuer if there is one.
+static X509 *
+ssl_stapling_test_cert(const char * name, EVP_PKEY * key, X509 * issuer, EVP_PKEY * issuer_key)
+{
+  X509 * cert = X509_new();
+
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), issuer ? 2 : 1);
+  X509_gmtime_adj(X509_get_notBefore(cert), -3600);
+  X509_gmtime_adj(X509_get_notAfter(cert), 86400);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC, (const unsigned char *)name, -1, -1, 0);
+  X509_set_issuer_name(cert, X509_get_subject_name(issuer ? issuer : cert));
+  X509_set_pubkey(cert, key);
+  X509_sign(cert, issuer_key ? issuer_key : key, EVP_sha256());
+  return cert;
+}
+
+static EVP_PKEY *
+ssl_stapling_test_key()
+{
+  EVP_PKEY * key = EVP_PKEY_new();
+  EC_KEY *   ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+
+  EC_KEY_generate_key(ec);
+  EVP_PKEY_assign_EC_KEY(key, ec);
+  return key;
+}
+
+// An OCSP responder that says every certificate it is asked about is good.
+struct SSLStaplingTestResponder
+{
+  X509 *      ca;
+  EVP_PKEY *  ca_key;
+  int         fd;
+  int         port;
+  int         requests;   // how many to answer before exiting
+  int         answered;
+};
+
+static void
+ssl_stapling_test_answer(SSLStaplingTestResponder * r, int fd)
+{
+  char                  buf[8192];
+  int                   len = 0, n;
+  const char *          body = NULL;
+  int                   body_len = -1;
+
+  // Read the headers and the body.
+  while (len < (int)sizeof(buf) && (n = read(fd, buf + len, sizeof(buf) - len)) > 0) {
+    len += n;
+    if (body == NULL && (body = (const char *)memmem(buf, len, "\r\n\r\n", 4)) != NULL) {
+      const char * cl = (const char *)memmem(buf, body - buf, "Content-Length: ", 16);
+
+      body += 4;
+      body_len = cl ? atoi(cl + 16) : 0;
+    }
+    if (body && buf + len - body >= body_len) {
+      break;
+    }
+  }
+
+  if (body == NULL) {
+    return;
+  }
+
+  const unsigned char * p = (const unsigned char *)body;
+  OCSP_REQUEST *        req = d2i_OCSP_REQUEST(NULL, &p, body_len);
+  OCSP_BASICRESP *      bs = OCSP_BASICRESP_new();
+  ASN1_TIME *           thisupd = X509_gmtime_adj(NULL, 0);
+  ASN1_TIME *           nextupd = X509_gmtime_adj(NULL, 7200);
+  OCSP_RESPONSE *       resp;
+  unsigned char *       der = NULL;
+  int                   der_len;
+
+  if (req && OCSP_request_onereq_count(req) == 1) {
+    OCSP_basic_add1_status(bs, OCSP_onereq_get0_id(OCSP_request_onereq_get0(req, 0)),
+                           V_OCSP_CERTSTATUS_GOOD, 0, NULL, thisupd, nextupd);
+  }
+  OCSP_basic_sign(bs, r->ca, r->ca_key, EVP_sha256(), NULL, 0);
+  resp = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, bs);
+
+  if ((der_len = i2d_OCSP_RESPONSE(resp, &der)) > 0) {
+    len = snprintf(buf, sizeof(buf), "HTTP/1.0 200 OK\r\nContent-Type: application/ocsp-response\r\n"
+                   "Content-Length: %d\r\n\r\n", der_len);
+    if (write(fd, buf, len) == len && write(fd, der, der_len) == der_len) {
+      ++r->answered;
+    }
+  }
+
+  OPENSSL_free(der);
+  OCSP_RESPONSE_free(resp);
+  OCSP_BASICRESP_free(bs);
+  ASN1_TIME_free(thisupd);
+  ASN1_TIME_free(nextupd);
+  OCSP_REQUEST_free(req);
+}
+
+static void *
+ssl_stapling_test_respond(void * arg)
+{
+  SSLStaplingTestResponder * r = (SSLStaplingTestResponder *)arg;
+
+  for (int i = 0; i < r->requests; ++i) {
+    int fd = accept(r->fd, NULL, NULL);
+
+    if (fd < 0) {
+      break;
+    }
+    ssl_stapling_test_answer(r, fd);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+REGRESSION_TEST(SSLStaplingRefresh)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox                   box(t, pstatus);
+  SSLStaplingTestResponder  responder;
+  SSLConfigParams           params;
+  struct sockaddr_in        sin;
+  socklen_t                 slen = sizeof(sin);
+  char                      uri[64];
+  EVP_PKEY *                ca_key = ssl_stapling_test_key();
+  EVP_PKEY *                key = ssl_stapling_test_key();
+  X509 *                    ca = ssl_stapling_test_cert("OCSP test CA", ca_key, NULL, NULL);
+  X509 *                    cert = ssl_stapling_test_cert("ocsp.example.com", key, ca, ca_key);
+  SSL_CTX *                 ctx = SSL_CTX_new(SSLv23_server_method());
+  SSL *                     ssl;
+  SSLStaplingInfo *         info;
+  const unsigned char *     stapled;
+  ink_thread                tid;
+
+  box = REGRESSION_TEST_PASSED;
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  responder.ca = ca;
+  responder.ca_key = ca_key;
+  responder.fd = socket(AF_INET, SOCK_STREAM, 0);
+  responder.requests = 2;
+  responder.answered = 0;
+  if (bind(responder.fd, (struct sockaddr *)&sin, sizeof(sin)) != 0 || listen(responder.fd, 4) != 0 ||
+      getsockname(responder.fd, (struct sockaddr *)&sin, &slen) != 0) {
+    box.check(false, "failed to start the OCSP responder: %s", strerror(errno));
+    return;
+  }
+  responder.port = ntohs(sin.sin_port);
+  tid = ink_thread_create(ssl_stapling_test_respond, &responder);
+
+  snprintf(uri, sizeof(uri), "http://127.0.0.1:%d/", responder.port);
+  params.ssl_ocsp_responder = ats_strdup(uri);
+  params.ssl_ocsp_request_timeout = 5;
+
+  SSL_CTX_use_certificate(ctx, cert);
+  SSL_CTX_use_PrivateKey(ctx, key);
+  X509_up_ref(ca);
+  SSL_CTX_add_extra_chain_cert(ctx, ca);
+
+  SSLStaplingInitialize();
+  box.check(SSLStaplingInitCertificate(ctx, &params), "a certificate with its issuer in the chain can be stapled");
+  info = (SSLStaplingInfo *)SSL_CTX_get_ex_data(ctx, ssl_stapling_index);
+  ssl = SSL_new(ctx);
+
+  if (info == NULL || ssl == NULL) {
+    box.check(false, "no stapling information for the certificate");
+  } else {
+    box.check(ssl_stapling_callback(ssl, NULL) == SSL_TLSEXT_ERR_NOACK, "nothing is stapled before the first fetch");
+
+    // The first refresh fetches a response, which is then stapled.
+    ssl_stapling_refresh(ctx, &params);
+    box.check(responder.answered == 1, "the responder was asked once, not %d times", responder.answered);
+    box.check(ssl_stapling_callback(ssl, NULL) == SSL_TLSEXT_ERR_OK, "the fetched response is stapled");
+    box.check(SSL_get_tlsext_status_ocsp_resp(ssl, &stapled) == info->der_len && info->der_len > 0,
+              "the stapled response is the fetched one");
+
+    // It isn't fetched again until the cache timeout is up.
+    ssl_stapling_refresh(ctx, &params);
+    box.check(responder.answered == 1, "a fresh response is not fetched again");
+
+    info->refresh_time = 0;
+    ssl_stapling_refresh(ctx, &params);
+    box.check(responder.answered == 2, "a response that is due is fetched again");
+    box.check(info->refresh_time > time(NULL), "the refreshed response is not due");
+  }
+
+  ink_thread_join(tid);
+  close(responder.fd);
+
+  // With the responder gone, the last good response is still stapled.
+  if (info && ssl) {
+    info->refresh_time = 0;
+    ssl_stapling_refresh(ctx, &params);
+    box.check(info->refresh_time == 0, "a failed fetch is retried on the next update");
+    box.check(ssl_stapling_callback(ssl, NULL) == SSL_TLSEXT_ERR_OK, "the old response is stapled after a failed fetch");
+  }
+
+  SSL_free(ssl);
+  SSL_CTX_free(ctx);
+  X509_free(cert);
+  X509_free(ca);
+  EVP_PKEY_free(key);
+  EVP_PKEY_free(ca_key);
+}
+
+#endif /* HAVE_OPENSSL_OCSP_STAPLING */
+
+#endif // TS_HAS_TESTS
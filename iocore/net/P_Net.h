@@ -51,6 +51,34 @@ enum Net_Stats
   socks_connections_unsuccessful_stat,
   socks_connections_currently_open_stat,
   inactivity_cop_lock_acquire_failure_stat,
+  ssl_handshakes_stat,
+  ssl_handshake_time_stat,
+  ssl_handshake_time_500us_stat,
+  ssl_handshake_time_1ms_stat,
+  ssl_handshake_time_2ms_stat,
+  ssl_handshake_time_5ms_stat,
+  ssl_handshake_time_10ms_stat,
+  ssl_handshake_time_50ms_stat,
+  ssl_handshake_time_100ms_stat,
+  ssl_handshake_time_over_stat,
+  ssl_handshake_offloads_stat,
+  ssl_handshake_offload_wait_stat,
+  ssl_resumed_handshakes_stat,
+  ssl_session_cache_hit_stat,
+  ssl_session_cache_miss_stat,
+  ssl_session_cache_new_session_stat,
+  ssl_session_cache_eviction_stat,
+  ssl_session_cache_lock_contention_stat,
+  ssl_tickets_created_stat,
+  ssl_tickets_verified_stat,
+  ssl_tickets_renewed_stat,
+  ssl_tickets_not_found_stat,
+  ssl_ktls_send_stat,
+  ssl_ktls_send_fallback_stat,
+  ssl_ocsp_stapled_stat,
+  ssl_ocsp_refresh_stat,
+  ssl_ocsp_refresh_failure_stat,
+  ssl_lazy_context_load_stat,
   Net_Stat_Count
 };
 
@@ -60,6 +88,7 @@ extern RecRawStatBlock *net_rsb;
 #define SSL_HANDSHAKE_WANT_WRITE  7
 #define SSL_HANDSHAKE_WANT_ACCEPT 8
 #define SSL_HANDSHAKE_WANT_CONNECT 9
+#define SSL_HANDSHAKE_OFFLOADED   11
 
 #define NET_DEBUG_COUNT_DYN_STAT(_x, _y) \
 RecIncrRawStatCount(net_rsb, mutex->thread_holding, (int)_x, _y)
@@ -108,6 +137,8 @@ do { \
 #include "P_SSLNetProcessor.h"
 #include "P_SSLNetAccept.h"
 #include "P_SSLCertLookup.h"
+#include "P_SSLSessionCache.h"
+#include "P_OCSPStapling.h"
 
 #undef  NET_SYSTEM_MODULE_VERSION
 #define NET_SYSTEM_MODULE_VERSION makeModuleVersion(                    \
@@ -0,0 +1,53 @@
+/** @file
+
+  OCSP stapling for server certificates
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef __P_OCSPSTAPLING_H__
+#define __P_OCSPSTAPLING_H__
+
+#include "P_SSLUtils.h"
+
+// Finding the certificate and chain of a context needs OpenSSL 1.0.2.
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L && !defined(OPENSSL_NO_OCSP)
+#define HAVE_OPENSSL_OCSP_STAPLING 1
+#endif
+
+struct SSLConfigParams;
+
+// Register the SSL_CTX data that holds OCSP responses.
+void SSLStaplingInitialize();
+
+// Staple OCSP responses for the certificate of ctx. Its certificate and
+// chain must already be loaded. Nothing is read from disk here; stapling
+// starts once the task thread has read a response saved by an earlier run,
+// or fetched the first one. Returns false if the certificate can't be
+// stapled.
+bool SSLStaplingInitCertificate(SSL_CTX * ctx, const SSLConfigParams * params);
+
+// Get a response for a context created after SSLStaplingStartup(), such as
+// a lazily loaded certificate, without waiting for the next update.
+void SSLStaplingRefreshContext(SSL_CTX * ctx);
+
+// Start fetching and refreshing OCSP responses in the background.
+void SSLStaplingStartup(const SSLConfigParams * params);
+
+#endif /* __P_OCSPSTAPLING_H__ */
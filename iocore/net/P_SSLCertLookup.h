@@ -29,6 +29,12 @@
 
 struct SSLConfigParams;
 struct SSLContextStorage;
+struct SSLCertContext;
+struct SSLCertLookup;
+
+// Create the context of a lazily loaded certificate. The paths are as they
+// appear in ssl_multicert.config.
+typedef SSL_CTX * (*SSLContextLoader)(SSLCertLookup * lookup, const char * cert, const char * ca, const char * key);
 
 struct SSLCertLookup : public ConfigInfo
 {
@@ -37,12 +43,35 @@ struct SSLCertLookup : public ConfigInfo
 
   bool insert(SSL_CTX * ctx, const char * name);
   bool insert(SSL_CTX * ctx, const IpEndpoint& address);
+
+  // Find the context for a name or address. The caller gets a reference to
+  // it, which it drops with SSL_CTX_free(), since a lazily loaded context
+  // can be evicted at any time.
   SSL_CTX * findInfoInHash(const char * address) const;
   SSL_CTX * findInfoInHash(const IpEndpoint& address) const;
 
+  // Contexts are indexed by name through a handle, so that a certificate can
+  // be indexed before its context has been created. A context added with
+  // addContext() is owned by the lookup from then on.
+  SSLCertContext * addContext(SSL_CTX * ctx);
+  bool insert(SSLCertContext * cc, const char * name);
+
+  // Add a certificate whose context is only created, by the loader, when a
+  // handshake first asks for it. At most capacity lazily loaded contexts are
+  // kept, the least recently used ones are freed.
+  void enableLazyLoading(SSLContextLoader loader, unsigned capacity);
+  SSLCertContext * addLazyContext(const char * cert, const char * ca, const char * key);
+
   // Return the last-resort default TLS context if there is no name or address match.
   SSL_CTX * defaultContext() const { return ssl_default; }
 
+  // The number of distinct contexts that are not lazily loaded.
+  unsigned count() const;
+
+  // Add a reference to every distinct context that is loaded, lazily loaded
+  // ones included, to contexts. The caller drops them with SSL_CTX_free().
+  void getContexts(Vec<SSL_CTX *>& contexts) const;
+
   SSLCertLookup();
   virtual ~SSLCertLookup();
 };
@@ -49,7 +49,8 @@ struct SSLConfigParams : public ConfigInfo
   enum SSL_SESSION_CACHE_MODE
   {
     SSL_SESSION_CACHE_MODE_OFF = 0,
-    SSL_SESSION_CACHE_MODE_SERVER = 1
+    SSL_SESSION_CACHE_MODE_SERVER = 1,
+    SSL_SESSION_CACHE_MODE_SERVER_ATS_IMPL = 2
   };
 
   SSLConfigParams();
@@ -66,6 +67,11 @@ struct SSLConfigParams : public ConfigInfo
   int     verify_depth;
   int     ssl_session_cache; // SSL_SESSION_CACHE_MODE
   int     ssl_session_cache_size;
+  int     ssl_session_cache_num_buckets;
+  int     ssl_session_cache_timeout;
+  char *  ssl_session_cache_persist_file;
+  int     ssl_session_cache_persist_interval;
+  char *  ticket_key_filename;
 
   char *  clientCertPath;
   char *  clientKeyPath;
@@ -74,6 +80,20 @@ struct SSLConfigParams : public ConfigInfo
   int     clientVerify;
   int     client_verify_depth;
   long    ssl_ctx_options;
+  int     ssl_ktls;
+  int     ssl_ocsp_enabled;
+  int     ssl_ocsp_cache_timeout;
+  int     ssl_ocsp_request_timeout;
+  int     ssl_ocsp_update_period;
+  char *  ssl_ocsp_responder;
+  char *  ssl_ocsp_response_path;
+  int     ssl_context_cache_size;
+
+  // Record sizing is looked at on every write, so it is kept in statics
+  // rather than behind a configuration reference.
+  static int      ssl_maxrecord;
+  static int64_t  ssl_dynamic_record_threshold;
+  static int      ssl_dynamic_record_idle;
 
   void initialize();
   void cleanup();
@@ -98,6 +118,41 @@ private:
   static int configid;
 };
 
+// Session ticket keys, in the order they appear in the key file. The first
+// key encrypts new tickets, the others are only used to decrypt tickets that
+// were issued before the keys were rotated.
+struct ssl_ticket_key_t
+{
+  unsigned char key_name[16];
+  unsigned char hmac_secret[16];
+  unsigned char aes_key[16];
+};
+
+struct SSLTicketKeyBlock : public ConfigInfo
+{
+  SSLTicketKeyBlock() : keys(NULL), num_keys(0), mtime(0) { }
+  virtual ~SSLTicketKeyBlock();
+
+  ssl_ticket_key_t *  keys;
+  unsigned            num_keys;
+  time_t              mtime;  // of the key file they were loaded from
+};
+
+struct SSLTicketKeyConfig
+{
+  static void startup();
+  static void reconfigure();
+  static SSLTicketKeyBlock * acquire();
+  static void release(SSLTicketKeyBlock * block);
+
+  static bool enabled() { return configid != 0; }
+
+  typedef ConfigProcessor::scoped_config<SSLTicketKeyConfig, SSLTicketKeyBlock> scoped_config;
+
+private:
+  static int configid;
+};
+
 struct SSLCertificateConfig
 {
   static void startup();
@@ -62,6 +62,11 @@ public:
 
   static EventType ET_SSL;
 
+  // Threads that run server handshakes on behalf of the ET_SSL threads,
+  // see proxy.config.ssl.handshake_offload.threads.
+  static EventType ET_SSL_CRYPTO;
+  static int handshake_offload_threads;
+
   //
   // Private
   //
@@ -51,6 +51,13 @@
 #define SSL_TLSEXT_ERR_NOACK 3
 #endif
 
+// The most plaintext a TLS record can carry, and the record size used at
+// the start of a connection with dynamic record sizing. A small record
+// fits in one TCP segment, so the client can decrypt it as soon as that
+// segment arrives.
+#define SSL_MAX_TLS_RECORD_SIZE 16384
+#define SSL_DEF_TLS_RECORD_SIZE 1400
+
 class SSLNextProtocolSet;
 
 //////////////////////////////////////////////////////////////////
@@ -72,7 +79,9 @@ public:
   };
   virtual bool getSSLHandShakeComplete()
   {
-    return sslHandShakeComplete;
+    // An offloaded handshake is not complete until the net thread has
+    // collected the result.
+    return sslHandshakeOffloadState == SSL_HANDSHAKE_OFFLOAD_IDLE && sslHandShakeComplete;
   };
   void setSSLHandShakeComplete(bool state)
   {
@@ -86,8 +95,14 @@ public:
   {
     sslClientConnection = state;
   };
+  virtual bool getSSLHandShakeOffloaded()
+  {
+    return sslHandshakeOffloadState == SSL_HANDSHAKE_OFFLOAD_RUNNING;
+  };
   int sslServerHandShakeEvent(int &err);
   int sslClientHandShakeEvent(int &err);
+  int sslOffloadHandShake(int &err);
+  void sslOffloadHandShakeComplete(int ret, int err);
   virtual void net_read_io(NetHandler * nh, EThread * lthread);
   virtual int64_t load_buffer_and_write(int64_t towrite, int64_t &wattempted, int64_t &total_wrote, MIOBufferAccessor & buf);
 
@@ -115,8 +130,22 @@ private:
   SSLNetVConnection(const SSLNetVConnection &);
   SSLNetVConnection & operator =(const SSLNetVConnection &);
 
+  enum {
+    SSL_HANDSHAKE_OFFLOAD_IDLE,
+    SSL_HANDSHAKE_OFFLOAD_RUNNING,
+    SSL_HANDSHAKE_OFFLOAD_COMPLETE
+  };
+
   bool sslHandShakeComplete;
   bool sslClientConnection;
+  ink_hrtime sslHandshakeBeginTime;
+  int sslHandshakeOffloadState;
+  int sslHandshakeOffloadResult;
+  int sslHandshakeOffloadErrno;
+  int64_t sslTotalBytesSent;
+  ink_hrtime sslLastWriteTime;
+  int64_t sslPendingWriteSize;
+  bool sslKTLSSend;
   const SSLNextProtocolSet * npnSet;
   Continuation * npnEndpoint;
 };
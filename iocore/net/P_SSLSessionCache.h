@@ -0,0 +1,123 @@
+/** @file
+
+  A sharded cache of SSL sessions, owned by Traffic Server rather than OpenSSL
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef __P_SSLSESSIONCACHE_H__
+#define __P_SSLSESSIONCACHE_H__
+
+#include "libts.h"
+#include "P_SSLUtils.h"
+
+struct SSLConfigParams;
+
+struct SSLSessionID
+{
+  unsigned char bytes[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  size_t len;
+
+  SSLSessionID(const unsigned char * s, size_t l) : len(l) {
+    ink_assert(l <= sizeof(bytes));
+    memcpy(bytes, s, l);
+  }
+
+  bool operator == (const SSLSessionID& other) const {
+    return len == other.len && memcmp(bytes, other.bytes, len) == 0;
+  }
+
+  // Session IDs are random, so any bytes of them make a fine hash.
+  uint64_t hash() const {
+    uint64_t h = 0;
+    memcpy(&h, bytes, len < sizeof(h) ? len : sizeof(h));
+    return h;
+  }
+};
+
+// A cached session, kept in its DER encoding so that it can be handed to
+// any number of connections and written to disk as is.
+struct SSLSession
+{
+  SSLSessionID    id;
+  time_t          expires;
+  unsigned char * der;
+  int             der_len;
+
+  LINK(SSLSession, link);
+
+  SSLSession(const SSLSessionID& sid, time_t e, unsigned char * d, int l)
+    : id(sid), expires(e), der(d), der_len(l) {
+  }
+
+  ~SSLSession() {
+    ats_free(der);
+  }
+};
+
+// One shard of the cache. Sessions are kept in LRU order, most recently
+// used at the head.
+struct SSLSessionBucket
+{
+  SSLSessionBucket();
+  ~SSLSessionBucket();
+
+  ink_mutex         mutex;
+  Queue<SSLSession> queue;
+  size_t            count;
+};
+
+class SSLSessionCache
+{
+public:
+  SSLSessionCache(size_t nbuckets, size_t capacity);
+  ~SSLSessionCache();
+
+  // Return a new SSL_SESSION for id, or NULL if it is not cached.
+  SSL_SESSION * getSession(const SSLSessionID& id);
+  void insertSession(const SSLSessionID& id, SSL_SESSION * sess);
+  void removeSession(const SSLSessionID& id);
+
+  // Write the live sessions to path, readable by the owner only. Returns the
+  // number of sessions written or -1 on error.
+  int save(const char * path);
+
+  // Add the sessions from a file written by save(). Returns the number of
+  // sessions loaded or -1 on error.
+  int load(const char * path);
+
+private:
+  SSLSessionBucket * bucket(const SSLSessionID& id) const {
+    return &buckets[id.hash() % nbuckets];
+  }
+
+  void insert(SSLSessionBucket * b, SSLSession * s);
+
+  SSLSessionBucket *  buckets;
+  size_t              nbuckets;
+  size_t              bucket_capacity;
+};
+
+extern SSLSessionCache * session_cache;
+
+// Create the session cache when proxy.config.ssl.session_cache selects it,
+// loading and periodically saving it if it is persistent.
+void SSLSessionCacheStartup(const SSLConfigParams * params);
+
+#endif /* __P_SSLSESSIONCACHE_H__ */
@@ -28,8 +28,6 @@
 #include "P_SSLConfig.h"
 #include "I_EventSystem.h"
 #include "I_Layout.h"
-#include "Regex.h"
-#include "Trie.h"
 #include "ts/TestBox.h"
 
 struct SSLAddressLookupKey
@@ -68,33 +66,137 @@ private:
   unsigned char sep; // offset of address/port separator
 };
 
+// A context, or what it takes to create it when it is first needed.
+struct SSLCertContext
+{
+  explicit SSLCertContext(SSL_CTX * c)
+    : ctx(c), cert(NULL), ca(NULL), key(NULL), failed(false) {
+  }
+
+  SSLCertContext(const char * c, const char * a, const char * k)
+    : ctx(NULL), cert(ats_strdup(c)), ca(ats_strdup(a)), key(ats_strdup(k)), failed(false) {
+  }
+
+  ~SSLCertContext() {
+    if (ctx) {
+      SSL_CTX_free(ctx);
+    }
+    ats_free(cert);
+    ats_free(ca);
+    ats_free(key);
+  }
+
+  bool lazy() const { return cert != NULL; }
+
+  SSL_CTX * ctx;
+
+  // Lazily loaded contexts only.
+  char *    cert;
+  char *    ca;
+  char *    key;
+  bool      failed;     // don't retry a certificate that failed to load
+  LINK(SSLCertContext, link);
+};
+
+// A node of the name index. Names are split into labels and indexed from the
+// top level domain down, so "www.example.com" is found under "com", then
+// "example", then "www". The wildcard "*.example.com" is kept on the node of
+// "example.com" and matches every name below it, so the deepest wildcard
+// along the way is the longest match.
+struct SSLNameNode
+{
+  SSLNameNode() : exact(NULL), wildcard(NULL), children(NULL) {}
+  ~SSLNameNode();
+
+  SSLNameNode * child(const char * label) const;
+  SSLNameNode * addChild(const char * label);
+
+  SSLCertContext *  exact;
+  SSLCertContext *  wildcard;
+  InkHashTable *    children;   // SSLNameNode by label
+};
+
+// Split a host name into labels, last label first. Labels are lower cased,
+// since host names are not case sensitive.
+struct SSLNameLabels
+{
+  explicit SSLNameLabels(const char * name) : start(name), end(name + strlen(name)) {
+    // Ignore the empty root label of a fully qualified name.
+    if (end > start && end[-1] == '.') {
+      --end;
+    }
+
+    if (end == start) {
+      end = NULL;
+    }
+  }
+
+  bool next(char (&label)[TS_MAX_HOST_NAME_LEN + 1]) {
+    const char * ptr = end;
+    size_t len;
+
+    if (end == NULL) {
+      return false;
+    }
+
+    while (ptr > start && ptr[-1] != '.') {
+      --ptr;
+    }
+
+    len = end - ptr;
+    if (len >= sizeof(label)) {
+      len = sizeof(label) - 1;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      label[i] = tolower((unsigned char)ptr[i]);
+    }
+    label[len] = '\0';
+
+    end = (ptr > start) ? ptr - 1 : NULL;
+    return true;
+  }
+
+private:
+  const char * start;
+  const char * end;
+};
+
 struct SSLContextStorage
 {
   SSLContextStorage();
   ~SSLContextStorage();
 
-  bool insert(SSL_CTX * ctx, const char * name);
+  SSLCertContext * add(SSL_CTX * ctx);
+  SSLCertContext * add(const char * cert, const char * ca, const char * key);
+  bool insert(SSLCertContext * cc, const char * name);
   SSL_CTX * lookup(const char * name) const;
 
-private:
-  struct SSLEntry
-  {
-    explicit SSLEntry(SSL_CTX * c) : ctx(c) {}
+  unsigned count() const { return this->references.count(); }
+  void getContexts(Vec<SSL_CTX *>& contexts) const;
 
-    void Print() const { Debug("ssl", "SSLEntry=%p SSL_CTX=%p", this, ctx); }
+  SSLCertLookup *   owner;
+  SSLContextLoader  loader;
+  unsigned          capacity;
 
-    SSL_CTX * ctx;
-    LINK(SSLEntry, link);
-  };
-
-  Trie<SSLEntry>  wildcards;
-  InkHashTable *  hostnames;
-  Vec<SSL_CTX *>  references;
+private:
+  SSL_CTX * load(SSLCertContext * cc) const;
+  void evict() const;
+
+  SSLNameNode             names;
+  InkHashTable *          contexts;   // SSLCertContext by SSL_CTX
+  Vec<SSLCertContext *>   entries;
+  Vec<SSL_CTX *>          references; // contexts that are not lazily loaded
+
+  // Lazily loaded contexts, most recently used first.
+  mutable ink_mutex               mutex;
+  mutable Queue<SSLCertContext>   lru;
+  mutable unsigned                loaded;
 };
 
 SSLCertLookup::SSLCertLookup()
   : ssl_storage(NEW(new SSLContextStorage())), ssl_default(NULL)
 {
+  this->ssl_storage->owner = this;
 }
 
 SSLCertLookup::~SSLCertLookup()
@@ -128,160 +230,302 @@ SSLCertLookup::findInfoInHash(const IpEndpoint& address) const
   return NULL;
 }
 
+unsigned
+SSLCertLookup::count() const
+{
+  return this->ssl_storage->count();
+}
+
+void
+SSLCertLookup::getContexts(Vec<SSL_CTX *>& contexts) const
+{
+  this->ssl_storage->getContexts(contexts);
+}
+
+SSLCertContext *
+SSLCertLookup::addContext(SSL_CTX * ctx)
+{
+  return this->ssl_storage->add(ctx);
+}
+
+SSLCertContext *
+SSLCertLookup::addLazyContext(const char * cert, const char * ca, const char * key)
+{
+  return this->ssl_storage->add(cert, ca, key);
+}
+
+void
+SSLCertLookup::enableLazyLoading(SSLContextLoader loader, unsigned capacity)
+{
+  this->ssl_storage->loader = loader;
+  this->ssl_storage->capacity = capacity;
+}
+
+bool
+SSLCertLookup::insert(SSLCertContext * cc, const char * name)
+{
+  return this->ssl_storage->insert(cc, name);
+}
+
 bool
 SSLCertLookup::insert(SSL_CTX * ctx, const char * name)
 {
-  return this->ssl_storage->insert(ctx, name);
+  return this->ssl_storage->insert(this->ssl_storage->add(ctx), name);
 }
 
 bool
 SSLCertLookup::insert(SSL_CTX * ctx, const IpEndpoint& address)
 {
   SSLAddressLookupKey key(address);
-  return this->ssl_storage->insert(ctx, key.get());
+  return this->ssl_storage->insert(this->ssl_storage->add(ctx), key.get());
 }
 
+// Matches wildcard names of the "*.domain" form.
 struct ats_wildcard_matcher
 {
-  ats_wildcard_matcher() {
-    if (regex.compile("^\\*\\.[^\\*.]+") != 0) {
-      Fatal("failed to compile TLS wildcard matching regex");
-    }
-  }
-
-  ~ats_wildcard_matcher() {
-  }
-
   bool match(const char * hostname) const {
-    return regex.match(hostname) != -1;
+    return hostname[0] == '*' && hostname[1] == '.' && hostname[2] != '\0' && hostname[2] != '*' && hostname[2] != '.';
   }
-
-private:
-  DFA regex;
 };
 
-static char *
-reverse_dns_name(const char * hostname, char (&reversed)[TS_MAX_HOST_NAME_LEN+1])
+SSLNameNode::~SSLNameNode()
 {
-  char * ptr = reversed + sizeof(reversed);
-  const char * part = hostname;
+  if (this->children) {
+    InkHashTableIteratorState state;
 
-  *(--ptr) = '\0'; // NUL-terminate
+    for (InkHashTableEntry * e = ink_hash_table_iterator_first(this->children, &state); e != NULL;
+         e = ink_hash_table_iterator_next(this->children, &state)) {
+      delete (SSLNameNode *)ink_hash_table_entry_value(this->children, e);
+    }
 
-  while (*part) {
-    ssize_t len = strcspn(part, ".");
-    ssize_t remain = ptr - reversed;
+    ink_hash_table_destroy(this->children);
+  }
+}
 
-    // We are going to put the '.' separator back for all components except the first.
-    if (*ptr == '\0') {
-      if (remain < len) {
-        return NULL;
-      }
-    } else {
-      if (remain < (len + 1)) {
-        return NULL;
-      }
-      *(--ptr) = '.';
-    }
+SSLNameNode *
+SSLNameNode::child(const char * label) const
+{
+  InkHashTableValue value;
+
+  if (this->children && ink_hash_table_lookup(this->children, label, &value)) {
+    return (SSLNameNode *)value;
+  }
 
-    ptr -= len;
-    memcpy(ptr, part, len);
+  return NULL;
+}
 
-    // Skip to the next domain component. This will take us to either a '.' or a NUL.
-    // If it's a '.' we need to skip over it.
-    part += len;
-    if (*part == '.') {
-      ++part;
+SSLNameNode *
+SSLNameNode::addChild(const char * label)
+{
+  SSLNameNode * node = this->child(label);
+
+  if (node == NULL) {
+    if (this->children == NULL) {
+      this->children = ink_hash_table_create(InkHashTableKeyType_String);
     }
+
+    node = NEW(new SSLNameNode());
+    ink_hash_table_insert(this->children, label, (void *)node);
   }
 
-  return ptr;
+  return node;
 }
 
 SSLContextStorage::SSLContextStorage()
-  :wildcards(), hostnames(ink_hash_table_create(InkHashTableKeyType_String))
+  : owner(NULL), loader(NULL), capacity(0), contexts(ink_hash_table_create(InkHashTableKeyType_Word)), loaded(0)
 {
+  ink_mutex_init(&this->mutex, "SSLContextStorage");
 }
 
 SSLContextStorage::~SSLContextStorage()
 {
-  for (unsigned i = 0; i < this->references.count(); ++i) {
-    SSL_CTX_free(this->references[i]);
+  for (unsigned i = 0; i < this->entries.count(); ++i) {
+    delete this->entries[i];
   }
 
-  ink_hash_table_destroy(this->hostnames);
+  ink_hash_table_destroy(this->contexts);
+  ink_mutex_destroy(&this->mutex);
+}
+
+SSLCertContext *
+SSLContextStorage::add(SSL_CTX * ctx)
+{
+  InkHashTableValue value;
+  SSLCertContext * cc;
+
+  // The same context is usually indexed by several names, but it must only
+  // be freed once.
+  if (ink_hash_table_lookup(this->contexts, (const char *)ctx, &value)) {
+    return (SSLCertContext *)value;
+  }
+
+  cc = NEW(new SSLCertContext(ctx));
+  ink_hash_table_insert(this->contexts, (const char *)ctx, (void *)cc);
+  this->entries.push_back(cc);
+  this->references.push_back(ctx);
+  return cc;
+}
+
+SSLCertContext *
+SSLContextStorage::add(const char * cert, const char * ca, const char * key)
+{
+  SSLCertContext * cc = NEW(new SSLCertContext(cert, ca, key));
+
+  this->entries.push_back(cc);
+  return cc;
 }
 
 bool
-SSLContextStorage::insert(SSL_CTX * ctx, const char * name)
+SSLContextStorage::insert(SSLCertContext * cc, const char * name)
 {
   ats_wildcard_matcher wildcard;
-  bool inserted = true;
-
-  if (wildcard.match(name)) {
-    // We turn wildcards into the reverse DNS form, then insert them into the trie
-    // so that we can do a longest match lookup.
-    char namebuf[TS_MAX_HOST_NAME_LEN + 1];
-    char * reversed;
-    xptr<SSLEntry> entry;
-
-    reversed = reverse_dns_name(name + 2, namebuf);
-    if (!reversed) {
-      Error("wildcard name '%s' is too long", name);
+  char label[TS_MAX_HOST_NAME_LEN + 1];
+  bool is_wildcard = wildcard.match(name);
+  SSLNameNode * node = &this->names;
+
+  if (strlen(name) > TS_MAX_HOST_NAME_LEN) {
+    Error("certificate name '%s' is too long", name);
+    return false;
+  }
+
+  SSLNameLabels labels(is_wildcard ? name + 2 : name);
+  while (labels.next(label)) {
+    node = node->addChild(label);
+  }
+
+  if (is_wildcard) {
+    if (node->wildcard && node->wildcard != cc) {
+      Debug("ssl", "wildcard certificate for '%s' is already indexed", name);
       return false;
     }
 
-    Debug("ssl", "indexed wildcard certificate for '%s' as '%s' with SSL_CTX %p", name, reversed, ctx);
-    entry = new SSLEntry(ctx);
-    inserted = this->wildcards.Insert(reversed, entry, 0 /* rank */, -1 /* keylen */);
-    if (inserted) {
-      entry.release();
-    }
+    Debug("ssl", "indexed wildcard certificate for '%s' with SSL_CTX %p", name, cc->ctx);
+    node->wildcard = cc;
   } else {
-    Debug("ssl", "indexed '%s' with SSL_CTX %p", name, ctx);
-    ink_hash_table_insert(this->hostnames, name, (void *)ctx);
+    Debug("ssl", "indexed '%s' with SSL_CTX %p", name, cc->ctx);
+    node->exact = cc;
+  }
+
+  return true;
+}
+
+SSL_CTX *
+SSLContextStorage::lookup(const char * name) const
+{
+  char label[TS_MAX_HOST_NAME_LEN + 1];
+  const SSLNameNode * node = &this->names;
+  SSLCertContext * cc = NULL;
+
+  if (strlen(name) > TS_MAX_HOST_NAME_LEN) {
+    return NULL;
   }
 
-  // Keep a unique reference to the SSL_CTX, so that we can free it later. Since we index by name, multiple
-  // certificates can be indexed for the same name. If this happens, we will overwrite the previous pointer
-  // and leak a context. So if we insert a certificate, keep an ownership reference to it.
-  if (inserted) {
-    if (this->references.in(ctx) == NULL) {
-      this->references.push_back(ctx);
+  SSLNameLabels labels(name);
+  while (node && labels.next(label)) {
+    node = node->child(label);
+    if (node && node->wildcard) {
+      cc = node->wildcard;
     }
   }
 
-  return inserted;
+  // An exact match beats any wildcard.
+  if (node && node->exact) {
+    cc = node->exact;
+  }
+
+  if (cc == NULL) {
+    return NULL;
+  }
+
+  if (cc->lazy()) {
+    return this->load(cc);
+  }
+
+  SSL_CTX_up_ref(cc->ctx);
+  return cc->ctx;
 }
 
-SSL_CTX *
-SSLContextStorage::lookup(const char * name) const
+void
+SSLContextStorage::getContexts(Vec<SSL_CTX *>& contexts) const
 {
-  InkHashTableValue value;
+  for (unsigned i = 0; i < this->references.count(); ++i) {
+    SSL_CTX_up_ref(this->references[i]);
+    contexts.push_back(this->references[i]);
+  }
 
-  if (ink_hash_table_lookup(const_cast<InkHashTable *>(this->hostnames), name, &value)) {
-    return (SSL_CTX *)value;
+  ink_mutex_acquire(&this->mutex);
+  for (SSLCertContext * cc = this->lru.head; cc; cc = cc->link.next) {
+    SSL_CTX_up_ref(cc->ctx);
+    contexts.push_back(cc->ctx);
   }
+  ink_mutex_release(&this->mutex);
+}
+
+// The caller gets a reference of its own, so that the context stays good even
+// if it is evicted before the caller is done with it.
+SSL_CTX *
+SSLContextStorage::load(SSLCertContext * cc) const
+{
+  SSL_CTX * ctx;
 
-  if (!this->wildcards.Empty()) {
-    char namebuf[TS_MAX_HOST_NAME_LEN + 1];
-    char * reversed;
-    SSLEntry * entry;
+  ink_mutex_acquire(&this->mutex);
 
-    reversed = reverse_dns_name(name, namebuf);
-    if (!reversed) {
-      Error("failed to reverse hostname name '%s' is too long", name);
-      return NULL;
+  if (cc->ctx || cc->failed || this->loader == NULL) {
+    if (cc->ctx) {
+      this->lru.remove(cc);
+      this->lru.push(cc);
+      SSL_CTX_up_ref(cc->ctx);
     }
 
-    Debug("ssl", "attempting wildcard match for %s", reversed);
-    entry = this->wildcards.Search(reversed);
-    if (entry) {
-      return entry->ctx;
+    ctx = cc->ctx;
+    ink_mutex_release(&this->mutex);
+    return ctx;
+  }
+
+  // Loading the certificate reads it from disk, don't hold up the handshakes
+  // of other certificates meanwhile.
+  ink_mutex_release(&this->mutex);
+  ctx = this->loader(this->owner, cc->cert, cc->ca, cc->key);
+  ink_mutex_acquire(&this->mutex);
+
+  if (cc->ctx) {
+    // Another thread loaded it first.
+    if (ctx) {
+      SSL_CTX_free(ctx);
     }
+  } else if (ctx) {
+    Debug("ssl", "loaded SSL_CTX %p for certificate %s", ctx, cc->cert);
+    cc->ctx = ctx;
+    this->lru.push(cc);
+    ++this->loaded;
+    this->evict();
+  } else {
+    cc->failed = true;
   }
 
-  return NULL;
+  ctx = cc->ctx;
+  if (ctx) {
+    SSL_CTX_up_ref(ctx);
+  }
+  ink_mutex_release(&this->mutex);
+  return ctx;
+}
+
+// Drop our reference to the least recently used contexts that are over
+// capacity. Connections that still use one of them hold references of their
+// own, the context is only freed once the last of them is done.
+void
+SSLContextStorage::evict() const
+{
+  while (this->loaded > this->capacity && this->lru.tail != this->lru.head) {
+    SSLCertContext * cc = this->lru.tail;
+
+    Debug("ssl", "evicting SSL_CTX %p for certificate %s", cc->ctx, cc->cert);
+    this->lru.remove(cc);
+    SSL_CTX_free(cc->ctx);
+    cc->ctx = NULL;
+    --this->loaded;
+  }
 }
 
 #if TS_HAS_TESTS
@@ -300,21 +544,39 @@ REGRESSION_TEST(SSLWildcardMatch)(RegressionTest * t, int /* atype ATS_UNUSED */
   box.check(wildcard.match("") == false, "'' is not a wildcard");
 }
 
-REGRESSION_TEST(SSLReverseHostname)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+REGRESSION_TEST(SSLHostnameLabels)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
 {
   TestBox box(t, pstatus);
 
-  char reversed[TS_MAX_HOST_NAME_LEN + 1];
-
-#define _R(name) reverse_dns_name(name, reversed)
+  char label[TS_MAX_HOST_NAME_LEN + 1];
 
   box = REGRESSION_TEST_PASSED;
 
-  box.check(strcmp(_R("foo.com"), "com.foo") == 0, "reversed foo.com");
-  box.check(strcmp(_R("bar.foo.com"), "com.foo.bar") == 0, "reversed bar.foo.com");
-  box.check(strcmp(_R("foo"), "foo") == 0, "reversed foo");
+  {
+    SSLNameLabels labels("bar.foo.com");
+    box.check(labels.next(label) && strcmp(label, "com") == 0, "first label of bar.foo.com");
+    box.check(labels.next(label) && strcmp(label, "foo") == 0, "second label of bar.foo.com");
+    box.check(labels.next(label) && strcmp(label, "bar") == 0, "third label of bar.foo.com");
+    box.check(!labels.next(label), "bar.foo.com has three labels");
+  }
+
+  {
+    SSLNameLabels labels("Foo.COM.");
+    box.check(labels.next(label) && strcmp(label, "com") == 0, "first label of Foo.COM.");
+    box.check(labels.next(label) && strcmp(label, "foo") == 0, "second label of Foo.COM.");
+    box.check(!labels.next(label), "Foo.COM. has two labels");
+  }
 
-#undef _R
+  {
+    SSLNameLabels labels("foo");
+    box.check(labels.next(label) && strcmp(label, "foo") == 0, "label of foo");
+    box.check(!labels.next(label), "foo has one label");
+  }
+
+  {
+    SSLNameLabels labels("");
+    box.check(!labels.next(label), "the empty name has no labels");
+  }
 }
 
 #endif // TS_HAS_TESTS
@@ -37,10 +37,12 @@
 #include "P_SSLConfig.h"
 #include "P_SSLUtils.h"
 #include "P_SSLCertLookup.h"
+#include "I_Tasks.h"
 #include <records/I_RecHttp.h>
 
 int SSLConfig::configid = 0;
 int SSLCertificateConfig::configid = 0;
+int SSLTicketKeyConfig::configid = 0;
 
 static ConfigUpdateHandler<SSLCertificateConfig> * sslCertUpdate;
 
@@ -56,15 +58,32 @@ SSLConfigParams::SSLConfigParams()
     clientCACertFilename =
     clientCACertPath =
     cipherSuite =
+    ssl_session_cache_persist_file =
+    ticket_key_filename =
+    ssl_ocsp_responder =
+    ssl_ocsp_response_path =
     serverKeyPathOnly = NULL;
 
   clientCertLevel = client_verify_depth = verify_depth = clientVerify = 0;
+  ssl_ktls = 0;
 
   ssl_ctx_options = 0;
   ssl_session_cache = SSL_SESSION_CACHE_MODE_SERVER;
   ssl_session_cache_size = 1024*20;
+  ssl_session_cache_num_buckets = 256;
+  ssl_session_cache_timeout = 0;
+  ssl_session_cache_persist_interval = 300;
+  ssl_ocsp_enabled = 0;
+  ssl_ocsp_cache_timeout = 3600;
+  ssl_ocsp_request_timeout = 10;
+  ssl_ocsp_update_period = 60;
+  ssl_context_cache_size = 0;
 }
 
+int SSLConfigParams::ssl_maxrecord = 0;
+int64_t SSLConfigParams::ssl_dynamic_record_threshold = 1024 * 1024;
+int SSLConfigParams::ssl_dynamic_record_idle = 1000;
+
 SSLConfigParams::~SSLConfigParams()
 {
   cleanup();
@@ -84,6 +103,10 @@ SSLConfigParams::cleanup()
   ats_free_null(serverCertPathOnly);
   ats_free_null(serverKeyPathOnly);
   ats_free_null(cipherSuite);
+  ats_free_null(ssl_session_cache_persist_file);
+  ats_free_null(ticket_key_filename);
+  ats_free_null(ssl_ocsp_responder);
+  ats_free_null(ssl_ocsp_response_path);
 
   clientCertLevel = client_verify_depth = verify_depth = clientVerify = 0;
 }
@@ -183,6 +206,51 @@ SSLConfigParams::initialize()
   // SSL session cache configurations
   REC_ReadConfigInteger(ssl_session_cache, "proxy.config.ssl.session_cache");
   REC_ReadConfigInteger(ssl_session_cache_size, "proxy.config.ssl.session_cache.size");
+  REC_ReadConfigInteger(ssl_session_cache_num_buckets, "proxy.config.ssl.session_cache.num_buckets");
+  REC_ReadConfigInteger(ssl_session_cache_timeout, "proxy.config.ssl.session_cache.timeout");
+  REC_ReadConfigStringAlloc(ssl_session_cache_persist_file, "proxy.config.ssl.session_cache.persist_file");
+  REC_ReadConfigInteger(ssl_session_cache_persist_interval, "proxy.config.ssl.session_cache.persist_interval");
+
+  char * ticket_key_filename_only = NULL;
+  REC_ReadConfigStringAlloc(ticket_key_filename_only, "proxy.config.ssl.server.ticket_key.filename");
+  if (ticket_key_filename_only) {
+    ticket_key_filename = Layout::relative_to(serverCertPathOnly, ticket_key_filename_only);
+    ats_free(ticket_key_filename_only);
+  }
+
+  REC_ReadConfigInt32(ssl_ktls, "proxy.config.ssl.ktls.enabled");
+#if !defined(SSL_OP_ENABLE_KTLS)
+  if (ssl_ktls) {
+    Warning("this OpenSSL library does not support kernel TLS, ignoring proxy.config.ssl.ktls.enabled");
+    ssl_ktls = 0;
+  }
+#endif
+
+  REC_ReadConfigInt32(ssl_maxrecord, "proxy.config.ssl.max_record_size");
+  if (ssl_maxrecord < -1) {
+    Warning("invalid proxy.config.ssl.max_record_size %d, using 0", ssl_maxrecord);
+    ssl_maxrecord = 0;
+  } else if (ssl_maxrecord > SSL_MAX_TLS_RECORD_SIZE) {
+    Warning("proxy.config.ssl.max_record_size %d is larger than a TLS record, using %d", ssl_maxrecord, SSL_MAX_TLS_RECORD_SIZE);
+    ssl_maxrecord = SSL_MAX_TLS_RECORD_SIZE;
+  }
+  REC_ReadConfigInteger(ssl_dynamic_record_threshold, "proxy.config.ssl.dynamic_record.byte_threshold");
+  REC_ReadConfigInt32(ssl_dynamic_record_idle, "proxy.config.ssl.dynamic_record.idle_reset");
+
+  REC_ReadConfigInt32(ssl_context_cache_size, "proxy.config.ssl.server.context_cache.size");
+
+  REC_ReadConfigInt32(ssl_ocsp_enabled, "proxy.config.ssl.ocsp.enabled");
+  REC_ReadConfigInt32(ssl_ocsp_cache_timeout, "proxy.config.ssl.ocsp.cache_timeout");
+  REC_ReadConfigInt32(ssl_ocsp_request_timeout, "proxy.config.ssl.ocsp.request_timeout");
+  REC_ReadConfigInt32(ssl_ocsp_update_period, "proxy.config.ssl.ocsp.update_period");
+  REC_ReadConfigStringAlloc(ssl_ocsp_responder, "proxy.config.ssl.ocsp.responder");
+
+  char * ssl_ocsp_response_path_only = NULL;
+  REC_ReadConfigStringAlloc(ssl_ocsp_response_path_only, "proxy.config.ssl.ocsp.response.path");
+  if (ssl_ocsp_response_path_only) {
+    ssl_ocsp_response_path = Layout::relative_to(Layout::get()->runtimedir, ssl_ocsp_response_path_only);
+    ats_free(ssl_ocsp_response_path_only);
+  }
 
   // ++++++++++++++++++++++++ Client part ++++++++++++++++++++
   client_verify_depth = 7;
@@ -273,3 +341,109 @@ SSLCertificateConfig::release(SSLCertLookup * lookup)
   configProcessor.release(configid, lookup);
 }
 
+
+// How often the session ticket key file is checked for new keys.
+#define SSL_TICKET_KEY_CHECK_INTERVAL HRTIME_SECONDS(30)
+
+SSLTicketKeyBlock::~SSLTicketKeyBlock()
+{
+  if (keys) {
+    OPENSSL_cleanse(keys, num_keys * sizeof(ssl_ticket_key_t));
+    ats_free(keys);
+  }
+}
+
+static SSLTicketKeyBlock *
+ssl_create_ticket_keyblock(const char * path)
+{
+  struct stat sb;
+  int fd;
+  ssize_t nread;
+  SSLTicketKeyBlock * block;
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    Error("failed to open session ticket key file %s: %s", path, strerror(errno));
+    return NULL;
+  }
+
+  if (fstat(fd, &sb) != 0 || sb.st_size == 0 || sb.st_size % sizeof(ssl_ticket_key_t) != 0) {
+    Error("session ticket key file %s must hold one or more %u byte keys", path, (unsigned)sizeof(ssl_ticket_key_t));
+    close(fd);
+    return NULL;
+  }
+
+  block = NEW(new SSLTicketKeyBlock());
+  block->num_keys = sb.st_size / sizeof(ssl_ticket_key_t);
+  block->keys = (ssl_ticket_key_t *)ats_malloc(sb.st_size);
+  block->mtime = sb.st_mtime;
+
+  nread = read(fd, block->keys, sb.st_size);
+  close(fd);
+
+  if (nread != sb.st_size) {
+    Error("failed to read session ticket key file %s", path);
+    delete block;
+    return NULL;
+  }
+
+  return block;
+}
+
+// Reloads the session ticket keys when the key file changes, so that keys
+// can be rotated without restarting.
+struct SSLTicketKeyWatcher : public Continuation
+{
+  SSLTicketKeyWatcher() : Continuation(new_ProxyMutex()) {
+    SET_HANDLER(&SSLTicketKeyWatcher::checkEvent);
+  }
+
+  int checkEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */) {
+    SSLConfig::scoped_config params;
+    SSLTicketKeyConfig::scoped_config keys;
+    struct stat sb;
+
+    if (stat(params->ticket_key_filename, &sb) == 0 && sb.st_mtime != keys->mtime) {
+      SSLTicketKeyConfig::reconfigure();
+    }
+    return EVENT_CONT;
+  }
+};
+
+void
+SSLTicketKeyConfig::startup()
+{
+  SSLConfig::scoped_config params;
+
+  if (params->ticket_key_filename == NULL) {
+    return;
+  }
+
+  reconfigure();
+  if (configid) {
+    eventProcessor.schedule_every(NEW(new SSLTicketKeyWatcher()), SSL_TICKET_KEY_CHECK_INTERVAL, ET_TASK);
+  }
+}
+
+void
+SSLTicketKeyConfig::reconfigure()
+{
+  SSLConfig::scoped_config params;
+  SSLTicketKeyBlock * block = ssl_create_ticket_keyblock(params->ticket_key_filename);
+
+  if (block) {
+    Note("loaded %u session ticket keys from %s", block->num_keys, params->ticket_key_filename);
+    configid = configProcessor.set(configid, block);
+  }
+}
+
+SSLTicketKeyBlock *
+SSLTicketKeyConfig::acquire()
+{
+  return (SSLTicketKeyBlock *)configProcessor.get(configid);
+}
+
+void
+SSLTicketKeyConfig::release(SSLTicketKeyBlock * block)
+{
+  configProcessor.release(configid, block);
+}
@@ -33,6 +33,8 @@
 SSLNetProcessor   ssl_NetProcessor;
 NetProcessor&     sslNetProcessor = ssl_NetProcessor;
 EventType         SSLNetProcessor::ET_SSL;
+EventType         SSLNetProcessor::ET_SSL_CRYPTO;
+int               SSLNetProcessor::handshake_offload_threads = 0;
 
 void
 SSLNetProcessor::cleanup(void)
@@ -51,7 +53,16 @@ SSLNetProcessor::start(int number_of_ssl_threads, size_t stacksize)
   SSLConfig::startup();
 
   if (HttpProxyPort::hasSSL()) {
+    {
+      SSLConfig::scoped_config params;
+      SSLSessionCacheStartup(params);
+    }
+    SSLTicketKeyConfig::startup();
     SSLCertificateConfig::startup();
+    {
+      SSLConfig::scoped_config params;
+      SSLStaplingStartup(params);
+    }
   }
 
   // Acquire a SSLConfigParams instance *after* we start SSL up.
@@ -65,6 +76,13 @@ SSLNetProcessor::start(int number_of_ssl_threads, size_t stacksize)
     SSLError("Can't initialize the SSL client, HTTPS in remap rules will not function");
   }
 
+  REC_ReadConfigInteger(handshake_offload_threads, "proxy.config.ssl.handshake_offload.threads");
+  if (handshake_offload_threads > 0) {
+    SSLNetProcessor::ET_SSL_CRYPTO = eventProcessor.spawn_event_threads(handshake_offload_threads, "ET_SSL_CRYPTO", stacksize);
+  } else {
+    handshake_offload_threads = 0;
+  }
+
   if (number_of_ssl_threads < 1) {
     return -1;
   }
@@ -39,6 +39,90 @@
 
 ClassAllocator<SSLNetVConnection> sslNetVCAllocator("sslNetVCAllocator");
 
+// Upper bounds of the proxy.process.ssl.handshake_time histogram buckets,
+// the last bucket collects everything slower.
+static const ink_hrtime ssl_handshake_time_bounds[] = {
+  HRTIME_USECONDS(500), HRTIME_MSECONDS(1), HRTIME_MSECONDS(2), HRTIME_MSECONDS(5),
+  HRTIME_MSECONDS(10), HRTIME_MSECONDS(50), HRTIME_MSECONDS(100)
+};
+
+static int
+ssl_handshake_time_bucket(ink_hrtime elapsed)
+{
+  int i = 0;
+
+  while (i < (int) countof(ssl_handshake_time_bounds) && elapsed > ssl_handshake_time_bounds[i])
+    ++i;
+  return ssl_handshake_time_500us_stat + i;
+}
+
+//
+// Runs one SSL_accept() step of a server handshake on an ET_SSL_CRYPTO
+// thread, then hands the result back to the net thread that owns the
+// SSLNetVConnection. The net thread leaves the connection alone while the
+// job is outstanding; in particular it defers closing it.
+//
+struct SSLHandshakeOffload : public Continuation
+{
+  SSLNetVConnection *vc;
+  ink_hrtime dispatched;
+  int ret;
+  int err;
+
+  void init(SSLNetVConnection *netvc)
+  {
+    mutex = new_ProxyMutex();
+    vc = netvc;
+    dispatched = ink_get_hrtime();
+    ret = EVENT_ERROR;
+    err = 0;
+    SET_HANDLER(&SSLHandshakeOffload::handshakeEvent);
+  }
+
+  int handshakeEvent(int event, Event *e);
+  int completeEvent(int event, Event *e);
+};
+
+static ClassAllocator<SSLHandshakeOffload> sslHandshakeOffloadAllocator("sslHandshakeOffloadAllocator");
+
+int
+SSLHandshakeOffload::handshakeEvent(int /* event ATS_UNUSED */, Event *e)
+{
+  RecIncrRawStatSum(net_rsb, e->ethread, (int) ssl_handshake_offloads_stat, 1);
+  RecIncrRawStatSum(net_rsb, e->ethread, (int) ssl_handshake_offload_wait_stat,
+                    ink_hrtime_to_usec(ink_get_hrtime() - dispatched));
+
+  ret = vc->sslServerHandShakeEvent(err);
+
+  // Switch over to the NetHandler lock, the net thread owns the rest.
+  mutex = vc->nh->mutex;
+  SET_HANDLER(&SSLHandshakeOffload::completeEvent);
+  vc->thread->schedule_imm(this);
+  return EVENT_DONE;
+}
+
+int
+SSLHandshakeOffload::completeEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
+{
+  vc->sslOffloadHandShakeComplete(ret, err);
+  mutex.clear();
+  sslHandshakeOffloadAllocator.free(this);
+  return EVENT_DONE;
+}
+
+// Whether the client has sent anything for SSL_accept() to work on. Errors
+// and EOF count as readable so that the handshake can fail.
+static bool
+ssl_socket_readable(int fd)
+{
+  char c;
+
+  if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0) {
+    return errno != EAGAIN && errno != EWOULDBLOCK;
+  }
+  return true;
+}
+
 //
 // Private
 //
@@ -51,13 +135,16 @@ make_ssl_connection(SSL_CTX * ctx, SSLNetVConnection * netvc)
   if (likely(ssl = SSL_new(ctx))) {
     SSL_set_fd(ssl, netvc->get_socket());
     SSL_set_app_data(ssl, netvc);
+    // Records gathered from several buffer blocks are written from a copy,
+    // which need not be at the same address when a write is retried.
+    SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
   }
 
   return ssl;
 }
 
 static inline int
-do_SSL_write(SSL * ssl, void *buf, int size)
+do_SSL_write(SSL * ssl, const void *buf, int size)
 {
   int r = 0;
   do {
@@ -73,6 +160,86 @@ do_SSL_write(SSL * ssl, void *buf, int size)
   return r;
 }
 
+// How much data to put into each TLS record, 0 for as much as will fit.
+// With dynamic sizing (maxrecord < 0) a connection uses small records until
+// it has sent threshold bytes.
+static int64_t
+ssl_record_size(int maxrecord, int64_t threshold, int64_t sent)
+{
+  if (maxrecord >= 0) {
+    return maxrecord;
+  }
+  return sent < threshold ? SSL_DEF_TLS_RECORD_SIZE : SSL_MAX_TLS_RECORD_SIZE;
+}
+
+// Pick the next run of bytes to hand to SSL_write, at most wavail of them,
+// starting offset bytes into block b. Whole records are written straight out
+// of a block, while short blocks are gathered into coalesce so that they go
+// out as one record. b and offset are moved past the bytes returned, and past
+// any blocks that are then used up.
+static int64_t
+ssl_next_write(IOBufferBlock *&b, int64_t &offset, int64_t wavail, int64_t record, int64_t pending,
+               char *coalesce, const char *&data)
+{
+  int64_t chunk = record ? record : SSL_MAX_TLS_RECORD_SIZE;
+  int64_t l;
+
+  // OpenSSL wants a write that would have blocked to be retried with at
+  // least as much data as before.
+  if (chunk < pending)
+    chunk = pending;
+
+  while (b && offset >= b->read_avail()) {
+    offset -= b->read_avail();
+    b = b->next;
+  }
+  if (!b || wavail <= 0)
+    return 0;
+
+  l = b->read_avail() - offset;
+  if (l > wavail)
+    l = wavail;
+  data = b->start() + offset;
+
+  if (l >= chunk) {
+    // Write whole records straight out of the block.
+    if (record)
+      l = chunk;
+    else
+      l -= l % chunk;
+    offset += l;
+  } else if (l < wavail) {
+    // Gather this block and the ones after it into a single record
+    // rather than sending a short record for each of them.
+    int64_t want = wavail < chunk ? wavail : chunk;
+
+    l = 0;
+    while (b && l < want) {
+      int64_t n = b->read_avail() - offset;
+
+      if (n > want - l)
+        n = want - l;
+      if (n > 0) {
+        memcpy(coalesce + l, b->start() + offset, n);
+        l += n;
+        offset += n;
+      }
+      if (offset >= b->read_avail()) {
+        offset -= b->read_avail();
+        b = b->next;
+      }
+    }
+    data = coalesce;
+  } else {
+    offset += l;
+  }
+
+  while (b && offset >= b->read_avail()) {
+    offset -= b->read_avail();
+    b = b->next;
+  }
+  return l;
+}
 
 static int
 ssl_read_from_net(UnixNetVConnection * vc, EThread * lthread, int64_t &ret)
@@ -228,6 +395,10 @@ SSLNetVConnection::net_read_io(NetHandler *nh, EThread *lthread)
       write.triggered = 0;
       nh->write_ready_list.remove(this);
       writeReschedule(nh);
+    } else if (ret == SSL_HANDSHAKE_OFFLOADED) {
+      // A crypto thread has the handshake, it retriggers us when done.
+      read.triggered = 0;
+      nh->read_ready_list.remove(this);
     } else if (ret == EVENT_DONE) {
       // If this was driven by a zero length read, signal complete when
       // the handshake is complete. Otherwise set up for continuing read
@@ -251,7 +422,11 @@ SSLNetVConnection::net_read_io(NetHandler *nh, EThread *lthread)
   }
 
   do {
-    if (!buf.writer()->write_avail()) {
+    // Make sure there is a fresh block to read into once the current one
+    // is short of a full record. The block is of the buffer's size index,
+    // so it can still be smaller than a record, in which case SSL_read
+    // fills it and the rest of the record goes into the next block.
+    if (buf.writer()->write_avail() < SSL_MAX_TLS_RECORD_SIZE) {
       buf.writer()->add_block();
     }
     ret = ssl_read_from_net(this, lthread, r);
@@ -331,41 +506,57 @@ SSLNetVConnection::load_buffer_and_write(int64_t towrite, int64_t &wattempted, i
   ProxyMutex *mutex = this_ethread()->mutex;
   int64_t r = 0;
   int64_t l = 0;
+  int64_t sent = 0;
+  char coalesce[SSL_MAX_TLS_RECORD_SIZE];
+
+  // The kernel encrypts whatever is written to a kernel TLS socket, so
+  // write the plain text like any other connection does.
+  if (sslKTLSSend) {
+    return UnixNetVConnection::load_buffer_and_write(towrite, wattempted, total_wrote, buf);
+  }
 
   // XXX Rather than dealing with the block directly, we should use the IOBufferReader API.
   int64_t offset = buf.reader()->start_offset;
   IOBufferBlock *b = buf.reader()->block;
 
+  // After an idle period the congestion window has likely shrunk, so go back
+  // to small records. Not while a write is pending though, its retry must
+  // not get any shorter.
+  if (SSLConfigParams::ssl_maxrecord < 0 && SSLConfigParams::ssl_dynamic_record_idle > 0 && sslPendingWriteSize == 0 &&
+      ink_get_hrtime() - sslLastWriteTime > HRTIME_MSECONDS(SSLConfigParams::ssl_dynamic_record_idle)) {
+    sslTotalBytesSent = 0;
+  }
+
   do {
-    // check if we have done this block
-    l = b->read_avail();
-    l -= offset;
-    if (l <= 0) {
-      offset = -l;
-      b = b->next;
-      continue;
-    }
-    // check if to amount to write exceeds that in this buffer
-    int64_t wavail = towrite - total_wrote;
+    int64_t record = ssl_record_size(SSLConfigParams::ssl_maxrecord, SSLConfigParams::ssl_dynamic_record_threshold,
+                                     sslTotalBytesSent + sent);
+    const char *data = NULL;
 
-    if (l > wavail)
-      l = wavail;
+    l = ssl_next_write(b, offset, towrite - total_wrote, record, sslPendingWriteSize, coalesce, data);
     if (!l)
       break;
+
     wattempted = l;
     total_wrote += l;
     Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite, before do_SSL_write, l=%" PRId64", towrite=%" PRId64", b=%p",
           l, towrite, b);
-    r = do_SSL_write(ssl, b->start() + offset, (int)l);
+    r = do_SSL_write(ssl, data, (int)l);
     if (r == l) {
       wattempted = total_wrote;
+      sent += r;
+      sslPendingWriteSize = 0;
+    } else {
+      sslPendingWriteSize = l;
     }
-    // on to the next block
-    offset = 0;
-    b = b->next;
     Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite,Number of bytes written=%" PRId64" , total=%" PRId64"", r, total_wrote);
     NET_DEBUG_COUNT_DYN_STAT(net_calls_to_write_stat, 1);
   } while (r == l && total_wrote < towrite && b);
+
+  if (sent > 0) {
+    sslTotalBytesSent += sent;
+    sslLastWriteTime = ink_get_hrtime();
+  }
+
   if (r > 0) {
     if (total_wrote != wattempted) {
       Debug("ssl", "SSLNetVConnection::loadBufferAndCallWrite, wrote some bytes, but not all requested.");
@@ -410,6 +601,14 @@ SSLNetVConnection::load_buffer_and_write(int64_t towrite, int64_t &wattempted, i
 SSLNetVConnection::SSLNetVConnection():
   sslHandShakeComplete(false),
   sslClientConnection(false),
+  sslHandshakeBeginTime(0),
+  sslHandshakeOffloadState(SSL_HANDSHAKE_OFFLOAD_IDLE),
+  sslHandshakeOffloadResult(SSL_HANDSHAKE_WANT_READ),
+  sslHandshakeOffloadErrno(0),
+  sslTotalBytesSent(0),
+  sslLastWriteTime(0),
+  sslPendingWriteSize(0),
+  sslKTLSSend(false),
   npnSet(NULL),
   npnEndpoint(NULL)
 {
@@ -433,13 +632,25 @@ SSLNetVConnection::free(EThread * t) {
   closed = 0;
   ink_assert(con.fd == NO_FD);
   if (ssl != NULL) {
-    /*if (sslHandShakeComplete)
-       SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN|SSL_RECEIVED_SHUTDOWN); */
+    // Freeing an SSL connection that was not shut down makes OpenSSL drop its
+    // session from the session cache. We never send close_notify, so mark a
+    // completed connection as shut down to keep its session resumable.
+    if (sslHandShakeComplete) {
+      SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN|SSL_RECEIVED_SHUTDOWN);
+    }
     SSL_free(ssl);
     ssl = NULL;
   }
   sslHandShakeComplete = false;
   sslClientConnection = false;
+  sslHandshakeBeginTime = 0;
+  sslHandshakeOffloadState = SSL_HANDSHAKE_OFFLOAD_IDLE;
+  sslHandshakeOffloadResult = SSL_HANDSHAKE_WANT_READ;
+  sslHandshakeOffloadErrno = 0;
+  sslTotalBytesSent = 0;
+  sslLastWriteTime = 0;
+  sslPendingWriteSize = 0;
+  sslKTLSSend = false;
   npnSet = NULL;
 
   if (from_accept_thread) {
@@ -465,20 +676,121 @@ SSLNetVConnection::sslStartHandShake(int event, int &err)
         SSLError("SSL_StartHandShake");
         return EVENT_ERROR;
       }
+      sslHandshakeBeginTime = ink_get_hrtime();
+
+#if defined(SSL_OP_ENABLE_KTLS)
+      SSLConfig::scoped_config params;
+      if (params->ssl_ktls) {
+        SSL_set_options(this->ssl, SSL_OP_ENABLE_KTLS);
+      }
+#endif
+    }
+
+    int ret;
+
+    if (SSLNetProcessor::handshake_offload_threads > 0) {
+      ret = sslOffloadHandShake(err);
+    } else {
+      ret = sslServerHandShakeEvent(err);
+    }
+
+    if (ret == EVENT_DONE) {
+      ProxyMutex *mutex = this_ethread()->mutex;
+      ink_hrtime elapsed = ink_get_hrtime() - sslHandshakeBeginTime;
+
+      NET_INCREMENT_DYN_STAT(ssl_handshakes_stat);
+      NET_SUM_DYN_STAT(ssl_handshake_time_stat, ink_hrtime_to_usec(elapsed));
+      NET_INCREMENT_DYN_STAT(ssl_handshake_time_bucket(elapsed));
+      if (SSL_session_reused(ssl)) {
+        NET_INCREMENT_DYN_STAT(ssl_resumed_handshakes_stat);
+      }
+
+#if defined(SSL_OP_ENABLE_KTLS)
+      // OpenSSL moves the socket to kernel TLS as the handshake completes,
+      // provided the kernel supports the negotiated cipher.
+      if (SSL_get_options(ssl) & SSL_OP_ENABLE_KTLS) {
+        sslKTLSSend = BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+        NET_INCREMENT_DYN_STAT(sslKTLSSend ? ssl_ktls_send_stat : ssl_ktls_send_fallback_stat);
+        Debug("ssl", "kernel TLS %s for cipher %s", sslKTLSSend ? "enabled" : "not available", SSL_get_cipher_name(ssl));
+      }
+#endif
     }
 
-    return sslServerHandShakeEvent(err);
+    return ret;
   } else {
     ink_assert(event == SSL_EVENT_CLIENT);
     if (this->ssl == NULL) {
       this->ssl = make_ssl_connection(ssl_NetProcessor.client_ctx, this);
     }
+    // Only server connections are moved to kernel TLS.
+    sslKTLSSend = false;
     ink_assert(event == SSL_EVENT_CLIENT);
     return (sslClientHandShakeEvent(err));
   }
 
 }
 
+//
+// Drive a server handshake from an ET_SSL_CRYPTO thread. Returns
+// SSL_HANDSHAKE_OFFLOADED while a step is running; the net thread is kicked
+// again when it finishes and picks up the result here.
+//
+int
+SSLNetVConnection::sslOffloadHandShake(int &err)
+{
+  if (sslHandshakeOffloadState == SSL_HANDSHAKE_OFFLOAD_RUNNING) {
+    return SSL_HANDSHAKE_OFFLOADED;
+  }
+
+  if (sslHandshakeOffloadState == SSL_HANDSHAKE_OFFLOAD_COMPLETE) {
+    sslHandshakeOffloadState = SSL_HANDSHAKE_OFFLOAD_IDLE;
+    if (sslHandshakeOffloadResult != SSL_HANDSHAKE_WANT_READ) {
+      err = sslHandshakeOffloadErrno;
+      return sslHandshakeOffloadResult;
+    }
+  }
+
+  // SSL_accept() is waiting on the client. Don't bother a crypto thread until
+  // there is something to read, the poll loop tells us when there is.
+  if (sslHandshakeOffloadResult == SSL_HANDSHAKE_WANT_READ && !ssl_socket_readable(get_socket())) {
+    return SSL_HANDSHAKE_WANT_READ;
+  }
+
+  SSLHandshakeOffload *job = sslHandshakeOffloadAllocator.alloc();
+
+  job->init(this);
+  sslHandshakeOffloadState = SSL_HANDSHAKE_OFFLOAD_RUNNING;
+  eventProcessor.schedule_imm(job, SSLNetProcessor::ET_SSL_CRYPTO);
+  return SSL_HANDSHAKE_OFFLOADED;
+}
+
+//
+// Called on the net thread, with the NetHandler locked, when an offloaded
+// handshake step finishes.
+//
+void
+SSLNetVConnection::sslOffloadHandShakeComplete(int ret, int err)
+{
+  sslHandshakeOffloadState = SSL_HANDSHAKE_OFFLOAD_COMPLETE;
+  sslHandshakeOffloadResult = ret;
+  sslHandshakeOffloadErrno = err;
+
+  if (closed) {
+    sslHandshakeOffloadState = SSL_HANDSHAKE_OFFLOAD_IDLE;
+    close_UnixNetVConnection(this, thread);
+    return;
+  }
+
+  // Edges that fired while the job ran were dropped, so retrigger both
+  // sides and let the NetHandler pick the result up.
+  read.triggered = 1;
+  if (read.enabled)
+    nh->read_ready_list.in_or_enqueue(this);
+  write.triggered = 1;
+  if (write.enabled)
+    nh->write_ready_list.in_or_enqueue(this);
+}
+
 int
 SSLNetVConnection::sslServerHandShakeEvent(int &err)
 {
@@ -643,3 +955,103 @@ SSLNetVConnection::advertise_next_protocol(SSL *ssl, const unsigned char **out,
 
   return SSL_TLSEXT_ERR_NOACK;
 }
+
+#if TS_HAS_TESTS
+#include "ts/TestBox.h"
+
+REGRESSION_TEST(SSLHandshakeTimeBuckets)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+
+  box = REGRESSION_TEST_PASSED;
+
+  box.check(ssl_handshake_time_bucket(0) == ssl_handshake_time_500us_stat, "0us is in the first bucket");
+  box.check(ssl_handshake_time_bucket(HRTIME_USECONDS(500)) == ssl_handshake_time_500us_stat, "bounds are inclusive");
+  box.check(ssl_handshake_time_bucket(HRTIME_USECONDS(501)) == ssl_handshake_time_1ms_stat, "501us is under 1ms");
+  box.check(ssl_handshake_time_bucket(HRTIME_MSECONDS(3)) == ssl_handshake_time_5ms_stat, "3ms is under 5ms");
+  box.check(ssl_handshake_time_bucket(HRTIME_MSECONDS(100)) == ssl_handshake_time_100ms_stat, "100ms is under 100ms");
+  box.check(ssl_handshake_time_bucket(HRTIME_SECONDS(2)) == ssl_handshake_time_over_stat, "2s is in the overflow bucket");
+}
+
+REGRESSION_TEST(SSLDynamicRecordSize)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+
+  box = REGRESSION_TEST_PASSED;
+
+  box.check(ssl_record_size(0, 1000, 0) == 0, "records are unlimited by default");
+  box.check(ssl_record_size(4096, 1000, 0) == 4096, "a fixed record size is used as is");
+  box.check(ssl_record_size(4096, 1000, 5000) == 4096, "a fixed record size does not grow");
+  box.check(ssl_record_size(-1, 1000, 0) == SSL_DEF_TLS_RECORD_SIZE, "dynamic records start small");
+  box.check(ssl_record_size(-1, 1000, 999) == SSL_DEF_TLS_RECORD_SIZE, "dynamic records stay small below the threshold");
+  box.check(ssl_record_size(-1, 1000, 1000) == SSL_MAX_TLS_RECORD_SIZE, "dynamic records grow at the threshold");
+}
+
+// Feed 1000 bytes held in 128 byte blocks through ssl_next_write and check
+// how they are cut into writes.
+static void
+ssl_check_writes(TestBox & box, int64_t record, const int64_t * expect, int nexpect)
+{
+  MIOBuffer *mbuf = new_MIOBuffer(BUFFER_SIZE_INDEX_128);
+  IOBufferReader *reader = mbuf->alloc_reader();
+  char src[1000];
+  char out[1000];
+  char coalesce[SSL_MAX_TLS_RECORD_SIZE];
+  int64_t total = 0;
+  int n = 0;
+
+  for (unsigned i = 0; i < sizeof(src); ++i) {
+    src[i] = (char) (i % 251);
+  }
+  mbuf->write(src, sizeof(src));
+
+  IOBufferBlock *b = reader->block;
+  int64_t offset = reader->start_offset;
+
+  for (;;) {
+    const char *data = NULL;
+    int64_t l = ssl_next_write(b, offset, sizeof(src) - total, record, 0, coalesce, data);
+
+    if (!l)
+      break;
+    if (n < nexpect) {
+      box.check(l == expect[n], "record size %d: write %d is %d bytes, expected %d", (int) record, n, (int) l,
+                (int) expect[n]);
+    }
+    memcpy(out + total, data, l);
+    total += l;
+    ++n;
+  }
+
+  box.check(n == nexpect, "record size %d: %d writes, expected %d", (int) record, n, nexpect);
+  box.check(total == (int64_t) sizeof(src) && memcmp(src, out, sizeof(src)) == 0, "record size %d: all data is written in order",
+            (int) record);
+  box.check(b == NULL, "record size %d: every block is used up", (int) record);
+
+  free_MIOBuffer(mbuf);
+}
+
+REGRESSION_TEST(SSLCoalesceWrites)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+
+  box = REGRESSION_TEST_PASSED;
+
+  // Unlimited records gather every block into one write.
+  const int64_t unlimited[] = { 1000 };
+  ssl_check_writes(box, 0, unlimited, countof(unlimited));
+
+  // Records spanning block boundaries are gathered from several blocks.
+  const int64_t fixed[] = { 300, 300, 300, 100 };
+  ssl_check_writes(box, 300, fixed, countof(fixed));
+
+  // Records that end exactly on a block boundary move on to the next block.
+  const int64_t aligned[] = { 128, 128, 128, 128, 128, 128, 128, 104 };
+  ssl_check_writes(box, 128, aligned, countof(aligned));
+
+  // Smaller records are cut out of a block in place.
+  const int64_t small[] = { 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 40 };
+  ssl_check_writes(box, 64, small, countof(small));
+}
+
+#endif // TS_HAS_TESTS
@@ -0,0 +1,479 @@
+/** @file
+
+  A sharded cache of SSL sessions, owned by Traffic Server rather than OpenSSL
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "ink_config.h"
+#include "P_Net.h"
+#include "P_SSLConfig.h"
+#include "I_Layout.h"
+#include "I_Tasks.h"
+#include "TextBuffer.h"
+#include "ts/TestBox.h"
+
+// OpenSSL's internal session cache sits behind a single lock per SSL_CTX and
+// is lost on restart. This cache is striped over a number of buckets, each
+// with its own lock and LRU list, and can be saved to a local file so that a
+// restarted Traffic Server can still resume its clients' sessions.
+
+SSLSessionCache * session_cache = NULL;
+
+// Header of the persistent cache file. Records follow, each one is the
+// session id length and bytes, the expiry time and the DER session length
+// and bytes. The file is in host byte order, it is only meant to survive a
+// restart on the same host.
+static const char ssl_session_file_magic[8] = { 'T', 'S', 'S', 'S', 'L', 'S', 'C', '1' };
+
+static inline void
+ssl_session_stat(int stat)
+{
+  EThread * ethread = this_ethread();
+
+  if (ethread) {
+    RecIncrRawStatSum(net_rsb, ethread, stat, 1);
+  }
+}
+
+SSLSessionBucket::SSLSessionBucket() : count(0)
+{
+  ink_mutex_init(&mutex, "SSLSessionBucket");
+}
+
+SSLSessionBucket::~SSLSessionBucket()
+{
+  while (SSLSession * s = queue.pop()) {
+    delete s;
+  }
+  ink_mutex_destroy(&mutex);
+}
+
+// Lock a bucket, counting the times another thread already had it.
+struct SSLSessionBucketLock
+{
+  explicit SSLSessionBucketLock(SSLSessionBucket * b) : bucket(b) {
+    if (!ink_mutex_try_acquire(&bucket->mutex)) {
+      ssl_session_stat(ssl_session_cache_lock_contention_stat);
+      ink_mutex_acquire(&bucket->mutex);
+    }
+  }
+
+  ~SSLSessionBucketLock() {
+    ink_mutex_release(&bucket->mutex);
+  }
+
+  SSLSessionBucket * bucket;
+};
+
+static SSLSession *
+ssl_session_find(SSLSessionBucket * b, const SSLSessionID& id)
+{
+  for (SSLSession * s = b->queue.head; s; s = s->link.next) {
+    if (s->id == id) {
+      return s;
+    }
+  }
+  return NULL;
+}
+
+SSLSessionCache::SSLSessionCache(size_t nb, size_t capacity)
+  : buckets(NULL), nbuckets(nb ? nb : 1), bucket_capacity(0)
+{
+  buckets = NEW(new SSLSessionBucket[nbuckets]);
+  bucket_capacity = capacity / nbuckets;
+  if (bucket_capacity == 0) {
+    bucket_capacity = 1;
+  }
+  Debug("ssl_session_cache", "%zu buckets of %zu sessions", nbuckets, bucket_capacity);
+}
+
+SSLSessionCache::~SSLSessionCache()
+{
+  delete [] buckets;
+}
+
+void
+SSLSessionCache::insert(SSLSessionBucket * b, SSLSession * s)
+{
+  SSLSessionBucketLock lock(b);
+  SSLSession * old = ssl_session_find(b, s->id);
+
+  if (old) {
+    b->queue.remove(old);
+    b->count--;
+    delete old;
+  }
+
+  while (b->count >= bucket_capacity) {
+    SSLSession * victim = b->queue.tail;
+
+    b->queue.remove(victim);
+    b->count--;
+    delete victim;
+    ssl_session_stat(ssl_session_cache_eviction_stat);
+  }
+
+  b->queue.push(s);
+  b->count++;
+}
+
+SSL_SESSION *
+SSLSessionCache::getSession(const SSLSessionID& id)
+{
+  SSLSessionBucket * b = bucket(id);
+  SSL_SESSION * sess = NULL;
+
+  {
+    SSLSessionBucketLock lock(b);
+    SSLSession * s = ssl_session_find(b, id);
+
+    if (s) {
+      const unsigned char * p = s->der;
+
+      if (s->expires > time(NULL) && (sess = d2i_SSL_SESSION(NULL, &p, s->der_len)) != NULL) {
+        b->queue.remove(s);
+        b->queue.push(s);
+      } else {
+        b->queue.remove(s);
+        b->count--;
+        delete s;
+      }
+    }
+  }
+
+  Debug("ssl_session_cache", "session lookup %s", sess ? "hit" : "miss");
+  ssl_session_stat(sess ? ssl_session_cache_hit_stat : ssl_session_cache_miss_stat);
+  return sess;
+}
+
+void
+SSLSessionCache::insertSession(const SSLSessionID& id, SSL_SESSION * sess)
+{
+  int len = i2d_SSL_SESSION(sess, NULL);
+
+  if (len <= 0) {
+    Debug("ssl_session_cache", "failed to encode session, not caching it");
+    return;
+  }
+
+  unsigned char * der = (unsigned char *)ats_malloc(len);
+  unsigned char * p = der;
+
+  i2d_SSL_SESSION(sess, &p);
+  insert(bucket(id), NEW(new SSLSession(id, SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess), der, len)));
+  ssl_session_stat(ssl_session_cache_new_session_stat);
+}
+
+void
+SSLSessionCache::removeSession(const SSLSessionID& id)
+{
+  SSLSessionBucket * b = bucket(id);
+  SSLSessionBucketLock lock(b);
+  SSLSession * s = ssl_session_find(b, id);
+
+  if (s) {
+    b->queue.remove(s);
+    b->count--;
+    delete s;
+  }
+}
+
+int
+SSLSessionCache::save(const char * path)
+{
+  textBuffer  buf(64 * 1024);
+  time_t      now = time(NULL);
+  int         count = 0;
+
+  buf.copyFrom(ssl_session_file_magic, sizeof(ssl_session_file_magic));
+
+  // Copy the sessions out bucket by bucket so that no lock is held across
+  // the disk write.
+  for (size_t i = 0; i < nbuckets; ++i) {
+    SSLSessionBucketLock lock(&buckets[i]);
+
+    for (SSLSession * s = buckets[i].queue.head; s; s = s->link.next) {
+      uint32_t  id_len = s->id.len;
+      int64_t   expires = s->expires;
+      uint32_t  der_len = s->der_len;
+
+      if (s->expires <= now) {
+        continue;
+      }
+
+      buf.copyFrom(&id_len, sizeof(id_len));
+      buf.copyFrom(s->id.bytes, id_len);
+      buf.copyFrom(&expires, sizeof(expires));
+      buf.copyFrom(&der_len, sizeof(der_len));
+      buf.copyFrom(s->der, der_len);
+      ++count;
+    }
+  }
+
+  // Sessions hold master secrets, so only the owner may read the file. Write
+  // it under a temporary name so that a crash never leaves half a file.
+  size_t    tmplen = strlen(path) + 5;
+  char *    tmppath = (char *)alloca(tmplen);
+  int       fd;
+
+  snprintf(tmppath, tmplen, "%s.tmp", path);
+  if ((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+    Warning("failed to save SSL sessions to %s: %s", tmppath, strerror(errno));
+    return -1;
+  }
+
+  bool ok = write(fd, buf.bufPtr(), buf.spaceUsed()) == buf.spaceUsed();
+
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmppath, path) != 0) {
+    Warning("failed to save SSL sessions to %s: %s", path, strerror(errno));
+    unlink(tmppath);
+    return -1;
+  }
+
+  Debug("ssl_session_cache", "saved %d sessions to %s", count, path);
+  return count;
+}
+
+int
+SSLSessionCache::load(const char * path)
+{
+  textBuffer  buf(64 * 1024);
+  int         fd;
+  int         count = 0;
+  time_t      now = time(NULL);
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    if (errno != ENOENT) {
+      Warning("failed to load SSL sessions from %s: %s", path, strerror(errno));
+    }
+    return -1;
+  }
+
+  while (buf.rawReadFromFile(fd) > 0)
+    ;
+  close(fd);
+
+  const char *  p = buf.bufPtr();
+  const char *  end = p + buf.spaceUsed();
+
+  if (end - p < (ptrdiff_t)sizeof(ssl_session_file_magic) ||
+      memcmp(p, ssl_session_file_magic, sizeof(ssl_session_file_magic)) != 0) {
+    Warning("ignoring SSL session file %s, it was not written by this version of Traffic Server", path);
+    return -1;
+  }
+  p += sizeof(ssl_session_file_magic);
+
+  while (p < end) {
+    uint32_t  id_len;
+    int64_t   expires;
+    uint32_t  der_len;
+
+    if (end - p < (ptrdiff_t)sizeof(id_len)) break;
+    memcpy(&id_len, p, sizeof(id_len));
+    p += sizeof(id_len);
+
+    if (id_len > SSL_MAX_SSL_SESSION_ID_LENGTH || end - p < (ptrdiff_t)(id_len + sizeof(expires) + sizeof(der_len))) break;
+    SSLSessionID id((const unsigned char *)p, id_len);
+    p += id_len;
+    memcpy(&expires, p, sizeof(expires));
+    p += sizeof(expires);
+    memcpy(&der_len, p, sizeof(der_len));
+    p += sizeof(der_len);
+
+    if (end - p < (ptrdiff_t)der_len) break;
+    if (expires > now) {
+      unsigned char * der = (unsigned char *)ats_malloc(der_len);
+
+      memcpy(der, p, der_len);
+      insert(bucket(id), NEW(new SSLSession(id, expires, der, der_len)));
+      ++count;
+    }
+    p += der_len;
+  }
+
+  if (p != end) {
+    Warning("SSL session file %s is truncated, loaded %d sessions", path, count);
+  }
+
+  Debug("ssl_session_cache", "loaded %d sessions from %s", count, path);
+  return count;
+}
+
+// Periodically saves the session cache for the next restart.
+struct SSLSessionCacheSaver : public Continuation
+{
+  xptr<char> path;
+
+  explicit SSLSessionCacheSaver(char * p) : Continuation(new_ProxyMutex()), path(p) {
+    SET_HANDLER(&SSLSessionCacheSaver::saveEvent);
+  }
+
+  int saveEvent(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */) {
+    session_cache->save(path);
+    return EVENT_CONT;
+  }
+};
+
+void
+SSLSessionCacheStartup(const SSLConfigParams * params)
+{
+  if (params->ssl_session_cache != SSLConfigParams::SSL_SESSION_CACHE_MODE_SERVER_ATS_IMPL) {
+    return;
+  }
+
+  session_cache = NEW(new SSLSessionCache(params->ssl_session_cache_num_buckets, params->ssl_session_cache_size));
+
+  if (params->ssl_session_cache_persist_file) {
+    char * path = Layout::relative_to(Layout::get()->runtimedir, params->ssl_session_cache_persist_file);
+    int loaded = session_cache->load(path);
+
+    if (loaded >= 0) {
+      Note("loaded %d SSL sessions from %s", loaded, path);
+    }
+
+    if (params->ssl_session_cache_persist_interval > 0) {
+      eventProcessor.schedule_every(NEW(new SSLSessionCacheSaver(path)),
+                                    HRTIME_SECONDS(params->ssl_session_cache_persist_interval), ET_TASK);
+    } else {
+      ats_free(path);
+    }
+  }
+}
+
+#if TS_HAS_TESTS
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+
+// A TLS 1.2 session with enough filled in to survive DER encoding.
+static SSL_SESSION *
+ssl_test_session(unsigned char tag, long timeout)
+{
+  SSL_CTX *       ctx = SSL_CTX_new(SSLv23_server_method());
+  SSL *           ssl = SSL_new(ctx);
+  SSL_SESSION *   sess = SSL_SESSION_new();
+  unsigned char   id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char   master[48];
+  const unsigned char cipher[2] = { 0xc0, 0x2f }; // ECDHE-RSA-AES128-GCM-SHA256
+
+  memset(id, tag, sizeof(id));
+  memset(master, tag, sizeof(master));
+  SSL_SESSION_set_protocol_version(sess, TLS1_2_VERSION);
+  SSL_SESSION_set_cipher(sess, SSL_CIPHER_find(ssl, cipher));
+  SSL_free(ssl);
+  SSL_CTX_free(ctx);
+  SSL_SESSION_set1_id(sess, id, sizeof(id));
+  SSL_SESSION_set1_master_key(sess, master, sizeof(master));
+  SSL_SESSION_set_time(sess, time(NULL));
+  SSL_SESSION_set_timeout(sess, timeout);
+  return sess;
+}
+
+static SSLSessionID
+ssl_test_session_id(SSL_SESSION * sess)
+{
+  unsigned int len;
+  const unsigned char * id = SSL_SESSION_get_id(sess, &len);
+
+  return SSLSessionID(id, len);
+}
+
+REGRESSION_TEST(SSLSessionCache_LRU)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  SSLSessionCache cache(1, 2);
+  SSL_SESSION * s[3];
+  SSL_SESSION * found;
+
+  box = REGRESSION_TEST_PASSED;
+
+  for (int i = 0; i < 3; ++i) {
+    s[i] = ssl_test_session('a' + i, 300);
+  }
+
+  cache.insertSession(ssl_test_session_id(s[0]), s[0]);
+  cache.insertSession(ssl_test_session_id(s[1]), s[1]);
+
+  // Touch the first session so that the second is the LRU victim.
+  found = cache.getSession(ssl_test_session_id(s[0]));
+  box.check(found != NULL, "inserted session is found");
+  if (found) {
+    unsigned char key[48];
+    size_t len = SSL_SESSION_get_master_key(found, key, sizeof(key));
+
+    box.check(len == sizeof(key) && key[0] == 'a', "cached session keeps its master key");
+    SSL_SESSION_free(found);
+  }
+
+  cache.insertSession(ssl_test_session_id(s[2]), s[2]);
+  found = cache.getSession(ssl_test_session_id(s[1]));
+  box.check(found == NULL, "least recently used session is evicted");
+  SSL_SESSION_free(found);
+
+  found = cache.getSession(ssl_test_session_id(s[0]));
+  box.check(found != NULL, "recently used session survives");
+  SSL_SESSION_free(found);
+
+  cache.removeSession(ssl_test_session_id(s[0]));
+  found = cache.getSession(ssl_test_session_id(s[0]));
+  box.check(found == NULL, "removed session is gone");
+  SSL_SESSION_free(found);
+
+  for (int i = 0; i < 3; ++i) {
+    SSL_SESSION_free(s[i]);
+  }
+}
+
+REGRESSION_TEST(SSLSessionCache_Persist)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  SSLSessionCache cache(4, 16);
+  SSLSessionCache restored(4, 16);
+  SSL_SESSION * live = ssl_test_session('x', 300);
+  SSL_SESSION * expired = ssl_test_session('y', 300);
+  SSL_SESSION * found;
+  char path[PATH_NAME_MAX];
+
+  box = REGRESSION_TEST_PASSED;
+
+  SSL_SESSION_set_time(expired, time(NULL) - 600);
+  cache.insertSession(ssl_test_session_id(live), live);
+  cache.insertSession(ssl_test_session_id(expired), expired);
+
+  snprintf(path, sizeof(path), "/tmp/ssl_session_cache_test.%d", (int)getpid());
+  box.check(cache.save(path) == 1, "expired sessions are not saved");
+  box.check(restored.load(path) == 1, "saved sessions are loaded");
+
+  found = restored.getSession(ssl_test_session_id(live));
+  box.check(found != NULL, "restored session is found");
+  SSL_SESSION_free(found);
+
+  found = restored.getSession(ssl_test_session_id(expired));
+  box.check(found == NULL, "expired session is not restored");
+  SSL_SESSION_free(found);
+
+  unlink(path);
+  SSL_SESSION_free(live);
+  SSL_SESSION_free(expired);
+}
+
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10101000L */
+
+#endif // TS_HAS_TESTS
@@ -30,10 +30,20 @@
 #include <openssl/x509.h>
 #include <openssl/asn1.h>
 
+#include <openssl/rand.h>
+
 #if HAVE_OPENSSL_TS_H
 #include <openssl/ts.h>
 #endif
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#define HAVE_SSL_TICKET_KEY_EVP_CB 1
+#elif defined(SSL_CTX_set_tlsext_ticket_key_cb)
+#include <openssl/hmac.h>
+#define HAVE_SSL_TICKET_KEY_CB 1
+#endif
+
 // ssl_multicert.config field names:
 #define SSL_IP_TAG            "dest_ip"
 #define SSL_CERT_TAG          "ssl_cert_name"
@@ -149,8 +159,11 @@ ssl_servername_callback(SSL * ssl, int * ad, void * arg)
     ctx = lookup->findInfoInHash(ip);
   }
 
+  // The connection takes a reference of its own, so drop the one the lookup
+  // gave us.
   if (ctx != NULL) {
     SSL_set_SSL_CTX(ssl, ctx);
+    SSL_CTX_free(ctx);
   }
 
   ctx = SSL_get_SSL_CTX(ssl);
@@ -185,6 +198,161 @@ ssl_context_enable_sni(SSL_CTX * ctx, SSLCertLookup * lookup)
   return ctx;
 }
 
+static int
+ssl_new_cached_session(SSL * /* ssl ATS_UNUSED */, SSL_SESSION * sess)
+{
+  unsigned int len;
+  const unsigned char * id = SSL_SESSION_get_id(sess, &len);
+
+  session_cache->insertSession(SSLSessionID(id, len), sess);
+
+  // We did not keep a reference to the session.
+  return 0;
+}
+
+static SSL_SESSION *
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+ssl_get_cached_session(SSL * /* ssl ATS_UNUSED */, const unsigned char * id, int len, int * copy)
+#else
+ssl_get_cached_session(SSL * /* ssl ATS_UNUSED */, unsigned char * id, int len, int * copy)
+#endif
+{
+  // The session we return is a new object, OpenSSL can have our reference.
+  *copy = 0;
+  if (len <= 0 || len > SSL_MAX_SSL_SESSION_ID_LENGTH) {
+    return NULL;
+  }
+  return session_cache->getSession(SSLSessionID(id, len));
+}
+
+static void
+ssl_rm_cached_session(SSL_CTX * /* ctx ATS_UNUSED */, SSL_SESSION * sess)
+{
+  unsigned int len;
+  const unsigned char * id = SSL_SESSION_get_id(sess, &len);
+
+  session_cache->removeSession(SSLSessionID(id, len));
+}
+
+#if HAVE_SSL_TICKET_KEY_EVP_CB
+typedef EVP_MAC_CTX ssl_ticket_hmac_ctx;
+
+static int
+ssl_ticket_hmac_init(EVP_MAC_CTX * hctx, const unsigned char * secret, size_t len)
+{
+  OSSL_PARAM params[] = {
+    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0),
+    OSSL_PARAM_construct_end()
+  };
+
+  return EVP_MAC_init(hctx, secret, len, params);
+}
+#elif HAVE_SSL_TICKET_KEY_CB
+typedef HMAC_CTX ssl_ticket_hmac_ctx;
+
+static int
+ssl_ticket_hmac_init(HMAC_CTX * hctx, const unsigned char * secret, size_t len)
+{
+  return HMAC_Init_ex(hctx, secret, len, EVP_sha256(), NULL);
+}
+#endif
+
+#if HAVE_SSL_TICKET_KEY_EVP_CB || HAVE_SSL_TICKET_KEY_CB
+// Encrypt new session tickets with the first key, and decrypt tickets with
+// whichever key they name. Tickets under an older key are renewed.
+static int
+ssl_callback_session_ticket(SSL * /* ssl ATS_UNUSED */, unsigned char * keyname, unsigned char * iv,
+                            EVP_CIPHER_CTX * cipher_ctx, ssl_ticket_hmac_ctx * hctx, int enc)
+{
+  SSLTicketKeyConfig::scoped_config keyblock;
+  ProxyMutex * mutex = this_ethread()->mutex;
+
+  if (!keyblock || keyblock->num_keys == 0) {
+    return 0;
+  }
+
+  if (enc == 1) {
+    const ssl_ticket_key_t * key = &keyblock->keys[0];
+
+    memcpy(keyname, key->key_name, sizeof(key->key_name));
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) != 1 ||
+        EVP_EncryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key->aes_key, iv) != 1 ||
+        ssl_ticket_hmac_init(hctx, key->hmac_secret, sizeof(key->hmac_secret)) != 1) {
+      return -1;
+    }
+    NET_INCREMENT_DYN_STAT(ssl_tickets_created_stat);
+    return 1;
+  }
+
+  for (unsigned i = 0; i < keyblock->num_keys; ++i) {
+    const ssl_ticket_key_t * key = &keyblock->keys[i];
+
+    if (memcmp(keyname, key->key_name, sizeof(key->key_name)) == 0) {
+      if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key->aes_key, iv) != 1 ||
+          ssl_ticket_hmac_init(hctx, key->hmac_secret, sizeof(key->hmac_secret)) != 1) {
+        return -1;
+      }
+
+      if (i == 0) {
+        NET_INCREMENT_DYN_STAT(ssl_tickets_verified_stat);
+        return 1;
+      }
+
+      NET_INCREMENT_DYN_STAT(ssl_tickets_renewed_stat);
+      return 2;
+    }
+  }
+
+  // No matching key, fall back to a full handshake.
+  NET_INCREMENT_DYN_STAT(ssl_tickets_not_found_stat);
+  return 0;
+}
+#endif
+
+// Session resumption settings. These have to be applied to the default
+// context too, OpenSSL resumes sessions through the context the SSL
+// connection was created with, not the one the SNI callback switches to.
+static SSL_CTX *
+ssl_context_enable_sessions(SSL_CTX * ctx, const SSLConfigParams * params)
+{
+  if (ctx == NULL) {
+    return ctx;
+  }
+
+  switch (params->ssl_session_cache) {
+  case SSLConfigParams::SSL_SESSION_CACHE_MODE_OFF:
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF|SSL_SESS_CACHE_NO_INTERNAL);
+    break;
+  case SSLConfigParams::SSL_SESSION_CACHE_MODE_SERVER:
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, params->ssl_session_cache_size);
+    break;
+  case SSLConfigParams::SSL_SESSION_CACHE_MODE_SERVER_ATS_IMPL:
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER|SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ctx, ssl_new_cached_session);
+    SSL_CTX_sess_set_get_cb(ctx, ssl_get_cached_session);
+    SSL_CTX_sess_set_remove_cb(ctx, ssl_rm_cached_session);
+    break;
+  }
+
+  if (params->ssl_session_cache_timeout > 0) {
+    SSL_CTX_set_timeout(ctx, params->ssl_session_cache_timeout);
+  }
+
+  if (SSLTicketKeyConfig::enabled()) {
+#if HAVE_SSL_TICKET_KEY_EVP_CB
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ssl_callback_session_ticket);
+#elif HAVE_SSL_TICKET_KEY_CB
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, ssl_callback_session_ticket);
+#else
+    Warning("this OpenSSL library does not support session ticket key callbacks, ignoring %s",
+            params->ticket_key_filename);
+#endif
+  }
+
+  return ctx;
+}
+
 void
 SSLInitializeLibrary()
 {
@@ -202,6 +370,8 @@ SSLInitializeLibrary()
 
     CRYPTO_set_locking_callback(SSL_locking_callback);
     CRYPTO_set_id_callback(SSL_pthreads_thread_id);
+
+    SSLStaplingInitialize();
   }
 
   open_ssl_initialized = true;
@@ -303,15 +473,7 @@ SSLInitServerContext(
   // disable selected protocols
   SSL_CTX_set_options(ctx, params->ssl_ctx_options);
 
-  switch (params->ssl_session_cache) {
-  case SSLConfigParams::SSL_SESSION_CACHE_MODE_OFF:
-    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF|SSL_SESS_CACHE_NO_INTERNAL);
-    break;
-  case SSLConfigParams::SSL_SESSION_CACHE_MODE_SERVER:
-    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
-    SSL_CTX_sess_set_cache_size(ctx, params->ssl_session_cache_size);
-    break;
-  }
+  ssl_context_enable_sessions(ctx, params);
 
   SSL_CTX_set_quiet_shutdown(ctx, 1);
 
@@ -363,16 +525,18 @@ SSLInitServerContext(
     goto fail;
   }
 
-  if (params->clientCertLevel != 0) {
-
-    if (params->serverCACertFilename != NULL && params->serverCACertPath != NULL) {
-      if ((!SSL_CTX_load_verify_locations(ctx, params->serverCACertFilename, params->serverCACertPath)) ||
-          (!SSL_CTX_set_default_verify_paths(ctx))) {
-        SSLError("CA Certificate file or CA Certificate path invalid");
-        goto fail;
-      }
+  // The CA certificates verify clients, and may hold the issuer of our
+  // certificate for OCSP stapling.
+  if ((params->clientCertLevel != 0 || params->ssl_ocsp_enabled) &&
+      params->serverCACertFilename != NULL && params->serverCACertPath != NULL) {
+    if ((!SSL_CTX_load_verify_locations(ctx, params->serverCACertFilename, params->serverCACertPath)) ||
+        (!SSL_CTX_set_default_verify_paths(ctx))) {
+      SSLError("CA Certificate file or CA Certificate path invalid");
+      goto fail;
     }
+  }
 
+  if (params->clientCertLevel != 0) {
     if (params->clientCertLevel == 2) {
       server_verify_client = SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT | SSL_VERIFY_CLIENT_ONCE;
     } else if (params->clientCertLevel == 1) {
@@ -401,6 +565,12 @@ SSLInitServerContext(
     }
   }
 
+  // The issuer of the certificate may only be in the CA certificates, so
+  // look for it once they are loaded.
+  if (params->ssl_ocsp_enabled) {
+    SSLStaplingInitCertificate(ctx, params);
+  }
+
   return ctx;
 
 fail:
@@ -489,17 +659,21 @@ asn1_strdup(ASN1_STRING * s)
     return ats_strndup((const char *)ASN1_STRING_data(s), ASN1_STRING_length(s));
 }
 
-// Given a certificate and it's corresponding SSL_CTX context, insert hash
-// table aliases for all of the subject and subjectAltNames. Note that we don't
-// deal with wildcards (yet).
+// Given a certificate and its corresponding context, index the context by
+// all of the subject and subjectAltNames of the certificate.
 static void
-ssl_index_certificate(SSLCertLookup * lookup, SSL_CTX * ctx, const char * certfile)
+ssl_index_certificate(SSLCertLookup * lookup, SSLCertContext * cc, const char * certfile)
 {
   X509_NAME * subject = NULL;
 
   ats_file_bio bio(certfile, "r");
   X509* cert = PEM_read_bio_X509_AUX(bio.bio, NULL, NULL, NULL);
 
+  if (cert == NULL) {
+    Error("failed to read certificate from %s", certfile);
+    return;
+  }
+
   // Insert a key for the subject CN.
   subject = X509_get_subject_name(cert);
   if (subject) {
@@ -515,7 +689,7 @@ ssl_index_certificate(SSLCertLookup * lookup, SSL_CTX * ctx, const char * certfi
       xptr<char> name(asn1_strdup(cn));
 
       Debug("ssl", "mapping '%s' to certificate %s", (const char *)name, certfile);
-      lookup->insert(ctx, name);
+      lookup->insert(cc, name);
     }
   }
 
@@ -531,7 +705,7 @@ ssl_index_certificate(SSLCertLookup * lookup, SSL_CTX * ctx, const char * certfi
       if (name->type == GEN_DNS) {
         xptr<char> dns(asn1_strdup(name->d.dNSName));
         Debug("ssl", "mapping '%s' to certificate %s", (const char *)dns, certfile);
-        lookup->insert(ctx, dns);
+        lookup->insert(cc, dns);
       }
     }
 
@@ -541,6 +715,47 @@ ssl_index_certificate(SSLCertLookup * lookup, SSL_CTX * ctx, const char * certfi
   X509_free(cert);
 }
 
+static SSL_CTX *
+ssl_new_server_context(
+    const SSLConfigParams * params,
+    SSLCertLookup *         lookup,
+    const char *            cert,
+    const char *            ca,
+    const char *            key)
+{
+  SSL_CTX * ctx = ssl_context_enable_sni(SSLInitServerContext(params, cert, ca, key), lookup);
+
+#if TS_USE_TLS_NPN
+  if (ctx) {
+    SSL_CTX_set_next_protos_advertised_cb(ctx, SSLNetVConnection::advertise_next_protocol, NULL);
+  }
+#endif /* TS_USE_TLS_NPN */
+
+  return ctx;
+}
+
+// Create the context of a certificate on the first handshake that asks for
+// it. This runs on a net thread.
+static SSL_CTX *
+ssl_load_lazy_context(SSLCertLookup * lookup, const char * cert, const char * ca, const char * key)
+{
+  SSLConfig::scoped_config params;
+  ProxyMutex * mutex = this_ethread()->mutex;
+  SSL_CTX * ctx = ssl_new_server_context(params, lookup, cert, ca, key);
+
+  if (ctx) {
+    NET_INCREMENT_DYN_STAT(ssl_lazy_context_load_stat);
+    // The stapling updater only gets to it on its next pass.
+    if (params->ssl_ocsp_enabled) {
+      SSLStaplingRefreshContext(ctx);
+    }
+  } else {
+    Error("failed to load SSL certificate %s", cert);
+  }
+
+  return ctx;
+}
+
 static bool
 ssl_store_ssl_context(
     const SSLConfigParams * params,
@@ -553,17 +768,20 @@ ssl_store_ssl_context(
   SSL_CTX *   ctx;
   xptr<char>  certpath;
 
-  ctx = ssl_context_enable_sni(SSLInitServerContext(params, cert, ca, key), lookup);
+  certpath = Layout::relative_to(params->serverCertPathOnly, cert);
+
+  // Certificates that are only picked by name can wait for their first
+  // handshake to be loaded. Only the names are read now.
+  if (params->ssl_context_cache_size > 0 && !addr) {
+    ssl_index_certificate(lookup, lookup->addLazyContext(cert, ca, key), certpath);
+    return true;
+  }
+
+  ctx = ssl_new_server_context(params, lookup, cert, ca, key);
   if (!ctx) {
     return false;
   }
 
-#if TS_USE_TLS_NPN
-  SSL_CTX_set_next_protos_advertised_cb(ctx, SSLNetVConnection::advertise_next_protocol, NULL);
-#endif /* TS_USE_TLS_NPN */
-
-  certpath = Layout::relative_to(params->serverCertPathOnly, cert);
-
   // Index this certificate by the specified IP(v6) address. If the address is "*", make it the default context.
   if (addr) {
     if (strcmp(addr, "*") == 0) {
@@ -581,10 +799,8 @@ ssl_store_ssl_context(
     }
   }
 
-  // Insert additional mappings. Note that this maps multiple keys to the same value, so when
-  // this code is updated to reconfigure the SSL certificates, it will need some sort of
-  // refcounting or alternate way of avoiding double frees.
-  ssl_index_certificate(lookup, ctx, certpath);
+  // Insert additional mappings for the names in the certificate.
+  ssl_index_certificate(lookup, lookup->addContext(ctx), certpath);
   return true;
 }
 
@@ -661,6 +877,10 @@ SSLParseCertificateConfiguration(
     return false;
   }
 
+  if (params->ssl_context_cache_size > 0) {
+    lookup->enableLazyLoading(ssl_load_lazy_context, params->ssl_context_cache_size);
+  }
+
   line = tokLine(file_buf, &tok_state);
   while (line != NULL) {
 
@@ -706,7 +926,7 @@ SSLParseCertificateConfiguration(
   // bootstrap the SSL handshake so that we can subsequently do the SNI lookup to switch to the real
   // context.
   if (lookup->ssl_default == NULL) {
-    lookup->ssl_default = ssl_context_enable_sni(SSLDefaultServerContext(), lookup);
+    lookup->ssl_default = ssl_context_enable_sni(ssl_context_enable_sessions(SSLDefaultServerContext(), params), lookup);
     lookup->insert(lookup->ssl_default, "*");
   }
 
@@ -95,6 +95,11 @@ net_activity(UnixNetVConnection *vc, EThread *thread)
 void
 close_UnixNetVConnection(UnixNetVConnection *vc, EThread *t)
 {
+  // A crypto thread is still using the socket for a handshake, it closes
+  // the connection when it hands it back.
+  if (vc->getSSLHandShakeOffloaded())
+    return;
+
   NetHandler *nh = vc->nh;
   vc->cancel_OOB();
   vc->ep.stop();
@@ -385,6 +390,9 @@ write_to_net_io(NetHandler *nh, UnixNetVConnection *vc, EThread *thread)
       vc->write.triggered = 0;
       nh->write_ready_list.remove(vc);
       write_reschedule(nh, vc);
+    } else if (ret == SSL_HANDSHAKE_OFFLOADED) {
+      vc->write.triggered = 0;
+      nh->write_ready_list.remove(vc);
     } else if (ret == EVENT_DONE) {
       vc->write.triggered = 1;
       if (vc->write.enabled)
@@ -24,6 +24,21 @@
 #include "P_SSLCertLookup.h"
 #include "ts/TestBox.h"
 #include <fstream>
+#include <vector>
+
+// Look a context up, and drop the reference the lookup takes since the
+// lookup holds one of its own.
+template <typename T>
+static SSL_CTX *
+find(const SSLCertLookup& lookup, const T& key)
+{
+  SSL_CTX * ctx = lookup.findInfoInHash(key);
+
+  if (ctx) {
+    SSL_CTX_free(ctx);
+  }
+  return ctx;
+}
 
 static IpEndpoint
 make_endpoint(const char * address)
@@ -64,18 +79,102 @@ REGRESSION_TEST(SSLCertificateLookup)(RegressionTest* t, int /* atype ATS_UNUSED
   lookup.insert(b_notwild, "*.b.notwild.com");
 
   // Basic wildcard cases.
-  box.check(lookup.findInfoInHash("a.wild.com") == wild, "wildcard lookup for a.wild.com");
-  box.check(lookup.findInfoInHash("b.wild.com") == wild, "wildcard lookup for b.wild.com");
-  box.check(lookup.findInfoInHash("wild.com") == wild, "wildcard lookup for wild.com");
+  box.check(find(lookup, "a.wild.com") == wild, "wildcard lookup for a.wild.com");
+  box.check(find(lookup, "b.wild.com") == wild, "wildcard lookup for b.wild.com");
+  box.check(find(lookup, "wild.com") == wild, "wildcard lookup for wild.com");
 
   // Verify that wildcard does longest match.
-  box.check(lookup.findInfoInHash("a.notwild.com") == notwild, "wildcard lookup for a.notwild.com");
-  box.check(lookup.findInfoInHash("notwild.com") == notwild, "wildcard lookup for notwild.com");
-  box.check(lookup.findInfoInHash("c.b.notwild.com") == b_notwild, "wildcard lookup for c.b.notwild.com");
+  box.check(find(lookup, "a.notwild.com") == notwild, "wildcard lookup for a.notwild.com");
+  box.check(find(lookup, "notwild.com") == notwild, "wildcard lookup for notwild.com");
+  box.check(find(lookup, "c.b.notwild.com") == b_notwild, "wildcard lookup for c.b.notwild.com");
+
+  // Wildcards match whole labels only.
+  box.check(find(lookup, "a.wildcat.com") == NULL, "wildcard lookup for a.wildcat.com");
+  box.check(find(lookup, "com") == NULL, "wildcard lookup for com");
 
   // Basic hostname cases.
-  box.check(lookup.findInfoInHash("www.foo.com") == foo, "host lookup for www.foo.com");
-  box.check(lookup.findInfoInHash("www.bar.com") == NULL, "host lookup for www.bar.com");
+  box.check(find(lookup, "www.foo.com") == foo, "host lookup for www.foo.com");
+  box.check(find(lookup, "www.bar.com") == NULL, "host lookup for www.bar.com");
+  box.check(find(lookup, "WWW.Foo.com") == foo, "host lookup for WWW.Foo.com");
+  box.check(find(lookup, "www.foo.com.") == foo, "host lookup for www.foo.com.");
+  box.check(find(lookup, "foo.com") == NULL, "host lookup for foo.com");
+
+  // Every context is owned once, however many names it has.
+  box.check(lookup.count() == 4, "4 distinct contexts");
+}
+
+static unsigned lazy_loads = 0;
+
+static SSL_CTX *
+load_lazy_context(SSLCertLookup * /* lookup ATS_UNUSED */, const char * cert, const char * /* ca ATS_UNUSED */,
+                  const char * /* key ATS_UNUSED */)
+{
+  ++lazy_loads;
+  return strcmp(cert, "bad.pem") == 0 ? NULL : SSL_CTX_new(SSLv23_server_method());
+}
+
+// Count the contexts that are loaded, and drop the references to them.
+static unsigned
+count_contexts(const SSLCertLookup& lookup)
+{
+  Vec<SSL_CTX *> contexts;
+
+  lookup.getContexts(contexts);
+  for (unsigned i = 0; i < contexts.count(); ++i) {
+    SSL_CTX_free(contexts[i]);
+  }
+  return contexts.count();
+}
+
+REGRESSION_TEST(SSLLazyContextLookup)(RegressionTest* t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox       box(t, pstatus);
+  SSLCertLookup lookup;
+  SSLCertContext * cc;
+  SSL_CTX * a;
+  SSL_CTX * b;
+  SSL_CTX * a2;
+  SSL * ssl;
+
+  box = REGRESSION_TEST_PASSED;
+
+  lookup.enableLazyLoading(load_lazy_context, 1);
+
+  cc = lookup.addLazyContext("a.pem", NULL, NULL);
+  box.check(lookup.insert(cc, "a.example.com"), "insert lazy host context");
+  box.check(lookup.insert(cc, "*.a.example.com"), "insert lazy wildcard context");
+  box.check(lookup.insert(lookup.addLazyContext("b.pem", NULL, NULL), "b.example.com"), "insert lazy host context");
+  box.check(lookup.insert(lookup.addLazyContext("bad.pem", NULL, NULL), "bad.example.com"), "insert lazy host context");
+
+  box.check(lazy_loads == 0, "contexts are not loaded before they are looked up");
+  box.check(lookup.count() == 0 && count_contexts(lookup) == 0, "lazy contexts are not iterated before they are loaded");
+
+  // Hold on to a, as a connection would until it has been handed its context.
+  a = lookup.findInfoInHash("a.example.com");
+  box.check(a != NULL && lazy_loads == 1, "context is loaded by its first lookup");
+  box.check(find(lookup, "www.a.example.com") == a && lazy_loads == 1, "context is shared by its names");
+  box.check(count_contexts(lookup) == 1, "loaded lazy contexts are iterated");
+
+  // Loading b takes the cache over capacity, so a is evicted right away.
+  b = lookup.findInfoInHash("b.example.com");
+  box.check(b != NULL && b != a && lazy_loads == 2, "second context is loaded");
+  box.check(count_contexts(lookup) == 1, "least recently used context is evicted");
+
+  // Our reference keeps the evicted context good.
+  ssl = SSL_new(a);
+  box.check(ssl != NULL, "evicted context can still be used while it is referenced");
+  SSL_free(ssl);
+
+  a2 = lookup.findInfoInHash("a.example.com");
+  box.check(a2 != NULL && a2 != a && lazy_loads == 3, "evicted context is loaded again");
+  box.check(find(lookup, "b.example.com") != NULL && lazy_loads == 4, "b was evicted in turn");
+
+  box.check(find(lookup, "bad.example.com") == NULL, "context that fails to load is not found");
+  box.check(find(lookup, "bad.example.com") == NULL && lazy_loads == 5, "failed context is not loaded again");
+
+  SSL_CTX_free(a);
+  SSL_CTX_free(b);
+  SSL_CTX_free(a2);
 }
 
 REGRESSION_TEST(SSLAddressLookup)(RegressionTest* t, int /* atype ATS_UNUSED */, int * pstatus)
@@ -113,34 +212,28 @@ REGRESSION_TEST(SSLAddressLookup)(RegressionTest* t, int /* atype ATS_UNUSED */,
   // the most specific match (ie. find the context with the port if it is available) ...
 
   box.check(lookup.insert(context.ip6, endpoint.ip6), "insert IPv6 address");
-  box.check(lookup.findInfoInHash(endpoint.ip6) == context.ip6, "IPv6 exact match lookup");
-  box.check(lookup.findInfoInHash(endpoint.ip6p) == context.ip6, "IPv6 exact match lookup w/ port");
+  box.check(find(lookup, endpoint.ip6) == context.ip6, "IPv6 exact match lookup");
+  box.check(find(lookup, endpoint.ip6p) == context.ip6, "IPv6 exact match lookup w/ port");
 
   box.check(lookup.insert(context.ip6p, endpoint.ip6p), "insert IPv6 address w/ port");
-  box.check(lookup.findInfoInHash(endpoint.ip6) == context.ip6, "IPv6 longest match lookup");
-  box.check(lookup.findInfoInHash(endpoint.ip6p) == context.ip6p, "IPv6 longest match lookup w/ port");
+  box.check(find(lookup, endpoint.ip6) == context.ip6, "IPv6 longest match lookup");
+  box.check(find(lookup, endpoint.ip6p) == context.ip6p, "IPv6 longest match lookup w/ port");
 
   box.check(lookup.insert(context.ip4, endpoint.ip4), "insert IPv4 address");
-  box.check(lookup.findInfoInHash(endpoint.ip4) == context.ip4, "IPv4 exact match lookup");
-  box.check(lookup.findInfoInHash(endpoint.ip4p) == context.ip4, "IPv4 exact match lookup w/ port");
+  box.check(find(lookup, endpoint.ip4) == context.ip4, "IPv4 exact match lookup");
+  box.check(find(lookup, endpoint.ip4p) == context.ip4, "IPv4 exact match lookup w/ port");
 
   box.check(lookup.insert(context.ip4p, endpoint.ip4p), "insert IPv4 address w/ port");
-  box.check(lookup.findInfoInHash(endpoint.ip4) == context.ip4, "IPv4 longest match lookup");
-  box.check(lookup.findInfoInHash(endpoint.ip4p) == context.ip4p, "IPv4 longest match lookup w/ port");
+  box.check(find(lookup, endpoint.ip4) == context.ip4, "IPv4 longest match lookup");
+  box.check(find(lookup, endpoint.ip4p) == context.ip4p, "IPv4 longest match lookup w/ port");
 }
 
 static unsigned
-load_hostnames_csv(const char * fname, SSLCertLookup& lookup)
+load_hostnames_csv(const char * fname, std::vector<std::string>& names)
 {
   std::fstream infile(fname, std::ios_base::in);
   unsigned count = 0;
 
-  // SSLCertLookup correctly handles indexing the same certificate
-  // with multiple names, an it's way faster to load a lot of names
-  // if we don't need a new context every time.
-
-  SSL_CTX * ctx = SSL_CTX_new(SSLv23_server_method());
-
   // The input should have 2 comma-separated fields; this is the format that you get when
   // you download the top 1M sites from alexa.
   //
@@ -162,11 +255,10 @@ load_hostnames_csv(const char * fname, SSLCertLookup& lookup)
 
     pos = line.find_first_of(',');
     if (pos != std::string::npos) {
-      std::string host(line.substr(pos + 1));
-      lookup.insert(ctx, host.c_str());
+      names.push_back(line.substr(pos + 1));
     } else {
       // No comma? Assume the whole line is the hostname
-      lookup.insert(ctx, line.c_str());
+      names.push_back(line);
     }
 
     ++count;
@@ -175,6 +267,68 @@ load_hostnames_csv(const char * fname, SSLCertLookup& lookup)
   return count;
 }
 
+// Make up count names, one in ten of them a wildcard.
+static void
+make_hostnames(unsigned count, std::vector<std::string>& names)
+{
+  char name[TS_MAX_HOST_NAME_LEN + 1];
+
+  for (unsigned i = 0; i < count; ++i) {
+    if (i % 10 == 0) {
+      snprintf(name, sizeof(name), "*.wild%u.example%u.com", i, i % 100);
+    } else {
+      snprintf(name, sizeof(name), "www.host%u.example%u.com", i, i % 100);
+    }
+    names.push_back(name);
+  }
+}
+
+static double
+elapsed(ink_hrtime start)
+{
+  return (double)(ink_get_hrtime_internal() - start) / HRTIME_SECOND;
+}
+
+// Time indexing the names, then looking each of them up again.
+static void
+benchmark_hostnames(const std::vector<std::string>& names)
+{
+  SSLCertLookup lookup;
+  ink_hrtime start;
+  unsigned found = 0;
+  double secs;
+
+  // SSLCertLookup correctly handles indexing the same certificate
+  // with multiple names, an it's way faster to load a lot of names
+  // if we don't need a new context every time.
+  SSL_CTX * ctx = SSL_CTX_new(SSLv23_server_method());
+
+  start = ink_get_hrtime_internal();
+  for (unsigned i = 0; i < names.size(); ++i) {
+    lookup.insert(ctx, names[i].c_str());
+  }
+  secs = elapsed(start);
+  printf("indexed %u host names in %.3f sec, %.0f names/sec\n", (unsigned)names.size(), secs, names.size() / secs);
+
+  start = ink_get_hrtime_internal();
+  for (unsigned i = 0; i < names.size(); ++i) {
+    const char * name = names[i].c_str();
+
+    // Look wildcards up by a name they match.
+    if (name[0] == '*') {
+      char host[TS_MAX_HOST_NAME_LEN + 1];
+
+      snprintf(host, sizeof(host), "www%s", name + 1);
+      found += find(lookup, host) == ctx;
+    } else {
+      found += find(lookup, name) == ctx;
+    }
+  }
+  secs = elapsed(start);
+  printf("looked up %u host names (%u found) in %.3f sec, %.0f lookups/sec\n", (unsigned)names.size(), found, secs,
+         names.size() / secs);
+}
+
 int main(int argc, const char ** argv)
 {
   res_track_memory = 1;
@@ -182,15 +336,23 @@ int main(int argc, const char ** argv)
   SSL_library_init();
   ink_freelists_snap_baseline();
 
-  if (argc > 1) {
-    SSLCertLookup lookup;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    // Benchmark with made up names, eg. "test_certlookup -n 100000".
+    std::vector<std::string> names;
+
+    make_hostnames(atoi(argv[2]), names);
+    benchmark_hostnames(names);
+
+  } else if (argc > 1) {
+    std::vector<std::string> names;
     unsigned count = 0;
 
     for (int i = 1; i < argc; ++i) {
-      count += load_hostnames_csv(argv[i], lookup);
+      count += load_hostnames_csv(argv[i], names);
     }
 
     printf("loaded %u host names\n", count);
+    benchmark_hostnames(names);
 
   } else {
     // Standard regression tests.
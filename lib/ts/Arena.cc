@@ -29,8 +29,14 @@
 #define DEFAULT_ALLOC_SIZE   1024
 #define DEFAULT_BLOCK_SIZE   (DEFAULT_ALLOC_SIZE - (sizeof (ArenaBlock) - 8))
 
+// Large blocks hold several header heaps at once, which is what
+// per-transaction arenas (HttpTransact::State) mostly allocate.
+#define LARGE_ALLOC_SIZE     8192
+#define LARGE_BLOCK_SIZE     (LARGE_ALLOC_SIZE - (sizeof (ArenaBlock) - 8))
+
 
 static Allocator defaultSizeArenaBlock("ArenaBlock", DEFAULT_ALLOC_SIZE);
+static Allocator largeSizeArenaBlock("ArenaBlockLarge", LARGE_ALLOC_SIZE);
 
 
 /*-------------------------------------------------------------------------
@@ -43,6 +49,8 @@ blk_alloc(int size)
 
   if (size == DEFAULT_BLOCK_SIZE) {
     blk = (ArenaBlock *) defaultSizeArenaBlock.alloc_void();
+  } else if (size == LARGE_BLOCK_SIZE) {
+    blk = (ArenaBlock *) largeSizeArenaBlock.alloc_void();
   } else {
     blk = (ArenaBlock *)ats_malloc(size + sizeof(ArenaBlock) - 8);
   }
@@ -65,6 +73,8 @@ blk_free(ArenaBlock * blk)
   size = blk->m_heap_end - &blk->data[0];
   if (size == DEFAULT_BLOCK_SIZE) {
     defaultSizeArenaBlock.free_void(blk);
+  } else if (size == LARGE_BLOCK_SIZE) {
+    largeSizeArenaBlock.free_void(blk);
   } else {
     ats_free(blk);
   }
@@ -101,6 +111,9 @@ Arena::alloc(size_t size, size_t alignment)
 
   ink_assert((alignment & (alignment - 1)) == 0);
 
+  m_alloc_count += 1;
+  m_alloc_bytes += size;
+
   b = m_blocks;
   while (b) {
     mem = block_alloc(b, size, alignment);
@@ -113,6 +126,8 @@ Arena::alloc(size_t size, size_t alignment)
   block_size = (unsigned int) (size * 1.5);
   if (block_size < DEFAULT_BLOCK_SIZE) {
     block_size = DEFAULT_BLOCK_SIZE;
+  } else if (block_size < LARGE_BLOCK_SIZE) {
+    block_size = LARGE_BLOCK_SIZE;
   }
 
   b = blk_alloc(block_size);
@@ -157,4 +172,22 @@ Arena::reset()
     m_blocks = b;
   }
   ink_assert(m_blocks == NULL);
+
+  m_alloc_count = 0;
+  m_alloc_bytes = 0;
+}
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+size_t
+Arena::bytes_reserved() const
+{
+  size_t total = 0;
+
+  for (ArenaBlock *b = m_blocks; b; b = b->next) {
+    total += b->m_heap_end - &b->data[0];
+  }
+
+  return total;
 }
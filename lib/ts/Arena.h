@@ -42,7 +42,7 @@ struct ArenaBlock
 class Arena
 {
 public:
-  Arena():m_blocks(NULL)
+  Arena():m_blocks(NULL), m_alloc_count(0), m_alloc_bytes(0)
   {
   }
    ~Arena()
@@ -59,8 +59,17 @@ public:
 
   inkcoreapi void reset();
 
+  /// Number of allocations served since the last reset().
+  size_t allocation_count() const { return m_alloc_count; }
+  /// Bytes handed out (before alignment padding) since the last reset().
+  size_t bytes_allocated() const { return m_alloc_bytes; }
+  /// Bytes currently held in blocks, used or not.
+  inkcoreapi size_t bytes_reserved() const;
+
 private:
   ArenaBlock * m_blocks;
+  size_t m_alloc_count;
+  size_t m_alloc_bytes;
 };
 
 
@@ -111,12 +111,46 @@ test_block_boundries()
   return failures;
 }
 
+int
+test_usage_counters()
+{
+  int failures = 0;
+  Arena a;
+
+  for (int i = 0; i < 16; i++) {
+    a.alloc(2048);
+  }
+  a.str_store("counted", 7);
+
+  if (a.allocation_count() != 17) {
+    fprintf(stderr, "usage_counters test failed.  %d allocations\n", (int) a.allocation_count());
+    failures++;
+  }
+  if (a.bytes_allocated() < 16 * 2048 + 7) {
+    fprintf(stderr, "usage_counters test failed.  %d bytes allocated\n", (int) a.bytes_allocated());
+    failures++;
+  }
+  if (a.bytes_reserved() < a.bytes_allocated()) {
+    fprintf(stderr, "usage_counters test failed.  %d bytes reserved\n", (int) a.bytes_reserved());
+    failures++;
+  }
+
+  a.reset();
+  if (a.allocation_count() != 0 || a.bytes_allocated() != 0 || a.bytes_reserved() != 0) {
+    fprintf(stderr, "usage_counters test failed.  counters not cleared by reset\n");
+    failures++;
+  }
+
+  return failures;
+}
+
 int
 main()
 {
   int failures = 0;
 
   failures += test_block_boundries();
+  failures += test_usage_counters();
 
   if (failures) {
     return 1;
@@ -58,7 +58,9 @@ static const char *ParentResultStr[] = {
 static const char *ParentRRStr[] = {
   "false",
   "strict",
-  "true"
+  "true",
+  "consistent_hash",
+  "least_latency"
 };
 
 //
@@ -92,6 +94,296 @@ ParentConfigParams::~ParentConfigParams()
   }
 }
 
+//
+//   Active parent health checks
+//
+//   There is one ParentHealth per distinct parent host:port, kept for
+//   the life of the process on parent_health_list.  Each reconfiguration
+//   stamps the entries it uses with a new generation, and only entries
+//   of the current generation are probed.
+//
+static ParentHealth *parent_health_list = NULL;
+static ink_mutex parent_health_mutex;
+static int32_t parent_health_generation = 0;
+static int parent_health_enabled = 0;
+static int parent_health_interval = 10;
+static int parent_health_timeout = 5;
+static int parent_health_fail_threshold = 3;
+static char *parent_health_url = NULL;
+
+static void
+parent_health_set_stat(ParentHealth * h, const char *stat, int64_t value, bool create)
+{
+  char name[MAXDNAME + 128];
+
+  snprintf(name, sizeof(name), "proxy.process.http.parent_proxy.%s:%d.%s", h->hostname, h->port, stat);
+  if (create) {
+    RecRegisterStatInt(RECT_PROCESS, name, value, RECP_NON_PERSISTENT);
+  } else {
+    RecSetRecordInt(name, value);
+  }
+}
+
+void
+ParentHealth::record_probe(bool success, int32_t usecs)
+{
+  if (success) {
+    latency_us = latency_us ? (latency_us * 7 + usecs) / 8 : usecs;
+    error_rate = error_rate * 7 / 8;
+    fail_streak = 0;
+    if (down) {
+      Note("parent %s:%d passed its health check, marking it up", hostname, port);
+      down = 0;
+    }
+  } else {
+    error_rate = (error_rate * 7 + 1000) / 8;
+    if (++fail_streak >= parent_health_fail_threshold && !down) {
+      Warning("parent %s:%d failed %d health checks in a row, marking it down", hostname, port, fail_streak);
+      down = 1;
+    }
+  }
+  probes++;
+  Debug("parent_health", "%s:%d %s in %d us, latency %d us, error rate %d/1000", hostname, port,
+        success ? "passed" : "failed", usecs, latency_us, error_rate);
+
+  if (parent_health_enabled) {
+    parent_health_set_stat(this, "up", !down, false);
+    parent_health_set_stat(this, "latency_us", latency_us, false);
+    parent_health_set_stat(this, "error_rate", error_rate, false);
+  }
+}
+
+static ParentHealth *
+parent_health_get(const char *hostname, int port)
+{
+  ParentHealth *h;
+
+  ink_mutex_acquire(&parent_health_mutex);
+  for (h = parent_health_list; h != NULL; h = h->next) {
+    if (h->port == port && strcasecmp(h->hostname, hostname) == 0) {
+      break;
+    }
+  }
+  if (h == NULL) {
+    h = (ParentHealth *)ats_malloc(sizeof(ParentHealth));
+    memset(h, 0, sizeof(ParentHealth));
+    ink_strlcpy(h->hostname, hostname, sizeof(h->hostname));
+    h->port = port;
+    parent_health_set_stat(h, "up", 1, true);
+    parent_health_set_stat(h, "latency_us", 0, true);
+    parent_health_set_stat(h, "error_rate", 0, true);
+    h->next = parent_health_list;
+    parent_health_list = h;
+  }
+  h->generation = parent_health_generation;
+  ink_mutex_release(&parent_health_mutex);
+
+  return h;
+}
+
+static void
+attach_parent_health(ParentRecord * rec_arr, int len)
+{
+  for (int j = 0; j < len; j++) {
+    pRecord *pr = rec_arr[j].parents;
+
+    for (int i = 0; i < rec_arr[j].num_parents; i++) {
+      pr[i].health = parent_health_get(pr[i].hostname, pr[i].port);
+    }
+  }
+}
+
+// struct ParentHealthProbe
+//
+//   Sends one health check request to a parent and records the
+//     time to the response status line, or the failure
+//
+struct ParentHealthProbe:public Continuation
+{
+  ParentHealthProbe(ParentHealth * h)
+    : Continuation(new_ProxyMutex()), health(h), pending_action(NULL), timeout(NULL), vc(NULL), read_buf(NULL),
+      write_buf(NULL), reader(NULL), start_time(0)
+  {
+    SET_HANDLER(&ParentHealthProbe::main_event);
+  }
+
+  int main_event(int event, void *data);
+  void connect(sockaddr const *addr);
+  int check_status(bool eos);
+  int finish(bool success);
+
+  ParentHealth *health;
+  Action *pending_action;
+  Event *timeout;
+  NetVConnection *vc;
+  MIOBuffer *read_buf;
+  MIOBuffer *write_buf;
+  IOBufferReader *reader;
+  ink_hrtime start_time;
+};
+
+void
+ParentHealthProbe::connect(sockaddr const *addr)
+{
+  IpEndpoint target;
+
+  ats_ip_copy(&target, addr);
+  target.port() = htons(health->port);
+  // Do not touch this after connect_re(), a failure may have freed it
+  Action *action = netProcessor.connect_re(this, &target.sa);
+  if (action != ACTION_RESULT_DONE) {
+    pending_action = action;
+  }
+}
+
+// Succeeds on any status line below 500, fails on a 5xx or a reply
+//   that is not HTTP.  Returns EVENT_CONT while more data is needed.
+int
+ParentHealthProbe::check_status(bool eos)
+{
+  char buf[16];
+  int64_t avail = reader->read_avail();
+
+  if (avail < 12) {
+    return eos ? finish(false) : EVENT_CONT;
+  }
+  reader->memcpy(buf, 12);
+  buf[12] = '\0';
+  if (strncmp(buf, "HTTP/", 5) != 0 || buf[8] != ' ') {
+    return finish(false);
+  }
+  return finish(atoi(buf + 9) < 500);
+}
+
+int
+ParentHealthProbe::finish(bool success)
+{
+  if (pending_action) {
+    pending_action->cancel();
+  }
+  if (timeout) {
+    timeout->cancel();
+  }
+  if (vc) {
+    vc->do_io_close();
+  }
+  if (read_buf) {
+    free_MIOBuffer(read_buf);
+  }
+  if (write_buf) {
+    free_MIOBuffer(write_buf);
+  }
+  health->record_probe(success, (int32_t) ((ink_get_hrtime_internal() - start_time) / HRTIME_USECOND));
+  health->probing = 0;
+
+  mutex.clear();
+  delete this;
+  return EVENT_DONE;
+}
+
+int
+ParentHealthProbe::main_event(int event, void *data)
+{
+  switch (event) {
+  case EVENT_IMMEDIATE:
+    {
+      IpEndpoint ip;
+
+      timeout = this_ethread()->schedule_in(this, HRTIME_SECONDS(parent_health_timeout));
+      start_time = ink_get_hrtime_internal();
+      if (0 == ats_ip_pton(health->hostname, &ip)) {
+        connect(&ip.sa);
+      } else {
+        Action *action = hostDBProcessor.getbyname_re(this, health->hostname, 0);
+        if (action != ACTION_RESULT_DONE) {
+          pending_action = action;
+        }
+      }
+      return EVENT_DONE;
+    }
+
+  case EVENT_HOST_DB_LOOKUP:
+    pending_action = NULL;
+    if (data == NULL) {
+      return finish(false);
+    }
+    connect(((HostDBInfo *) data)->ip());
+    return EVENT_DONE;
+
+  case NET_EVENT_OPEN:
+    {
+      char req[1024];
+      int len;
+
+      pending_action = NULL;
+      vc = (NetVConnection *) data;
+      len = snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\nHost: %s:%d\r\nUser-Agent: Traffic Server parent health check\r\n\r\n",
+                     parent_health_url, health->hostname, health->port);
+      write_buf = new_MIOBuffer();
+      write_buf->write(req, len);
+      read_buf = new_MIOBuffer();
+      reader = read_buf->alloc_reader();
+      vc->do_io_write(this, len, write_buf->alloc_reader());
+      vc->do_io_read(this, INT64_MAX, read_buf);
+      return EVENT_DONE;
+    }
+
+  case NET_EVENT_OPEN_FAILED:
+    pending_action = NULL;
+    return finish(false);
+
+  case VC_EVENT_WRITE_READY:
+    ((VIO *) data)->reenable();
+    return EVENT_CONT;
+
+  case VC_EVENT_WRITE_COMPLETE:
+    return EVENT_CONT;
+
+  case VC_EVENT_READ_READY:
+    if (check_status(false) == EVENT_CONT) {
+      ((VIO *) data)->reenable();
+    }
+    return EVENT_CONT;
+
+  case VC_EVENT_READ_COMPLETE:
+  case VC_EVENT_EOS:
+    return check_status(true);
+
+  case EVENT_INTERVAL:
+    timeout = NULL;
+    return finish(false);
+
+  default:
+    // VC_EVENT_ERROR and the inactivity / active timeouts
+    return finish(false);
+  }
+}
+
+// struct ParentHealthChecker
+//
+//   Starts a probe of every parent in the current configuration
+//     once per interval, unless its last probe is still running
+//
+struct ParentHealthChecker:public Continuation
+{
+  ParentHealthChecker():Continuation(new_ProxyMutex())
+  {
+    SET_HANDLER(&ParentHealthChecker::check_event);
+  }
+
+  int check_event(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+  {
+    ink_mutex_acquire(&parent_health_mutex);
+    for (ParentHealth *h = parent_health_list; h != NULL; h = h->next) {
+      if (h->generation == parent_health_generation && ink_atomic_cas(&h->probing, 0, 1)) {
+        eventProcessor.schedule_imm(NEW(new ParentHealthProbe(h)), ET_NET);
+      }
+    }
+    ink_mutex_release(&parent_health_mutex);
+    return EVENT_CONT;
+  }
+};
+
 int ParentConfig::m_id = 0;
 
 //
@@ -102,6 +394,20 @@ ParentConfig::startup()
 {
   parentConfigUpdate = NEW(new ConfigUpdateHandler<ParentConfig>());
 
+  // Active health checks, before the first load attaches parents to them
+  PARENT_ReadConfigInteger(parent_health_enabled, "proxy.config.http.parent_proxy.health_check.enabled");
+  if (parent_health_enabled) {
+    PARENT_ReadConfigInteger(parent_health_interval, "proxy.config.http.parent_proxy.health_check.interval");
+    PARENT_ReadConfigInteger(parent_health_timeout, "proxy.config.http.parent_proxy.health_check.timeout");
+    PARENT_ReadConfigInteger(parent_health_fail_threshold, "proxy.config.http.parent_proxy.health_check.fail_threshold");
+    PARENT_ReadConfigStringAlloc(parent_health_url, "proxy.config.http.parent_proxy.health_check.url");
+    if (parent_health_url == NULL) {
+      parent_health_url = ats_strdup("/");
+    }
+    ink_mutex_init(&parent_health_mutex, "ParentHealth");
+    eventProcessor.schedule_every(NEW(new ParentHealthChecker), HRTIME_SECONDS(parent_health_interval), ET_CALL);
+  }
+
   // Load the initial configuration
   reconfigure();
 
@@ -158,6 +464,25 @@ ParentConfig::reconfigure()
   PARENT_ReadConfigInteger(dns_parent_only, dns_parent_only_var);
   params->DNS_ParentOnly = dns_parent_only;
 
+  // Hook every parent up to its health check state
+  if (parent_health_enabled) {
+    P_table *table = params->ParentTable;
+
+    ink_atomic_increment(&parent_health_generation, 1);
+    if (params->DefaultParent)
+      attach_parent_health(params->DefaultParent, 1);
+    if (table->hostMatch)
+      attach_parent_health(table->hostMatch->getDataArray(), table->hostMatch->getNumElements());
+    if (table->reMatch)
+      attach_parent_health(table->reMatch->getDataArray(), table->reMatch->getNumElements());
+    if (table->urlMatch)
+      attach_parent_health(table->urlMatch->getDataArray(), table->urlMatch->getNumElements());
+    if (table->ipMatch)
+      attach_parent_health(table->ipMatch->getDataArray(), table->ipMatch->getNumElements());
+    if (table->hrMatch)
+      attach_parent_health(table->hrMatch->getDataArray(), table->hrMatch->getNumElements());
+  }
+
   m_id = configProcessor.set(m_id, params);
 
   if (is_debug_tag_set("parent_config")) {
@@ -488,6 +813,11 @@ ParentRecord::FindParent(bool first_call, ParentResult * result, RequestData * r
 
   ink_assert(num_parents > 0 || go_direct == true);
 
+  if (round_robin == P_CONSISTENT_HASH && parents != NULL) {
+    FindChashParent(first_call, result, request_info, config, bypass_ok);
+    return;
+  }
+
   if (first_call == true) {
     if (parents == NULL) {
       // We should only get into this state if
@@ -515,6 +845,9 @@ ParentRecord::FindParent(bool first_call, ParentResult * result, RequestData * r
             cur_index = 0;
         }
         break;
+      case P_LEAST_LATENCY:
+        cur_index = result->start_parent = FindFastestParent(config);
+        break;
       case P_NO_ROUND_ROBIN:
         cur_index = result->start_parent = 0;
         break;
@@ -544,7 +877,10 @@ ParentRecord::FindParent(bool first_call, ParentResult * result, RequestData * r
   //   should be retried
   do {
     // DNS ParentOnly inhibits bypassing the parent so always return that t
-    if ((parents[cur_index].failedAt == 0) || (parents[cur_index].failCount < config->FailThreshold)) {
+    if (parents[cur_index].health && parents[cur_index].health->down && !result->wrap_around) {
+      // Failing its active health checks, only used when nothing else is up
+      parentUp = false;
+    } else if ((parents[cur_index].failedAt == 0) || (parents[cur_index].failCount < config->FailThreshold)) {
       Debug("parent_select", "config->FailThreshold = %d", config->FailThreshold);
       Debug("parent_select", "Selecting a down parent due to little failCount"
             "(faileAt: %u failCount: %d)", (unsigned)parents[cur_index].failedAt, parents[cur_index].failCount);
@@ -597,6 +933,189 @@ NO_PARENTS:
   result->port = 0;
 }
 
+static int
+chash_point_cmp(const void *a, const void *b)
+{
+  uint32_t x = ((pChashPoint const *) a)->hash, y = ((pChashPoint const *) b)->hash;
+  return x < y ? -1 : (x > y);
+}
+
+// void ParentRecord::BuildChashRing()
+//
+//    Places PARENT_CHASH_VNODES points per parent on the ring, each at
+//      the hash of "host:port-n", so adding or losing a parent only
+//      moves the URLs next to its own points
+//
+void
+ParentRecord::BuildChashRing()
+{
+  char buf[MAXDNAME + 32];
+  INK_MD5 md5;
+
+  ats_free(chash_ring);
+  chash_points = num_parents * PARENT_CHASH_VNODES;
+  chash_ring = (pChashPoint *)ats_malloc(sizeof(pChashPoint) * chash_points);
+
+  for (int i = 0; i < num_parents; i++) {
+    for (int n = 0; n < PARENT_CHASH_VNODES; n++) {
+      int len = snprintf(buf, sizeof(buf), "%s:%d-%d", parents[i].hostname, parents[i].port, n);
+      md5.encodeBuffer(buf, len);
+      chash_ring[i * PARENT_CHASH_VNODES + n].hash = md5.word(0);
+      chash_ring[i * PARENT_CHASH_VNODES + n].parent = i;
+    }
+  }
+  qsort(chash_ring, chash_points, sizeof(pChashPoint), chash_point_cmp);
+}
+
+// uint32_t ParentRecord::ChashSearch(uint32_t hash)
+//
+//    Returns the first ring point at or after hash, wrapping
+//
+uint32_t
+ParentRecord::ChashSearch(uint32_t hash) const
+{
+  int lo = 0, hi = chash_points;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (chash_ring[mid].hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo == chash_points ? 0 : lo;
+}
+
+// void ParentRecord::FindChashParent(...)
+//
+//    FindParent() for round_robin=consistent_hash.  The URL picks a ring
+//      point and the parent that owns it; on failure we walk on around
+//      the ring to the next parent not yet tried.  With a load bound a
+//      parent that has had more than its share of recent requests is
+//      passed over the same way, unless nothing else is up.
+//
+void
+ParentRecord::FindChashParent(bool first_call, ParentResult * result, HttpRequestData * request_info,
+                              ParentConfigParams * config, bool bypass_ok)
+{
+  uint32_t pos;
+
+  if (first_call) {
+    INK_MD5 md5;
+
+    if (request_info->hdr) {
+      request_info->hdr->url_get()->MD5_get(&md5);
+    } else {
+      const char *host = request_info->get_host();
+      md5.encodeBuffer(host, strlen(host));
+    }
+    pos = ChashSearch((uint32_t) md5.fold());
+    result->chash_tried = 0;
+    result->wrap_around = false;
+  } else {
+    pos = result->chash_pos + 1;
+  }
+
+  // Pass 0 honors the load bound, pass 1 ignores it, and pass 2 (only
+  // when we may not bypass) takes any parent, up or not.
+  for (int pass = 0; pass < 3; pass++) {
+    if (pass == 0 && chash_load_bound <= 0)
+      continue;
+    if (pass == 2) {
+      if (bypass_ok)
+        break;
+      result->wrap_around = true;
+      result->chash_tried = 0;
+    }
+
+    int32_t cap = (int32_t) (chash_load_bound * (chash_total + 1) / num_parents) + 1;
+
+    for (int n = 0; n < chash_points; n++) {
+      uint32_t p = (pos + n) % chash_points;
+      int idx = chash_ring[p].parent;
+      pRecord *rec = parents + idx;
+      bool retry = false;
+
+      if (idx < 64 && (result->chash_tried & (1ULL << idx)))
+        continue;
+      if (!first_call && idx == (int) result->last_parent && pass < 2)
+        continue;
+      if (rec->health && rec->health->down && !result->wrap_around)
+        continue;
+      if (rec->failedAt != 0 && rec->failCount >= config->FailThreshold) {
+        if (result->wrap_around || (rec->failedAt + config->ParentRetryTime) < request_info->xact_start)
+          retry = true;
+        else
+          continue;
+      }
+      if (pass == 0 && rec->chash_load >= cap)
+        continue;
+
+      if (idx < 64)
+        result->chash_tried |= (1ULL << idx);
+      result->chash_pos = p;
+      result->r = PARENT_SPECIFIED;
+      result->hostname = rec->hostname;
+      result->port = rec->port;
+      result->last_parent = idx;
+      result->retry = retry;
+
+      if (chash_load_bound > 0) {
+        ink_atomic_increment(&rec->chash_load, 1);
+        int32_t total = ink_atomic_increment(&chash_total, 1) + 1;
+        // Decay so the bound follows recent traffic.  Racing increments
+        // may be lost, the counts only need to be roughly right.
+        if (total >= PARENT_CHASH_DECAY * num_parents && ink_atomic_cas(&chash_total, total, total / 2)) {
+          for (int i = 0; i < num_parents; i++)
+            parents[i].chash_load /= 2;
+        }
+      }
+      Debug("parent_select", "Chosen parent = %s.%d (ring point %u)", result->hostname, result->port, p);
+      return;
+    }
+  }
+
+  if (this->go_direct == true) {
+    result->r = PARENT_DIRECT;
+  } else {
+    result->r = PARENT_FAIL;
+  }
+  result->hostname = NULL;
+  result->port = 0;
+}
+
+// Cost of sending a request to a parent for round_robin=least_latency:
+//   the probe latency, scaled up to ten times as the probes start failing
+static inline int64_t
+parent_cost(pRecord * p, ParentConfigParams * config)
+{
+  if ((p->failedAt != 0 && p->failCount >= config->FailThreshold) || (p->health && p->health->down))
+    return INT64_MAX;
+  if (p->health == NULL)
+    return 0;
+  return (int64_t) p->health->latency_us * (1000 + 9 * p->health->error_rate);
+}
+
+// int ParentRecord::FindFastestParent(ParentConfigParams* config)
+//
+//    Power of two choices: takes two different parents at random and
+//      returns the cheaper one.  Comparing just two keeps all the
+//      transactions from piling onto whichever parent probed fastest.
+//
+int
+ParentRecord::FindFastestParent(ParentConfigParams * config)
+{
+  if (num_parents == 1)
+    return 0;
+
+  uint32_t n = (uint32_t) ink_atomic_increment((int32_t *) & rr_next, 1);
+  uint64_t x = (uint64_t) n * 0x9E3779B97F4A7C15ULL;
+  int a = (int) ((x >> 32) % num_parents);
+  int b = (a + 1 + (int) ((uint32_t) x % (num_parents - 1))) % num_parents;
+
+  return parent_cost(parents + b, config) < parent_cost(parents + a, config) ? b : a;
+}
+
 // const char* ParentRecord::ProcessParents(char* val)
 //
 //   Reads in the value of a "round-robin" or "order"
@@ -669,7 +1188,10 @@ ParentRecord::ProcessParents(char *val)
     this->parents[i].hostname[tmp - current] = '\0';
     this->parents[i].port = port;
     this->parents[i].failedAt = 0;
+    this->parents[i].failCount = 0;
     this->parents[i].scheme = scheme;
+    this->parents[i].chash_load = 0;
+    this->parents[i].health = NULL;
   }
 
   num_parents = numTok;
@@ -755,6 +1277,10 @@ ParentRecord::Init(matcher_line * line_info)
         round_robin = P_STRICT_ROUND_ROBIN;
       } else if (strcasecmp(val, "false") == 0) {
         round_robin = P_NO_ROUND_ROBIN;
+      } else if (strcasecmp(val, "consistent_hash") == 0) {
+        round_robin = P_CONSISTENT_HASH;
+      } else if (strcasecmp(val, "least_latency") == 0) {
+        round_robin = P_LEAST_LATENCY;
       } else {
         round_robin = P_NO_ROUND_ROBIN;
         errPtr = "invalid argument to round_robin directive";
@@ -763,6 +1289,12 @@ ParentRecord::Init(matcher_line * line_info)
     } else if (strcasecmp(label, "parent") == 0) {
       errPtr = ProcessParents(val);
       used = true;
+    } else if (strcasecmp(label, "load_bound") == 0) {
+      chash_load_bound = atof(val);
+      if (chash_load_bound != 0 && chash_load_bound < 1) {
+        errPtr = "load_bound must be 0 or at least 1";
+      }
+      used = true;
     } else if (strcasecmp(label, "go_direct") == 0) {
       if (strcasecmp(val, "false") == 0) {
         go_direct = false;
@@ -792,6 +1324,10 @@ ParentRecord::Init(matcher_line * line_info)
     snprintf(errBuf, errBufLen, "%s No parent specified in parent.config at line %d", modulePrefix, line_num);
     return errBuf;
   }
+
+  if (round_robin == P_CONSISTENT_HASH && parents != NULL) {
+    BuildChashRing();
+  }
   // Process any modifiers to the directive, if they exist
   if (line_info->num_el > 0) {
     tmp = ProcessModifiers(line_info);
@@ -834,6 +1370,7 @@ ParentRecord::UpdateMatch(ParentResult * result, RequestData * rdata)
 ParentRecord::~ParentRecord()
 {
   ats_free(parents);
+  ats_free(chash_ring);
 }
 
 void
@@ -1226,6 +1763,195 @@ EXCLUSIVE_REGRESSION_TEST(PARENTSELECTION) (RegressionTest * /* t ATS_UNUSED */,
   *pstatus = (!fails ? REGRESSION_TEST_PASSED : REGRESSION_TEST_FAILED);
 }
 
+// Simulates round_robin=consistent_hash over many URLs: how evenly they
+//   spread, how many move when a parent goes down (against plain modulo
+//   hashing), how a skewed load looks with and without load_bound, and
+//   that requests with a header are hashed on their URL.
+REGRESSION_TEST(PARENTSELECTION_CHASH) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  const int nparents = 8, nkeys = 50000, nrequests = 200000;
+  ParentRecord rec;
+  ParentConfigParams config;
+  HttpRequestData req;
+  ParentResult r;
+  char list[] = "p0:80,p1:80,p2:80,p3:80,p4:80,p5:80,p6:80,p7:80";
+  char host[64];
+  int *owner = (int *)ats_malloc(sizeof(int) * nkeys);
+  int count[nparents];
+  int status = REGRESSION_TEST_PASSED;
+
+  rec.scheme = NULL;
+  rec.ProcessParents(list);
+  rec.round_robin = P_CONSISTENT_HASH;
+  rec.BuildChashRing();
+  config.FailThreshold = 1;
+  config.ParentRetryTime = 300;
+  req.xact_start = time(NULL);
+  req.hostname_str = host;
+
+  // Distribution
+  memset(count, 0, sizeof(count));
+  for (int k = 0; k < nkeys; k++) {
+    snprintf(host, sizeof(host), "obj%d.example.com", k);
+    rec.FindChashParent(true, &r, &req, &config, true);
+    owner[k] = r.last_parent;
+    count[owner[k]]++;
+  }
+  int lo = nkeys, hi = 0;
+  for (int i = 0; i < nparents; i++) {
+    lo = count[i] < lo ? count[i] : lo;
+    hi = count[i] > hi ? count[i] : hi;
+  }
+  rprintf(t, "%d URLs over %d parents: min %d%% max %d%% of the mean\n", nkeys, nparents,
+          lo * nparents * 100 / nkeys, hi * nparents * 100 / nkeys);
+  if (hi * nparents > nkeys * 13 / 10)
+    status = REGRESSION_TEST_FAILED;
+
+  // Remapping when p3 goes down: only its URLs may move.
+  int moved = 0, wrong = 0, modulo_moved = 0;
+  rec.parents[3].failedAt = req.xact_start;
+  rec.parents[3].failCount = 1;
+  for (int k = 0; k < nkeys; k++) {
+    snprintf(host, sizeof(host), "obj%d.example.com", k);
+    rec.FindChashParent(true, &r, &req, &config, true);
+    if ((int) r.last_parent != owner[k]) {
+      moved++;
+      if (owner[k] != 3)
+        wrong++;
+    }
+    if (k % nparents != k % (nparents - 1))
+      modulo_moved++;
+  }
+  rprintf(t, "parent down: %d%% of URLs moved (modulo hashing %d%%), %d moved needlessly\n",
+          moved * 100 / nkeys, modulo_moved * 100 / nkeys, wrong);
+  if (wrong || r.r != PARENT_SPECIFIED)
+    status = REGRESSION_TEST_FAILED;
+  rec.parents[3].failedAt = 0;
+  rec.parents[3].failCount = 0;
+
+  // Skewed popularity, without and with a load bound of 1.25.
+  for (int bounded = 0; bounded < 2; bounded++) {
+    uint32_t seed = 1;
+
+    rec.chash_load_bound = bounded ? 1.25 : 0;
+    rec.chash_total = 0;
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < nparents; i++)
+      rec.parents[i].chash_load = 0;
+    for (int n = 0; n < nrequests; n++) {
+      seed = seed * 1103515245 + 12345;
+      double u = (seed >> 8) / (double) (1 << 24);
+      snprintf(host, sizeof(host), "obj%d.example.com", (int) (nkeys * u * u * u * u));
+      rec.FindChashParent(true, &r, &req, &config, true);
+      count[r.last_parent]++;
+    }
+    hi = 0;
+    for (int i = 0; i < nparents; i++)
+      hi = count[i] > hi ? count[i] : hi;
+    rprintf(t, "skewed load %s: busiest parent %d%% of the mean\n", bounded ? "with load_bound=1.25" : "unbounded",
+            hi * nparents * 100 / nrequests);
+    if (bounded && hi * nparents > nrequests * 14 / 10)
+      status = REGRESSION_TEST_FAILED;
+  }
+
+  // URL hashing with a real request header: the URLs of a single host
+  // spread over the parents, each one keeps its parent, and a retry goes
+  // to another parent.
+  HTTPHdr hdr;
+  char url[128];
+  int used = 0, unstable = 0, same_retry = 0;
+
+  rec.chash_load_bound = 0;
+  hdr.create(HTTP_TYPE_REQUEST);
+  req.hdr = &hdr;
+  snprintf(host, sizeof(host), "www.example.com");
+  memset(count, 0, sizeof(count));
+  for (int k = 0; k < 64; k++) {
+    snprintf(url, sizeof(url), "http://www.example.com/obj%d.html", k);
+    hdr.url_set(url, strlen(url));
+    rec.FindChashParent(true, &r, &req, &config, true);
+    int first = r.last_parent;
+    count[first]++;
+    rec.FindChashParent(true, &r, &req, &config, true);
+    if ((int) r.last_parent != first)
+      unstable++;
+    rec.FindChashParent(false, &r, &req, &config, true);
+    if ((int) r.last_parent == first || r.r != PARENT_SPECIFIED)
+      same_retry++;
+  }
+  for (int i = 0; i < nparents; i++)
+    used += count[i] ? 1 : 0;
+  rprintf(t, "64 URLs of one host: %d parents used, %d changed parent, %d retried on the same parent\n",
+          used, unstable, same_retry);
+  if (used < nparents / 2 || unstable || same_retry)
+    status = REGRESSION_TEST_FAILED;
+  req.hdr = NULL;
+  hdr.destroy();
+
+  req.hostname_str = NULL;
+  ats_free(owner);
+  *pstatus = status;
+}
+
+// round_robin=least_latency against canned health check results: the
+//   faster parents should get most of the traffic, the slowest none,
+//   and a parent that fails its health checks nothing at all.
+REGRESSION_TEST(PARENTSELECTION_LATENCY) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  const int nparents = 4, nrequests = 100000;
+  ParentRecord rec;
+  ParentConfigParams config;
+  HttpRequestData req;
+  ParentResult r;
+  ParentHealth health[nparents];
+  char list[] = "p0:80,p1:80,p2:80,p3:80";
+  int count[nparents];
+  int status = REGRESSION_TEST_PASSED;
+
+  rec.scheme = NULL;
+  rec.ProcessParents(list);
+  rec.round_robin = P_LEAST_LATENCY;
+  config.FailThreshold = 1;
+  config.ParentRetryTime = 300;
+  req.xact_start = time(NULL);
+  memset(health, 0, sizeof(health));
+  for (int i = 0; i < nparents; i++) {
+    ink_strlcpy(health[i].hostname, rec.parents[i].hostname, sizeof(health[i].hostname));
+    health[i].port = 80;
+    health[i].record_probe(true, 1000 << i);
+    rec.parents[i].health = &health[i];
+  }
+
+  for (int round = 0; round < 2; round++) {
+    memset(count, 0, sizeof(count));
+    for (int n = 0; n < nrequests; n++) {
+      rec.FindParent(true, &r, &req, &config);
+      count[r.last_parent]++;
+    }
+    rprintf(t, "%s: p0 %d%% p1 %d%% p2 %d%% p3 %d%%\n", round ? "p0 down" : "latency 1/2/4/8 ms",
+            count[0] * 100 / nrequests, count[1] * 100 / nrequests, count[2] * 100 / nrequests,
+            count[3] * 100 / nrequests);
+    if (count[1] < count[2] || count[2] < count[3])
+      status = REGRESSION_TEST_FAILED;
+    if (round == 0 && (count[3] != 0 || count[0] < count[1]))
+      status = REGRESSION_TEST_FAILED;
+    if (round == 1 && count[0] != 0)
+      status = REGRESSION_TEST_FAILED;
+
+    // Fail p0's health checks until it is marked down
+    for (int i = 0; i < parent_health_fail_threshold; i++)
+      health[0].record_probe(false, 0);
+    if (!health[0].down)
+      status = REGRESSION_TEST_FAILED;
+  }
+
+  health[0].record_probe(true, 1000);
+  if (health[0].down || health[0].error_rate == 0)
+    status = REGRESSION_TEST_FAILED;
+
+  *pstatus = status;
+}
+
 // verify returns 1 iff the test passes
 int
 verify(ParentResult * r, ParentResultType e, const char *h, int p)
@@ -61,7 +61,7 @@ struct ParentResult
 {
   ParentResult()
     : r(PARENT_UNDEFINED), hostname(NULL), port(0), line_number(0), epoch(NULL), rec(NULL),
-      last_parent(0), start_parent(0), wrap_around(false), retry(false)
+      last_parent(0), start_parent(0), wrap_around(false), retry(false), chash_pos(0), chash_tried(0)
   { };
 
   // For outside consumption
@@ -78,6 +78,8 @@ struct ParentResult
   uint32_t start_parent;
   bool wrap_around;
   bool retry;
+  uint32_t chash_pos;           // Ring point of the current parent
+  uint64_t chash_tried;         // Bit per parent already tried (first 64)
 };
 
 class HttpRequestData;
@@ -150,6 +152,27 @@ public:
 //
 
 
+// struct ParentHealth
+//
+//    Active health check state for one parent host:port.  Shared by
+//    every configuration that lists the parent, so it survives reloads.
+//
+struct ParentHealth
+{
+  char hostname[MAXDNAME + 1];
+  int port;
+  volatile int32_t down;        // fail_threshold probes failed in a row
+  int32_t fail_streak;
+  volatile int32_t latency_us;  // EWMA of the probe response time
+  volatile int32_t error_rate;  // EWMA of failed probes, per 1000
+  int32_t probes;
+  volatile int32_t generation;  // last configuration that listed the parent
+  volatile int32_t probing;
+  ParentHealth *next;
+
+  void record_probe(bool success, int32_t usecs);
+};
+
 // struct pRecord
 //
 //    A record for an invidual parent
@@ -162,13 +185,32 @@ struct pRecord
   int failCount;
   int32_t upAt;
   const char *scheme;           // for which parent matches (if any)
+  volatile int32_t chash_load;  // recent selections, for bounded loads
+  ParentHealth *health;         // NULL unless health checks are enabled
 };
 
 enum ParentRR_t
 {
   P_NO_ROUND_ROBIN = 0,
   P_STRICT_ROUND_ROBIN,
-  P_HASH_ROUND_ROBIN
+  P_HASH_ROUND_ROBIN,
+  P_CONSISTENT_HASH,
+  P_LEAST_LATENCY
+};
+
+// Points on the consistent hash ring for each parent
+#define PARENT_CHASH_VNODES 160
+// Halve the bounded load counts after this many selections per parent
+#define PARENT_CHASH_DECAY 1024
+
+// struct pChashPoint
+//
+//    A point on the consistent hash ring of a ParentRecord
+//
+struct pChashPoint
+{
+  uint32_t hash;
+  int parent;
 };
 
 // class ParentRecord : public ControlBase
@@ -180,7 +222,8 @@ class ParentRecord: public ControlBase
 {
 public:
   ParentRecord()
-    : parents(NULL), num_parents(0), round_robin(P_NO_ROUND_ROBIN), rr_next(0), go_direct(true)
+    : parents(NULL), num_parents(0), round_robin(P_NO_ROUND_ROBIN), rr_next(0), go_direct(true),
+      chash_ring(NULL), chash_points(0), chash_load_bound(0), chash_total(0)
   { }
 
   ~ParentRecord();
@@ -201,6 +244,20 @@ public:
   ParentRR_t round_robin;
   volatile uint32_t rr_next;
   bool go_direct;
+
+  // round_robin=consistent_hash: parents on a ring by URL hash, with
+  // load_bound > 0 capping each parent at that multiple of the average.
+  void BuildChashRing();
+  uint32_t ChashSearch(uint32_t hash) const;
+  void FindChashParent(bool first_call, ParentResult *result, HttpRequestData *request_info,
+                       ParentConfigParams *config, bool bypass_ok);
+  // round_robin=least_latency: the faster of two parents picked at random
+  int FindFastestParent(ParentConfigParams *config);
+
+  pChashPoint *chash_ring;
+  int chash_points;
+  float chash_load_bound;
+  volatile int32_t chash_total;
 };
 
 // Helper Functions
@@ -500,50 +500,48 @@ FailHistory::init(int window)
     bins[i] = 0;
   }
   last_event = 0;
-  cur_index = 0;
-  events = 0;
-  start = 0;
 }
 
-void
-FailHistory::init_event(long t, int n)
+int
+FailHistory::regist_event(long t, int n)
 {
-  last_event = t;
-  cur_index = 0;
-  events = n;
-  bins[0] = n;
-  for (int i = 1; i < CONG_HIST_ENTRIES; i++) {
-    bins[i] = 0;
-  }
-  start = (last_event + bin_len) - last_event % bin_len - length;
+  int64_t period = t / bin_len + 1;     // 0 marks an unused bin
+  volatile int64_t *bin = &bins[period % CONG_HIST_ENTRIES];
+  int64_t old_bin, new_bin;
+
+  do {
+    old_bin = *bin;
+    if ((old_bin >> CONG_HIST_COUNT_BITS) == period) {
+      new_bin = old_bin + n;
+    } else if ((old_bin >> CONG_HIST_COUNT_BITS) < period) {
+      new_bin = (period << CONG_HIST_COUNT_BITS) | n;
+    } else {
+      // A newer period owns the bin, this event is out of the window
+      return events(t);
+    }
+  } while (!ink_atomic_cas(bin, old_bin, new_bin));
+
+  for (long last = last_event; last < t && !ink_atomic_cas(&last_event, last, t); last = last_event);
+  return events(t);
 }
 
 int
-FailHistory::regist_event(long t, int n)
+FailHistory::events(long t)
 {
-  if (t < start)
-    return events;
-  if (t > last_event + length) {
-    init_event(t, n);
-    return events;
-  }
-  if (t < start + length) {
-    bins[((t - start) / bin_len + 1 + cur_index) % CONG_HIST_ENTRIES] += n;
-  } else {
-    do {
-      start += bin_len;
-      cur_index++;
-      if (cur_index == CONG_HIST_ENTRIES)
-        cur_index = 0;
-      events -= bins[cur_index];
-      bins[cur_index] = 0;
-    } while (start + length < t);
-    bins[cur_index] = n;
-  }
-  events += n;
-  if (last_event < t)
-    last_event = t;
-  return events;
+  if (bin_len <= 0)
+    return 0;
+
+  long now = last_event > t ? last_event : t;
+  int64_t newest = now / bin_len + 1;
+  int total = 0;
+
+  for (int i = 0; i < CONG_HIST_ENTRIES; i++) {
+    int64_t bin = bins[i];
+    int64_t period = bin >> CONG_HIST_COUNT_BITS;
+    if (period > newest - CONG_HIST_ENTRIES && period <= newest)
+      total += (int) (bin & CONG_HIST_COUNT_MASK);
+  }
+  return total;
 }
 
 //----------------------------------------------------------
@@ -564,7 +562,6 @@ m_M_congested(0), m_last_M_congested(0), m_num_connections(0), m_stat_congested_
   rule->get();
   pRecord = rule;
   clearFailHistory();
-  m_hist_lock = new_ProxyMutex();
 }
 
 void
@@ -630,7 +627,7 @@ CongestionEntry::applyNewRule(CongestionControlRecord * rule)
     if (ink_atomic_swap(&m_congested, 0)) {
       // action not congested?
     }
-  } else if (mcf > pRecord->max_connection_failures && m_history.events >= pRecord->max_connection_failures) {
+  } else if (mcf > pRecord->max_connection_failures && m_history.events() >= pRecord->max_connection_failures) {
     if (!ink_atomic_swap(&m_congested, 1)) {
       // action congested?
     }
@@ -684,7 +681,7 @@ CongestionEntry::sprint(char *buf, int buflen, int format)
         len += snprintf(buf + len, buflen - len, "|%ld", m_history.last_event);
 
         if (format > 3) {
-          len += snprintf(buf + len, buflen - len, "|%d|%d|%d", m_history.events, m_ref_count, m_num_connections);
+          len += snprintf(buf + len, buflen - len, "|%d|%d|%d", m_history.events(), m_ref_count, m_num_connections);
         }
       }
     }
@@ -694,9 +691,9 @@ CongestionEntry::sprint(char *buf, int buflen, int format)
 }
 
 //-------------------------------------------------------------
-// When a connection failure happened, try to get the lock
-//  first and change register the event, if we can not get
-//  the lock, discard the event
+// When a connection failure happened, register it in the
+//  fail history.  This is lock free, so no failures are lost
+//  when many transactions to the same server fail at once.
 //-------------------------------------------------------------
 void
 CongestionEntry::failed_at(ink_hrtime t)
@@ -706,19 +703,14 @@ CongestionEntry::failed_at(ink_hrtime t)
   // long time = ink_hrtime_to_sec(t);
   long time = t;
   Debug("congestion_control", "failed_at: %ld", time);
-  MUTEX_TRY_LOCK(lock, m_hist_lock, this_ethread());
-  if (lock) {
-    m_history.regist_event(time);
-    if (!m_congested) {
-      int32_t new_congested = compCongested();
-      // TODO: This used to signal via SNMP
-      if (new_congested && !ink_atomic_swap(&m_congested, 1)) {
-        m_last_congested = m_history.last_event;
-        // action congested ?
-      }
+  int events = m_history.regist_event(time);
+  if (!m_congested) {
+    int32_t new_congested = compCongested(events);
+    // TODO: This used to signal via SNMP
+    if (new_congested && !ink_atomic_swap(&m_congested, 1)) {
+      m_last_congested = m_history.last_event;
+      // action congested ?
     }
-  } else {
-    Debug("congestion_control", "failure info lost due to lock contention(Entry: %p, Time: %ld)", (void *) this, time);
   }
 }
 
@@ -170,28 +170,34 @@ CongestionControlRecord::cleanup()
 
 typedef unsigned short cong_hist_t;
 #define CONG_HIST_ENTRIES 17
+// Low bits of a bin hold its event count, the high bits the period it counts
+#define CONG_HIST_COUNT_BITS 24
+#define CONG_HIST_COUNT_MASK ((1LL << CONG_HIST_COUNT_BITS) - 1)
 
 // CongestionEntry
+//
+// FailHistory counts connection failures over the last length seconds in
+// CONG_HIST_ENTRIES bins of bin_len seconds.  Every bin is tagged with the
+// bin_len period it counts, so registering a failure is a single compare
+// and swap, and a bin left over from an older period reads as empty.
 struct FailHistory
 {
-  long start;
   int bin_len;
   int length;
-  cong_hist_t bins[CONG_HIST_ENTRIES];
-  int cur_index;
-  long last_event;
-  int events;
+  volatile int64_t bins[CONG_HIST_ENTRIES];
+  volatile long last_event;
 
-    FailHistory():start(0), bin_len(0), length(0), cur_index(0), last_event(0), events(0)
+    FailHistory():bin_len(0), length(0), last_event(0)
   {
     bzero((void *) &bins, sizeof(bins));
   }
   void init(int window);
-  void init_event(long t, int n = 1);
   int regist_event(long t, int n = 1);
+  // failures in the window ending at t (or at the last failure, if later)
+  int events(long t = 0);
   int get_bin_events(int index)
   {
-    return bins[(index + 1 + cur_index) % CONG_HIST_ENTRIES];
+    return (int) (bins[index] & CONG_HIST_COUNT_MASK);
   }
 };
 
@@ -210,7 +216,6 @@ struct CongestionEntry: public RequestData
 
   // State -- connection failures
   FailHistory m_history;
-  Ptr<ProxyMutex> m_hist_lock;
   ink_hrtime m_last_congested;
   volatile int m_congested;     //0 | 1
   int m_stat_congested_conn_failures;
@@ -286,7 +291,7 @@ struct CongestionEntry: public RequestData
 
   // fail history operations
   void clearFailHistory();
-  bool compCongested();
+  bool compCongested(int events);
 
   // CongestionEntry and CongestionControl rules interaction helper functions
   bool usefulInfo(ink_hrtime t);
@@ -300,7 +305,7 @@ inline bool CongestionEntry::usefulInfo(ink_hrtime t)
 {
   return (m_ref_count > 1 ||
           m_congested != 0 ||
-          m_num_connections > 0 || (m_history.last_event + pRecord->fail_window > t && m_history.events > 0));
+          m_num_connections > 0 || (m_history.last_event + pRecord->fail_window > t && m_history.events(t) > 0));
 }
 
 inline int
@@ -375,13 +380,13 @@ CongestionEntry::stat_inc_M()
   ink_atomic_increment(&m_stat_congested_max_conn, 1);
 }
 
-inline bool CongestionEntry::compCongested()
+inline bool CongestionEntry::compCongested(int events)
 {
   if (m_congested)
     return true;
   if (pRecord->max_connection_failures == -1)
     return false;
-  return pRecord->max_connection_failures <= m_history.events;
+  return pRecord->max_connection_failures <= events;
 }
 
 // return true when max_conn state changed
@@ -415,7 +420,6 @@ m_stat_congested_conn_failures(0),
 m_M_congested(0), m_last_M_congested(0), m_num_connections(0), m_stat_congested_max_conn(0), m_ref_count(1)
 {
   memset(&m_ip, 0, sizeof(m_ip));
-  m_hist_lock = new_ProxyMutex();
 }
 
 
@@ -423,7 +427,6 @@ inline CongestionEntry::~CongestionEntry()
 {
   if (m_hostname)
     ats_free(m_hostname), m_hostname = NULL;
-  m_hist_lock = NULL;
   if (pRecord)
     pRecord->put(), pRecord = NULL;
 }
@@ -35,16 +35,13 @@
 #include "Congestion.h"
 #include "ProcessManager.h"
 
-#define SCHEDULE_CONGEST_CONT_INTERVAL HRTIME_MSECONDS(5)
-int CONGESTION_DB_SIZE = 1024;
+int CONGESTION_DB_SIZE = 16384;
 
 CongestionDB *theCongestionDB = NULL;
 
-
 /*
- * the CongestionDBCont is the continuation to do the congestion db related work
- * when the CongestionDB's corresponding function does not get the lock in the
- * first try
+ * the CongestionDBCont is the continuation that periodically garbage
+ * collects the congestion db
  */
 
 class CongestionDBCont:public Continuation
@@ -52,71 +49,12 @@ class CongestionDBCont:public Continuation
 public:
   CongestionDBCont();
   int GC(int event, Event * e);
-
-  int get_congest_list(int event, Event * e);
-
-  int get_congest_entry(int event, Event * e);
-
-
-  Action m_action;
-
-  // To save momery, use a union here
-  union
-  {
-    struct
-    {
-      MIOBuffer *m_iobuf;
-      int m_CurPartitionID;
-      int m_list_format;        // format of list
-    } list_info;
-    struct
-    {
-      uint64_t m_key;
-      char *m_hostname;
-      IpEndpoint m_ip;
-      CongestionControlRecord *m_rule;
-      CongestionEntry **m_ppEntry;
-    } entry_info;
-  } data;
 };
 
-// MACRO's to save typing
-#define CDBC_buf  data.list_info.m_iobuf
-#define CDBC_pid  data.list_info.m_CurPartitionID
-#define CDBC_lf   data.list_info.m_list_format
-#define CDBC_key  data.entry_info.m_key
-#define CDBC_host data.entry_info.m_hostname
-#define CDBC_ip   data.entry_info.m_ip
-#define CDBC_rule data.entry_info.m_rule
-#define CDBC_ppE  data.entry_info.m_ppEntry
-
 inline CongestionDBCont::CongestionDBCont()
-:Continuation(NULL)
-{
-  memset(&data, 0, sizeof(data));
-}
-
-//--------------------------------------------------------------
-// class allocators
-static
-  ClassAllocator <
-  CongestionDBCont >
-CongestionDBContAllocator("CongestionDBContAllocator");
-
-inline void
-Free_CongestionDBCont(CongestionDBCont * cont)
-{
-  cont->m_action = NULL;
-  cont->mutex = NULL;
-  CongestionDBContAllocator.free(cont);
-}
-
-ClassAllocator<CongestRequestParam> CongestRequestParamAllocator("CongestRequestParamAllocator");
-
-inline void
-Free_CongestRequestParam(CongestRequestParam * param)
+:Continuation(new_ProxyMutex())
 {
-  CongestRequestParamAllocator.free(param);
+  SET_HANDLER(&CongestionDBCont::GC);
 }
 
 //-----------------------------------------------------------------
@@ -124,50 +62,120 @@ Free_CongestRequestParam(CongestRequestParam * param)
 //-----------------------------------------------------------------
 /*
  * CongestionDB(int tablesize)
- *  tablesize is the initial hashtable bucket number
+ *  tablesize is the number of hash chains, split evenly between the
+ *  partitions.  The table is never resized, so size it for the number
+ *  of origin servers expected.
  */
-static long
-  congestEntryGCTime = 0;
+CongestionDB::CongestionDB(int tablesize)
+  : m_part_buckets(tablesize / CONGEST_DB_PARTITIONS), m_buckets(NULL), m_entries(0)
+{
+  ink_assert(tablesize > 0);
+  if (m_part_buckets < 1)
+    m_part_buckets = 1;
+  m_buckets = (CongestionDBNode * volatile *)ats_calloc(m_part_buckets * CONGEST_DB_PARTITIONS, sizeof(CongestionDBNode *));
+  for (int i = 0; i < CONGEST_DB_PARTITIONS; i++) {
+    ink_mutex_init(&m_locks[i], "CongestionDB");
+    m_retired[i] = NULL;
+  }
+}
 
-// Before the garbage collection of the congestion db, set the
-//  current GC time, CongestionEntry::usefulInfo(t) will use the
-//  timestamp to determine if the entry contains useful infomation
+/*
+ * No other thread may use the DB once the destructor is called
+ */
 
-void
-preCongestEntryGC(void)
+CongestionDB::~CongestionDB()
 {
-  congestEntryGCTime = (long) ink_hrtime_to_sec(ink_get_hrtime());
+  for (int i = 0; i < m_part_buckets * CONGEST_DB_PARTITIONS; i++) {
+    CongestionDBNode *node = m_buckets[i];
+    while (node) {
+      CongestionDBNode *next = node->m_next;
+      node->m_pEntry->put();
+      ats_free(node);
+      node = next;
+    }
+  }
+  for (int i = 0; i < CONGEST_DB_PARTITIONS; i++) {
+    reclaim(i, HRTIME_FOREVER);
+    ink_mutex_destroy(&m_locks[i]);
+  }
+  ats_free((void *) m_buckets);
 }
 
-// if the entry contains useful info, return false -- keep it
-// else return true -- delete it
-bool
-congestEntryGC(CongestionEntry * p)
+CongestionEntry *
+CongestionDB::lookup_entry(uint64_t key)
 {
-  if (!p->usefulInfo(congestEntryGCTime)) {
-    p->put();
-    return true;
+  for (CongestionDBNode *node = *bucket_for(key); node; node = node->m_next) {
+    if (node->m_key == key && !node->m_removed)
+      return node->m_pEntry;
   }
-  return false;
+  return NULL;
 }
 
-CongestionDB::CongestionDB(int tablesize)
-:CongestionTable(tablesize, &congestEntryGC, &preCongestEntryGC)
+CongestionEntry *
+CongestionDB::insert_entry(uint64_t key, CongestionEntry * pEntry)
 {
-  ink_assert(tablesize > 0);
-  todo_lists = new InkAtomicList[MT_HASHTABLE_PARTITIONS];
-  for (int i = 0; i < MT_HASHTABLE_PARTITIONS; i++) {
-    ink_atomiclist_init(&todo_lists[i], "cong_todo_list", (uintptr_t) &((CongestRequestParam *) 0)->link);
+  CongestionDBNode *volatile *head = bucket_for(key);
+  CongestionDBNode *node = (CongestionDBNode *)ats_malloc(sizeof(CongestionDBNode));
+
+  node->m_key = key;
+  node->m_pEntry = pEntry;
+  node->m_removed = 0;
+  node->m_retired_at = 0;
+  node->m_retired_next = NULL;
+  for (;;) {
+    CongestionDBNode *first = *head;
+    // Inserts only ever push a new head, so rescanning from the head we
+    // lost to sees anything inserted for the same key in the meantime
+    for (CongestionDBNode *cur = first; cur; cur = cur->m_next) {
+      if (cur->m_key == key && !cur->m_removed) {
+        ats_free(node);
+        return cur->m_pEntry;
+      }
+    }
+    node->m_next = first;
+    if (ink_atomic_cas(head, first, node)) {
+      ink_atomic_increment(&m_entries, 1);
+      return pEntry;
+    }
   }
 }
 
-/*
- * There should be no entry in the DB, before you call the destructor
- */
+// Called with the partition mutex held
+void
+CongestionDB::unlink(int part, CongestionDBNode *volatile *head, CongestionDBNode * node)
+{
+  node->m_removed = 1;
+  // An insert may have pushed a new head since, but only removals
+  // (serialized by the mutex) change the links after the head
+  if (!ink_atomic_cas(head, node, (CongestionDBNode *) node->m_next)) {
+    CongestionDBNode *prev = *head;
+    while (prev->m_next != node)
+      prev = prev->m_next;
+    prev->m_next = node->m_next;
+  }
+  ink_atomic_increment(&m_entries, -1);
+  node->m_retired_at = ink_get_hrtime();
+  node->m_retired_next = m_retired[part];
+  m_retired[part] = node;
+}
 
-CongestionDB::~CongestionDB()
+// Frees the nodes removed before the given time, called with the
+//  partition mutex held
+void
+CongestionDB::reclaim(int part, ink_hrtime before)
 {
-  delete[]todo_lists;
+  CongestionDBNode **pp = &m_retired[part];
+
+  while (*pp) {
+    CongestionDBNode *node = *pp;
+    if (node->m_retired_at < before) {
+      *pp = node->m_retired_next;
+      node->m_pEntry->put();
+      ats_free(node);
+    } else {
+      pp = &node->m_retired_next;
+    }
+  }
 }
 
 void
@@ -175,255 +183,115 @@ CongestionDB::addRecord(uint64_t key, CongestionEntry * pEntry)
 {
   ink_assert(key == pEntry->m_key);
   pEntry->get();
-  ProxyMutex *bucket_mutex = lock_for_key(key);
-  MUTEX_TRY_LOCK(lock, bucket_mutex, this_ethread());
-  if (lock) {
-    RunTodoList(part_num(key));
-    CongestionEntry *tmp = insert_entry(key, pEntry);
-    if (tmp)
-      tmp->put();
-  } else {
-    CongestRequestParam *param = CongestRequestParamAllocator.alloc();
-    param->m_op = CongestRequestParam::ADD_RECORD;
-    param->m_key = key;
-    param->m_pEntry = pEntry;
-    ink_atomiclist_push(&todo_lists[part_num(key)], param);
-  }
+  while (insert_entry(key, pEntry) != pEntry)
+    removeRecord(key);
 }
 
 void
 CongestionDB::removeAllRecords()
 {
-  CongestionEntry *tmp;
-  Iter it;
-  for (int part = 0; part < MT_HASHTABLE_PARTITIONS; part++) {
-    ProxyMutex *bucket_mutex = lock_for_key(part);
-    MUTEX_TRY_LOCK(lock, bucket_mutex, this_ethread());
-    if (lock) {
-      RunTodoList(part);
-      tmp = first_entry(part, &it);
-      while (tmp) {
-        remove_entry(part, &it);
-        tmp->put();
-        tmp = cur_entry(part, &it);
-      }
-    } else {
-      CongestRequestParam *param = CongestRequestParamAllocator.alloc();
-      param->m_op = CongestRequestParam::REMOVE_ALL_RECORDS;
-      param->m_key = part;
-      ink_atomiclist_push(&todo_lists[part], param);
+  for (int part = 0; part < CONGEST_DB_PARTITIONS; part++) {
+    ink_mutex_acquire(&m_locks[part]);
+    for (int i = 0; i < m_part_buckets; i++) {
+      CongestionDBNode *volatile *head = &m_buckets[part * m_part_buckets + i];
+      while (*head)
+        unlink(part, head, *head);
     }
+    ink_mutex_release(&m_locks[part]);
   }
 }
 
 void
 CongestionDB::removeRecord(uint64_t key)
 {
-  CongestionEntry *tmp;
-  ProxyMutex *bucket_mutex = lock_for_key(key);
-  MUTEX_TRY_LOCK(lock, bucket_mutex, this_ethread());
-  if (lock) {
-    RunTodoList(part_num(key));
-    tmp = remove_entry(key);
-    if (tmp)
-      tmp->put();
-  } else {
-    CongestRequestParam *param = CongestRequestParamAllocator.alloc();
-    param->m_op = CongestRequestParam::REMOVE_RECORD;
-    param->m_key = key;
-    ink_atomiclist_push(&todo_lists[part_num(key)], param);
-  }
-}
+  int part = part_num(key);
+  CongestionDBNode *volatile *head = bucket_for(key);
 
-// process one item in the to do list
-void
-CongestionDB::process(int buckId, CongestRequestParam * param)
-{
-  CongestionEntry *pEntry = NULL;
-  switch (param->m_op) {
-  case CongestRequestParam::ADD_RECORD:
-    pEntry = insert_entry(param->m_key, param->m_pEntry);
-    if (pEntry) {
-      pEntry->put();
-    }
-    break;
-  case CongestRequestParam::REMOVE_ALL_RECORDS:
-    {
-      CongestionEntry *tmp;
-      Iter it;
-      tmp = first_entry(param->m_key, &it);
-      while (tmp) {
-        remove_entry(param->m_key, &it);
-        tmp->put();
-        tmp = cur_entry(param->m_key, &it);
-      }
+  ink_mutex_acquire(&m_locks[part]);
+  for (CongestionDBNode *node = *head; node; node = node->m_next) {
+    if (node->m_key == key && !node->m_removed) {
+      unlink(part, head, node);
       break;
     }
-  case CongestRequestParam::REMOVE_RECORD:
-    pEntry = remove_entry(param->m_key);
-    if (pEntry)
-      pEntry->put();
-    break;
-  case CongestRequestParam::REVALIDATE_BUCKET:
-    revalidateBucket(buckId);
-    break;
-  default:
-    ink_assert(!"CongestionDB::process unrecognized op");
   }
+  ink_mutex_release(&m_locks[part]);
 }
 
 void
-CongestionDB::RunTodoList(int buckId)
+CongestionDB::revalidatePartition(int part)
 {
-  CongestRequestParam *param = NULL, *cur = NULL;
-  if ((param = (CongestRequestParam *)
-       ink_atomiclist_popall(&todo_lists[buckId])) != NULL) {
-    /* start the work at the end of the list */
-    param->link.prev = NULL;
-    while (param->link.next) {
-      param->link.next->link.prev = param;
-      param = param->link.next;
-    };
-    while (param) {
-      process(buckId, param);
-      cur = param;
-      param = param->link.prev;
-      Free_CongestRequestParam(cur);
+  ink_mutex_acquire(&m_locks[part]);
+  for (int i = 0; i < m_part_buckets; i++) {
+    CongestionDBNode *volatile *head = &m_buckets[part * m_part_buckets + i];
+    CongestionDBNode *node = *head;
+    while (node) {
+      CongestionDBNode *next = node->m_next;
+      if (!node->m_pEntry->validate())
+        unlink(part, head, node);
+      node = next;
     }
   }
+  ink_mutex_release(&m_locks[part]);
 }
 
+// Removes the entries with no useful information left and frees
+//  the nodes removed at least one GC interval ago
 void
-CongestionDB::revalidateBucket(int buckId)
+CongestionDB::GC(int part, long now)
 {
-  Iter it;
-  CongestionEntry *cur = NULL;
-  cur = first_entry(buckId, &it);
-  while (cur != NULL) {
-    if (!cur->validate()) {
-      remove_entry(buckId, &it);
-      cur->put();
-      // the next entry has been moved to the current pos
-      //because of the remove_entry
-      cur = cur_entry(buckId, &it);
-    } else
-      cur = next_entry(buckId, &it);
+  ink_mutex_acquire(&m_locks[part]);
+  for (int i = 0; i < m_part_buckets; i++) {
+    CongestionDBNode *volatile *head = &m_buckets[part * m_part_buckets + i];
+    CongestionDBNode *node = *head;
+    while (node) {
+      CongestionDBNode *next = node->m_next;
+      if (!node->m_pEntry->usefulInfo(now))
+        unlink(part, head, node);
+      node = next;
+    }
   }
+  reclaim(part, ink_get_hrtime() - CONGEST_DB_GC_INTERVAL);
+  ink_mutex_release(&m_locks[part]);
 }
 
-//-----------------------------------------------------------------
-//  CongestionDBCont implementation
-//-----------------------------------------------------------------
-
-int
-CongestionDBCont::GC(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
+CongestionEntry *
+CongestionDB::first_entry(int part, Iter * it)
 {
-  if (congestionControlEnabled == 1 || congestionControlEnabled == 2) {
-    if (theCongestionDB == NULL)
-      goto Ldone;
-    for (; CDBC_pid < theCongestionDB->getSize(); CDBC_pid++) {
-      ProxyMutex *bucket_mutex = theCongestionDB->lock_for_key(CDBC_pid);
-      {
-        MUTEX_TRY_LOCK(lock, bucket_mutex, this_ethread());
-        if (lock) {
-          ink_hrtime now = ink_get_hrtime();
-          now = ink_hrtime_to_sec(now);
-          theCongestionDB->RunTodoList(CDBC_pid);
-          Iter it;
-          CongestionEntry *pEntry = theCongestionDB->first_entry(CDBC_pid, &it);
-          while (pEntry) {
-            if (!pEntry->usefulInfo(now)) {
-              theCongestionDB->remove_entry(CDBC_pid, &it);
-              pEntry->put();
-              pEntry = theCongestionDB->cur_entry(CDBC_pid, &it);
-            }
-          }
-        } else {
-          Debug("congestion_db", "flush gc missed the lock [%d], retry", CDBC_pid);
-          return EVENT_CONT;
-        }
-      }
-    }
-  }
-Ldone:
-  CDBC_pid = 0;
-  return EVENT_DONE;
+  it->m_bucket = part * m_part_buckets - 1;
+  it->m_node = NULL;
+  return next_entry(part, it);
 }
 
-int
-CongestionDBCont::get_congest_list(int /* event ATS_UNUSED */, Event * e)
+CongestionEntry *
+CongestionDB::next_entry(int part, Iter * it)
 {
-  if (m_action.cancelled) {
-    Free_CongestionDBCont(this);
-    return EVENT_DONE;
+  if (it->m_node)
+    it->m_node = it->m_node->m_next;
+  for (;;) {
+    while (it->m_node && it->m_node->m_removed)
+      it->m_node = it->m_node->m_next;
+    if (it->m_node)
+      return it->m_node->m_pEntry;
+    if (++it->m_bucket >= (part + 1) * m_part_buckets)
+      return NULL;
+    it->m_node = m_buckets[it->m_bucket];
   }
-  for (; CDBC_pid < theCongestionDB->getSize(); CDBC_pid++) {
-    ProxyMutex *bucket_mutex = theCongestionDB->lock_for_key(CDBC_pid);
-    {
-      MUTEX_TRY_LOCK(lock_bucket, bucket_mutex, this_ethread());
-      if (!lock_bucket) {
-        e->schedule_in(SCHEDULE_CONGEST_CONT_INTERVAL);
-        return EVENT_CONT;
-      } else {
-        theCongestionDB->RunTodoList(CDBC_pid);
-        char buf[1024];
-        Iter it;
-        int len;
-        CongestionEntry *pEntry = theCongestionDB->first_entry(CDBC_pid, &it);
-        while (pEntry) {
-          if ((pEntry->congested() && pEntry->pRecord->max_connection != 0) || CDBC_lf > 10) {
-            len = pEntry->sprint(buf, 1024, CDBC_lf);
-            CDBC_buf->write(buf, len);
-          }
-          pEntry = theCongestionDB->next_entry(CDBC_pid, &it);
-        }
-      }
-    }
-  }
-
-  /* handle event done */
-  m_action.continuation->handleEvent(CONGESTION_EVENT_CONGESTED_LIST_DONE, NULL);
-  Free_CongestionDBCont(this);
-  return EVENT_DONE;
 }
 
+//-----------------------------------------------------------------
+//  CongestionDBCont implementation
+//-----------------------------------------------------------------
+
 int
-CongestionDBCont::get_congest_entry(int /* event ATS_UNUSED */, Event * e)
+CongestionDBCont::GC(int /* event ATS_UNUSED */, Event * /* e ATS_UNUSED */)
 {
-  Debug("congestion_control", "cont::get_congest_entry started");
-
-  if (m_action.cancelled) {
-    Debug("congestion_cont", "action cancelled for %p", this);
-    Free_CongestionDBCont(this);
-    Debug("congestion_control", "cont::get_congest_entry state machine canceled");
-    return EVENT_DONE;
-  }
-  ProxyMutex *bucket_mutex = theCongestionDB->lock_for_key(CDBC_key);
-  MUTEX_TRY_LOCK(lock_bucket, bucket_mutex, this_ethread());
-  if (lock_bucket) {
-    theCongestionDB->RunTodoList(theCongestionDB->part_num(CDBC_key));
-    *CDBC_ppE = theCongestionDB->lookup_entry(CDBC_key);
-    if (*CDBC_ppE != NULL) {
-      CDBC_rule->put();
-      (*CDBC_ppE)->get();
-      Debug("congestion_control", "cont::get_congest_entry entry found");
-      m_action.continuation->handleEvent(CONGESTION_EVENT_CONTROL_LOOKUP_DONE, NULL);
-    } else {
-      /* create a new entry and add it to the congestDB */
-      *CDBC_ppE = new CongestionEntry(CDBC_host, &CDBC_ip.sa, CDBC_rule, CDBC_key);
-      CDBC_rule->put();
-      (*CDBC_ppE)->get();
-      theCongestionDB->insert_entry(CDBC_key, *CDBC_ppE);
-      Debug("congestion_control", "cont::get_congest_entry new entry created");
-      m_action.continuation->handleEvent(CONGESTION_EVENT_CONTROL_LOOKUP_DONE, NULL);
-    }
-    Free_CongestionDBCont(this);
-    return EVENT_DONE;
-  } else {
-    Debug("congestion_control", "cont::get_congest_entry MUTEX_TRY_LOCK failed");
-    e->schedule_in(SCHEDULE_CONGEST_CONT_INTERVAL);
-    return EVENT_CONT;
+  if ((congestionControlEnabled == 1 || congestionControlEnabled == 2) && theCongestionDB != NULL) {
+    long now = (long) ink_hrtime_to_sec(ink_get_hrtime());
+    for (int part = 0; part < theCongestionDB->getSize(); part++)
+      theCongestionDB->GC(part, now);
+    Debug("congestion_db", "gc done, %d entries left", theCongestionDB->getCurSize());
   }
+  return EVENT_CONT;
 }
 
 //-----------------------------------------------------------------
@@ -434,38 +302,27 @@ void
 initCongestionDB()
 {
   if (theCongestionDB == NULL) {
-    theCongestionDB = new CongestionDB(CONGESTION_DB_SIZE / MT_HASHTABLE_PARTITIONS);
+    theCongestionDB = new CongestionDB(CONGESTION_DB_SIZE);
+    eventProcessor.schedule_every(NEW(new CongestionDBCont), CONGEST_DB_GC_INTERVAL, ET_NET);
   }
 }
 
 void
 revalidateCongestionDB()
 {
-  ProxyMutex *bucket_mutex;
   if (theCongestionDB == NULL) {
-    theCongestionDB = new CongestionDB(CONGESTION_DB_SIZE / MT_HASHTABLE_PARTITIONS);
+    initCongestionDB();
     return;
   }
   Debug("congestion_config", "congestion control revalidating CongestionDB");
   for (int i = 0; i < theCongestionDB->getSize(); i++) {
-    bucket_mutex = theCongestionDB->lock_for_key(i);
-    {
-      MUTEX_TRY_LOCK(lock_bucket, bucket_mutex, this_ethread());
-      if (lock_bucket) {
-        theCongestionDB->RunTodoList(i);
-        theCongestionDB->revalidateBucket(i);
-      } else {
-        CongestRequestParam *param = CongestRequestParamAllocator.alloc();
-        param->m_op = CongestRequestParam::REVALIDATE_BUCKET;
-        ink_atomiclist_push(&theCongestionDB->todo_lists[i], param);
-      }
-    }
+    theCongestionDB->revalidatePartition(i);
   }
   Debug("congestion_config", "congestion control revalidating CongestionDB Done");
 }
 
 Action *
-get_congest_entry(Continuation * cont, HttpRequestData * data, CongestionEntry ** ppEntry)
+get_congest_entry(Continuation * /* cont ATS_UNUSED */, HttpRequestData * data, CongestionEntry ** ppEntry)
 {
   if (congestionControlEnabled != 1 && congestionControlEnabled != 2)
     return ACTION_RESULT_DONE;
@@ -482,75 +339,38 @@ get_congest_entry(Continuation * cont, HttpRequestData * data, CongestionEntry *
   uint64_t key = make_key((char *) data->get_host(), data->get_ip(), p);
   Debug("congestion_control", "Key = %" PRIu64 "", key);
 
-  ProxyMutex *bucket_mutex = theCongestionDB->lock_for_key(key);
-  MUTEX_TRY_LOCK(lock_bucket, bucket_mutex, this_ethread());
-  if (lock_bucket) {
-    theCongestionDB->RunTodoList(theCongestionDB->part_num(key));
-    *ppEntry = theCongestionDB->lookup_entry(key);
-    if (*ppEntry != NULL) {
-      (*ppEntry)->get();
-      Debug("congestion_control", "get_congest_entry, found entry %p done", (void *) *ppEntry);
-      return ACTION_RESULT_DONE;
-    } else {
-      // create a new entry and add it to the congestDB
-      *ppEntry = new CongestionEntry(data->get_host(), data->get_ip(), p, key);
-      (*ppEntry)->get();
-      theCongestionDB->insert_entry(key, *ppEntry);
-      Debug("congestion_control", "get_congest_entry, new entry %p done", (void *) *ppEntry);
-      return ACTION_RESULT_DONE;
-    }
+  *ppEntry = theCongestionDB->lookup_entry(key);
+  if (*ppEntry == NULL) {
+    // create a new entry and add it to the congestDB, unless another
+    // transaction just did
+    CongestionEntry *pEntry = new CongestionEntry(data->get_host(), data->get_ip(), p, key);
+    *ppEntry = theCongestionDB->insert_entry(key, pEntry);
+    if (*ppEntry != pEntry)
+      pEntry->put();
+    Debug("congestion_control", "get_congest_entry, new entry %p done", (void *) *ppEntry);
   } else {
-    Debug("congestion_control", "get_congest_entry, trylock failed, schedule cont");
-    CongestionDBCont *Ccont = CongestionDBContAllocator.alloc();
-    Ccont->m_action = cont;
-    Ccont->mutex = cont->mutex;
-    Ccont->CDBC_key = key;
-    Ccont->CDBC_host = (char *) data->get_host();
-    ats_ip_copy(&Ccont->CDBC_ip.sa, data->get_ip());
-    p->get();
-    Ccont->CDBC_rule = p;
-    Ccont->CDBC_ppE = ppEntry;
-
-    SET_CONTINUATION_HANDLER(Ccont, &CongestionDBCont::get_congest_entry);
-    eventProcessor.schedule_in(Ccont, SCHEDULE_CONGEST_CONT_INTERVAL, ET_NET);
-    return &Ccont->m_action;
+    Debug("congestion_control", "get_congest_entry, found entry %p done", (void *) *ppEntry);
   }
+  (*ppEntry)->get();
+  return ACTION_RESULT_DONE;
 }
 
 Action *
-get_congest_list(Continuation * cont, MIOBuffer * buffer, int format)
+get_congest_list(Continuation * /* cont ATS_UNUSED */, MIOBuffer * buffer, int format)
 {
   if (theCongestionDB == NULL || (congestionControlEnabled != 1 && congestionControlEnabled != 2))
     return ACTION_RESULT_DONE;
   for (int i = 0; i < theCongestionDB->getSize(); i++) {
-    ProxyMutex *bucket_mutex = theCongestionDB->lock_for_key(i);
-    {
-      MUTEX_TRY_LOCK(lock_bucket, bucket_mutex, this_ethread());
-      if (lock_bucket) {
-        theCongestionDB->RunTodoList(i);
-        char buf[1024];
-        Iter it;
-        int len;
-        CongestionEntry *pEntry = theCongestionDB->first_entry(i, &it);
-        while (pEntry) {
-          if ((pEntry->congested() && pEntry->pRecord->max_connection != 0) || format > 10) {
-            len = pEntry->sprint(buf, 1024, format);
-            buffer->write(buf, len);
-          }
-          pEntry = theCongestionDB->next_entry(i, &it);
-        }
-      } else {
-        /* we did not get the lock, schedule it */
-        CongestionDBCont *CCcont = CongestionDBContAllocator.alloc();
-        CCcont->CDBC_pid = i;
-        CCcont->CDBC_buf = buffer;
-        CCcont->m_action = cont;
-        CCcont->mutex = cont->mutex;
-        CCcont->CDBC_lf = format;
-        SET_CONTINUATION_HANDLER(CCcont, &CongestionDBCont::get_congest_list);
-        eventProcessor.schedule_in(CCcont, SCHEDULE_CONGEST_CONT_INTERVAL, ET_NET);
-        return &CCcont->m_action;
+    char buf[1024];
+    Iter it;
+    int len;
+    CongestionEntry *pEntry = theCongestionDB->first_entry(i, &it);
+    while (pEntry) {
+      if ((pEntry->congested() && pEntry->pRecord->max_connection != 0) || format > 10) {
+        len = pEntry->sprint(buf, 1024, format);
+        buffer->write(buf, len);
       }
+      pEntry = theCongestionDB->next_entry(i, &it);
     }
   }
   return ACTION_RESULT_DONE;
@@ -29,22 +29,48 @@
  ****************************************************************************/
 
 /*
- * CongestionDB is implemented in a Multithread-Safe hash table
- * the Data will be wrote to a disk file for recovery purpose.
+ * CongestionDB is a hash table of the CongestionEntry for every origin
+ * server, consulted on each connection attempt.  Lookups and inserts
+ * never lock: each hash chain is singly linked and its head is only
+ * changed with compare and swap.  Removals (GC, revalidation and the
+ * admin interface) take their partition's mutex so they never race each
+ * other, and a removed node is only freed by a GC pass at least
+ * CONGEST_DB_GC_INTERVAL later, long after any lookup that could still
+ * see it has taken its own reference to the entry.
  */
 #ifndef CongestionDB_H_
 #define CongestionDB_H_
 
 #include "P_EventSystem.h"
-#include "MT_hashtable.h"
 #include "ControlMatcher.h"
 
+#define CONGEST_DB_PARTITION_BITS 6
+#define CONGEST_DB_PARTITIONS (1 << CONGEST_DB_PARTITION_BITS)
+#define CONGEST_DB_GC_INTERVAL HRTIME_SECONDS(10)
 
 class CongestionControlRecord;
 struct CongestionEntry;
 
-typedef MTHashTable<uint64_t, CongestionEntry *>CongestionTable;
-typedef HashTableIteratorState<uint64_t, CongestionEntry *>Iter;
+struct CongestionDBNode
+{
+  uint64_t m_key;
+  CongestionEntry *m_pEntry;    // holds a reference to the entry
+  CongestionDBNode *volatile m_next;
+  volatile int m_removed;
+  ink_hrtime m_retired_at;
+  CongestionDBNode *m_retired_next;
+};
+
+struct CongestionDBIter
+{
+  CongestionDBIter():m_bucket(-1), m_node(NULL)
+  {
+  }
+  int m_bucket;
+  CongestionDBNode *m_node;
+};
+
+typedef CongestionDBIter Iter;
 
 /* API to the outside world */
 // check whether key was congested, store the found entry into pEntry
@@ -56,58 +82,55 @@ void remove_congested_entry(char *buf, MIOBuffer * out_buffer);
 void revalidateCongestionDB();
 void initCongestionDB();
 
-/*
- * CongestRequestParam is the data structure passed to the request
- * to update the congestion db with the appropriate info
- * It is used when the TS missed a try_lock, the request info will be
- * stored in the CongestRequestParam and insert in the to-do list of the
- * approperiate DB partition.
- * The first operation after the TS get the lock for a partition is
- * to run the to do list
- */
-
-struct CongestRequestParam
-{
-  enum Op_t
-  {
-    ADD_RECORD,
-    REMOVE_RECORD,
-    REMOVE_ALL_RECORDS,
-    REVALIDATE_BUCKET
-  };
-
-    CongestRequestParam():m_key(0), m_op(REVALIDATE_BUCKET), m_pEntry(NULL)
-  {
-  }
-
-   ~CongestRequestParam()
-  {
-  }
-
-  uint64_t m_key;
-  Op_t m_op;
-  CongestionEntry *m_pEntry;
-
-  LINK(CongestRequestParam, link);
-};
-
 /* struct declaration and definitions */
-class CongestionDB:public CongestionTable
+class CongestionDB
 {
 public:
   CongestionDB(int tablesize);
    ~CongestionDB();
-  bool congested(uint64_t key);
+
+  // Lock free, the caller must get() the entry it wants to keep
+  CongestionEntry *lookup_entry(uint64_t key);
+  // Lock free, returns the entry already in the table for the key if
+  // there is one, else pEntry, whose reference passes to the table
+  CongestionEntry *insert_entry(uint64_t key, CongestionEntry * pEntry);
 
 // add an entry to the db
   void addRecord(uint64_t key, CongestionEntry * pEntry);
 // remove an entry from the db
   void removeRecord(uint64_t key);
   void removeAllRecords(void);
-  InkAtomicList *todo_lists;
-  void RunTodoList(int buckId);
-  void process(int buckId, CongestRequestParam * param);
-  void revalidateBucket(int buckId);
+  void revalidatePartition(int part);
+  void GC(int part, long now);
+
+  int getSize()
+  {
+    return CONGEST_DB_PARTITIONS;
+  }
+  int getCurSize()
+  {
+    return m_entries;
+  }
+  int part_num(uint64_t key)
+  {
+    return (int) (key & (CONGEST_DB_PARTITIONS - 1));
+  }
+  CongestionEntry *first_entry(int part, Iter * it);
+  CongestionEntry *next_entry(int part, Iter * it);
+
+private:
+  CongestionDBNode *volatile *bucket_for(uint64_t key)
+  {
+    return &m_buckets[part_num(key) * m_part_buckets + (int) ((key >> CONGEST_DB_PARTITION_BITS) % m_part_buckets)];
+  }
+  void unlink(int part, CongestionDBNode *volatile *head, CongestionDBNode * node);
+  void reclaim(int part, ink_hrtime before);
+
+  int m_part_buckets;
+  CongestionDBNode *volatile *m_buckets;
+  ink_mutex m_locks[CONGEST_DB_PARTITIONS];
+  CongestionDBNode *m_retired[CONGEST_DB_PARTITIONS];
+  volatile int m_entries;
 };
 
 extern CongestionDB *theCongestionDB;
@@ -32,6 +32,7 @@
 #include "Main.h"
 #include "CongestionDB.h"
 #include "Congestion.h"
+#include "MT_hashtable.h"
 #include "Error.h"
 
 //-------------------------------------------------------------
@@ -301,18 +302,17 @@ CCFailHistoryTestCont::check_history(bool print)
     rprintf(test, "Content of history\n");
     int e = 0;
     for (int i = 0; i < CONG_HIST_ENTRIES; i++) {
-      e += entry->m_history.bins[i];
-      rprintf(test, "bucket %d => events %d , sum = %d\n", i, entry->m_history.bins[i], e);
+      e += entry->m_history.get_bin_events(i);
+      rprintf(test, "bucket %d => events %d , sum = %d\n", i, entry->m_history.get_bin_events(i), e);
     }
-    fprintf(stderr, "Events: %d, CurIndex: %d, LastEvent: %ld, HistLen: %d, BinLen: %d, Start: %ld\n",
-            entry->m_history.events,
-            entry->m_history.cur_index,
-            entry->m_history.last_event, entry->m_history.length, entry->m_history.bin_len, entry->m_history.start);
+    fprintf(stderr, "Events: %d, LastEvent: %ld, HistLen: %d, BinLen: %d\n",
+            entry->m_history.events(),
+            entry->m_history.last_event, entry->m_history.length, entry->m_history.bin_len);
     char buf[1024];
     entry->sprint(buf, 1024, 10);
     rprintf(test, "%s", buf);
   }
-  if (test_mode == CCFailHistoryTestCont::SIMPLE_TEST && entry->m_history.events == 65536)
+  if (test_mode == CCFailHistoryTestCont::SIMPLE_TEST && entry->m_history.events() == 65536)
     return 0;
   return 0;
 }
@@ -419,7 +419,7 @@ CCCongestionDBTestCont::init()
 {
 // create/clear db
   if (!db)
-    db = new CongestionDB(dbsize / MT_HASHTABLE_PARTITIONS);
+    db = new CongestionDB(256 * 1024);
   else
     db->removeAllRecords();
   if (!rule) {
@@ -438,7 +438,6 @@ CCCongestionDBTestCont::get_congest_list()
   if (db == NULL)
     return 0;
   for (int i = 0; i < db->getSize(); i++) {
-    db->RunTodoList(i);
     char buf[1024];
     Iter it;
 
@@ -537,6 +536,152 @@ EXCLUSIVE_REGRESSION_TEST(Congestion_CongestionDB) (RegressionTest * t, int /* a
   *pstatus = REGRESSION_TEST_INPROGRESS;
 }
 
+//-------------------------------------------------------------
+// Benchmark the CongestionDB under contention
+//-------------------------------------------------------------
+/* Threads hammer a few hot origin servers the way transactions do:
+ * look up the entry, count a connection open and close, and now and
+ * then a connection failure.  Compared against the partition locked
+ * MTHashTable the DB used to be, and checked that no failure or
+ * connection count is lost.
+ */
+typedef MTHashTable<uint64_t, CongestionEntry *> LockedCongestionTable;
+
+struct DBContentionBench
+{
+  CongestionDB *db;             // NULL to use the locked table
+  LockedCongestionTable *locked_db;
+  ink_mutex *locks;             // one per partition of locked_db
+  uint64_t *keys;
+  int nkeys;
+  int loops;
+  int offset;
+  int found;
+};
+
+static void *
+db_contention_bench(void *arg)
+{
+  DBContentionBench *b = (DBContentionBench *) arg;
+
+  for (int i = 0; i < b->loops; i++) {
+    uint64_t key = b->keys[(i + b->offset) % b->nkeys];
+    CongestionEntry *entry;
+
+    if (b->db) {
+      entry = b->db->lookup_entry(key);
+      if (entry)
+        entry->get();
+    } else {
+      ink_mutex *lock = &b->locks[b->locked_db->part_num(key)];
+      ink_mutex_acquire(lock);
+      entry = b->locked_db->lookup_entry(key);
+      if (entry)
+        entry->get();
+      ink_mutex_release(lock);
+    }
+    if (entry == NULL)
+      continue;
+    b->found++;
+    entry->connection_opened();
+    if (i % 16 == 0)
+      entry->failed_at(1000);
+    entry->connection_closed();
+    entry->put();
+  }
+  return NULL;
+}
+
+REGRESSION_TEST(Congestion_DBContention) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  const int nkeys = 16, loops = 200000;
+  CongestionDB *db = new CongestionDB(1024);
+  LockedCongestionTable locked_db(16);
+  ink_mutex locks[MT_HASHTABLE_PARTITIONS];
+  CongestionEntry *entries[nkeys];
+  uint64_t keys[nkeys];
+  CongestionControlRecord *rule = new CongestionControlRecord;
+  int status = REGRESSION_TEST_PASSED;
+
+  rule->fail_window = 300;
+  rule->pRecord = new CongestionControlRecord(*rule);
+  for (int i = 0; i < MT_HASHTABLE_PARTITIONS; i++)
+    ink_mutex_init(&locks[i], "Congestion_DBContention");
+  for (int i = 0; i < nkeys; i++) {
+    IpEndpoint ip;
+    char hostname[INET6_ADDRSTRLEN];
+
+    ats_ip4_set(&ip, htonl(0x0a000001 + i));
+    ats_ip_ntop(&ip.sa, hostname, sizeof(hostname));
+    keys[i] = make_key(hostname, strlen(hostname), &ip.sa, rule->pRecord);
+    entries[i] = new CongestionEntry(hostname, &ip.sa, rule->pRecord, keys[i]);
+    if (db->insert_entry(keys[i], entries[i]) != entries[i])
+      status = REGRESSION_TEST_FAILED;
+    entries[i]->get();
+    locked_db.insert_entry(keys[i], entries[i]);
+  }
+
+  for (int nthreads = 1; nthreads <= 64; nthreads *= 4) {
+    for (int locked = 0; locked < 2; locked++) {
+      DBContentionBench b[64];
+      ink_thread tid[64];
+      int found = 0, failures = 0, connections = 0;
+
+      for (int i = 0; i < nkeys; i++)
+        entries[i]->clearFailHistory();
+      ink_hrtime start = ink_get_hrtime_internal();
+      for (int i = 0; i < nthreads; i++) {
+        b[i].db = locked ? NULL : db;
+        b[i].locked_db = &locked_db;
+        b[i].locks = locks;
+        b[i].keys = keys;
+        b[i].nkeys = nkeys;
+        b[i].loops = loops;
+        b[i].offset = i;
+        b[i].found = 0;
+        tid[i] = ink_thread_create(db_contention_bench, b + i);
+      }
+      for (int i = 0; i < nthreads; i++) {
+        ink_thread_join(tid[i]);
+        found += b[i].found;
+      }
+      ink_hrtime elapsed = ink_get_hrtime_internal() - start;
+
+      for (int i = 0; i < nkeys; i++) {
+        failures += entries[i]->m_history.events(1000);
+        connections += entries[i]->m_num_connections;
+      }
+      // rprintf() only knows %s and %d.
+      rprintf(t, "%d threads %s: %d lookups in %d usecs, %d failures counted\n", nthreads,
+              locked ? "partition locked" : "lock free", nthreads * loops, (int) ink_hrtime_to_usec(elapsed), failures);
+      if (found != nthreads * loops || failures != nthreads * ((loops + 15) / 16) || connections != 0)
+        status = REGRESSION_TEST_FAILED;
+    }
+  }
+
+  // Removed entries stay readable until a later GC frees them
+  CongestionEntry *gone = entries[3];
+  gone->get();
+  db->removeRecord(keys[3]);
+  if (db->lookup_entry(keys[3]) != NULL || db->getCurSize() != nkeys - 1)
+    status = REGRESSION_TEST_FAILED;
+  db->GC(db->part_num(keys[3]), 1000);
+  if (gone->m_ref_count != 3)     // ours, locked_db's and the retired node's
+    status = REGRESSION_TEST_FAILED;
+  gone->put();
+  entries[3]->get();
+  if (db->insert_entry(keys[3], entries[3]) != entries[3])
+    status = REGRESSION_TEST_FAILED;
+
+  for (int i = 0; i < nkeys; i++)
+    entries[i]->put();          // locked_db's reference
+  delete db;
+  for (int i = 0; i < MT_HASHTABLE_PARTITIONS; i++)
+    ink_mutex_destroy(&locks[i]);
+  delete rule;
+  *pstatus = status;
+}
+
 //-------------------------------------------------------------
 // Test the CongestionControl implementation
 //-------------------------------------------------------------
@@ -550,4 +695,5 @@ init_CongestionRegressionTest()
   (void) regressionTest_Congestion_HashTable;
   (void) regressionTest_Congestion_FailHistory;
   (void) regressionTest_Congestion_CongestionDB;
+  (void) regressionTest_Congestion_DBContention;
 }
@@ -92,6 +92,7 @@ HdrHeap::init()
   m_data_start = m_free_start = ((char *) this) + HDR_HEAP_HDR_SIZE;
   m_magic = HDR_BUF_MAGIC_ALIVE;
   m_writeable = true;
+  m_arena_backed = false;
 
   m_next = NULL;
   m_free_size = m_size - HDR_HEAP_HDR_SIZE;
@@ -113,11 +114,16 @@ HdrHeap::init()
 }
 
 HdrHeap *
-new_HdrHeap(int size)
+new_HdrHeap(int size, Arena *arena)
 {
   HdrHeap *h;
   if (size <= HDR_HEAP_DEFAULT_SIZE) {
     size = HDR_HEAP_DEFAULT_SIZE;
+  }
+
+  if (arena) {
+    h = (HdrHeap *)arena->alloc(size, HDR_PTR_SIZE);
+  } else if (size == HDR_HEAP_DEFAULT_SIZE) {
     h = (HdrHeap *)(THREAD_ALLOC(hdrHeapAllocator, this_ethread()));
   } else {
     h = (HdrHeap *)ats_malloc(size);
@@ -130,7 +136,7 @@ new_HdrHeap(int size)
 
   h->m_size = size;
   h->init();
-
+  h->m_arena_backed = (arena != NULL);
 
   return h;
 }
@@ -180,7 +186,10 @@ HdrHeap::destroy()
   for (int i = 0; i < HDR_BUF_RONLY_HEAPS; i++)
     m_ronly_heap[i].m_ref_count_ptr = NULL;
 
-  if (m_size == HDR_HEAP_DEFAULT_SIZE) {
+  if (m_arena_backed) {
+    // The owning arena releases the memory.
+    m_magic = HDR_BUF_MAGIC_DEAD;
+  } else if (m_size == HDR_HEAP_DEFAULT_SIZE) {
     THREAD_FREE(this, hdrHeapAllocator, this_ethread());
   } else {
     ats_free(this);
@@ -647,6 +656,7 @@ HdrHeap::marshal(char *buf, int len)
   marshal_hdr->m_data_start = (char *) HDR_HEAP_HDR_SIZE;       // offset
   marshal_hdr->m_magic = HDR_BUF_MAGIC_MARSHALED;
   marshal_hdr->m_writeable = false;
+  marshal_hdr->m_arena_backed = false;
   marshal_hdr->m_size = ptr_heap_size + HDR_HEAP_HDR_SIZE;
   marshal_hdr->m_next = NULL;
   marshal_hdr->m_free_size = 0;
@@ -879,6 +889,9 @@ HdrHeap::unmarshal(int buf_length, int obj_type, HdrHeapObjImpl ** found_obj, Re
   ink_release_assert(m_free_size == 0);
   ink_release_assert(m_ronly_heap[0].m_heap_start != NULL);
 
+  // Headers marshalled by older versions have garbage in this padding.
+  m_arena_backed = false;
+
   ink_assert(m_free_start == NULL);
 
   // Convert Heap offsets to pointers
@@ -246,6 +246,10 @@ public:
   uint32_t m_size;
 
   bool m_writeable;
+  // Memory for this heap block belongs to an Arena and is released
+  //   with it rather than by destroy().  Lives in what was padding
+  //   so the marshalled layout is unchanged.
+  bool m_arena_backed;
 
   // Overflow block ptr
   //   Overflow blocks are necessary because we can
@@ -488,7 +492,7 @@ HdrHeapSDKHandle::set(const HdrHeapSDKHandle * from)
   m_heap = from->m_heap;
 }
 
-inkcoreapi HdrHeap *new_HdrHeap(int size = HDR_HEAP_DEFAULT_SIZE);
+inkcoreapi HdrHeap *new_HdrHeap(int size = HDR_HEAP_DEFAULT_SIZE, Arena *arena = NULL);
 
 void hdr_heap_test();
 #endif
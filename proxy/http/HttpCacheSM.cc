@@ -173,8 +173,20 @@ HttpCacheSM::state_cache_open_write(int event, void *data)
     break;
 
   case CACHE_EVENT_OPEN_WRITE_FAILED:
+    if (data == (void *) -ECACHE_DOC_BUSY && retry_write && cache_read_vc == NULL &&
+        master_sm->t_state.http_config_param->cache_collapsed_forwarding) {
+      // Another transaction is fetching this miss from the origin.
+      // Open the object for read; the cache parks us on the writer
+      // until it has something to serve.
+      SET_HANDLER(&HttpCacheSM::state_cache_open_write_read);
+      open_read_cb = false;
+      do_cache_open_read();
+      break;
+    }
     // The cache is hosed or full or something.
     // Forward the failure to the main sm
+    if (data == (void *) -ECACHE_DOC_BUSY)
+      HTTP_INCREMENT_DYN_STAT(http_cache_collapse_bypassed_stat);
     open_write_cb = true;
     master_sm->handleEvent(event, data);
     break;
@@ -186,6 +198,50 @@ HttpCacheSM::state_cache_open_write(int event, void *data)
   return VC_EVENT_CONT;
 }
 
+//////////////////////////////////////////////////////////////////////////
+//
+//  HttpCacheSM::state_cache_open_write_read()
+//
+//  The open read issued after a write lock miss when collapsed
+//  forwarding is enabled.  The outcome is reported to the master
+//  state machine as the result of its open write:
+// - CACHE_EVENT_OPEN_READ
+//   - the read was joined to the writer; HttpSM treats this as
+//     CACHE_WL_READ_RETRY and serves the object from the cache
+// - CACHE_EVENT_OPEN_READ_FAILED
+//   - reported as a write lock miss, the request goes to the origin
+//
+//////////////////////////////////////////////////////////////////////////
+int
+HttpCacheSM::state_cache_open_write_read(int event, void *data)
+{
+  STATE_ENTER(&HttpCacheSM::state_cache_open_write_read, event);
+  ink_assert(captive_action.cancelled == 0);
+  pending_action = NULL;
+  open_read_cb = true;
+  open_write_cb = true;
+
+  switch (event) {
+  case CACHE_EVENT_OPEN_READ:
+    HTTP_INCREMENT_DYN_STAT(http_current_cache_connections_stat);
+    HTTP_INCREMENT_DYN_STAT(http_cache_collapsed_stat);
+    ink_assert(cache_read_vc == NULL);
+    cache_read_vc = (CacheVConnection *) data;
+    master_sm->handleEvent(event, data);
+    break;
+
+  case CACHE_EVENT_OPEN_READ_FAILED:
+    HTTP_INCREMENT_DYN_STAT(http_cache_collapse_bypassed_stat);
+    master_sm->handleEvent(CACHE_EVENT_OPEN_WRITE_FAILED, (void *) -ECACHE_DOC_BUSY);
+    break;
+
+  default:
+    ink_release_assert(0);
+  }
+
+  return VC_EVENT_CONT;
+}
+
 void
 HttpCacheSM::do_schedule_in()
 {
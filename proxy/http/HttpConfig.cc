@@ -31,6 +31,7 @@
 #include "ICPProcessor.h"
 #include "P_Net.h"
 #include "P_RecUtils.h"
+#include "HttpLatency.h"
 #include <records/I_RecHttp.h>
 
 #ifndef min
@@ -212,6 +213,47 @@ register_stat_callbacks()
                      "proxy.process.http.current_server_connections",
                      RECD_INT, RECP_NON_PERSISTENT, (int) http_current_server_connections_stat, RecRawStatSyncSum);
   HTTP_CLEAR_DYN_STAT(http_current_server_connections_stat);
+
+  // Keep-alive origin session pool
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_sessions_reused",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_sessions_reused_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_sessions_stolen",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_sessions_stolen_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_session_steal_busy",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_session_steal_busy_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_prewarm.opened",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_prewarm_opened_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_prewarm.failed",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_prewarm_failed_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_prewarm.hits",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_prewarm_hits_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_server_prewarm.expired",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_prewarm_expired_stat, RecRawStatSyncCount);
+
+  // Origin connection limits and queues, summed over all origins
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_connections.limit_decreases",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_limit_decreases_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_connections.queue_depth",
+                     RECD_INT, RECP_NON_PERSISTENT, (int) http_origin_queue_depth_stat, RecRawStatSyncSum);
+  HTTP_CLEAR_DYN_STAT(http_origin_queue_depth_stat);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_connections.queue_admitted",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_queue_admitted_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_connections.queue_wait_ms",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_queue_wait_ms_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.origin_connections.queue_rejected",
+                     RECD_COUNTER, RECP_NULL, (int) http_origin_queue_rejected_stat, RecRawStatSyncSum);
   RecRegisterRawStat(http_rsb, RECT_PROCESS,
                      "proxy.process.http.current_cache_connections",
                      RECD_INT, RECP_NON_PERSISTENT, (int) http_current_cache_connections_stat, RecRawStatSyncSum);
@@ -620,6 +662,14 @@ register_stat_callbacks()
                      "proxy.process.http.total_transactions_think_time",
                      RECD_INT, RECP_NULL, (int) http_total_transactions_think_time_stat, RecRawStatSyncSum);
 
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.transaction_arena_allocations",
+                     RECD_INT, RECP_NULL, (int) http_transaction_arena_allocations_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.transaction_arena_bytes",
+                     RECD_INT, RECP_NULL, (int) http_transaction_arena_bytes_stat, RecRawStatSyncSum);
+
   RecRegisterRawStat(http_rsb, RECT_PROCESS,
                      "proxy.process.http.cache_hit_fresh",
                      RECD_COUNTER, RECP_NULL, (int) http_cache_hit_fresh_stat, RecRawStatSyncCount);
@@ -812,6 +862,14 @@ register_stat_callbacks()
                      "proxy.process.http.cache_read_errors",
                      RECD_INT, RECP_NULL, (int) http_cache_read_errors, RecRawStatSyncSum);
 
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_collapsed",
+                     RECD_INT, RECP_NULL, (int) http_cache_collapsed_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_collapse_bypassed",
+                     RECD_INT, RECP_NULL, (int) http_cache_collapse_bypassed_stat, RecRawStatSyncSum);
+
   ////////////////////////////////////////////////////////////////////////////////
   // status code counts
   ////////////////////////////////////////////////////////////////////////////////
@@ -1118,6 +1176,7 @@ HttpConfig::startup()
   http_rsb = RecAllocateRawStatBlock((int) http_stat_count);
   register_configs();
   register_stat_callbacks();
+  http_latency_init();
 
   HttpConfigParams &c = m_master;
 
@@ -1145,6 +1204,21 @@ HttpConfig::startup()
   HttpEstablishStaticConfigLongLong(c.oride.server_tcp_init_cwnd, "proxy.config.http.server_tcp_init_cwnd");
   HttpEstablishStaticConfigLongLong(c.oride.origin_max_connections, "proxy.config.http.origin_max_connections");
   HttpEstablishStaticConfigLongLong(c.origin_min_keep_alive_connections, "proxy.config.http.origin_min_keep_alive_connections");
+  HttpEstablishStaticConfigByte(c.origin_max_connections_adaptive, "proxy.config.http.origin_max_connections_adaptive");
+  HttpEstablishStaticConfigLongLong(c.origin_max_connections_adaptive_floor,
+                                    "proxy.config.http.origin_max_connections_adaptive_floor");
+  HttpEstablishStaticConfigLongLong(c.origin_max_connections_adaptive_tolerance,
+                                    "proxy.config.http.origin_max_connections_adaptive_tolerance");
+  HttpEstablishStaticConfigLongLong(c.origin_max_connections_queue, "proxy.config.http.origin_max_connections_queue");
+  HttpEstablishStaticConfigLongLong(c.origin_max_connections_queue_timeout,
+                                    "proxy.config.http.origin_max_connections_queue_timeout");
+  HttpEstablishStaticConfigByte(c.server_session_steal, "proxy.config.http.server_session_steal");
+  HttpEstablishStaticConfigLongLong(c.server_session_prewarm_min_idle, "proxy.config.http.server_session_prewarm.min_idle");
+  HttpEstablishStaticConfigLongLong(c.server_session_prewarm_parent_min_idle,
+                                    "proxy.config.http.server_session_prewarm.parent_min_idle");
+  HttpEstablishStaticConfigLongLong(c.server_session_prewarm_max_age, "proxy.config.http.server_session_prewarm.max_age");
+  HttpEstablishStaticConfigLongLong(c.server_session_prewarm_origin_timeout,
+                                    "proxy.config.http.server_session_prewarm.origin_timeout");
 
   HttpEstablishStaticConfigByte(c.parent_proxy_routing_enable, "proxy.config.http.parent_proxy_routing_enable");
 
@@ -1268,6 +1342,7 @@ HttpConfig::startup()
 
   // open write failure retries
   HttpEstablishStaticConfigLongLong(c.max_cache_open_write_retries, "proxy.config.http.cache.max_open_write_retries");
+  HttpEstablishStaticConfigByte(c.cache_collapsed_forwarding, "proxy.config.http.cache.collapsed_forwarding");
 
   HttpEstablishStaticConfigByte(c.oride.cache_http, "proxy.config.http.cache.http");
   HttpEstablishStaticConfigByte(c.oride.cache_cluster_cache_local, "proxy.config.http.cache.cluster_cache_local");
@@ -1421,6 +1496,20 @@ HttpConfig::reconfigure()
     Warning("origin_max_connections < origin_min_keep_alive_connections, setting min=max , please correct your records.config");
     params->origin_min_keep_alive_connections = params->oride.origin_max_connections;
   }
+  params->origin_max_connections_adaptive = INT_TO_BOOL(m_master.origin_max_connections_adaptive);
+  params->origin_max_connections_adaptive_floor = m_master.origin_max_connections_adaptive_floor;
+  params->origin_max_connections_adaptive_tolerance = m_master.origin_max_connections_adaptive_tolerance;
+  if (params->origin_max_connections_adaptive_tolerance < 100) {
+    Warning("origin_max_connections_adaptive_tolerance is under 100%%, using 100%%");
+    params->origin_max_connections_adaptive_tolerance = 100;
+  }
+  params->origin_max_connections_queue = m_master.origin_max_connections_queue;
+  params->origin_max_connections_queue_timeout = m_master.origin_max_connections_queue_timeout;
+  params->server_session_steal = INT_TO_BOOL(m_master.server_session_steal);
+  params->server_session_prewarm_min_idle = m_master.server_session_prewarm_min_idle;
+  params->server_session_prewarm_parent_min_idle = m_master.server_session_prewarm_parent_min_idle;
+  params->server_session_prewarm_max_age = m_master.server_session_prewarm_max_age;
+  params->server_session_prewarm_origin_timeout = m_master.server_session_prewarm_origin_timeout;
 
   params->parent_proxy_routing_enable = INT_TO_BOOL(m_master.parent_proxy_routing_enable);
   params->enable_url_expandomatic = INT_TO_BOOL(m_master.enable_url_expandomatic);
@@ -1536,6 +1625,7 @@ HttpConfig::reconfigure()
 
   // open write failure retries
   params->max_cache_open_write_retries = m_master.max_cache_open_write_retries;
+  params->cache_collapsed_forwarding = INT_TO_BOOL(m_master.cache_collapsed_forwarding);
 
   params->oride.cache_http = INT_TO_BOOL(m_master.oride.cache_http);
   params->oride.cache_cluster_cache_local = INT_TO_BOOL(m_master.oride.cache_cluster_cache_local);
@@ -94,6 +94,18 @@ enum
   http_current_parent_proxy_connections_stat,
   http_current_server_connections_stat,
   http_current_cache_connections_stat,
+  http_origin_sessions_reused_stat,
+  http_origin_sessions_stolen_stat,
+  http_origin_session_steal_busy_stat,
+  http_origin_prewarm_opened_stat,
+  http_origin_prewarm_failed_stat,
+  http_origin_prewarm_hits_stat,
+  http_origin_prewarm_expired_stat,
+  http_origin_limit_decreases_stat,
+  http_origin_queue_depth_stat,
+  http_origin_queue_admitted_stat,
+  http_origin_queue_wait_ms_stat,
+  http_origin_queue_rejected_stat,
 
   // Http K-A Stats
   http_transactions_per_client_con,
@@ -282,6 +294,10 @@ enum
   http_total_transactions_time_stat,
   http_total_transactions_think_time_stat,
 
+  // Per-transaction arena usage
+  http_transaction_arena_allocations_stat,
+  http_transaction_arena_bytes_stat,
+
   http_client_transaction_time_stat,
 
   http_client_write_time_stat,
@@ -297,6 +313,8 @@ enum
   // Http cache errors
   http_cache_write_errors,
   http_cache_read_errors,
+  http_cache_collapsed_stat,
+  http_cache_collapse_bypassed_stat,
 
   // status code stats
   http_response_status_100_count_stat,
@@ -643,6 +661,16 @@ public:
 
   MgmtInt server_max_connections;
   MgmtInt origin_min_keep_alive_connections; // TODO: This one really ought to be overridable, but difficult right now.
+  MgmtByte origin_max_connections_adaptive;
+  MgmtInt origin_max_connections_adaptive_floor;
+  MgmtInt origin_max_connections_adaptive_tolerance;
+  MgmtInt origin_max_connections_queue;
+  MgmtInt origin_max_connections_queue_timeout;
+  MgmtByte server_session_steal;
+  MgmtInt server_session_prewarm_min_idle;
+  MgmtInt server_session_prewarm_parent_min_idle;
+  MgmtInt server_session_prewarm_max_age;
+  MgmtInt server_session_prewarm_origin_timeout;
 
   MgmtByte parent_proxy_routing_enable;
   MgmtByte disable_ssl_parenting;
@@ -709,6 +737,9 @@ public:
   // open write failure retries.
   MgmtInt max_cache_open_write_retries;
 
+  // on a write lock miss, read from the writer instead of going to the origin.
+  MgmtByte cache_collapsed_forwarding;
+
   ///////////////////
   // cache control //
   ///////////////////
@@ -888,6 +919,16 @@ HttpConfigParams::HttpConfigParams()
     proxy_hostname_len(0),
     server_max_connections(0),
     origin_min_keep_alive_connections(0),
+    origin_max_connections_adaptive(0),
+    origin_max_connections_adaptive_floor(2),
+    origin_max_connections_adaptive_tolerance(200),
+    origin_max_connections_queue(0),
+    origin_max_connections_queue_timeout(0),
+    server_session_steal(1),
+    server_session_prewarm_min_idle(0),
+    server_session_prewarm_parent_min_idle(0),
+    server_session_prewarm_max_age(300),
+    server_session_prewarm_origin_timeout(3600),
     parent_proxy_routing_enable(0),
     disable_ssl_parenting(0),
     enable_url_expandomatic(0),
@@ -922,6 +963,7 @@ HttpConfigParams::HttpConfigParams()
     cache_vary_default_images(NULL),
     cache_vary_default_other(NULL),
     max_cache_open_write_retries(1),
+    cache_collapsed_forwarding(0),
     cache_enable_default_vary_headers(0),
     cache_when_to_add_no_cache_to_msie_requests(-1),
     connect_ports_string(NULL),
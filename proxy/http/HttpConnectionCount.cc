@@ -22,6 +22,364 @@
  */
 
 #include "HttpConnectionCount.h"
+#include "HttpConfig.h"
 
+// A host is cut back at most this often, so the requests that were in
+// flight when it slowed down do not each take their own cut.
+#define ORIGIN_DECREASE_INTERVAL HRTIME_MSECONDS(100)
+#define ORIGIN_DECREASE_FACTOR   0.9
+// How long the fastest response of a host is remembered.
+#define ORIGIN_BASELINE_WINDOW   HRTIME_SECONDS(30)
 
 ConnectionCount ConnectionCount::_connectionCount;
+
+ConnectionCount::Policy::Policy(const HttpConfigParams *params, int64_t origin_max)
+  : max(origin_max), adaptive(params->origin_max_connections_adaptive != 0),
+    floor(params->origin_max_connections_adaptive_floor),
+    tolerance(params->origin_max_connections_adaptive_tolerance),
+    queue_max(params->origin_max_connections_queue),
+    queue_timeout(HRTIME_SECONDS(params->origin_max_connections_queue_timeout))
+{
+}
+
+ConnectionCount::Origin *
+ConnectionCount::getOrigin(const IpEndpoint& addr)
+{
+  Origin *origin = _hostCount.get(ConnAddr(addr));
+
+  if (origin == NULL) {
+    origin = new Origin;
+    ats_ip_copy(&origin->addr, &addr);
+    _hostCount.put(ConnAddr(addr), origin);
+  }
+  return origin;
+}
+
+int
+ConnectionCount::currentLimit(Origin *origin, const Policy& policy)
+{
+  if (policy.max <= 0)
+    return 0;
+  if (!policy.adaptive)
+    return policy.max;
+
+  int floor = policy.floor < 1 ? 1 : (policy.floor > policy.max ? policy.max : policy.floor);
+
+  // A new host starts wide open, and max can be changed under us.
+  if (origin->limit == 0 || origin->limit > policy.max)
+    origin->limit = policy.max;
+  if (origin->limit < floor)
+    origin->limit = floor;
+  return (int) origin->limit;
+}
+
+void
+ConnectionCount::dequeue(Origin *origin, Waiter *waiter, ink_hrtime now)
+{
+  origin->waiters.remove(waiter);
+  waiter->origin = NULL;
+  HTTP_SUM_GLOBAL_DYN_STAT(http_origin_queue_depth_stat, -1);
+  if (now) {
+    HTTP_SUM_GLOBAL_DYN_STAT(http_origin_queue_admitted_stat, 1);
+    HTTP_SUM_GLOBAL_DYN_STAT(http_origin_queue_wait_ms_stat, (now - waiter->start) / HRTIME_MSECOND);
+  }
+}
+
+int
+ConnectionCount::getLimit(const IpEndpoint& addr, const Policy& policy)
+{
+  ink_mutex_acquire(&_mutex);
+  int limit = currentLimit(getOrigin(addr), policy);
+  ink_mutex_release(&_mutex);
+  return limit;
+}
+
+ConnectionCount::Admission
+ConnectionCount::admit(const IpEndpoint& addr, const Policy& policy, Waiter *waiter, ink_hrtime now)
+{
+  Admission result;
+
+  ink_mutex_acquire(&_mutex);
+
+  // A waiter keeps a slot it already holds.
+  if (waiter->slot) {
+    ink_mutex_release(&_mutex);
+    return ADMIT;
+  }
+
+  Origin *origin = waiter->origin ? waiter->origin : getOrigin(addr);
+  int limit = currentLimit(origin, policy);
+
+  // Waiters go in order, newcomers may not pass them.  The slot is
+  // taken right here, so waiters that look at once do not all get in.
+  if (limit <= 0 || (origin->count < limit && origin->waiters.head == (waiter->origin ? waiter : NULL))) {
+    if (waiter->origin)
+      dequeue(origin, waiter, now);
+    origin->count++;
+    waiter->slot = origin;
+    result = ADMIT;
+  } else if (waiter->origin) {
+    if (policy.queue_timeout > 0 && now - waiter->start >= policy.queue_timeout) {
+      dequeue(origin, waiter, 0);
+      HTTP_SUM_GLOBAL_DYN_STAT(http_origin_queue_rejected_stat, 1);
+      result = REJECT;
+    } else {
+      result = WAIT;
+    }
+  } else if (policy.queue_max <= 0) {
+    result = WAIT;
+  } else if (origin->waiters.size < policy.queue_max) {
+    waiter->origin = origin;
+    waiter->start = now;
+    origin->waiters.enqueue(waiter);
+    HTTP_SUM_GLOBAL_DYN_STAT(http_origin_queue_depth_stat, 1);
+    result = WAIT;
+  } else {
+    HTTP_SUM_GLOBAL_DYN_STAT(http_origin_queue_rejected_stat, 1);
+    result = REJECT;
+  }
+
+  ink_mutex_release(&_mutex);
+  return result;
+}
+
+void
+ConnectionCount::release(Waiter *waiter)
+{
+  ink_mutex_acquire(&_mutex);
+  if (waiter->slot) {
+    waiter->slot->count--;
+    waiter->slot = NULL;
+  }
+  ink_mutex_release(&_mutex);
+}
+
+void
+ConnectionCount::leave(Waiter *waiter, ink_hrtime now)
+{
+  ink_mutex_acquire(&_mutex);
+  if (waiter->origin)
+    dequeue(waiter->origin, waiter, now);
+  ink_mutex_release(&_mutex);
+}
+
+void
+ConnectionCount::recordResponse(const IpEndpoint& addr, const Policy& policy, ink_hrtime latency, bool error,
+                                ink_hrtime now)
+{
+  if (policy.max <= 0 || !policy.adaptive)
+    return;
+
+  ink_mutex_acquire(&_mutex);
+
+  Origin *origin = getOrigin(addr);
+
+  // The baseline is the fastest response over the last one or two
+  // windows, so a host that got slower for good is not taken as
+  // overloaded for long.
+  if (!error) {
+    if (now - origin->window_start >= ORIGIN_BASELINE_WINDOW) {
+      origin->baseline = origin->window_min;
+      origin->window_min = 0;
+      origin->window_start = now;
+    }
+    if (origin->window_min == 0 || latency < origin->window_min)
+      origin->window_min = latency;
+    if (origin->baseline == 0 || origin->window_min < origin->baseline)
+      origin->baseline = origin->window_min;
+  }
+
+  bool congested = error || latency * 100 > origin->baseline * policy.tolerance;
+
+  // currentLimit() keeps the limit between floor and max.
+  currentLimit(origin, policy);
+  if (congested) {
+    if (now - origin->last_decrease >= ORIGIN_DECREASE_INTERVAL) {
+      origin->limit *= ORIGIN_DECREASE_FACTOR;
+      origin->last_decrease = now;
+      HTTP_SUM_GLOBAL_DYN_STAT(http_origin_limit_decreases_stat, 1);
+    }
+  } else {
+    // About one more connection per limit's worth of good responses.
+    origin->limit += 1 / origin->limit;
+  }
+
+  currentLimit(origin, policy);
+  ink_mutex_release(&_mutex);
+}
+
+#if TS_HAS_TESTS
+#include "TestBox.h"
+
+static void
+test_origin_addr(IpEndpoint *addr, const char *text)
+{
+  ink_zero(*addr);
+  ats_ip_pton(text, addr);
+}
+
+REGRESSION_TEST(HttpConnectionCount_Queue)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  ConnectionCount *cc = ConnectionCount::getInstance();
+  ConnectionCount::Policy policy;
+  ConnectionCount::Waiter w[5];
+  IpEndpoint addr;
+  ink_hrtime now = HRTIME_SECONDS(1000);
+
+  box = REGRESSION_TEST_PASSED;
+  test_origin_addr(&addr, "192.0.2.40");
+  policy.max = 2;
+  policy.queue_max = 3;
+  policy.queue_timeout = HRTIME_SECONDS(1);
+
+  box.check(cc->admit(addr, policy, &w[0], now) == ConnectionCount::ADMIT && w[0].slot, "first connection was not admitted");
+  box.check(cc->admit(addr, policy, &w[1], now) == ConnectionCount::ADMIT && w[1].slot, "second connection was not admitted");
+  box.check(cc->getCount(addr) == 2, "admitted connections were not counted, count is %d", cc->getCount(addr));
+  // Both connections open, their sessions now hold the slots.
+  w[0].slot = w[1].slot = NULL;
+
+  // Over the limit, three wait in line and the fourth is turned away.
+  for (int i = 0; i < 3; i++)
+    box.check(cc->admit(addr, policy, &w[i], now) == ConnectionCount::WAIT && w[i].origin, "waiter %d was not queued", i);
+  box.check(cc->admit(addr, policy, &w[3], now) == ConnectionCount::REJECT, "a full queue took another waiter");
+
+  // A free slot goes to the head of the line only.
+  cc->incrementCount(addr, -1);
+  box.check(cc->admit(addr, policy, &w[1], now) == ConnectionCount::WAIT, "waiter 1 passed waiter 0");
+  box.check(cc->admit(addr, policy, &w[0], now + HRTIME_MSECONDS(20)) == ConnectionCount::ADMIT && !w[0].origin,
+            "the head of the line was not admitted");
+  // The slot is taken as soon as waiter 0 is admitted, so the next in
+  // line cannot have it too while waiter 0 is still connecting.
+  box.check(cc->admit(addr, policy, &w[1], now + HRTIME_MSECONDS(20)) == ConnectionCount::WAIT,
+            "waiter 1 took the slot given to waiter 0");
+  // Waiter 0 fails to connect and gives its slot back.
+  cc->release(&w[0]);
+  box.check(w[0].slot == NULL && cc->getCount(addr) == 1, "a failed connection kept its slot, count is %d",
+            cc->getCount(addr));
+  cc->leave(&w[1]);
+  box.check(w[1].origin == NULL, "waiter 1 did not leave");
+  box.check(cc->admit(addr, policy, &w[2], now + HRTIME_MSECONDS(30)) == ConnectionCount::ADMIT,
+            "waiter 2 was not admitted after waiter 1 left");
+  w[2].slot = NULL;
+
+  // Newcomers queue behind waiters even when there is room.
+  box.check(cc->admit(addr, policy, &w[3], now) == ConnectionCount::WAIT, "waiter 3 was not queued");
+  cc->incrementCount(addr, -1);
+  box.check(cc->admit(addr, policy, &w[4], now) == ConnectionCount::WAIT, "a newcomer passed waiter 3");
+  box.check(cc->admit(addr, policy, &w[3], now + HRTIME_SECONDS(2)) == ConnectionCount::ADMIT,
+            "waiter 3 was not admitted");
+  w[3].slot = NULL;
+
+  // A waiter that sits past the timeout is turned away.
+  box.check(cc->admit(addr, policy, &w[4], now + HRTIME_SECONDS(2)) == ConnectionCount::REJECT && !w[4].origin,
+            "waiter 4 did not time out");
+  box.check(cc->getCount(addr) == 2, "count is %d", cc->getCount(addr));
+  cc->incrementCount(addr, -2);
+}
+
+// A simulated origin that serves 8 requests at a time in 10ms, and gets
+// proportionally slower beyond that, with 64 clients that always have a
+// request ready.
+static void
+simulate_origin(ConnectionCount *cc, const IpEndpoint& addr, const ConnectionCount::Policy& policy,
+                int *limit, int *latency_ms, int *served)
+{
+  static const int CLIENTS = 64;
+  ink_hrtime done[CLIENTS], started[CLIENTS];
+  ConnectionCount::Waiter w[CLIENTS];
+  int inflight = 0, latency_sum = 0, n = 0;
+
+  *served = 0;
+  for (int ms = 0; ms < 20000; ms++) {
+    ink_hrtime now = HRTIME_SECONDS(1000) + HRTIME_MSECONDS(ms);
+
+    for (int i = 0; i < inflight; ) {
+      if (done[i] <= now) {
+        cc->recordResponse(addr, policy, done[i] - started[i], false, now);
+        if (ms >= 10000) {
+          latency_sum += (int) ((done[i] - started[i]) / HRTIME_MSECOND);
+          n++;
+          (*served)++;
+        }
+        cc->release(&w[i]);
+        done[i] = done[--inflight];
+        started[i] = started[inflight];
+        w[i].slot = w[inflight].slot;
+        w[inflight].slot = NULL;
+      } else {
+        i++;
+      }
+    }
+    while (inflight < CLIENTS && cc->admit(addr, policy, &w[inflight], now) == ConnectionCount::ADMIT) {
+      started[inflight] = now;
+      done[inflight] = now + HRTIME_MSECONDS(10) * (inflight + 1 > 8 ? inflight + 1 : 8) / 8;
+      inflight++;
+    }
+  }
+  for (int i = 0; i < inflight; i++)
+    cc->release(&w[i]);
+  *limit = cc->getLimit(addr, policy);
+  *latency_ms = n ? latency_sum / n : 0;
+}
+
+REGRESSION_TEST(HttpConnectionCount_Adaptive)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  ConnectionCount *cc = ConnectionCount::getInstance();
+  ConnectionCount::Policy policy;
+  IpEndpoint addr;
+  ink_hrtime now = HRTIME_SECONDS(1000);
+  int limit, latency, served;
+
+  box = REGRESSION_TEST_PASSED;
+  test_origin_addr(&addr, "192.0.2.41");
+  policy.max = 64;
+  policy.adaptive = true;
+  policy.floor = 2;
+  policy.tolerance = 200;
+
+  box.check(cc->getLimit(addr, policy) == 64, "a new host starts at %d", cc->getLimit(addr, policy));
+  for (int i = 0; i < 100; i++, now += HRTIME_MSECONDS(10))
+    cc->recordResponse(addr, policy, HRTIME_MSECONDS(10), false, now);
+  box.check(cc->getLimit(addr, policy) == 64, "a healthy host went to %d", cc->getLimit(addr, policy));
+
+  // Slow responses cut the limit once per interval, not once per response.
+  for (int i = 0; i < 100; i++)
+    cc->recordResponse(addr, policy, HRTIME_MSECONDS(50), false, now);
+  box.check(cc->getLimit(addr, policy) == 57, "a burst of slow responses took the limit to %d", cc->getLimit(addr, policy));
+  for (int i = 0; i < 100; i++, now += HRTIME_MSECONDS(10))
+    cc->recordResponse(addr, policy, HRTIME_MSECONDS(50), false, now);
+  limit = cc->getLimit(addr, policy);
+  box.check(limit >= 18 && limit <= 22, "a second of slow responses took the limit to %d", limit);
+
+  // Errors take it down to the floor, good responses bring it back.
+  for (int i = 0; i < 100; i++, now += HRTIME_MSECONDS(100))
+    cc->recordResponse(addr, policy, 0, true, now);
+  box.check(cc->getLimit(addr, policy) == 2, "errors took the limit to %d", cc->getLimit(addr, policy));
+  for (int i = 0; i < 1000; i++, now += HRTIME_MSECONDS(1))
+    cc->recordResponse(addr, policy, HRTIME_MSECONDS(10), false, now);
+  limit = cc->getLimit(addr, policy);
+  box.check(limit >= 40 && limit < 64, "1000 good responses brought the limit back to %d", limit);
+  for (int i = 0; i < 2000; i++, now += HRTIME_MSECONDS(1))
+    cc->recordResponse(addr, policy, HRTIME_MSECONDS(10), false, now);
+  box.check(cc->getLimit(addr, policy) == 64, "3000 good responses brought the limit back to %d", cc->getLimit(addr, policy));
+
+  // Against an overloaded origin the adaptive limit keeps latency down
+  // at the same throughput.
+  test_origin_addr(&addr, "192.0.2.42");
+  policy.adaptive = false;
+  simulate_origin(cc, addr, policy, &limit, &latency, &served);
+  rprintf(t, "static limit %d: %d ms latency, %d responses in 10s\n", limit, latency, served);
+  int static_latency = latency, static_served = served;
+
+  test_origin_addr(&addr, "192.0.2.43");
+  policy.adaptive = true;
+  simulate_origin(cc, addr, policy, &limit, &latency, &served);
+  rprintf(t, "adaptive limit %d: %d ms latency, %d responses in 10s\n", limit, latency, served);
+  box.check(limit >= 8 && limit <= 20, "adaptive limit settled at %d", limit);
+  box.check(latency * 2 < static_latency, "adaptive latency %d ms, static %d ms", latency, static_latency);
+  box.check(served * 10 >= static_served * 9, "adaptive served %d, static %d", served, static_served);
+}
+
+#endif // TS_HAS_TESTS
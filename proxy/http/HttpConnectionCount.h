@@ -26,13 +26,60 @@
 #include "Map.h"
 
 #ifndef _HTTP_CONNECTION_COUNT_H_
+#define _HTTP_CONNECTION_COUNT_H_
+
+struct HttpConfigParams;
 
 /**
  * Singleton class to keep track of the number of connections per host
+ *
+ * When origin_max_connections is set it also meters new connections to
+ * each host.  The limit can adapt to how the host is doing (additive
+ * increase on good responses, multiplicative decrease on slow or failed
+ * ones), and transactions over the limit can wait in a bounded FIFO.
  */
 class ConnectionCount
 {
 public:
+  struct Origin;
+
+  /**
+   * How new connections to a host are metered, taken from the
+   * configuration of the transaction asking for one.
+   */
+  struct Policy {
+    int max;                    ///< origin_max_connections, 0 is no limit
+    bool adaptive;              ///< Adapt the limit between floor and max
+    int floor;                  ///< Smallest adaptive limit
+    int tolerance;              ///< Latency over this % of the baseline is congestion
+    int queue_max;              ///< Waiters allowed per host, 0 to poll unordered
+    ink_hrtime queue_timeout;   ///< Longest wait in the queue, 0 for none
+
+    Policy() : max(0), adaptive(false), floor(1), tolerance(200), queue_max(0), queue_timeout(0) { }
+    Policy(const HttpConfigParams *params, int64_t origin_max);
+  };
+
+  /**
+   * A transaction waiting for a connection to a host.  The waiter is
+   * owned by the transaction and is on the host's queue while origin
+   * is set.  It holds one of the host's connection slots while slot is
+   * set.
+   */
+  struct Waiter {
+    Origin *origin;
+    Origin *slot;
+    ink_hrtime start;
+    LINK(Waiter, link);
+
+    Waiter() : origin(NULL), slot(NULL), start(0) { }
+  };
+
+  enum Admission {
+    ADMIT,                      ///< Open the connection now
+    WAIT,                       ///< Try again shortly
+    REJECT                      ///< Queue is full or the wait timed out
+  };
+
   /**
    * Static method to get the instance of the class
    * @return Returns a pointer to the instance of the class
@@ -48,7 +95,8 @@ public:
    */
   int getCount(const IpEndpoint& addr) {
     ink_mutex_acquire(&_mutex);
-    int count = _hostCount.get(ConnAddr(addr));
+    Origin *origin = _hostCount.get(ConnAddr(addr));
+    int count = origin ? origin->count : 0;
     ink_mutex_release(&_mutex);
     return count;
   }
@@ -59,13 +107,48 @@ public:
    * @param delta Default is +1, can be set to negative to decrement
    */
   void incrementCount(const IpEndpoint& addr, const int delta = 1) {
-    ConnAddr caddr(addr);
     ink_mutex_acquire(&_mutex);
-    int count = _hostCount.get(caddr);
-    _hostCount.put(caddr, count + delta);
+    getOrigin(addr)->count += delta;
     ink_mutex_release(&_mutex);
   }
 
+  /**
+   * Gets the limit currently in force for the host
+   * @param policy Metering for the transaction
+   * @return Number of connections allowed, 0 is no limit
+   */
+  int getLimit(const IpEndpoint& addr, const Policy& policy);
+
+  /**
+   * Asks to open a new connection to the host.  On WAIT the caller
+   * retries later with the same waiter, which keeps its place in line.
+   * On ADMIT the waiter holds a slot in the host's count, which the
+   * caller either hands to the new session by clearing waiter->slot or
+   * gives back with release().
+   * @param waiter Owned by the caller, must stay valid until the call
+   *        that does not return WAIT or until leave()
+   */
+  Admission admit(const IpEndpoint& addr, const Policy& policy, Waiter *waiter, ink_hrtime now);
+
+  /**
+   * Gives back the slot taken by admit(), if the waiter still holds one
+   */
+  void release(Waiter *waiter);
+
+  /**
+   * Removes a waiter from its host's queue, if it is on one
+   * @param now Set when the waiter got a connection some other way,
+   *        such as a keep-alive session, so its wait is counted
+   */
+  void leave(Waiter *waiter, ink_hrtime now = 0);
+
+  /**
+   * Feeds the outcome of a request to the host into its adaptive limit
+   * @param latency Time from sending the request to the response header
+   * @param error The host failed, timed out or answered 5xx
+   */
+  void recordResponse(const IpEndpoint& addr, const Policy& policy, ink_hrtime latency, bool error, ink_hrtime now);
+
   struct ConnAddr {
     IpEndpoint _addr;
 
@@ -81,6 +164,25 @@ public:
       static int equal(ConnAddr& a, ConnAddr& b) { return ats_ip_addr_eq(&a._addr, &b._addr); }
   };
 
+  /**
+   * Per host state, never freed
+   */
+  struct Origin {
+    IpEndpoint addr;
+    int count;                  ///< Open connections
+    double limit;               ///< Adaptive limit, 0 until first used
+    ink_hrtime baseline;        ///< Fastest response in the last window
+    ink_hrtime window_min;      ///< Fastest response in this window
+    ink_hrtime window_start;
+    ink_hrtime last_decrease;
+    CountQueue<Waiter> waiters;
+
+    Origin() : count(0), limit(0), baseline(0), window_min(0), window_start(0), last_decrease(0)
+    {
+      ink_zero(addr);
+    }
+  };
+
 private:
   // Hide the constructor and copy constructor
   ConnectionCount() {
@@ -88,8 +190,12 @@ private:
   }
   ConnectionCount(const ConnectionCount & /* x ATS_UNUSED */) { }
 
+  Origin *getOrigin(const IpEndpoint& addr);
+  int currentLimit(Origin *origin, const Policy& policy);
+  void dequeue(Origin *origin, Waiter *waiter, ink_hrtime now);
+
   static ConnectionCount _connectionCount;
-  HashMap<ConnAddr, ConnAddrHashFns, int> _hostCount;
+  HashMap<ConnAddr, ConnAddrHashFns, Origin *> _hostCount;
   ink_mutex _mutex;
 };
 
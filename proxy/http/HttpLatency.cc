@@ -0,0 +1,299 @@
+/** @file
+
+  Latency histograms for HTTP transaction milestones.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+/****************************************************************************
+
+   HttpLatency.cc
+
+   Description:
+       Each event thread counts the milestone deltas of the transactions
+       it finishes into its own histograms (in EThread::thread_private,
+       like the raw stat blocks), so recording takes no locks and no
+       atomics.  The raw stat sync merges the threads and publishes
+       percentiles of the samples seen since the previous sync as
+       proxy.process.http.latency.<metric>.p50 and friends.
+
+ ****************************************************************************/
+
+#include "HttpLatency.h"
+#include "StatSystem.h"
+#include "P_EventSystem.h"
+#include "P_RecUtils.h"
+
+static char const * const latency_metric_names[HTTP_LATENCY_METRIC_COUNT] = {
+  "ua_read_header",
+  "cache_lookup",
+  "dns_lookup",
+  "server_connect",
+  "server_first_byte",
+  "total"
+};
+
+// Stats for each metric: the sample count, then one per percentile.
+static double const latency_percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+static char const * const latency_percentile_names[] = { "p50", "p90", "p99", "p999" };
+static int const LATENCY_STATS_PER_METRIC = 1 + countof(latency_percentiles);
+
+static off_t latency_offset = -1;
+static RecRawStatBlock *latency_rsb = NULL;
+
+// Only used from the raw stat sync.
+static HttpLatencyHistogram latency_last[HTTP_LATENCY_METRIC_COUNT];
+static HttpLatencyHistogram latency_interval[HTTP_LATENCY_METRIC_COUNT];
+
+int
+HttpLatencyHistogram::bucket_index(int64_t usec)
+{
+  if (usec < (1 << SUB_BUCKET_BITS))
+    return usec < 0 ? 0 : static_cast<int>(usec);
+  if (usec >= (static_cast<int64_t>(1) << MAX_VALUE_BITS))
+    return BUCKET_COUNT - 1;
+
+  // Keep the top SUB_BUCKET_BITS bits of the value.
+  int shift = (63 - __builtin_clzll(usec)) - (SUB_BUCKET_BITS - 1);
+  return shift * SUB_BUCKET_HALF + static_cast<int>(usec >> shift);
+}
+
+int64_t
+HttpLatencyHistogram::bucket_max(int idx)
+{
+  if (idx < 2 * SUB_BUCKET_HALF)
+    return idx;
+
+  int shift = idx / SUB_BUCKET_HALF - 1;
+  int64_t mantissa = idx - shift * SUB_BUCKET_HALF;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void
+HttpLatencyHistogram::merge(HttpLatencyHistogram const &h)
+{
+  count += h.count;
+  for (int i = 0; i < BUCKET_COUNT; i++)
+    buckets[i] += h.buckets[i];
+}
+
+void
+HttpLatencyHistogram::difference(HttpLatencyHistogram const &now, HttpLatencyHistogram const &then)
+{
+  count = now.count - then.count;
+  for (int i = 0; i < BUCKET_COUNT; i++)
+    buckets[i] = now.buckets[i] - then.buckets[i];
+}
+
+int64_t
+HttpLatencyHistogram::percentile(double p) const
+{
+  uint64_t total = 0, target, seen = 0;
+  int last = -1;
+
+  // Other threads may be adding to the buckets, so go by what they hold
+  // rather than by count.
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    if (buckets[i]) {
+      total += buckets[i];
+      last = i;
+    }
+  }
+  if (last < 0)
+    return 0;
+
+  target = static_cast<uint64_t>(ceil(p * total));
+  if (target == 0)
+    target = 1;
+  for (int i = 0; i < last; i++) {
+    seen += buckets[i];
+    if (seen >= target)
+      return bucket_max(i);
+  }
+  return bucket_max(last);
+}
+
+static inline HttpLatencyHistogram *
+latency_thread_histograms(EThread *thread)
+{
+  return static_cast<HttpLatencyHistogram *>(ETHREAD_GET_PTR(thread, latency_offset));
+}
+
+static void
+latency_merge_threads(int metric, HttpLatencyHistogram *total)
+{
+  total->clear();
+  for (int i = 0; i < eventProcessor.n_ethreads; i++)
+    total->merge(latency_thread_histograms(eventProcessor.all_ethreads[i])[metric]);
+}
+
+static int
+latency_stat_sync(const char * /* name ATS_UNUSED */, RecDataT data_type, RecData *data,
+                  RecRawStatBlock * /* rsb ATS_UNUSED */, int id)
+{
+  static HttpLatencyHistogram total;
+  int metric = id / LATENCY_STATS_PER_METRIC;
+  int which = id % LATENCY_STATS_PER_METRIC;
+
+  if (which == 0) {
+    // The count is registered ahead of the metric's percentiles, so each
+    // sync pass takes the new interval here before they read it.
+    latency_merge_threads(metric, &total);
+    latency_interval[metric].difference(total, latency_last[metric]);
+    latency_last[metric] = total;
+    RecDataSetFromInk64(data_type, data, total.count);
+  } else if (latency_interval[metric].count) {
+    // An idle interval leaves the last percentiles in place.
+    RecDataSetFromInk64(data_type, data, latency_interval[metric].percentile(latency_percentiles[which - 1]));
+  }
+  return REC_ERR_OKAY;
+}
+
+void
+http_latency_init()
+{
+  char name[128];
+
+  ink_assert(latency_offset == -1);
+  latency_offset = eventProcessor.allocate(HTTP_LATENCY_METRIC_COUNT * sizeof(HttpLatencyHistogram));
+  if (latency_offset == -1) {
+    Warning("not enough thread local space for HTTP latency histograms");
+    return;
+  }
+
+  latency_rsb = RecAllocateRawStatBlock(HTTP_LATENCY_METRIC_COUNT * LATENCY_STATS_PER_METRIC);
+  for (int metric = 0; metric < HTTP_LATENCY_METRIC_COUNT; metric++) {
+    int id = metric * LATENCY_STATS_PER_METRIC;
+
+    snprintf(name, sizeof(name), "proxy.process.http.latency.%s.count", latency_metric_names[metric]);
+    RecRegisterRawStat(latency_rsb, RECT_PROCESS, name, RECD_INT, RECP_NON_PERSISTENT, id, latency_stat_sync);
+    for (unsigned i = 0; i < countof(latency_percentiles); i++) {
+      snprintf(name, sizeof(name), "proxy.process.http.latency.%s.%s", latency_metric_names[metric],
+               latency_percentile_names[i]);
+      RecRegisterRawStat(latency_rsb, RECT_PROCESS, name, RECD_INT, RECP_NON_PERSISTENT, id + 1 + i, latency_stat_sync);
+    }
+  }
+}
+
+static inline void
+latency_add(HttpLatencyHistogram *hists, int metric, ink_hrtime begin, ink_hrtime end)
+{
+  if (begin != 0 && end >= begin)
+    hists[metric].add(ink_hrtime_to_usec(end - begin));
+}
+
+void
+http_latency_record(EThread *thread, TransactionMilestones const &m)
+{
+  if (latency_offset == -1)
+    return;
+
+  HttpLatencyHistogram *hists = latency_thread_histograms(thread);
+
+  latency_add(hists, HTTP_LATENCY_UA_READ_HEADER, m.ua_begin, m.ua_read_header_done);
+  latency_add(hists, HTTP_LATENCY_CACHE_LOOKUP, m.cache_open_read_begin, m.cache_open_read_end);
+  latency_add(hists, HTTP_LATENCY_DNS_LOOKUP, m.dns_lookup_begin, m.dns_lookup_end);
+  latency_add(hists, HTTP_LATENCY_SERVER_CONNECT, m.server_connect, m.server_connect_end);
+  latency_add(hists, HTTP_LATENCY_SERVER_FIRST_BYTE, m.server_begin_write, m.server_first_read);
+  latency_add(hists, HTTP_LATENCY_TOTAL, m.sm_start, m.sm_finish);
+}
+
+void
+http_latency_snapshot(HttpLatencyHistogram hists[HTTP_LATENCY_METRIC_COUNT])
+{
+  for (int metric = 0; metric < HTTP_LATENCY_METRIC_COUNT; metric++) {
+    if (latency_offset == -1)
+      hists[metric].clear();
+    else
+      latency_merge_threads(metric, &hists[metric]);
+  }
+}
+
+const char *
+http_latency_metric_name(int metric)
+{
+  return (metric >= 0 && metric < HTTP_LATENCY_METRIC_COUNT) ? latency_metric_names[metric] : "unknown";
+}
+
+#if TS_HAS_TESTS
+#include "TestBox.h"
+
+REGRESSION_TEST(HttpLatency_Histogram)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  HttpLatencyHistogram *h = static_cast<HttpLatencyHistogram *>(ats_malloc(sizeof(HttpLatencyHistogram)));
+  int prev = 0;
+
+  box = REGRESSION_TEST_PASSED;
+
+  // Buckets are contiguous and ascending.
+  for (int idx = 0; idx < HttpLatencyHistogram::BUCKET_COUNT - 1; idx++) {
+    int64_t max = HttpLatencyHistogram::bucket_max(idx);
+
+    if (HttpLatencyHistogram::bucket_index(max) != idx || HttpLatencyHistogram::bucket_index(max + 1) != idx + 1) {
+      box.check(false, "bucket %d ends at %d, which is in bucket %d", idx, (int) max,
+                HttpLatencyHistogram::bucket_index(max));
+      break;
+    }
+  }
+
+  // A value's bucket reports it within 1/16.
+  for (int64_t v = 0; v < (static_cast<int64_t>(1) << HttpLatencyHistogram::MAX_VALUE_BITS); v += 1 + v / 7) {
+    int idx = HttpLatencyHistogram::bucket_index(v);
+    int64_t max = HttpLatencyHistogram::bucket_max(idx);
+
+    if (idx < prev || max < v || max - v > v / 16) {
+      box.check(false, "value %d is in bucket %d (max %d) after bucket %d", (int) v, idx, (int) max, prev);
+      break;
+    }
+    prev = idx;
+  }
+  box.check(HttpLatencyHistogram::bucket_index(INT64_MAX) == HttpLatencyHistogram::BUCKET_COUNT - 1,
+            "large values do not land in the last bucket");
+  box.check(HttpLatencyHistogram::bucket_index(-5) == 0, "negative values do not land in the first bucket");
+
+  // 1..1000 once each, plus one outlier.
+  h->clear();
+  box.check(h->percentile(0.5) == 0, "empty histogram has a median");
+  for (int v = 1; v <= 1000; v++)
+    h->add(v);
+  h->add(5000000);
+
+  int64_t p50 = h->percentile(0.5), p99 = h->percentile(0.99), p999 = h->percentile(0.999), pmax = h->percentile(1.0);
+  box.check(p50 >= 500 && p50 <= 500 + 500 / 16, "p50 is %d", (int) p50);
+  box.check(p99 >= 990 && p99 <= 990 + 990 / 16, "p99 is %d", (int) p99);
+  box.check(p999 >= 1000 && p999 <= 1000 + 1000 / 16, "p999 is %d", (int) p999);
+  box.check(pmax >= 5000000 && pmax <= 5000000 + 5000000 / 16, "max is %d", (int) pmax);
+
+  HttpLatencyHistogram *d = static_cast<HttpLatencyHistogram *>(ats_malloc(sizeof(HttpLatencyHistogram)));
+  HttpLatencyHistogram *then = static_cast<HttpLatencyHistogram *>(ats_malloc(sizeof(HttpLatencyHistogram)));
+
+  *then = *h;
+  for (int v = 0; v < 10; v++)
+    h->add(200000);
+  d->difference(*h, *then);
+  box.check(d->count == 10 && d->percentile(0.5) >= 200000 && d->percentile(0.5) <= 200000 + 200000 / 16,
+            "interval holds %d samples with median %d", (int) d->count, (int) d->percentile(0.5));
+
+  ats_free(then);
+  ats_free(d);
+  ats_free(h);
+}
+
+#endif // TS_HAS_TESTS
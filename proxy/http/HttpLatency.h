@@ -0,0 +1,99 @@
+/** @file
+
+  Latency histograms for HTTP transaction milestones.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef _HTTP_LATENCY_H_
+#define _HTTP_LATENCY_H_
+
+#include "libts.h"
+
+class EThread;
+class TransactionMilestones;
+
+/// The milestone deltas that are tracked.
+enum HttpLatencyMetric
+{
+  HTTP_LATENCY_UA_READ_HEADER,      ///< ua_begin -> ua_read_header_done
+  HTTP_LATENCY_CACHE_LOOKUP,        ///< cache_open_read_begin -> cache_open_read_end
+  HTTP_LATENCY_DNS_LOOKUP,          ///< dns_lookup_begin -> dns_lookup_end
+  HTTP_LATENCY_SERVER_CONNECT,      ///< server_connect -> server_connect_end
+  HTTP_LATENCY_SERVER_FIRST_BYTE,   ///< server_begin_write -> server_first_read
+  HTTP_LATENCY_TOTAL,               ///< sm_start -> sm_finish
+  HTTP_LATENCY_METRIC_COUNT
+};
+
+/** A log-linear histogram of microsecond values.
+
+    Values below 2^SUB_BUCKET_BITS get a bucket each. Above that every
+    power of two is split into 2^(SUB_BUCKET_BITS - 1) equal buckets, so a
+    reported value is within about 6% of the recorded one (the same idea
+    as an HDR histogram with a fixed range). Anything past the top bucket
+    (about 19 hours) is counted there.
+ */
+struct HttpLatencyHistogram
+{
+  static int const SUB_BUCKET_BITS = 5;
+  static int const SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+  static int const MAX_VALUE_BITS = 36;
+  static int const BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF;
+
+  uint64_t count;
+  uint64_t buckets[BUCKET_COUNT];
+
+  void clear() { memset(this, 0, sizeof(*this)); }
+
+  void add(int64_t usec)
+  {
+    ++buckets[bucket_index(usec)];
+    ++count;
+  }
+
+  /// Add the samples in @a h to this histogram.
+  void merge(HttpLatencyHistogram const &h);
+  /// Set this histogram to the samples in @a now that are not in @a then.
+  void difference(HttpLatencyHistogram const &now, HttpLatencyHistogram const &then);
+  /** The smallest bucket value at or above the @a p fraction of samples.
+      @return The bucket's highest value, or 0 if there are no samples.
+   */
+  int64_t percentile(double p) const;
+
+  static int bucket_index(int64_t usec);
+  /// The largest value that lands in bucket @a idx.
+  static int64_t bucket_max(int idx);
+};
+
+/** Reserve the per thread histograms and register the
+    proxy.process.http.latency.* stats.  Call once, before the event
+    threads start.
+ */
+void http_latency_init();
+
+/// Count the milestone deltas of a finished transaction on @a thread.
+void http_latency_record(EThread *thread, TransactionMilestones const &milestones);
+
+/// Merge every thread's histograms since startup into @a hists.
+void http_latency_snapshot(HttpLatencyHistogram hists[HTTP_LATENCY_METRIC_COUNT]);
+
+/// The stat name component for @a metric, e.g. "total".
+const char *http_latency_metric_name(int metric);
+
+#endif
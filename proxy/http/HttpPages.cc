@@ -33,6 +33,7 @@
 #include "HttpPages.h"
 #include "HttpSM.h"
 #include "HttpDebugNames.h"
+#include "HttpLatency.h"
 
 HttpSMListBucket HttpSMList[HTTP_LIST_BUCKETS];
 
@@ -58,6 +59,9 @@ HttpPagesHandler::HttpPagesHandler(Continuation * cont, HTTPHdr * header)
     request = arena.str_store(request, length);
     SET_HANDLER(&HttpPagesHandler::handle_smdetails);
 
+  } else if (strncmp(request, "latency", sizeof("latency")) == 0) {
+    SET_HANDLER(&HttpPagesHandler::handle_latency);
+
   } else {
     SET_HANDLER(&HttpPagesHandler::handle_smlist);
   }
@@ -427,6 +431,57 @@ HttpPagesHandler::handle_smlist(int event, void */* data ATS_UNUSED */)
   return EVENT_DONE;
 }
 
+int
+HttpPagesHandler::handle_latency(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+{
+  static double const percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  HttpLatencyHistogram *hists =
+    static_cast<HttpLatencyHistogram *>(ats_malloc(HTTP_LATENCY_METRIC_COUNT * sizeof(HttpLatencyHistogram)));
+
+  http_latency_snapshot(hists);
+
+  resp_begin("Http:Latency");
+  resp_add("<h3> Transaction latency since startup (microseconds) </h3>\n");
+  resp_begin_table(1, 6, 60);
+
+  resp_begin_row();
+  resp_begin_column();
+  resp_add("metric");
+  resp_end_column();
+  resp_begin_column();
+  resp_add("count");
+  resp_end_column();
+  for (unsigned i = 0; i < countof(percentiles); i++) {
+    resp_begin_column();
+    resp_add("p%g", percentiles[i] * 100);
+    resp_end_column();
+  }
+  resp_end_row();
+
+  for (int metric = 0; metric < HTTP_LATENCY_METRIC_COUNT; metric++) {
+    resp_begin_row();
+    resp_begin_column();
+    resp_add("%s", http_latency_metric_name(metric));
+    resp_end_column();
+    resp_begin_column();
+    resp_add("%" PRIu64, hists[metric].count);
+    resp_end_column();
+    for (unsigned i = 0; i < countof(percentiles); i++) {
+      resp_begin_column();
+      resp_add("%" PRId64, hists[metric].percentile(percentiles[i]));
+      resp_end_column();
+    }
+    resp_end_row();
+  }
+
+  resp_end_table();
+  resp_end();
+  ats_free(hists);
+  handle_callback(EVENT_NONE, NULL);
+
+  return EVENT_DONE;
+}
+
 int
 HttpPagesHandler::handle_callback(int /* event ATS_UNUSED */, void * /* edata ATS_UNUSED */)
 {
@@ -40,6 +40,7 @@
 #include "Transform.h"
 
 #include "HttpPages.h"
+#include "HttpLatency.h"
 
 //#include "I_Auth.h"
 //#include "HttpAuthParams.h"
@@ -618,7 +619,7 @@ HttpSM::attach_client_session(HttpClientSession * client_vc, IOBufferReader * bu
   ua_buffer_reader = buffer_reader;
   ua_entry->vc_handler = &HttpSM::state_read_client_request_header;
   t_state.hdr_info.client_request.destroy();
-  t_state.hdr_info.client_request.create(HTTP_TYPE_REQUEST);
+  t_state.hdr_create(&t_state.hdr_info.client_request, HTTP_TYPE_REQUEST);
   http_parser_init(&http_parser);
 
   // Prepare raw reader which will live until we are sure this is HTTP indeed
@@ -980,7 +981,7 @@ HttpSM::setup_push_read_response_header()
   // Note: we must use destroy() here since clear()
   //  does not free the memory from the header
   t_state.hdr_info.server_response.destroy();
-  t_state.hdr_info.server_response.create(HTTP_TYPE_RESPONSE);
+  t_state.hdr_create(&t_state.hdr_info.server_response, HTTP_TYPE_RESPONSE);
   http_parser_clear(&http_parser);
 
   // We already done the READ when we read the client
@@ -1119,6 +1120,9 @@ HttpSM::state_raw_http_server_open(int event, void *data)
   NetVConnection *netvc = NULL;
 
   pending_action = NULL;
+  // Raw connections are not counted against the origin.
+  if (origin_waiter.slot)
+    ConnectionCount::getInstance()->release(&origin_waiter);
   switch (event) {
   case NET_EVENT_OPEN:
 
@@ -1154,6 +1158,10 @@ HttpSM::state_raw_http_server_open(int event, void *data)
   case CONGESTION_EVENT_CONGESTED_ON_M:
     t_state.current.state = HttpTransact::CONGEST_CONTROL_CONGESTED_ON_M;
     break;
+  case EVENT_INTERVAL:
+    // Waited for room under origin_max_connections
+    do_http_server_open(true);
+    return 0;
 
   default:
     ink_release_assert(0);
@@ -1668,6 +1676,11 @@ HttpSM::state_http_server_open(int event, void *data)
   pending_action = NULL;
   milestones.server_connect_end = ink_get_hrtime();
   HttpServerSession *session;
+  bool counted = false;
+
+  // A connection that failed gives back the slot it was admitted with.
+  if (event != NET_EVENT_OPEN && origin_waiter.slot)
+    ConnectionCount::getInstance()->release(&origin_waiter);
 
   switch (event) {
   case NET_EVENT_OPEN:
@@ -1675,6 +1688,7 @@ HttpSM::state_http_server_open(int event, void *data)
       THREAD_ALLOC_INIT(httpServerSessionAllocator, mutex->thread_holding) :
       httpServerSessionAllocator.alloc();
     session->share_session = t_state.txn_conf->share_server_sessions;
+    session->is_ssl = (t_state.scheme == URL_WKSIDX_HTTPS);
 
     // If origin_max_connections or origin_min_keep_alive_connections is
     // set then we are metering the max and or min number
@@ -1686,12 +1700,21 @@ HttpSM::state_http_server_open(int event, void *data)
       DebugSM("http_ss", "[%" PRId64 "] max number of connections: %" PRIu64, sm_id, t_state.txn_conf->origin_max_connections);
       session->enable_origin_connection_limiting = true;
     }
+    // The session takes over the slot this connection was admitted with.
+    if (origin_waiter.slot) {
+      if (session->enable_origin_connection_limiting) {
+        origin_waiter.slot = NULL;
+        counted = true;
+      } else {
+        ConnectionCount::getInstance()->release(&origin_waiter);
+      }
+    }
     /*UnixNetVConnection * vc = (UnixNetVConnection*)(ua_session->client_vc);
        UnixNetVConnection *server_vc = (UnixNetVConnection*)data;
        printf("client fd is :%d , server fd is %d\n",vc->con.fd,
        server_vc->con.fd); */
     ats_ip_copy(&session->server_ip, &t_state.current.server->addr);
-    session->new_connection((NetVConnection *) data);
+    session->new_connection((NetVConnection *) data, counted);
     ats_ip_port_cast(&session->server_ip) = htons(t_state.current.server->port);
     session->state = HSS_ACTIVE;
 
@@ -1712,6 +1735,7 @@ HttpSM::state_http_server_open(int event, void *data)
   case VC_EVENT_ERROR:
   case NET_EVENT_OPEN_FAILED:
     t_state.current.state = HttpTransact::CONNECTION_ERROR;
+    record_origin_response(true);
     call_transact_and_set_next_state(HttpTransact::HandleResponse);
     return 0;
   case CONGESTION_EVENT_CONGESTED_ON_F:
@@ -1816,6 +1840,8 @@ HttpSM::state_read_server_response_header(int event, void *data)
     server_entry->read_vio->nbytes = server_entry->read_vio->ndone;
     http_parser_clear(&http_parser);
     milestones.server_read_header_done = ink_get_hrtime();
+    record_origin_response(state != PARSE_DONE ||
+                           t_state.hdr_info.server_response.status_get() >= HTTP_STATUS_INTERNAL_SERVER_ERROR);
   }
 
   switch (state) {
@@ -2686,7 +2712,7 @@ HttpSM::tunnel_handler_100_continue(int event, void *data)
       // Since 100 isn't a final (loggable) response header
       //   kill the 100 continue header and create an empty one
       t_state.hdr_info.server_response.destroy();
-      t_state.hdr_info.server_response.create(HTTP_TYPE_RESPONSE);
+      t_state.hdr_create(&t_state.hdr_info.server_response, HTTP_TYPE_RESPONSE);
       handle_server_setup_error(VC_EVENT_EOS, server_entry->read_vio);
     } else {
       setup_server_read_response_header();
@@ -4519,6 +4545,8 @@ HttpSM::do_http_server_open(bool raw)
     switch (shared_result) {
     case HSM_DONE:
       hsm_release_assert(server_session != NULL);
+      if (origin_waiter.origin)
+        ConnectionCount::getInstance()->leave(&origin_waiter, ink_get_hrtime());
       handle_http_server_open();
       return;
     case HSM_NOT_FOUND:
@@ -4588,13 +4616,26 @@ HttpSM::do_http_server_open(bool raw)
   // host.
   if (t_state.txn_conf->origin_max_connections > 0) {
     ConnectionCount *connections = ConnectionCount::getInstance();
+    ConnectionCount::Policy policy(t_state.http_config_param, t_state.txn_conf->origin_max_connections);
 
     char addrbuf[INET6_ADDRSTRLEN];
-    if (connections->getCount((t_state.current.server->addr)) >= t_state.txn_conf->origin_max_connections) {
-      DebugSM("http", "[%" PRId64 "] over the number of connection for this host: %s", sm_id,
-        ats_ip_ntop(&t_state.current.server->addr.sa, addrbuf, sizeof(addrbuf)));
+    switch (connections->admit(t_state.current.server->addr, policy, &origin_waiter, milestones.server_connect)) {
+    case ConnectionCount::ADMIT:
+      break;
+    case ConnectionCount::WAIT:
+      DebugSM("http", "[%" PRId64 "] over the number of connection for this host: %s%s", sm_id,
+        ats_ip_ntop(&t_state.current.server->addr.sa, addrbuf, sizeof(addrbuf)),
+        origin_waiter.origin ? ", queued" : "");
+      // Queued transactions look again soon so the head of the line
+      //   does not sit on a free slot
       ink_assert(pending_action == NULL);
-      pending_action = eventProcessor.schedule_in(this, HRTIME_MSECONDS(100));
+      pending_action = eventProcessor.schedule_in(this, HRTIME_MSECONDS(origin_waiter.origin ? 10 : 100));
+      return;
+    case ConnectionCount::REJECT:
+      DebugSM("http", "[%" PRId64 "] no room in the connection queue for this host: %s", sm_id,
+        ats_ip_ntop(&t_state.current.server->addr.sa, addrbuf, sizeof(addrbuf)));
+      t_state.current.state = HttpTransact::OUTBOUND_CONGESTION;
+      call_transact_and_set_next_state(raw ? HttpTransact::OriginServerRawOpen : HttpTransact::HandleResponse);
       return;
     }
   }
@@ -4680,6 +4721,29 @@ HttpSM::do_http_server_open(bool raw)
 }
 
 
+// void HttpSM::record_origin_response(bool error)
+//
+//   Feeds how the server did on this request into its adaptive
+//    connection limit.  Latency runs from sending the request to
+//    reading the response header.
+//
+void
+HttpSM::record_origin_response(bool error)
+{
+  if (t_state.txn_conf->origin_max_connections <= 0 || !t_state.http_config_param->origin_max_connections_adaptive)
+    return;
+  // Plugin intercepts have no server address
+  if (!ats_is_ip(&t_state.current.server->addr))
+    return;
+
+  ConnectionCount::Policy policy(t_state.http_config_param, t_state.txn_conf->origin_max_connections);
+  ink_hrtime now = ink_get_hrtime();
+  ink_hrtime latency = milestones.server_begin_write ? now - milestones.server_begin_write : 0;
+
+  ConnectionCount::getInstance()->recordResponse(t_state.current.server->addr, policy, latency, error, now);
+}
+
+
 void
 HttpSM::do_icp_lookup()
 {
@@ -5116,6 +5180,12 @@ HttpSM::handle_server_setup_error(int event, void *data)
     ink_release_assert(0);
   }
 
+  // A server that closes on us is usually an idle keep-alive
+  //   connection, not a sign of overload
+  if (event != VC_EVENT_EOS) {
+    record_origin_response(true);
+  }
+
   // Closedown server connection and deallocate buffers
   ink_assert(server_entry->in_tunnel == false);
   vc_table.cleanup_entry(server_entry);
@@ -5608,7 +5678,7 @@ HttpSM::setup_server_read_response_header()
   // Note: we must use destroy() here since clear()
   //  does not free the memory from the header
   t_state.hdr_info.server_response.destroy();
-  t_state.hdr_info.server_response.create(HTTP_TYPE_RESPONSE);
+  t_state.hdr_create(&t_state.hdr_info.server_response, HTTP_TYPE_RESPONSE);
   http_parser_clear(&http_parser);
   server_response_hdr_bytes = 0;
   milestones.server_read_header_done = 0;
@@ -6399,6 +6469,12 @@ HttpSM::kill_this()
       pending_action->cancel();
       pending_action = NULL;
     }
+    // Give up our place in line for an origin connection, or the slot
+    //   we were admitted with if the connect never finished
+    if (origin_waiter.origin)
+      ConnectionCount::getInstance()->leave(&origin_waiter);
+    if (origin_waiter.slot)
+      ConnectionCount::getInstance()->release(&origin_waiter);
 
     cache_sm.end_both();
     if (second_cache_sm)
@@ -6544,6 +6620,8 @@ HttpSM::update_stats()
 
   ink_hrtime total_time = milestones.sm_finish - milestones.sm_start;
 
+  http_latency_record(this_ethread(), milestones);
+
   // request_process_time  = The time after the header is parsed to the completion of the transaction
   ink_hrtime request_process_time = milestones.ua_close - milestones.ua_read_header_done;
 
@@ -7001,7 +7079,7 @@ HttpSM::set_next_state()
       if (transform_info.vc) {
         ink_assert(t_state.hdr_info.client_response.valid() == 0);
         ink_assert((t_state.hdr_info.transform_response.valid()? true : false) == true);
-        t_state.hdr_info.cache_response.create(HTTP_TYPE_RESPONSE);
+        t_state.hdr_create(&t_state.hdr_info.cache_response, HTTP_TYPE_RESPONSE);
         t_state.hdr_info.cache_response.copy(&t_state.hdr_info.transform_response);
 
         HttpTunnelProducer *p = setup_cache_transfer_to_transform();
@@ -7009,7 +7087,7 @@ HttpSM::set_next_state()
         tunnel.tunnel_run(p);
       } else {
         ink_assert((t_state.hdr_info.client_response.valid()? true : false) == true);
-        t_state.hdr_info.cache_response.create(HTTP_TYPE_RESPONSE);
+        t_state.hdr_create(&t_state.hdr_info.cache_response, HTTP_TYPE_RESPONSE);
         t_state.hdr_info.cache_response.copy(&t_state.hdr_info.client_response);
 
         perform_cache_write_action();
@@ -42,6 +42,7 @@
 #include "StatSystem.h"
 #include "HttpClientSession.h"
 #include "HdrUtils.h"
+#include "HttpConnectionCount.h"
 //#include "AuthHttpAdapter.h"
 
 /* Enable LAZY_BUF_ALLOC to delay allocation of buffers until they
@@ -333,6 +334,7 @@ protected:
   HttpSMHandler default_handler;
   Action *pending_action;
   Action *historical_action;
+  ConnectionCount::Waiter origin_waiter;
   Continuation *schedule_cont;
 
   HTTPParser http_parser;
@@ -406,6 +408,7 @@ protected:
   void do_hostdb_reverse_lookup();
   void do_cache_lookup_and_read();
   void do_http_server_open(bool raw = false);
+  void record_origin_response(bool error);
   void do_setup_post_tunnel(HttpVC_t to_vc_type);
   void do_cache_prepare_write();
   void do_cache_prepare_write_transform();
@@ -58,7 +58,7 @@ HttpServerSession::destroy()
 }
 
 void
-HttpServerSession::new_connection(NetVConnection *new_vc)
+HttpServerSession::new_connection(NetVConnection *new_vc, bool counted)
 {
   ink_assert(new_vc != NULL);
   server_vc = new_vc;
@@ -68,6 +68,7 @@ HttpServerSession::new_connection(NetVConnection *new_vc)
 
   // Unique client session identifier.
   con_id = ink_atomic_increment((int64_t *) (&next_ss_id), 1);
+  create_time = ink_get_hrtime();
 
   magic = HTTP_SS_MAGIC_ALIVE;
   HTTP_SUM_GLOBAL_DYN_STAT(http_current_server_connections_stat, 1); // Update the true global stat
@@ -77,7 +78,10 @@ HttpServerSession::new_connection(NetVConnection *new_vc)
   if (enable_origin_connection_limiting == true) {
     if (connection_count == NULL)
       connection_count = ConnectionCount::getInstance();
-    connection_count->incrementCount(server_ip);
+    // A connection admitted under origin_max_connections was counted
+    // when it was admitted.
+    if (!counted)
+      connection_count->incrementCount(server_ip);
     char addrbuf[INET6_ADDRSTRLEN];
     Debug("http_ss", "[%" PRId64 "] new connection, ip: %s, count: %u", 
         con_id, 
@@ -72,7 +72,8 @@ public:
       hostname_hash(),
       host_hash_computed(false), con_id(0), transact_count(0),
       state(HSS_INIT), to_parent_proxy(false), server_trans_stat(0),
-      private_session(false), share_session(0),
+      private_session(false), share_session(0), is_ssl(false),
+      prewarmed(false), create_time(0),
       enable_origin_connection_limiting(false),
       connection_count(NULL), read_buffer(NULL),
       server_vc(NULL), magic(HTTP_SS_MAGIC_DEAD), buf_reader(NULL)
@@ -81,7 +82,7 @@ public:
     }
 
   void destroy();
-  void new_connection(NetVConnection *new_vc);
+  void new_connection(NetVConnection *new_vc, bool counted = false);
 
   void reset_read_buffer(void)
   {
@@ -140,6 +141,15 @@ public:
   // Copy of the owning SM's share_server_session setting
   int share_session;
 
+  // Connected with sslNetProcessor
+  bool is_ssl;
+
+  // Opened by the pre-warmer and not yet used by a transaction
+  bool prewarmed;
+
+  // When the connection was made, for the pre-warmer's max age
+  ink_hrtime create_time;
+
   LINK(HttpServerSession, lru_link);
   LINK(HttpServerSession, hash_link);
 
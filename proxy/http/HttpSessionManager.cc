@@ -150,6 +150,8 @@ HttpSessionManager::init()
   for (int i = 0; i < HSM_LEVEL1_BUCKETS; i++) {
     g_l1_hash[i].mutex = new_ProxyMutex();
   }
+  prewarm.mutex = new_ProxyMutex();
+  eventProcessor.schedule_every(&prewarm, HRTIME_SECONDS(1), ET_NET);
 }
 
 // TODO: Should this really purge all keep-alive sessions?
@@ -175,6 +177,89 @@ HttpSessionManager::purge_keepalives()
   }
 }
 
+static int
+_count_idle_sessions(SessionBucket *bucket, sockaddr const* ip, INK_MD5 &hostname_hash)
+{
+  int count = 0;
+
+  for (HttpServerSession *s = bucket->l2_hash[SECOND_LEVEL_HASH(ip)].head; s; s = s->hash_link.next) {
+    if (ats_ip_addr_eq(&s->server_ip.sa, ip) && ats_ip_port_cast(ip) == ats_ip_port_cast(&s->server_ip) &&
+        hostname_hash == s->hostname_hash)
+      ++count;
+  }
+  return count;
+}
+
+int
+HttpSessionManager::count_idle_sessions(sockaddr const* ip, INK_MD5 &hostname_hash, int share_mode)
+{
+  EThread *ethread = this_ethread();
+  int l1_index = FIRST_LEVEL_HASH(ip);
+  int count = 0;
+
+  if (2 == share_mode) {
+    for (int i = 0; i < eventProcessor.n_ethreads; i++) {
+      EThread *t = eventProcessor.all_ethreads[i];
+
+      if (t->l1_hash == NULL)
+        continue;
+
+      SessionBucket *bucket = t->l1_hash + l1_index;
+      MUTEX_TRY_LOCK(lock, bucket->mutex, ethread);
+      if (!lock)
+        return -1;
+      count += _count_idle_sessions(bucket, ip, hostname_hash);
+    }
+  } else {
+    SessionBucket *bucket = g_l1_hash + l1_index;
+    MUTEX_TRY_LOCK(lock, bucket->mutex, ethread);
+    if (!lock)
+      return -1;
+    count = _count_idle_sessions(bucket, ip, hostname_hash);
+  }
+  return count;
+}
+
+static void
+_close_aged_sessions(SessionBucket *bucket, ink_hrtime created_before, EThread *ethread)
+{
+  MUTEX_TRY_LOCK(lock, bucket->mutex, ethread);
+  if (!lock)
+    return;                     // Next pass
+
+  HttpServerSession *s = bucket->lru_list.head;
+  while (s) {
+    HttpServerSession *next = s->lru_link.next;
+
+    if (s->create_time < created_before) {
+      Debug("http_ss", "[%" PRId64 "] [prewarm] closing session past its max age", s->con_id);
+      bucket->lru_list.remove(s);
+      bucket->l2_hash[SECOND_LEVEL_HASH(&s->server_ip.sa)].remove(s);
+      s->do_io_close();
+      RecIncrRawStat(http_rsb, ethread, (int) http_origin_prewarm_expired_stat, 1);
+    }
+    s = next;
+  }
+}
+
+void
+HttpSessionManager::close_aged_sessions(ink_hrtime created_before)
+{
+  EThread *ethread = this_ethread();
+
+  for (int i = 0; i < HSM_LEVEL1_BUCKETS; i++)
+    _close_aged_sessions(g_l1_hash + i, created_before, ethread);
+
+  for (int t = 0; t < eventProcessor.n_ethreads; t++) {
+    SessionBucket *l1_hash = eventProcessor.all_ethreads[t]->l1_hash;
+
+    if (l1_hash) {
+      for (int i = 0; i < HSM_LEVEL1_BUCKETS; i++)
+        _close_aged_sessions(l1_hash + i, created_before, ethread);
+    }
+  }
+}
+
 HSMresult_t
 _acquire_session(SessionBucket *bucket, sockaddr const* ip, INK_MD5 &hostname_hash, HttpSM *sm)
 {
@@ -198,6 +283,11 @@ _acquire_session(SessionBucket *bucket, sockaddr const* ip, INK_MD5 &hostname_ha
         to_return = b;
         Debug("http_ss", "[%" PRId64 "] [acquire session] " "return session from shared pool", to_return->con_id);
         sm->attach_server_session(to_return);
+        RecIncrRawStat(http_rsb, this_ethread(), (int) http_origin_sessions_reused_stat, 1);
+        if (to_return->prewarmed) {
+          to_return->prewarmed = false;
+          RecIncrRawStat(http_rsb, this_ethread(), (int) http_origin_prewarm_hits_stat, 1);
+        }
         return HSM_DONE;
       }
     }
@@ -208,6 +298,45 @@ _acquire_session(SessionBucket *bucket, sockaddr const* ip, INK_MD5 &hostname_ha
   return HSM_NOT_FOUND;
 }
 
+// Look for a session in the per thread pools of the other threads.  Only
+// try locks are taken, so a busy bucket is skipped rather than waited
+// for.  The session's NetVC stays with its own thread's NetHandler, just
+// as it does for sessions in the global pool.
+static HSMresult_t
+_steal_session(EThread *ethread, int l1_index, sockaddr const* ip, INK_MD5 &hostname_hash, HttpSM *sm)
+{
+  int l2_index = SECOND_LEVEL_HASH(ip);
+  int n = eventProcessor.n_ethreads;
+
+  // Start at a different thread for each origin so one thread's pool
+  // is not always drained first.
+  for (int i = 0; i < n; i++) {
+    EThread *t = eventProcessor.all_ethreads[(l1_index + i) % n];
+
+    if (t == ethread || t->l1_hash == NULL)
+      continue;
+
+    SessionBucket *bucket = t->l1_hash + l1_index;
+
+    // Unlocked peek; a stale answer only costs a missed or wasted try lock.
+    if (bucket->l2_hash[l2_index].head == NULL)
+      continue;
+
+    MUTEX_TRY_LOCK(lock, bucket->mutex, ethread);
+    if (!lock) {
+      RecIncrRawStat(http_rsb, ethread, (int) http_origin_session_steal_busy_stat, 1);
+      continue;
+    }
+    if (_acquire_session(bucket, ip, hostname_hash, sm) == HSM_DONE) {
+      Debug("http_ss", "[%" PRId64 "] [acquire session] took session from another thread's pool", sm->sm_id);
+      RecIncrRawStat(http_rsb, ethread, (int) http_origin_sessions_stolen_stat, 1);
+      return HSM_DONE;
+    }
+  }
+
+  return HSM_NOT_FOUND;
+}
+
 HSMresult_t
 HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockaddr const* ip,
                                     const char *hostname, HttpClientSession *ua_session, HttpSM *sm)
@@ -259,7 +388,17 @@ HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockad
 
   if (2 == sm->t_state.txn_conf->share_server_sessions) {
     ink_assert(ethread->l1_hash);
-    return _acquire_session(ethread->l1_hash + l1_index, ip, hostname_hash, sm);
+    // Other threads may take sessions from this pool, so it is locked
+    // like theirs.
+    {
+      SessionBucket *bucket = ethread->l1_hash + l1_index;
+      MUTEX_TRY_LOCK(lock, bucket->mutex, ethread);
+      if (lock && _acquire_session(bucket, ip, hostname_hash, sm) == HSM_DONE)
+        return HSM_DONE;
+    }
+    if (sm->t_state.http_config_param->server_session_steal)
+      return _steal_session(ethread, l1_index, ip, hostname_hash, sm);
+    return HSM_NOT_FOUND;
   } else {
     SessionBucket *bucket = g_l1_hash + l1_index;
 
@@ -274,6 +413,36 @@ HttpSessionManager::acquire_session(Continuation * /* cont ATS_UNUSED */, sockad
   return HSM_RETRY;
 }
 
+// Put a session into a pool.  The caller holds the bucket's lock.
+static HSMresult_t
+_release_session(SessionBucket *bucket, HttpServerSession *to_release)
+{
+  int l2_index = SECOND_LEVEL_HASH(&to_release->server_ip.sa);
+
+  ink_assert(l2_index < HSM_LEVEL2_BUCKETS);
+
+  // First insert the session on to our lists
+  bucket->lru_list.enqueue(to_release);
+  bucket->l2_hash[l2_index].push(to_release);
+  to_release->state = HSS_KA_SHARED;
+
+  // Now we need to issue a read on the connection to detect
+  //  if it closes on us.  We will get called back in the
+  //  continuation for this bucket, ensuring we have the lock
+  //  to remove the connection from our lists
+  to_release->do_io_read(bucket, INT64_MAX, to_release->read_buffer);
+
+  // Transfer control of the write side as well
+  to_release->do_io_write(bucket, 0, NULL);
+
+  // we probably don't need the active timeout set, but will leave it for now
+  to_release->get_netvc()->set_inactivity_timeout(to_release->get_netvc()->get_inactivity_timeout());
+  to_release->get_netvc()->set_active_timeout(to_release->get_netvc()->get_active_timeout());
+  Debug("http_ss", "[%" PRId64 "] [release session] " "session placed into shared pool", to_release->con_id);
+
+  return HSM_DONE;
+}
+
 HSMresult_t
 HttpSessionManager::release_session(HttpServerSession *to_release)
 {
@@ -283,41 +452,229 @@ HttpSessionManager::release_session(HttpServerSession *to_release)
 
   ink_assert(l1_index < HSM_LEVEL1_BUCKETS);
 
+  // A connection's first release, or the first use of a pre-warmed one,
+  // marks its origin as worth keeping warm.
+  if (to_release->transact_count == 1 &&
+      (HttpConfig::m_master.server_session_prewarm_min_idle > 0 ||
+       HttpConfig::m_master.server_session_prewarm_parent_min_idle > 0))
+    prewarm.learn(to_release);
+
   if (2 == to_release->share_session) {
+    // Pool the session with the thread that does its network I/O.  A
+    // session taken from another thread goes back there, unless that
+    // pool is busy.
+    EThread *home = to_release->get_netvc()->thread;
+
     bucket = ethread->l1_hash + l1_index;
+    if (home && home != ethread && home->l1_hash) {
+      SessionBucket *home_bucket = home->l1_hash + l1_index;
+      MUTEX_TRY_LOCK(home_lock, home_bucket->mutex, ethread);
+      if (home_lock)
+        return _release_session(home_bucket, to_release);
+    }
   } else {
     bucket = g_l1_hash + l1_index;
   }
 
   MUTEX_TRY_LOCK(lock, bucket->mutex, ethread);
   if (lock) {
-    int l2_index = SECOND_LEVEL_HASH(&to_release->server_ip.sa);
+    return _release_session(bucket, to_release);
+  } else {
+    Debug("http_ss", "[%" PRId64 "] [release session] could not release session due to lock contention", to_release->con_id);
+  }
 
-    ink_assert(l2_index < HSM_LEVEL2_BUCKETS);
+  return HSM_RETRY;
+}
 
-    // First insert the session on to our lists
-    bucket->lru_list.enqueue(to_release);
-    bucket->l2_hash[l2_index].push(to_release);
-    to_release->state = HSS_KA_SHARED;
+// Opens one connection for the pre-warmer and puts the session in the
+// pool.  Each has its own mutex, which becomes the session's, as an
+// HttpSM's does for the sessions it opens.
+struct SessionPrewarmConnect: public Continuation
+{
+  SessionPrewarmTarget *target;
+  IpEndpoint addr;
+  INK_MD5 hostname_hash;
+  bool is_ssl;
+  bool to_parent_proxy;
+
+  SessionPrewarmConnect(SessionPrewarmTarget *t)
+    : Continuation(new_ProxyMutex()), target(t), hostname_hash(t->hostname_hash),
+      is_ssl(t->is_ssl), to_parent_proxy(t->to_parent_proxy)
+  {
+    ats_ip_copy(&addr, &t->addr);
+    SET_HANDLER(&SessionPrewarmConnect::connect_handler);
+  }
 
-    // Now we need to issue a read on the connection to detect
-    //  if it closes on us.  We will get called back in the
-    //  continuation for this bucket, ensuring we have the lock
-    //  to remove the connection from our lists
-    to_release->do_io_read(bucket, INT64_MAX, to_release->read_buffer);
+  int connect_handler(int event, void *data);
+  void open_session(NetVConnection *netvc);
+};
 
-    // Transfer control of the write side as well
-    to_release->do_io_write(bucket, 0, NULL);
+int
+SessionPrewarmConnect::connect_handler(int event, void *data)
+{
+  HttpConfigParams *params = &HttpConfig::m_master;
 
-    // we probably don't need the active timeout set, but will leave it for now
-    to_release->get_netvc()->set_inactivity_timeout(to_release->get_netvc()->get_inactivity_timeout());
-    to_release->get_netvc()->set_active_timeout(to_release->get_netvc()->get_active_timeout());
-    Debug("http_ss", "[%" PRId64 "] [release session] " "session placed into shared pool", to_release->con_id);
+  switch (event) {
+  case EVENT_IMMEDIATE: {
+    // Now on a net thread, holding our mutex, so connect_re() will
+    // bind the new connection to this thread.
+    NetVCOptions opt;
+
+    opt.f_blocking_connect = false;
+    opt.set_sock_param(params->oride.sock_recv_buffer_size_out, params->oride.sock_send_buffer_size_out,
+                       params->oride.sock_option_flag_out, params->oride.sock_packet_mark_out,
+                       params->oride.sock_packet_tos_out);
+    opt.ip_family = addr.sa.sa_family;
+
+    // This may call back before it returns.
+    if (is_ssl)
+      sslNetProcessor.connect_re(this, &addr.sa, &opt);
+    else
+      netProcessor.connect_re(this, &addr.sa, &opt);
+    return EVENT_DONE;
+  }
 
-    return HSM_DONE;
-  } else {
-    Debug("http_ss", "[%" PRId64 "] [release session] could not release session due to lock contention", to_release->con_id);
+  case NET_EVENT_OPEN:
+    HTTP_INCREMENT_DYN_STAT(http_origin_prewarm_opened_stat);
+    open_session((NetVConnection *) data);
+    break;
+
+  case NET_EVENT_OPEN_FAILED:
+  default:
+    HTTP_INCREMENT_DYN_STAT(http_origin_prewarm_failed_stat);
+    break;
   }
 
-  return HSM_RETRY;
+  ink_atomic_increment(&target->pending, -1);
+  delete this;
+  return EVENT_DONE;
+}
+
+void
+SessionPrewarmConnect::open_session(NetVConnection *netvc)
+{
+  HttpConfigParams *params = &HttpConfig::m_master;
+  EThread *ethread = this_ethread();
+  int share_mode = params->oride.share_server_sessions;
+
+  // SSL connections may complete on a thread without its own pools.
+  if (2 == share_mode && ethread->l1_hash == NULL)
+    share_mode = 1;
+
+  HttpServerSession *session = (2 == share_mode) ?
+    THREAD_ALLOC_INIT(httpServerSessionAllocator, ethread) :
+    httpServerSessionAllocator.alloc();
+
+  session->share_session = share_mode;
+  session->is_ssl = is_ssl;
+  if (params->oride.origin_max_connections > 0 || params->origin_min_keep_alive_connections > 0)
+    session->enable_origin_connection_limiting = true;
+  ats_ip_copy(&session->server_ip, &addr);
+  session->new_connection(netvc);
+  session->hostname_hash = hostname_hash;
+  session->host_hash_computed = true;
+  session->prewarmed = true;
+  session->to_parent_proxy = to_parent_proxy;
+  if (to_parent_proxy) {
+    HTTP_INCREMENT_DYN_STAT(http_current_parent_proxy_connections_stat);
+    HTTP_INCREMENT_DYN_STAT(http_total_parent_proxy_connections_stat);
+  }
+
+  netvc->set_inactivity_timeout(HRTIME_SECONDS(params->oride.keep_alive_no_activity_timeout_out));
+  Debug("http_ss", "[%" PRId64 "] [prewarm] session opened", session->con_id);
+  session->release();
+}
+
+SessionPrewarm::SessionPrewarm()
+  : Continuation(NULL)
+{
+  memset(targets, 0, sizeof(targets));
+  SET_HANDLER(&SessionPrewarm::main_handler);
+}
+
+void
+SessionPrewarm::learn(HttpServerSession *s)
+{
+  MUTEX_TRY_LOCK(lock, mutex, this_ethread());
+  if (!lock)
+    return;                     // The next session to this origin will do
+
+  SessionPrewarmTarget *slot = NULL;
+
+  for (int i = 0; i < HSM_PREWARM_TARGETS; i++) {
+    SessionPrewarmTarget *t = targets + i;
+
+    if (t->last_seen == 0) {
+      // A free slot might still have connects in progress.
+      if (slot == NULL && t->pending == 0)
+        slot = t;
+    } else if (ats_ip_addr_eq(&t->addr.sa, &s->server_ip.sa) &&
+               ats_ip_port_cast(&t->addr) == ats_ip_port_cast(&s->server_ip) &&
+               t->hostname_hash == s->hostname_hash) {
+      t->last_seen = ink_get_hrtime();
+      return;
+    }
+  }
+
+  if (slot) {
+    Debug("http_ss", "[%" PRId64 "] [prewarm] keeping origin warm", s->con_id);
+    ats_ip_copy(&slot->addr, &s->server_ip);
+    slot->hostname_hash = s->hostname_hash;
+    slot->is_ssl = s->is_ssl;
+    slot->to_parent_proxy = s->to_parent_proxy;
+    slot->last_seen = ink_get_hrtime();
+  }
+}
+
+int
+SessionPrewarm::main_handler(int /* event ATS_UNUSED */, void * /* data ATS_UNUSED */)
+{
+  HttpConfigParams *params = &HttpConfig::m_master;
+  int share_mode = params->oride.share_server_sessions;
+  ink_hrtime now = ink_get_hrtime();
+
+  if (share_mode == 0 || (params->server_session_prewarm_min_idle <= 0 &&
+                          params->server_session_prewarm_parent_min_idle <= 0))
+    return EVENT_CONT;
+
+  if (params->server_session_prewarm_max_age > 0)
+    httpSessionManager.close_aged_sessions(now - HRTIME_SECONDS(params->server_session_prewarm_max_age));
+
+  for (int i = 0; i < HSM_PREWARM_TARGETS; i++) {
+    SessionPrewarmTarget *t = targets + i;
+
+    if (t->last_seen == 0)
+      continue;
+    if (now - t->last_seen > HRTIME_SECONDS(params->server_session_prewarm_origin_timeout)) {
+      t->last_seen = 0;
+      continue;
+    }
+
+    int64_t want = t->to_parent_proxy ? params->server_session_prewarm_parent_min_idle :
+      params->server_session_prewarm_min_idle;
+    int idle = httpSessionManager.count_idle_sessions(&t->addr.sa, t->hostname_hash, share_mode);
+
+    if (idle < 0)
+      continue;                 // A pool was busy, count again next pass
+
+    int64_t need = want - idle - t->pending;
+
+    // Stay under the origin's connection limit.
+    if (params->oride.origin_max_connections > 0) {
+      ConnectionCount *connections = ConnectionCount::getInstance();
+      ConnectionCount::Policy policy(params, params->oride.origin_max_connections);
+      int64_t room = connections->getLimit(t->addr, policy) - connections->getCount(t->addr) - t->pending;
+      if (need > room)
+        need = room;
+    }
+    if (need > HSM_PREWARM_BURST)
+      need = HSM_PREWARM_BURST;
+
+    for (int64_t n = 0; n < need; n++) {
+      ink_atomic_increment(&t->pending, 1);
+      eventProcessor.schedule_imm(NEW(new SessionPrewarmConnect(t)), ET_NET);
+    }
+  }
+
+  return EVENT_CONT;
 }
@@ -46,6 +46,11 @@ initialize_thread_for_http_sessions(EThread *thread, int thread_index);
 #define  HSM_LEVEL1_BUCKETS   127
 #define  HSM_LEVEL2_BUCKETS   63
 
+// Origins (and parents) the pre-warmer keeps idle sessions open to
+#define  HSM_PREWARM_TARGETS  64
+// Most connections the pre-warmer starts to one origin per pass
+#define  HSM_PREWARM_BURST    8
+
 class SessionBucket: public Continuation
 {
 public:
@@ -62,6 +67,30 @@ enum HSMresult_t
   HSM_NOT_FOUND
 };
 
+// An origin seen to keep connections alive, which the pre-warmer keeps
+// a minimum number of idle sessions open to.
+struct SessionPrewarmTarget
+{
+  IpEndpoint addr;
+  INK_MD5 hostname_hash;
+  bool is_ssl;
+  bool to_parent_proxy;
+  ink_hrtime last_seen;         // 0 if the slot is free
+  volatile int pending;         // connects in progress
+};
+
+// Runs once a second: recycles pooled sessions past their max age and
+// opens connections to origins that are short of idle sessions.
+class SessionPrewarm: public Continuation
+{
+public:
+  SessionPrewarm();
+  int main_handler(int event, void *data);
+  void learn(HttpServerSession *s);
+
+  SessionPrewarmTarget targets[HSM_PREWARM_TARGETS];
+};
+
 class HttpSessionManager
 {
 public:
@@ -75,12 +104,17 @@ public:
                               HttpClientSession *ua_session, HttpSM *sm);
   HSMresult_t release_session(HttpServerSession *to_release);
   void purge_keepalives();
+  /// Idle sessions pooled for the origin, or -1 if a pool was busy.
+  int count_idle_sessions(sockaddr const* ip, INK_MD5 &hostname_hash, int share_mode);
+  /// Close pooled sessions that connected before @a created_before.
+  void close_aged_sessions(ink_hrtime created_before);
   void init();
   int main_handler(int event, void *data);
 
 private:
   //    Global l1 hash, used when there is no per-thread buckets
   SessionBucket g_l1_hash[HSM_LEVEL1_BUCKETS];
+  SessionPrewarm prewarm;
 };
 
 extern HttpSessionManager httpSessionManager;
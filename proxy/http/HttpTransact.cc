@@ -597,7 +597,7 @@ HttpTransact::HandleBlindTunnel(State* s)
 
   // We've received a request on a port which we blind forward
   //  For logging purposes we create a fake request
-  s->hdr_info.client_request.create(HTTP_TYPE_REQUEST);
+  s->hdr_create(&s->hdr_info.client_request, HTTP_TYPE_REQUEST);
   s->hdr_info.client_request.method_set(HTTP_METHOD_CONNECT, HTTP_LEN_CONNECT);
   URL u;
   s->hdr_info.client_request.url_create(&u);
@@ -1951,7 +1951,7 @@ HttpTransact::HandlePushResponseHdr(State* s)
     return;
   }
   // We need to create the request header storing in the cache
-  s->hdr_info.server_request.create(HTTP_TYPE_REQUEST);
+  s->hdr_create(&s->hdr_info.server_request, HTTP_TYPE_REQUEST);
   s->hdr_info.server_request.copy(&s->hdr_info.client_request);
   s->hdr_info.server_request.method_set(HTTP_METHOD_GET, HTTP_LEN_GET);
   s->hdr_info.server_request.value_set("X-Inktomi-Source", 16, "http PUSH", 9);
@@ -3091,6 +3091,8 @@ HttpTransact::OriginServerRawOpen(State* s)
   case CONGEST_CONTROL_CONGESTED_ON_F:
     /* fall through */
   case CONGEST_CONTROL_CONGESTED_ON_M:
+    /* fall through */
+  case OUTBOUND_CONGESTION:
     handle_server_died(s);
 
     ink_assert(s->cache_info.action == CACHE_DO_NO_ACTION);
@@ -3491,6 +3493,14 @@ HttpTransact::handle_response_from_server(State* s)
     s->current.server->connect_failure = 1;
     handle_server_connection_not_open(s);
     break;
+  case OUTBOUND_CONGESTION:
+    // We are the ones holding back, the server is not to blame
+    DebugTxn("http_trans", "[handle_response_from_server] Error. origin connection queue full.");
+    SET_VIA_STRING(VIA_DETAIL_SERVER_CONNECT, VIA_DETAIL_SERVER_FAILURE);
+    SET_VIA_STRING(VIA_SERVER_RESULT, VIA_SERVER_ERROR);
+    handle_server_died(s);
+    s->next_action = PROXY_SEND_ERROR_CACHE_NOOP;
+    break;
   case OPEN_RAW_ERROR:
     /* fall through */
   case CONNECTION_ERROR:
@@ -3868,6 +3878,7 @@ HttpTransact::handle_100_continue_response(State* s)
 void
 HttpTransact::build_response_copy(State* s, HTTPHdr* base_response,HTTPHdr* outgoing_response, HTTPVersion outgoing_version)
 {
+  s->hdr_heap_setup(outgoing_response);
   HttpTransactHeaders::copy_header_fields(base_response, outgoing_response, s->txn_conf->fwd_proxy_auth_to_parent,
                                           s->current.now);
   HttpTransactHeaders::convert_response(outgoing_version, outgoing_response);   // http version conversion
@@ -4603,7 +4614,7 @@ HttpTransact::handle_transform_ready(State* s)
 void
 HttpTransact::set_header_for_transform(State* s, HTTPHdr* base_header)
 {
-  s->hdr_info.transform_response.create(HTTP_TYPE_RESPONSE);
+  s->hdr_create(&s->hdr_info.transform_response, HTTP_TYPE_RESPONSE);
   s->hdr_info.transform_response.copy(base_header);
 
   // Nuke the content length since 1) the transform will probably
@@ -6309,7 +6320,8 @@ HttpTransact::is_response_valid(State* s, HTTPHdr* incoming_response)
                       (s->current.state == INACTIVE_TIMEOUT) ||
                       (s->current.state == ACTIVE_TIMEOUT) ||
                       (s->current.state == CONGEST_CONTROL_CONGESTED_ON_M) ||
-                      (s->current.state == CONGEST_CONTROL_CONGESTED_ON_F));
+                      (s->current.state == CONGEST_CONTROL_CONGESTED_ON_F) ||
+                      (s->current.state == OUTBOUND_CONGESTION));
 
     s->hdr_info.response_error = CONNECTION_OPEN_FAILED;
     return false;
@@ -7389,7 +7401,8 @@ HttpTransact::handle_server_died(State* s)
   //
   if (s->pCongestionEntry != NULL) {
     s->congestion_congested_or_failed = 1;
-    if (s->current.state != CONGEST_CONTROL_CONGESTED_ON_F && s->current.state != CONGEST_CONTROL_CONGESTED_ON_M) {
+    if (s->current.state != CONGEST_CONTROL_CONGESTED_ON_F && s->current.state != CONGEST_CONTROL_CONGESTED_ON_M &&
+        s->current.state != OUTBOUND_CONGESTION) {
       s->pCongestionEntry->failed_at(s->current.now);
     }
   }
@@ -7454,6 +7467,12 @@ HttpTransact::handle_server_died(State* s)
       body_type = "congestion#retryAfter";
     s->hdr_info.response_error = TOTAL_RESPONSE_ERROR_TYPES;
     break;
+  case OUTBOUND_CONGESTION:
+    status = HTTP_STATUS_SERVICE_UNAVAILABLE;
+    reason = "Too Many Connections";
+    body_type = "congestion#retryAfter";
+    s->hdr_info.response_error = TOTAL_RESPONSE_ERROR_TYPES;
+    break;
   case STATE_UNDEFINED:
   case TRANSACTION_COMPLETE:
   default:                     /* unknown death */
@@ -7547,6 +7566,7 @@ HttpTransact::build_request(State* s, HTTPHdr* base_request, HTTPHdr* outgoing_r
     }
   }
 
+  s->hdr_heap_setup(outgoing_request);
   HttpTransactHeaders::copy_header_fields(base_request, outgoing_request, s->txn_conf->fwd_proxy_auth_to_parent);
   add_client_ip_to_outgoing_request(s, outgoing_request);
   HttpTransactHeaders::process_connection_headers(base_request, outgoing_request);
@@ -7667,6 +7687,8 @@ HttpTransact::build_response(State* s, HTTPHdr* base_response, HTTPHdr* outgoing
     reason_phrase = http_hdr_reason_lookup(status_code);
   }
 
+  s->hdr_heap_setup(outgoing_response);
+
   if (base_response == NULL) {
     HttpTransactHeaders::build_base_response(outgoing_response, status_code, reason_phrase, strlen(reason_phrase), s->current.now);
   } else {
@@ -409,7 +409,8 @@ public:
     PARSE_ERROR,
     TRANSACTION_COMPLETE,
     CONGEST_CONTROL_CONGESTED_ON_F,
-    CONGEST_CONTROL_CONGESTED_ON_M
+    CONGEST_CONTROL_CONGESTED_ON_M,
+    OUTBOUND_CONGESTION
   };
 
   enum CacheWriteStatus_t
@@ -1176,6 +1177,10 @@ public:
       }
 
       url_map.clear();
+      if (http_config_param->enable_http_stats) {
+        RecIncrRawStat(http_rsb, this_ethread(), http_transaction_arena_allocations_stat, arena.allocation_count());
+        RecIncrRawStat(http_rsb, this_ethread(), http_transaction_arena_bytes_stat, arena.bytes_reserved());
+      }
       arena.reset();
       pristine_url.clear();
 
@@ -1185,6 +1190,24 @@ public:
       return;
     }
 
+    // Give one of the transaction's own headers a heap carved from the
+    //   arena.  HTTPHdr::create() and copy() build on a heap that is
+    //   already set, and destroy() releases them all with one reset.
+    void
+    hdr_heap_setup(HTTPHdr * hdr)
+    {
+      if (hdr->m_heap == NULL) {
+        hdr->m_heap = new_HdrHeap(HDR_HEAP_DEFAULT_SIZE, &arena);
+      }
+    }
+
+    void
+    hdr_create(HTTPHdr * hdr, HTTPType polarity)
+    {
+      hdr_heap_setup(hdr);
+      hdr->create(polarity);
+    }
+
     // Little helper function to setup the per-transaction configuration copy
     void
     setup_per_txn_configs()
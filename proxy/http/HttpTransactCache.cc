@@ -141,13 +141,13 @@ do_strings_match_weakly(const char *raw_tag_field,
 }
 
 inline static bool
-is_asterisk(char *s)
+is_asterisk(const char *s)
 {
   return ((s[0] == '*') && (s[1] == NUL));
 }
 
 inline static bool
-is_empty(char *s)
+is_empty(const char *s)
 {
   return (s[0] == NUL);
 }
@@ -200,6 +200,9 @@ HttpTransactCache::SelectFromAlternates(CacheHTTPInfoVector * cache_vector,
     return 0;
   }
 
+  HttpAcceptPrefs prefs;
+  prefs.init(client_request, http_config_params);
+
   for (int i = 0; i < alt_count; i++) {
     float Q;
     CacheHTTPInfo *obj = cache_vector->get(i);
@@ -210,7 +213,7 @@ HttpTransactCache::SelectFromAlternates(CacheHTTPInfoVector * cache_vector,
       ink_assert(cached_request->valid());
       ink_assert(cached_response->valid());
 
-      Q = calculate_quality_of_match(http_config_params, client_request, cached_request, cached_response);
+      Q = calculate_quality_of_match(http_config_params, client_request, &prefs, cached_request, cached_response);
 
       if (alt_count > 1) {
         if (t_now == 0)
@@ -301,9 +304,23 @@ HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_confi
                                               HTTPHdr * obj_client_request,     // in
                                               HTTPHdr * obj_origin_server_response      // in
   )
+{
+  HttpAcceptPrefs prefs;
+
+  prefs.init(client_request, http_config_param);
+  return calculate_quality_of_match(http_config_param, client_request, &prefs, obj_client_request,
+                                    obj_origin_server_response);
+}
+
+float
+HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_config_param,        // in
+                                              HTTPHdr * client_request, // in
+                                              HttpAcceptPrefs * prefs,  // in
+                                              HTTPHdr * obj_client_request,     // in
+                                              HTTPHdr * obj_origin_server_response      // in
+  )
 {
   float q[4], Q;
-  MIMEField *accept_field;
   MIMEField *cached_accept_field;
   MIMEField *content_field;
 
@@ -316,31 +333,38 @@ HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_confi
   if (obj_origin_server_response->status_get() != HTTP_STATUS_OK)
     return (float)1.0;
 
+  // Unless a plugin may force this alternate, an alternate that varies
+  // for this request can never be chosen, so check Vary before doing
+  // any Accept* matching.  With many alternates most are rejected here.
+  if (!prefs->select_alt_hook &&
+      CalcVariability(http_config_param, client_request, obj_client_request, obj_origin_server_response) != VARIABILITY_NONE) {
+    Debug("http_match", "    CalcQualityOfMatch: CalcVariability says variability = 1");
+    return (float)-1.0;
+  }
+
   q[1] = (q[2] = (q[3] = -2.0));        /* just to make debug output happy :) */
 
   // Accept //
   // A NULL Accept or a NULL Content-Type field are perfect matches.
   content_field = obj_origin_server_response->field_find(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
-  accept_field = client_request->field_find(MIME_FIELD_ACCEPT, MIME_LEN_ACCEPT);
-  q[0] = (content_field != 0 && accept_field != 0 && !http_config_param->ignore_accept_mismatch) ?
-    calculate_quality_of_accept_match(accept_field, content_field) : 1.0;
+  q[0] = (content_field != 0 && prefs->accept.field != 0 && !http_config_param->ignore_accept_mismatch) ?
+    calculate_quality_of_accept_match(&prefs->accept, content_field) : 1.0;
 
   if (q[0] >= 0.0) {
     // Accept-Charset
     if (http_config_param->ignore_accept_charset_mismatch) {    //Bug 2393700 /ebalsa
       q[1] = 1.0;
     } else {
-      accept_field = client_request->field_find(MIME_FIELD_ACCEPT_CHARSET, MIME_LEN_ACCEPT_CHARSET);
       cached_accept_field = obj_client_request->field_find(MIME_FIELD_ACCEPT_CHARSET, MIME_LEN_ACCEPT_CHARSET);
       // content_field lookup is same as above
       // content_field = obj_origin_server_response->field_find(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
 
       // absence in both requests counts as exact match
-      if (accept_field == NULL && cached_accept_field == NULL) {
+      if (prefs->accept_charset.field == NULL && cached_accept_field == NULL) {
         Debug("http_alternate", "Exact match for ACCEPT CHARSET");
         q[1] = 1.001;           //slightly higher weight to this guy
       } else {
-        q[1] = calculate_quality_of_accept_charset_match(accept_field, content_field, cached_accept_field);
+        q[1] = calculate_quality_of_accept_charset_match(&prefs->accept_charset, content_field, cached_accept_field);
       }
     }
 
@@ -349,16 +373,15 @@ HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_confi
       if (http_config_param->ignore_accept_encoding_mismatch) { //Bug 2393700 /ebalsa
         q[2] = 1.0;
       } else {
-        accept_field = client_request->field_find(MIME_FIELD_ACCEPT_ENCODING, MIME_LEN_ACCEPT_ENCODING);
         content_field = obj_origin_server_response->field_find(MIME_FIELD_CONTENT_ENCODING, MIME_LEN_CONTENT_ENCODING);
         cached_accept_field = obj_client_request->field_find(MIME_FIELD_ACCEPT_ENCODING, MIME_LEN_ACCEPT_ENCODING);
 
         // absence in both requests counts as exact match
-        if (accept_field == NULL && cached_accept_field == NULL) {
+        if (prefs->accept_encoding.field == NULL && cached_accept_field == NULL) {
           Debug("http_alternate", "Exact match for ACCEPT ENCODING");
           q[2] = 1.001;         //slightly higher weight to this guy
         } else {
-          q[2] = calculate_quality_of_accept_encoding_match(accept_field, content_field, cached_accept_field);
+          q[2] = calculate_quality_of_accept_encoding_match(&prefs->accept_encoding, content_field, cached_accept_field);
         }
       }
 
@@ -367,17 +390,17 @@ HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_confi
         if (http_config_param->ignore_accept_language_mismatch) {       //Bug 2393700 /ebalsa
           q[3] = 1.0;
         } else {
-          accept_field = client_request->field_find(MIME_FIELD_ACCEPT_LANGUAGE, MIME_LEN_ACCEPT_LANGUAGE);
           content_field =
             obj_origin_server_response->field_find(MIME_FIELD_CONTENT_LANGUAGE, MIME_LEN_CONTENT_LANGUAGE);
           cached_accept_field = obj_client_request->field_find(MIME_FIELD_ACCEPT_LANGUAGE, MIME_LEN_ACCEPT_LANGUAGE);
 
           // absence in both requests counts as exact match
-          if (accept_field == NULL && cached_accept_field == NULL) {
+          if (prefs->accept_language.field == NULL && cached_accept_field == NULL) {
             Debug("http_alternate", "Exact match for ACCEPT LANGUAGE");
             q[3] = 1.001;       //slightly higher weight to this guy
           } else {
-            q[3] = calculate_quality_of_accept_language_match(accept_field, content_field, cached_accept_field);
+            q[3] = calculate_quality_of_accept_language_match(&prefs->accept_language, content_field,
+                                                              cached_accept_field);
           }
         }
       }
@@ -408,7 +431,7 @@ HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_confi
 
   int force_alt = 0;
 
-  if (Q > 0.0) {
+  if (Q > 0.0 && prefs->select_alt_hook) {
     APIHook *hook;
     HttpAltInfo info;
     float qvalue;
@@ -443,7 +466,7 @@ HttpTransactCache::calculate_quality_of_match(CacheLookupHttpConfig * http_confi
     }
   }
 
-  if (Q >= 0.0 && !force_alt ) {                 // make sense to check 'variability' only if Q >= 0.0
+  if (Q >= 0.0 && !force_alt && prefs->select_alt_hook) { // make sense to check 'variability' only if Q >= 0.0
     // set quality to -1, if cached copy would vary for this request //
     Variability_t variability = CalcVariability(http_config_param, client_request,
                                                 obj_client_request, obj_origin_server_response);
@@ -492,20 +515,19 @@ do_content_types_match(char *type1, char *subtype1, char *type2, char *subtype2)
 }
 
 float
-HttpTransactCache::calculate_quality_of_accept_match(MIMEField * accept_field, MIMEField * content_field)
+HttpTransactCache::calculate_quality_of_accept_match(HttpAcceptList * accept_list, MIMEField * content_field)
 {
   float q = -1.0;
-  const char *c_raw, *a_raw;
-  int c_raw_len, a_raw_len;
+  const char *c_raw;
+  int c_raw_len;
   char c_type[32], c_subtype[32];
-  Str *a_value;
-  StrList c_param_list, a_values_list;
+  StrList c_param_list;
   bool wildcard_type_present = false;
   bool wildcard_subtype_present = false;
   float wildcard_type_q = 1.0;
   float wildcard_subtype_q = 1.0;
 
-  ink_assert((accept_field != NULL) && (content_field != NULL));
+  ink_assert((accept_list->field != NULL) && (content_field != NULL));
 
   // Extract the content-type field value before the semicolon.
   // This has to be done just once because assuming single
@@ -524,46 +546,26 @@ HttpTransactCache::calculate_quality_of_accept_match(MIMEField * accept_field, M
   // Parse the type and subtype of the Content-Type field.
   HttpCompat::parse_mime_type(c_param->str, c_type, c_subtype, sizeof(c_type), sizeof(c_subtype));
 
-  // Now loop over Accept field values.
-  // TODO: Should we check the return value (count) from this?
-  accept_field->value_get_comma_list(&a_values_list);
-
-  for (a_value = a_values_list.head; a_value; a_value = a_value->next) {
-    // Get the raw string to the current comma-sep Accept field value
-    a_raw = a_value->str;
-    a_raw_len = a_value->len;
-
-    // Extract the field value before the semicolon
-    StrList a_param_list;
-    HttpCompat::parse_semicolon_list(&a_param_list, a_raw, a_raw_len);
-
-    // Read the next type/subtype media-range
-    Str *a_param = a_param_list.head;
-    if (!a_param)
-      continue;
-
-    // Parse the type and subtype of the Accept field
-    char a_type[32], a_subtype[32];
-    HttpCompat::parse_mime_type(a_param->str, a_type, a_subtype, sizeof(a_type), sizeof(a_subtype));
-
-//      printf("matching Content-type; '%s/%s' with Accept value '%s/%s'\n",
-//             c_type,c_subtype,a_type,a_subtype);
+  // Now loop over the Accept media-ranges, already split into
+  // type and subtype.
+  accept_list->parse();
+  for (int i = 0; i < accept_list->count; i++) {
+    HttpAcceptValue *a_value = &accept_list->values[i];
+    char *a_type = a_value->type;
+    char *a_subtype = a_value->subtype;
 
     // Is there a wildcard in the type or subtype?
     if (is_asterisk(a_type)) {
       wildcard_type_present = true;
-      wildcard_type_q = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+      wildcard_type_q = a_value->q;
     } else if (is_asterisk(a_subtype) && (strcasecmp(a_type, c_type) == 0)) {
       wildcard_subtype_present = true;
-      wildcard_subtype_q = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+      wildcard_subtype_q = a_value->q;
     } else {
 
       // No wildcard. Do explicit matching of accept and content values.
       if (do_content_types_match(a_type, a_subtype, c_type, c_subtype)) {
-
-        float tq;
-        tq = HttpCompat::find_Q_param_in_strlist(&a_param_list);
-        q = (tq > q ? tq : q);
+        q = (a_value->q > q ? a_value->q : q);
       }
     }
   }
@@ -602,23 +604,22 @@ HttpTransactCache::calculate_quality_of_accept_match(MIMEField * accept_field, M
 
 */
 static inline bool
-does_charset_match(char *charset1, char *charset2)
+does_charset_match(const char *charset1, char *charset2)
 {
   return (is_asterisk(charset1) || is_empty(charset1) || (strcasecmp(charset1, charset2) == 0));
 }
 
 
 float
-HttpTransactCache::calculate_quality_of_accept_charset_match(MIMEField * accept_field,
+HttpTransactCache::calculate_quality_of_accept_charset_match(HttpAcceptList * accept_list,
                                                              MIMEField * content_field, MIMEField * cached_accept_field)
 {
   float q = -1.0;
   const char *c_raw, *a_raw, *ca_raw;
   int c_raw_len, a_raw_len, ca_raw_len;
-  StrList a_values_list;
-  Str *a_value;
+  MIMEField *accept_field = accept_list->field;
   char c_charset[128];
-  char *a_charset;
+  const char *a_charset;
   int a_charset_len;
   const char *default_charset = "utf-8";
   bool wildcard_present = false;
@@ -644,36 +645,19 @@ HttpTransactCache::calculate_quality_of_accept_charset_match(MIMEField * accept_
     ink_strlcpy(c_charset, default_charset, sizeof(c_charset));
   }
   // Now loop over Accept-Charset field values.
-  // TODO: Should we check the return value (count) from this?
-  accept_field->value_get_comma_list(&a_values_list);
-
-  for (a_value = a_values_list.head; a_value; a_value = a_value->next) {
-    // Get the raw string to the current comma-sep Accept-Charset field value
-    a_raw = a_value->str;
-    a_raw_len = a_value->len;
-
-    // Extract the field value before the semicolon
-    StrList a_param_list(true); // FIXME: copies & NUL-terminates strings
-    HttpCompat::parse_semicolon_list(&a_param_list, a_raw, a_raw_len);
-
-    if (a_param_list.head) {
-      a_charset = (char *) a_param_list.head->str;
-      a_charset_len = a_param_list.head->len;
-    } else
-      continue;
-
-//      printf("matching Content-type; '%s' with Accept-Charset value '%s'\n",
-//             c_charset,a_charset);
+  accept_list->parse();
+  for (int i = 0; i < accept_list->count; i++) {
+    a_charset = accept_list->values[i].str;
+    a_charset_len = accept_list->values[i].len;
 
     // dont match wildcards //
     if ((a_charset_len == 1) && (a_charset[0] == '*')) {
       wildcard_present = true;
-      wildcard_q = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+      wildcard_q = accept_list->values[i].q;
     } else {
       // if type matches, get the Q factor //
       if (does_charset_match(a_charset, c_charset)) {
-        float tq;
-        tq = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+        float tq = accept_list->values[i].q;
         q = (tq > q ? tq : q);
       }
     }
@@ -724,7 +708,7 @@ HttpTransactCache::calculate_quality_of_accept_charset_match(MIMEField * accept_
 
 */
 static inline bool
-does_encoding_match(char *enc1, const char *enc2)
+does_encoding_match(const char *enc1, const char *enc2)
 {
   if (is_asterisk(enc1) || ((strcasecmp(enc1, enc2)) == 0))
     return true;
@@ -772,44 +756,77 @@ HttpTransactCache::match_gzip(MIMEField * accept_field)
   return NO_GZIP;
 }
 
-// TODO: This used to take a length for c_raw, but that was never used, so removed it from the prototype.
-static inline bool
-match_accept_content_encoding(const char *c_raw,
-                              MIMEField * accept_field, bool * wildcard_present, float *wildcard_q, float *q)
+void
+HttpAcceptList::do_parse()
 {
-  Str *a_value;
-  const char *a_raw;
   StrList a_values_list;
+  Arena *arena = m_arena;
 
-  if (!accept_field) {
-    return false;
-  }
-  // loop over Accept-Encoding elements, looking for match //
+  m_parsed = true;
   // TODO: Should we check the return value (count) here?
-  accept_field->value_get_comma_list(&a_values_list);
+  field->value_get_comma_list(&a_values_list);
+  if (a_values_list.count <= 0)
+    return;
+  values = (HttpAcceptValue *) arena->alloc(a_values_list.count * sizeof(HttpAcceptValue));
 
-  for (a_value = a_values_list.head; a_value; a_value = a_value->next) {
-    char *a_encoding = NULL;
+  for (Str * a_value = a_values_list.head; a_value; a_value = a_value->next) {
     StrList a_param_list;
 
-    // Get the raw string to the current comma-sep Accept-Charset field value
-    a_raw = a_value->str;
-
-    // break Accept-Encoding piece into semi-colon separated parts //
-    HttpCompat::parse_semicolon_list(&a_param_list, a_raw);
-    if (a_param_list.head)
-      a_encoding = (char *) a_param_list.head->str;
-    else
+    // break the value into semi-colon separated parts //
+    HttpCompat::parse_semicolon_list(&a_param_list, a_value->str, a_value->len);
+    if (!a_param_list.head)
       continue;
 
+    HttpAcceptValue *v = &values[count++];
+    v->str = arena->str_store(a_param_list.head->str, a_param_list.head->len);
+    v->len = a_param_list.head->len;
+    v->q = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+    v->type = v->subtype = NULL;
+    if (m_media_ranges) {
+      v->type = (char *) arena->alloc(32);
+      v->subtype = (char *) arena->alloc(32);
+      HttpCompat::parse_mime_type(v->str, v->type, v->subtype, 32, 32);
+    }
+    if (gzip == NO_GZIP && v->q != 0 && does_encoding_match(v->str, "gzip"))
+      gzip = GZIP;
+  }
+}
+
+void
+HttpAcceptPrefs::init(HTTPHdr * client_request, CacheLookupHttpConfig * http_config_params)
+{
+  // Fields whose mismatches are ignored are never matched, so skip them.
+  if (!http_config_params->ignore_accept_mismatch)
+    accept.init(client_request->field_find(MIME_FIELD_ACCEPT, MIME_LEN_ACCEPT), &arena, true);
+  if (!http_config_params->ignore_accept_charset_mismatch)
+    accept_charset.init(client_request->field_find(MIME_FIELD_ACCEPT_CHARSET, MIME_LEN_ACCEPT_CHARSET), &arena);
+  if (!http_config_params->ignore_accept_encoding_mismatch)
+    accept_encoding.init(client_request->field_find(MIME_FIELD_ACCEPT_ENCODING, MIME_LEN_ACCEPT_ENCODING), &arena);
+  if (!http_config_params->ignore_accept_language_mismatch)
+    accept_language.init(client_request->field_find(MIME_FIELD_ACCEPT_LANGUAGE, MIME_LEN_ACCEPT_LANGUAGE), &arena);
+  select_alt_hook = (http_global_hooks->get(TS_HTTP_SELECT_ALT_HOOK) != NULL);
+}
+
+// TODO: This used to take a length for c_raw, but that was never used, so removed it from the prototype.
+static inline bool
+match_accept_content_encoding(const char *c_raw,
+                              HttpAcceptList * accept_list, bool * wildcard_present, float *wildcard_q, float *q)
+{
+  if (!accept_list->field) {
+    return false;
+  }
+  // loop over Accept-Encoding elements, looking for match //
+  accept_list->parse();
+  for (int i = 0; i < accept_list->count; i++) {
+    const char *a_encoding = accept_list->values[i].str;
+
     if (is_asterisk(a_encoding)) {
       *wildcard_present = true;
-      *wildcard_q = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+      *wildcard_q = accept_list->values[i].q;
       return true;
     } else if (does_encoding_match(a_encoding, c_raw)) {
       // if type matches, get the Q factor //
-      float tq;
-      tq = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+      float tq = accept_list->values[i].q;
       *q = (tq > *q ? tq : *q);
 
       return true;
@@ -821,10 +838,11 @@ match_accept_content_encoding(const char *c_raw,
 }
 
 float
-HttpTransactCache::calculate_quality_of_accept_encoding_match(MIMEField * accept_field,
+HttpTransactCache::calculate_quality_of_accept_encoding_match(HttpAcceptList * accept_list,
                                                               MIMEField * content_field,
                                                               MIMEField * cached_accept_field)
 {
+  MIMEField *accept_field = accept_list->field;
 
   float q = -1.0;
   bool is_identity_encoding = false;
@@ -903,10 +921,10 @@ HttpTransactCache::calculate_quality_of_accept_encoding_match(MIMEField * accept
   // field, with a q value;
   if (!content_field) {
     if (!match_accept_content_encoding("identity",
-                                       accept_field, &wildcard_present, &wildcard_q, &q)) {
+                                       accept_list, &wildcard_present, &wildcard_q, &q)) {
 
       // CE was not returned, and AE does not have identity
-      if (match_gzip(accept_field) == GZIP && match_gzip(cached_accept_field) == GZIP) {
+      if (accept_list->gzip == GZIP && match_gzip(cached_accept_field) == GZIP) {
         return (float) 1.0;
       }
       goto encoding_wildcard;
@@ -927,7 +945,7 @@ HttpTransactCache::calculate_quality_of_accept_encoding_match(MIMEField * accept
     for (c_value = c_values_list.head; c_value; c_value = c_value->next) {
       float this_q = -1.0;
       if (!match_accept_content_encoding(c_value->str,
-                                         accept_field, &wildcard_present, &wildcard_q, &this_q)) {
+                                         accept_list, &wildcard_present, &wildcard_q, &this_q)) {
         goto encoding_wildcard;
       }
       combined_q *= this_q;
@@ -946,7 +964,8 @@ encoding_wildcard:
   // still okay, but otherwise, this is just not a match at all.         //
   /////////////////////////////////////////////////////////////////////////
   if ((q == -1.0) && is_identity_encoding) {
-    if (match_gzip(accept_field) == GZIP) {
+    accept_list->parse();
+    if (accept_list->gzip == GZIP) {
       if (match_gzip(cached_accept_field) == GZIP) {
         return (float) 1.0;
       } else {
@@ -995,30 +1014,17 @@ does_language_range_match(const char *range1, const char *range2)
 
 static inline bool
 match_accept_content_language(const char *c_raw,
-                              MIMEField * accept_field,
+                              HttpAcceptList * accept_list,
                               bool * wildcard_present,
                               float *wildcard_q, float *q, int *a_range_length)
 {
-  const char *a_raw;
-  int a_raw_len;
-  StrList a_values_list;
-  Str *a_value;
-
-  ink_assert(accept_field != NULL);
+  ink_assert(accept_list->field != NULL);
 
   // loop over each language-range pattern //
-  // TODO: Should we check the return value (count) here?
-  accept_field->value_get_comma_list(&a_values_list);
-
-  for (a_value = a_values_list.head; a_value; a_value = a_value->next) {
-    a_raw = a_value->str;
-    a_raw_len = a_value->len;
-
-    char *a_range;
-    StrList a_param_list;
-
-    HttpCompat::parse_semicolon_list(&a_param_list, a_raw, a_raw_len);
-    float tq = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+  accept_list->parse();
+  for (int i = 0; i < accept_list->count; i++) {
+    const char *a_range;
+    float tq = accept_list->values[i].q;
 
     /////////////////////////////////////////////////////////////////////
     // This algorithm is a bit wierd --- the resulting Q factor is     //
@@ -1027,16 +1033,12 @@ match_accept_content_language(const char *c_raw,
     // Also, if the lang value is "", meaning that no Content-Language //
     // was specified, this document matches all accept headers.        //
     /////////////////////////////////////////////////////////////////////
-    if (a_param_list.head) {
-      a_range = (char *) a_param_list.head->str;
-      *a_range_length = a_param_list.head->len;
-    } else {
-      continue;
-    }
+    a_range = accept_list->values[i].str;
+    *a_range_length = accept_list->values[i].len;
 
     if (is_asterisk(a_range)) {
       *wildcard_present = true;
-      *wildcard_q = HttpCompat::find_Q_param_in_strlist(&a_param_list);
+      *wildcard_q = tq;
       return true;
     } else if (does_language_range_match(a_range, c_raw)) {
       *q = tq;
@@ -1060,10 +1062,11 @@ match_accept_content_language(const char *c_raw,
 //      be updated to use the code in HttpCompat::match_accept_language.
 
 float
-HttpTransactCache::calculate_quality_of_accept_language_match(MIMEField * accept_field,
+HttpTransactCache::calculate_quality_of_accept_language_match(HttpAcceptList * accept_list,
                                                               MIMEField * content_field,
                                                               MIMEField * cached_accept_field)
 {
+  MIMEField *accept_field = accept_list->field;
   float q = -1.0;
   int a_range_length;
   bool wildcard_present = false;
@@ -1094,7 +1097,7 @@ HttpTransactCache::calculate_quality_of_accept_language_match(MIMEField * accept
 
   if (!content_field) {
     if (match_accept_content_language("identity",
-                                      accept_field,
+                                      accept_list,
                                       &wildcard_present, &wildcard_q, &q, &a_range_length)) {
       goto language_wildcard;
     }
@@ -1110,7 +1113,7 @@ HttpTransactCache::calculate_quality_of_accept_language_match(MIMEField * accept
 
     // get Content-Language value //
     if (match_accept_content_language(c_raw,
-                                      accept_field,
+                                      accept_list,
                                       &wildcard_present, &wildcard_q, &q, &a_range_length)) {
       min_q = (min_q < q ? min_q : q);
       match_found = true;
@@ -1558,3 +1561,87 @@ CacheLookupHttpConfig::unmarshal(Arena * arena, const char *buf, int buflen)
 
   return (p - buf);
 }
+
+#if TS_HAS_TESTS
+#include "TestBox.h"
+
+static void
+add_language_alternate(CacheHTTPInfoVector * vector, const char *lang, time_t now)
+{
+  CacheHTTPInfo info;
+  HTTPHdr req, resp;
+  INK_MD5 key;
+
+  req.create(HTTP_TYPE_REQUEST);
+  req.method_set(HTTP_METHOD_GET, HTTP_LEN_GET);
+  req.value_set(MIME_FIELD_ACCEPT, MIME_LEN_ACCEPT, "text/html, */*;q=0.1", 20);
+  req.value_set(MIME_FIELD_ACCEPT_ENCODING, MIME_LEN_ACCEPT_ENCODING, "gzip, deflate", 13);
+  req.value_set(MIME_FIELD_ACCEPT_LANGUAGE, MIME_LEN_ACCEPT_LANGUAGE, lang, strlen(lang));
+
+  resp.create(HTTP_TYPE_RESPONSE);
+  resp.status_set(HTTP_STATUS_OK);
+  resp.set_date(now);
+  resp.value_set(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE, "text/html; charset=utf-8", 24);
+  resp.value_set(MIME_FIELD_CONTENT_LANGUAGE, MIME_LEN_CONTENT_LANGUAGE, lang, strlen(lang));
+  resp.value_set(MIME_FIELD_VARY, MIME_LEN_VARY, "Accept-Language", 15);
+
+  key.encodeBuffer(lang, strlen(lang));
+  info.create();
+  info.request_set(&req);
+  info.response_set(&resp);
+  info.request_sent_time_set(now);
+  info.response_received_time_set(now);
+  info.object_key_set(key);
+  vector->insert(&info);
+
+  req.destroy();
+  resp.destroy();
+}
+
+REGRESSION_TEST(HttpTransactCache_SelectFromAlternates)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  CacheLookupHttpConfig config;
+  time_t now = ink_cluster_time();
+  const int iterations = 1000;
+
+  box = REGRESSION_TEST_PASSED;
+
+  for (int n = 1; n <= 64; n *= 2) {
+    CacheHTTPInfoVector vector;
+    char lang[16], tag[32];
+
+    for (int i = 0; i < n; i++) {
+      snprintf(lang, sizeof(lang), "x-lang%d", i);
+      add_language_alternate(&vector, lang, now);
+    }
+
+    // the client wants the last alternate added
+    HTTPHdr client;
+    client.create(HTTP_TYPE_REQUEST);
+    client.method_set(HTTP_METHOD_GET, HTTP_LEN_GET);
+    client.value_set(MIME_FIELD_ACCEPT, MIME_LEN_ACCEPT, "text/html, */*;q=0.1", 20);
+    client.value_set(MIME_FIELD_ACCEPT_ENCODING, MIME_LEN_ACCEPT_ENCODING, "gzip, deflate", 13);
+    client.value_set(MIME_FIELD_ACCEPT_LANGUAGE, MIME_LEN_ACCEPT_LANGUAGE, lang, strlen(lang));
+
+    int selected = -1;
+    ink_hrtime start = ink_get_hrtime_internal();
+    for (int i = 0; i < iterations; i++)
+      selected = HttpTransactCache::SelectFromAlternates(&vector, &client, &config);
+    ink_hrtime elapsed = ink_get_hrtime_internal() - start;
+
+    box.check(selected == n - 1, "%d alternates: selected %d, expected %d", n, selected, n - 1);
+    snprintf(tag, sizeof(tag), "ns_per_select_%d", n);
+    rperf(t, tag, (double) elapsed / iterations);
+
+    // no alternate has this language
+    client.value_set(MIME_FIELD_ACCEPT_LANGUAGE, MIME_LEN_ACCEPT_LANGUAGE, "x-none", 6);
+    selected = HttpTransactCache::SelectFromAlternates(&vector, &client, &config);
+    box.check(selected == -1, "%d alternates: selected %d for an unknown language", n, selected);
+
+    client.destroy();
+    vector.clear();
+  }
+}
+
+#endif // TS_HAS_TESTS
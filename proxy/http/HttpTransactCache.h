@@ -96,6 +96,72 @@ enum ContentEncoding
   GZIP
 };
 
+/**
+  One comma separated value of a client Accept* field: the part before
+  the first semicolon, NUL terminated, and its q value.  For Accept the
+  media range is also split into type and subtype.
+*/
+struct HttpAcceptValue
+{
+  const char *str;
+  int len;
+  float q;
+  char *type;
+  char *subtype;
+};
+
+/**
+  A client Accept* field split into values once, so that matching it
+  against many alternates does not re-parse it for each one.  The field
+  is parsed on first use, into the arena passed to init().
+*/
+struct HttpAcceptList
+{
+  MIMEField *field;             // NULL if the request has no such field
+  HttpAcceptValue *values;
+  int count;
+  ContentEncoding gzip;         // match_gzip() of the field
+
+  HttpAcceptList():field(NULL), values(NULL), count(0), gzip(NO_GZIP), m_arena(NULL), m_media_ranges(false),
+    m_parsed(false) { }
+  void init(MIMEField * f, Arena * arena, bool media_ranges = false)
+  {
+    field = f;
+    m_arena = arena;
+    m_media_ranges = media_ranges;
+    m_parsed = (f == NULL);
+  }
+  void parse()
+  {
+    if (!m_parsed)
+      do_parse();
+  }
+
+private:
+  void do_parse();
+
+  Arena *m_arena;
+  bool m_media_ranges;
+  bool m_parsed;
+};
+
+/**
+  The content negotiation preferences of a client request, parsed once
+  per SelectFromAlternates() call.
+*/
+struct HttpAcceptPrefs
+{
+  HttpAcceptList accept;
+  HttpAcceptList accept_charset;
+  HttpAcceptList accept_encoding;
+  HttpAcceptList accept_language;
+  bool select_alt_hook;         // TS_HTTP_SELECT_ALT_HOOK has to see every alternate
+  Arena arena;
+
+  HttpAcceptPrefs():select_alt_hook(false) { }
+  void init(HTTPHdr * client_request, CacheLookupHttpConfig * http_config_params);
+};
+
 
 class HttpTransactCache
 {
@@ -112,18 +178,23 @@ public:
                                           HTTPHdr * obj_client_request, // in
                                           HTTPHdr * obj_origin_server_response);        // in
 
-  static float calculate_quality_of_accept_match(MIMEField * accept_field, MIMEField * content_field);
+  static float calculate_quality_of_match(CacheLookupHttpConfig * http_config_params, HTTPHdr * client_request, // in
+                                          HttpAcceptPrefs * prefs,      // in
+                                          HTTPHdr * obj_client_request, // in
+                                          HTTPHdr * obj_origin_server_response);        // in
+
+  static float calculate_quality_of_accept_match(HttpAcceptList * accept_list, MIMEField * content_field);
 
-  static float calculate_quality_of_accept_charset_match(MIMEField * accept_field,
+  static float calculate_quality_of_accept_charset_match(HttpAcceptList * accept_list,
                                                          MIMEField * content_field,
                                                          MIMEField * cached_accept_field = NULL);
 
-  static float calculate_quality_of_accept_encoding_match(MIMEField * accept_field,
+  static float calculate_quality_of_accept_encoding_match(HttpAcceptList * accept_list,
                                                           MIMEField * content_field,
                                                           MIMEField * cached_accept_field = NULL);
   static ContentEncoding match_gzip(MIMEField * accept_field);
 
-  static float calculate_quality_of_accept_language_match(MIMEField * accept_field,
+  static float calculate_quality_of_accept_language_match(HttpAcceptList * accept_list,
                                                           MIMEField * content_field,
                                                           MIMEField * cached_accept_field = NULL);
 
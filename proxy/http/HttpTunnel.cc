@@ -106,7 +106,7 @@ ChunkedHandler::read_size()
   int64_t bytes_used;
   bool done = false;
 
-  while (chunked_reader->read_avail() > 0 && !done) {
+  while (chunked_reader->is_read_avail_more_than(0) && !done) {
     const char *tmp = chunked_reader->start();
     int64_t data_size = chunked_reader->block_read_avail();
 
@@ -114,42 +114,53 @@ ChunkedHandler::read_size()
     bytes_used = 0;
 
     while (data_size > 0) {
-      bytes_used++;
-      if (state == CHUNK_READ_SIZE) {
-        // The http spec says the chunked size is always in hex
-        if (ParseRules::is_hex(*tmp)) {
-          num_digits++;
-          running_sum *= 16;
-
-          if (ParseRules::is_digit(*tmp)) {
-            running_sum += *tmp - '0';
-          } else {
-            running_sum += ParseRules::ink_tolower(*tmp) - 'a' + 10;
-          }
-        } else {
-          // We are done parsing size
-          if (num_digits == 0 || running_sum < 0) {
-            // Bogus chunk size
-            state = CHUNK_READ_ERROR;
-            done = true;
-            break;
-          } else {
-            state = CHUNK_READ_SIZE_CRLF;       // now look for CRLF
-          }
+      if (state != CHUNK_READ_SIZE) {
+        // Both CHUNK_READ_SIZE_CRLF and CHUNK_READ_SIZE_START only wait
+        // for the end of the line, so let memchr() skip over any chunk
+        // extension and the CR rather than stepping through them.
+        const char *lf = static_cast<const char *>(memchr(tmp, '\n', data_size));
+
+        if (lf == NULL) {
+          bytes_used += data_size;
+          break;
         }
-      } else if (state == CHUNK_READ_SIZE_CRLF) {       // Scan for a linefeed
-        if (ParseRules::is_lf(*tmp)) {
+        bytes_used += lf - tmp + 1;
+        data_size -= lf - tmp + 1;
+        tmp = lf + 1;
+
+        if (state == CHUNK_READ_SIZE_CRLF) {
           Debug("http_chunk", "read chunk size of %d bytes", running_sum);
           bytes_left = (cur_chunk_size = running_sum);
           state = (running_sum == 0) ? CHUNK_READ_TRAILER_BLANK : CHUNK_READ_CHUNK;
           done = true;
           break;
         }
-      } else if (state == CHUNK_READ_SIZE_START) {
-        if (ParseRules::is_lf(*tmp)) {
-          running_sum = 0;
-          num_digits = 0;
-          state = CHUNK_READ_SIZE;
+        running_sum = 0;
+        num_digits = 0;
+        state = CHUNK_READ_SIZE;
+        continue;
+      }
+
+      bytes_used++;
+      // The http spec says the chunked size is always in hex
+      if (ParseRules::is_hex(*tmp)) {
+        num_digits++;
+        running_sum *= 16;
+
+        if (ParseRules::is_digit(*tmp)) {
+          running_sum += *tmp - '0';
+        } else {
+          running_sum += ParseRules::ink_tolower(*tmp) - 'a' + 10;
+        }
+      } else {
+        // We are done parsing size
+        if (num_digits == 0 || running_sum < 0) {
+          // Bogus chunk size
+          state = CHUNK_READ_ERROR;
+          done = true;
+          break;
+        } else {
+          state = CHUNK_READ_SIZE_CRLF;       // now look for CRLF
         }
       }
       tmp++;
@@ -234,6 +245,19 @@ ChunkedHandler::read_trailer()
 
     ink_assert(data_size > 0);
     for (bytes_used = 0; data_size > 0; data_size--) {
+      if (state == CHUNK_READ_TRAILER_LINE) {
+        // Only the LF ending a trailer line changes the state, so skip
+        // straight to it.
+        const char *lf = static_cast<const char *>(memchr(tmp, '\n', data_size));
+
+        if (lf == NULL) {
+          bytes_used += data_size;
+          break;
+        }
+        bytes_used += lf - tmp;
+        data_size -= lf - tmp;
+        tmp = lf;
+      }
       bytes_used++;
 
       if (ParseRules::is_cr(*tmp)) {
@@ -309,7 +333,10 @@ bool ChunkedHandler::generate_chunked_content()
     break;
   }
 
-  while ((r_avail = dechunked_reader->read_avail()) > 0 && state != CHUNK_WRITE_DONE) {
+  // Nothing is added to the dechunked buffer while we run, so take the
+  // (block walking) read_avail() once rather than once per chunk.
+  r_avail = dechunked_reader->read_avail();
+  while (r_avail > 0 && state != CHUNK_WRITE_DONE) {
     int64_t write_val = MIN(max_chunk_size, r_avail);
 
     state = CHUNK_WRITE_CHUNK;
@@ -325,19 +352,20 @@ bool ChunkedHandler::generate_chunked_content()
       chunked_size += max_chunk_header_len;
     }
 
-    // Output the chunk itself.
-    //
-    // BZ# 54395 Note - we really should only do a
-    //   block transfer if there is sizable amount of
-    //   data (like we do for the case where we are
-    //   removing chunked encoding in ChunkedHandler::transfer_bytes()
-    //   However, I want to do this fix with as small a risk
-    //   as possible so I'm leaving this issue alone for
-    //   now
-    //
-    chunked_buffer->write(dechunked_reader, write_val);
+    // Output the chunk itself.  Like transfer_bytes(), small chunks are
+    // copied in next to their header instead of being block referenced so
+    // the output is not a long chain of tiny blocks.
+    if (write_val < min_block_transfer_bytes) {
+      char body[min_block_transfer_bytes];
+
+      dechunked_reader->memcpy(body, write_val);
+      chunked_buffer->write(body, write_val);
+    } else {
+      chunked_buffer->write(dechunked_reader, write_val);
+    }
     chunked_size += write_val;
     dechunked_reader->consume(write_val);
+    r_avail -= write_val;
 
     // Output the trailing CRLF.
     chunked_buffer->write("\r\n", 2);
@@ -1598,3 +1626,136 @@ HttpTunnel::deallocate_redirect_postdata_buffers()
     postbuf = NULL;
   }
 }
+
+#if TS_HAS_TESTS
+#include "TestBox.h"
+
+// Dechunk a body with chunk extensions and a trailer, fed a byte at a time
+// so every delimiter lands at a read boundary.
+REGRESSION_TEST(HttpTunnel_ChunkedParse)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  static char const body[] = "5;name=value\r\nhello\r\n6\r\n world\r\n0;last\r\nX-Trailer: a\r\n\r\n";
+  HttpTunnelProducer dechunker;
+  ChunkedHandler dec;
+  MIOBuffer *wire = new_MIOBuffer(BUFFER_SIZE_INDEX_4K);
+  IOBufferReader *out;
+  char result[16];
+  int64_t len;
+
+  box = REGRESSION_TEST_PASSED;
+
+  dechunker.do_dechunking = true;
+  dec.init(wire->alloc_reader(), &dechunker);
+  dec.state = ChunkedHandler::CHUNK_READ_SIZE;
+  out = dec.dechunked_buffer->alloc_reader();
+
+  for (unsigned i = 0; i < sizeof(body) - 1; i++) {
+    wire->write(body + i, 1);
+    if (dec.process_chunked_content())
+      break;
+  }
+
+  len = out->read_avail();
+  memset(result, 0, sizeof(result));
+  out->memcpy(result, MIN(len, (int64_t) sizeof(result) - 1));
+  box.check(dec.state == ChunkedHandler::CHUNK_READ_DONE, "decoder state %d", dec.state);
+  box.check(len == 11 && strcmp(result, "hello world") == 0, "dechunked '%s'", result);
+  box.check(!dec.chunked_reader->is_read_avail_more_than(0), "trailer not consumed");
+
+  free_MIOBuffer(dec.dechunked_buffer);
+  free_MIOBuffer(wire);
+}
+
+// Push a body through a chunking and then a dechunking ChunkedHandler the
+// way a tunnel would, a read's worth at a time, and report the throughput
+// of each side for a few output chunk sizes.  The chunked stream is copied
+// into 32K blocks in between, as it would arrive from the network.
+REGRESSION_TEST(HttpTunnel_ChunkedThroughput)(RegressionTest * t, int /* atype ATS_UNUSED */, int * pstatus)
+{
+  TestBox box(t, pstatus);
+  static int64_t const chunk_sizes[] = { 64, 4096, 65536 };
+  int64_t const read_size = 32 * 1024;
+  int64_t const total = 16 * 1024 * 1024;
+  char *data = static_cast<char *>(ats_malloc(read_size));
+  char *check = static_cast<char *>(ats_malloc(read_size));
+
+  box = REGRESSION_TEST_PASSED;
+
+  for (int64_t i = 0; i < read_size; i++)
+    data[i] = static_cast<char>(i % 251);
+
+  for (unsigned i = 0; i < countof(chunk_sizes); i++) {
+    HttpTunnelProducer chunker, dechunker;
+    ChunkedHandler enc, dec;
+    MIOBuffer *src = new_MIOBuffer(BUFFER_SIZE_INDEX_32K);
+    MIOBuffer *wire = new_MIOBuffer(BUFFER_SIZE_INDEX_32K);
+    IOBufferReader *src_reader = src->alloc_reader();
+    IOBufferReader *chunked, *out;
+    ink_hrtime enc_time = 0, dec_time = 0, start;
+    int64_t verified = 0;
+    char tag[32];
+
+    chunker.do_chunking = true;
+    enc.init(src_reader, &chunker);
+    enc.set_max_chunk_size(chunk_sizes[i]);
+    enc.state = ChunkedHandler::CHUNK_WRITE_CHUNK;
+    chunked = enc.chunked_buffer->alloc_reader();
+
+    dechunker.do_dechunking = true;
+    dec.init(wire->alloc_reader(), &dechunker);
+    dec.state = ChunkedHandler::CHUNK_READ_SIZE;
+    out = dec.dechunked_buffer->alloc_reader();
+
+    for (int64_t n = 0; n < total; n += read_size) {
+      src->write(data, read_size);
+      if (n + read_size >= total)
+        enc.last_server_event = VC_EVENT_READ_COMPLETE;
+
+      start = ink_get_hrtime_internal();
+      enc.generate_chunked_content();
+      enc_time += ink_get_hrtime_internal() - start;
+      src_reader->consume(src_reader->read_avail());
+      while (chunked->is_read_avail_more_than(0)) {
+        int64_t len = chunked->block_read_avail();
+
+        wire->write(chunked->start(), len);
+        chunked->consume(len);
+      }
+
+      start = ink_get_hrtime_internal();
+      dec.process_chunked_content();
+      dec_time += ink_get_hrtime_internal() - start;
+
+      while (out->read_avail() >= read_size) {
+        out->memcpy(check, read_size);
+        out->consume(read_size);
+        if (memcmp(check, data, read_size) != 0)
+          break;
+        verified += read_size;
+      }
+    }
+
+    box.check(enc.state == ChunkedHandler::CHUNK_WRITE_DONE, "chunk size %d: encoder did not finish",
+              (int) chunk_sizes[i]);
+    box.check(dec.state == ChunkedHandler::CHUNK_READ_DONE, "chunk size %d: decoder state %d",
+              (int) chunk_sizes[i], dec.state);
+    box.check(dec.dechunked_size == total && verified == total, "chunk size %d: dechunked %d bytes, %d intact",
+              (int) chunk_sizes[i], (int) dec.dechunked_size, (int) verified);
+
+    snprintf(tag, sizeof(tag), "chunk_MBps_%d", (int) chunk_sizes[i]);
+    rperf(t, tag, (double) total / enc_time * HRTIME_SECOND / (1024 * 1024));
+    snprintf(tag, sizeof(tag), "dechunk_MBps_%d", (int) chunk_sizes[i]);
+    rperf(t, tag, (double) total / dec_time * HRTIME_SECOND / (1024 * 1024));
+
+    free_MIOBuffer(dec.dechunked_buffer);
+    free_MIOBuffer(enc.chunked_buffer);
+    free_MIOBuffer(wire);
+    free_MIOBuffer(src);
+  }
+
+  ats_free(check);
+  ats_free(data);
+}
+
+#endif // TS_HAS_TESTS
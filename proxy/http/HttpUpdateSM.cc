@@ -70,7 +70,7 @@ HttpUpdateSM::start_scheduled_update(Continuation * cont, HTTPHdr * request)
   start_sub_sm();
 
   // Make a copy of the request we being asked to do
-  t_state.hdr_info.client_request.create(HTTP_TYPE_REQUEST);
+  t_state.hdr_create(&t_state.hdr_info.client_request, HTTP_TYPE_REQUEST);
   t_state.hdr_info.client_request.copy(request);
 
   // Fix ME: What should these be set to since there is not a
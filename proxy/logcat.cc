@@ -42,6 +42,7 @@
 #include "LogObject.h"
 #include "LogConfig.h"
 #include "LogBuffer.h"
+#include "LogColumnar.h"
 #include "LogUtils.h"
 #include "LogSock.h"
 #include "Log.h"
@@ -55,6 +56,9 @@ static int clf_flag = 0;
 static int elf_flag = 0;
 static int elf2_flag = 0;
 static int auto_filenames = 0;
+static int columnar_flag = 0;
+static int benchmark_flag = 0;
+static int compression_level = LogColumnar::DEFAULT_COMPRESSION_LEVEL;
 static int overwrite_existing_file = 0;
 static char output_file[1024];
 extern int CacheClusteringEnabled;
@@ -65,6 +69,9 @@ static const ArgumentDescription argument_descriptions[] = {
   {"output_file", 'o', "Specify output file", "S1023", &output_file, NULL, NULL},
   {"auto_filenames", 'a', "Automatically generate output names",
    "T", &auto_filenames, NULL, NULL},
+  {"benchmark", 'b', "Time converting the input to ASCII and columnar", "T", &benchmark_flag, NULL, NULL},
+  {"columnar", 'c', "Convert to columnar blocks", "T", &columnar_flag, NULL, NULL},
+  {"compression_level", 'z', "Compression level of columnar blocks", "I", &compression_level, NULL, NULL},
   {"follow", 'f', "Follow the log file as it grows", "T", &follow_flag, NULL, NULL},
   {"clf", 'C', "Convert to Common Logging Format", "T", &clf_flag, NULL, NULL},
   {"elf", 'E', "Convert to Extended Logging Format", "T", &elf_flag, NULL, NULL},
@@ -78,14 +85,247 @@ static const ArgumentDescription argument_descriptions[] = {
    NULL}
 };
 
-static const char *USAGE_LINE = "Usage: " PROGRAM_NAME " [-o output-file | -a] [-CEhS"
+static const char *USAGE_LINE = "Usage: " PROGRAM_NAME " [-o output-file | -a] [-bcCEhS"
 #ifdef DEBUG
   "T"
 #endif
-  "Vw2] [input-file ...]";
+  "Vw2] [-z level] [input-file ...]";
 
 
 
+// Totals for --benchmark
+static struct
+{
+  int64_t buffers;
+  int64_t entries;
+  int64_t binary_bytes;
+  int64_t ascii_bytes;
+  int64_t columnar_bytes;
+  int64_t deflated_bytes;
+  int64_t mismatches;
+  ink_hrtime ascii_time;
+  ink_hrtime columnar_time;
+  ink_hrtime deflated_time;
+} bench;
+
+// Return the fieldlist of a buffer's entries, or NULL for text logs.
+static LogFieldList *
+buffer_fieldlist(LogBufferHeader * header)
+{
+  static LogFieldList *fieldlist = NULL;
+  static char *fieldlist_str = NULL;
+  char *str = header->fmt_fieldlist();
+
+  if (header->format_type == TEXT_LOG || !str)
+    return NULL;
+
+  if (!fieldlist_str || strcmp(fieldlist_str, str) != 0) {
+    bool contains_aggregates = false;
+
+    delete fieldlist;
+    ats_free(fieldlist_str);
+    fieldlist = NEW(new LogFieldList);
+    fieldlist_str = ats_strdup(str);
+    LogFormat::parse_symbol_string(str, fieldlist, &contains_aggregates);
+  }
+  return fieldlist;
+}
+
+static int
+ascii_entry(LogBufferHeader * header, LogEntryHeader * entry, char *buf, int len)
+{
+  return LogBuffer::to_ascii(entry, (LogFormatType) header->format_type, buf, len,
+                             header->fmt_fieldlist(), header->fmt_printf(), header->version, NULL);
+}
+
+// Convert the buffer to ASCII in memory and encode it into columnar blocks,
+// with and without compression, timing each. Then check the compressed
+// block decodes to the same entries.
+static void
+benchmark_logbuffer(LogBufferHeader * header)
+{
+  char line[LOG_MAX_FORMATTED_LINE];
+  char decoded_line[LOG_MAX_FORMATTED_LINE];
+  LogEntryHeader *entry;
+  LogFieldList *fieldlist = buffer_fieldlist(header);
+
+  ink_hrtime start = ink_get_hrtime_internal();
+  LogBufferIterator iter(header);
+  while ((entry = iter.next())) {
+    int n = ascii_entry(header, entry, line, sizeof(line) - 1);
+    if (n > 0)
+      bench.ascii_bytes += n + 1;
+  }
+
+  ink_hrtime ascii_done = ink_get_hrtime_internal();
+  LogColumnarHeader *plain = LogColumnar::encode(header, fieldlist, 0);
+  ink_hrtime columnar_done = ink_get_hrtime_internal();
+  LogColumnarHeader *block = LogColumnar::encode(header, fieldlist, compression_level);
+  ink_hrtime deflated_done = ink_get_hrtime_internal();
+
+  bench.ascii_time += ascii_done - start;
+  bench.columnar_time += columnar_done - ascii_done;
+  bench.deflated_time += deflated_done - columnar_done;
+  bench.binary_bytes += header->byte_count;
+  bench.buffers++;
+
+  LogBufferHeader *decoded = block ? LogColumnar::decode(block) : NULL;
+  bench.columnar_bytes += plain ? plain->byte_count : header->byte_count;
+  bench.deflated_bytes += block ? block->byte_count : header->byte_count;
+  ats_free(plain);
+
+  LogBufferIterator orig_iter(header);
+  if (decoded) {
+    LogBufferIterator decoded_iter(decoded);
+    LogEntryHeader *decoded_entry;
+    while ((entry = orig_iter.next())) {
+      bench.entries++;
+      decoded_entry = decoded_iter.next();
+      int n = ascii_entry(header, entry, line, sizeof(line) - 1);
+      int m = decoded_entry ? ascii_entry(decoded, decoded_entry, decoded_line, sizeof(decoded_line) - 1) : -1;
+      if (n != m || (n > 0 && memcmp(line, decoded_line, n) != 0))
+        bench.mismatches++;
+    }
+  } else {
+    while ((entry = orig_iter.next()))
+      bench.entries++;
+    if (block)
+      bench.mismatches += header->entry_count;
+  }
+
+  ats_free(decoded);
+  ats_free(block);
+}
+
+static void
+print_benchmark_line(const char *name, int64_t bytes, ink_hrtime time)
+{
+  double ms = (double)time / HRTIME_MSECOND;
+
+  printf("%-12s %12" PRId64 " bytes (%.2fx binary), %10.2f ms, %10.0f entries/s\n", name, bytes,
+         bench.binary_bytes ? (double)bytes / bench.binary_bytes : 0.0, ms, ms > 0 ? bench.entries / ms * 1000 : 0.0);
+}
+
+static void
+print_benchmark()
+{
+  char deflated[32];
+
+  snprintf(deflated, sizeof(deflated), "deflated/%d:", compression_level);
+  printf("%" PRId64 " buffers, %" PRId64 " entries, %" PRId64 " binary bytes\n",
+         bench.buffers, bench.entries, bench.binary_bytes);
+  print_benchmark_line("ascii:", bench.ascii_bytes, bench.ascii_time);
+  print_benchmark_line("columnar:", bench.columnar_bytes, bench.columnar_time);
+  print_benchmark_line(deflated, bench.deflated_bytes, bench.deflated_time);
+  if (bench.mismatches)
+    printf("%" PRId64 " entries did not survive columnar encoding!\n", bench.mismatches);
+}
+
+// Write a buffer read from the input in the requested output format.
+static unsigned
+write_logbuffer(LogBufferHeader * header, int out_fd)
+{
+  if (benchmark_flag) {
+    benchmark_logbuffer(header);
+    return 0;
+  }
+
+  if (columnar_flag) {
+    LogColumnarHeader *block = LogColumnar::encode(header, buffer_fieldlist(header), compression_level);
+    char *data = block ? (char *)block : (char *)header;
+    unsigned len = block ? block->byte_count : header->byte_count;
+    unsigned written = 0;
+
+    while (written < len) {
+      int rc = write(out_fd, data + written, len - written);
+      if (rc < 0) {
+        perror("Error writing columnar block");
+        break;
+      }
+      written += rc;
+    }
+    ats_free(block);
+    return written;
+  }
+
+  // see if there is an alternate format request from the command
+  // line
+  //
+  char *alt_format = NULL;
+  if (squid_flag)
+    alt_format = (char *) LogFormat::squid_format;
+  if (clf_flag)
+    alt_format = (char *) LogFormat::common_format;
+  if (elf_flag)
+    alt_format = (char *) LogFormat::extended_format;
+  if (elf2_flag)
+    alt_format = (char *) LogFormat::extended2_format;
+
+  // convert the buffer to ascii entries and place onto stdout
+  //
+  if (header->fmt_fieldlist()) {
+    return LogFile::write_ascii_logbuffer(header, out_fd, ".", alt_format);
+  } else {
+    // TODO investigate why this buffer goes wonky
+  }
+  return 0;
+}
+
+// Read the rest of a columnar block whose first first_read_size bytes are
+// in buffer, and decode it. Returns the decoded LogBuffer, or NULL at the
+// end of the input or on error, with *error set in the latter case.
+static LogBufferHeader *
+read_columnar_block(int in_fd, char *buffer, unsigned first_read_size, bool * error)
+{
+  LogColumnarHeader *header = (LogColumnarHeader *) buffer;
+  LogBufferHeader *decoded = NULL;
+  unsigned second_read_size = sizeof(LogColumnarHeader) - first_read_size;
+  int nread;
+
+  *error = true;
+  nread = read(in_fd, &buffer[first_read_size], second_read_size);
+  if (!nread || nread == EOF) {
+    if (follow_flag)
+      *error = false;
+    else
+      fprintf(stderr, "Bad LogColumnarHeader read!\n");
+    return NULL;
+  }
+
+  if (header->byte_count < sizeof(LogColumnarHeader) || header->byte_count > 16 * LOG_MEGABYTE) {
+    fprintf(stderr, "Bad columnar block!\n");
+    return NULL;
+  }
+
+  unsigned body_bytes = header->byte_count - sizeof(LogColumnarHeader);
+  char *block = (char *)ats_malloc(header->byte_count);
+  memcpy(block, header, sizeof(LogColumnarHeader));
+
+  // Read the body (allowing for "partial" reads)
+  unsigned total = 0;
+  while (total < body_bytes) {
+    int rc = read(in_fd, block + sizeof(LogColumnarHeader) + total, body_bytes - total);
+
+    if ((rc == EOF || rc == 0) && !follow_flag) {
+      fprintf(stderr, "Bad columnar block read!\n");
+      ats_free(block);
+      return NULL;
+    }
+    if (rc > 0)
+      total += rc;
+  }
+
+  decoded = LogColumnar::decode((LogColumnarHeader *) block);
+  ats_free(block);
+  if (!decoded) {
+    fprintf(stderr, "Corrupt columnar block!\n");
+    return NULL;
+  }
+
+  *error = false;
+  return decoded;
+}
+
 static int
 process_file(int in_fd, int out_fd)
 {
@@ -110,6 +350,19 @@ process_file(int in_fd, int out_fd)
     if (!nread || nread == EOF)
       return 0;
 
+    // columnar blocks are decoded back into LogBuffers
+    //
+    if (header->cookie == LOG_COLUMNAR_COOKIE) {
+      bool error;
+      LogBufferHeader *decoded = read_columnar_block(in_fd, buffer, first_read_size, &error);
+
+      if (!decoded)
+        return error ? 1 : 0;
+      bytes += write_logbuffer(decoded, out_fd);
+      ats_free(decoded);
+      continue;
+    }
+
     // ensure that this is a valid logbuffer header
     //
     if (header->cookie != LOG_SEGMENT_COOKIE) {
@@ -161,26 +414,8 @@ process_file(int in_fd, int out_fd)
       fprintf(stderr, "Read too many bytes!\n");
       return 1;
     }
-    // see if there is an alternate format request from the command
-    // line
-    //
-    char *alt_format = NULL;
-    if (squid_flag)
-      alt_format = (char *) LogFormat::squid_format;
-    if (clf_flag)
-      alt_format = (char *) LogFormat::common_format;
-    if (elf_flag)
-      alt_format = (char *) LogFormat::extended_format;
-    if (elf2_flag)
-      alt_format = (char *) LogFormat::extended2_format;
-
-    // convert the buffer to ascii entries and place onto stdout
-    //
-    if (header->fmt_fieldlist()) {
-      bytes += LogFile::write_ascii_logbuffer(header, out_fd, ".", alt_format);
-    } else {
-      // TODO investigate why this buffer goes wonky
-    }
+
+    bytes += write_logbuffer(header, out_fd);
   }
 }
 
@@ -283,8 +518,8 @@ main(int /* argc ATS_UNUSED */, char *argv[])
   int error = NO_ERROR;
 
   if (n_file_arguments) {
-    int bin_ext_len = strlen(BINARY_LOG_OBJECT_FILENAME_EXTENSION);
-    int ascii_ext_len = strlen(ASCII_LOG_OBJECT_FILENAME_EXTENSION);
+    const char *out_ext = columnar_flag ? COLUMNAR_LOG_OBJECT_FILENAME_EXTENSION : ASCII_LOG_OBJECT_FILENAME_EXTENSION;
+    int out_ext_len = strlen(out_ext);
 
     for (unsigned i = 0; i < n_file_arguments; ++i) {
       int in_fd = open(file_arguments[i], O_RDONLY);
@@ -296,19 +531,22 @@ main(int /* argc ATS_UNUSED */, char *argv[])
 #if HAVE_POSIX_FADVISE
         posix_fadvise(in_fd, 0, 0, POSIX_FADV_DONTNEED);
 #endif
-        if (auto_filenames) {
-          // change .blog to .log
+        if (auto_filenames && !benchmark_flag) {
+          // change .blog or .clog to .log, or to .clog when converting
+          // to columnar
           //
-          int n = strlen(file_arguments[i]);
-          int copy_len = (n >= bin_ext_len ? (strcmp(&file_arguments[i][n - bin_ext_len],
-                                                     BINARY_LOG_OBJECT_FILENAME_EXTENSION) ==
-                                              0 ? n - bin_ext_len : n) : n);
+          const char *in_ext = strrchr(file_arguments[i], '.');
+          int copy_len = strlen(file_arguments[i]);
+          if (in_ext && (strcmp(in_ext, BINARY_LOG_OBJECT_FILENAME_EXTENSION) == 0 ||
+                         strcmp(in_ext, COLUMNAR_LOG_OBJECT_FILENAME_EXTENSION) == 0)) {
+            copy_len = in_ext - file_arguments[i];
+          }
 
-          char *out_filename = (char *)ats_malloc(copy_len + ascii_ext_len + 1);
+          char *out_filename = (char *)ats_malloc(copy_len + out_ext_len + 1);
 
           memcpy(out_filename, file_arguments[i], copy_len);
-          memcpy(&out_filename[copy_len], ASCII_LOG_OBJECT_FILENAME_EXTENSION, ascii_ext_len);
-          out_filename[copy_len + ascii_ext_len] = 0;
+          memcpy(&out_filename[copy_len], out_ext, out_ext_len);
+          out_filename[copy_len + out_ext_len] = 0;
 
           out_fd = open_output_file(out_filename);
           ats_free(out_filename);
@@ -343,5 +581,8 @@ main(int /* argc ATS_UNUSED */, char *argv[])
     }
   }
 
+  if (benchmark_flag)
+    print_benchmark();
+
   _exit(error);
 }
@@ -1298,7 +1298,8 @@ Log::flush_thread_main(void * /* args ATS_UNUSED */)
         total_bytes = buffer_header->byte_count;
 
       } else if (logfile->m_file_format == ASCII_LOG
-                 || logfile->m_file_format == ASCII_PIPE){
+                 || logfile->m_file_format == ASCII_PIPE
+                 || logfile->m_file_format == COLUMNAR_LOG){
 
         buf = (char *)fdata->m_data;
         total_bytes = fdata->m_len;
@@ -1505,7 +1506,8 @@ Log::match_logobject(LogBufferHeader * header)
 
     if (fmt->valid()) {
       LogFileFormat file_format = header->log_object_flags & LogObject::BINARY ? BINARY_LOG :
-        (header->log_object_flags & LogObject::WRITES_TO_PIPE ? ASCII_PIPE : ASCII_LOG);
+        (header->log_object_flags & LogObject::COLUMNAR ? COLUMNAR_LOG :
+         (header->log_object_flags & LogObject::WRITES_TO_PIPE ? ASCII_PIPE : ASCII_LOG));
 
       obj = NEW(new LogObject(fmt, Log::config->logfile_dir,
                               header->log_filename(), file_format, NULL,
@@ -1513,7 +1515,8 @@ Log::match_logobject(LogBufferHeader * header)
                               Log::config->collation_preproc_threads,
                               Log::config->rolling_interval_sec,
                               Log::config->rolling_offset_hr,
-                              Log::config->rolling_size_mb));
+                              Log::config->rolling_size_mb,
+                              Log::config->ascii_compression_level));
 
       obj->set_remote_flag();
 
@@ -337,6 +337,9 @@ public:
     case ASCII_PIPE:
       free(m_data);
       break;
+    case COLUMNAR_LOG:
+      ats_free(m_data);
+      break;
     case N_LOGFILE_TYPES:
     default:
       ink_release_assert(!"Unknown file format type!");
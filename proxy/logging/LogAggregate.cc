@@ -0,0 +1,723 @@
+/** @file
+
+  Grouped aggregation of log entries
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "libts.h"
+#include "TestBox.h"
+#include "Error.h"
+#include "P_EventSystem.h"
+#include "LogUtils.h"
+#include "LogAccess.h"
+#include "LogField.h"
+#include "LogFormat.h"
+#include "LogAggregate.h"
+
+/*-------------------------------------------------------------------------
+  LogAggregateHistogram
+
+  The values of a percentile field, in the log-linear buckets of
+  HttpLatencyHistogram: each power of two above 32 is split into 16
+  buckets, so a percentile is within about 6% of the real value. The
+  counts only grow as far as the largest bucket used, and percentiles are
+  kept within the smallest and largest values seen.
+  -------------------------------------------------------------------------*/
+
+struct LogAggregateHistogram
+{
+  static const int SUB_BUCKET_BITS = 5;
+  static const int SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+
+  uint32_t *counts;
+  int size;
+  int64_t min;
+  int64_t max;
+
+  LogAggregateHistogram():counts(NULL), size(0), min(INT64_MAX), max(INT64_MIN) { }
+  ~LogAggregateHistogram() { ats_free(counts); }
+
+  void add(int64_t value, uint32_t n = 1)
+  {
+    int idx = bucket_index(value);
+
+    if (idx >= size)
+      grow(idx + 1);
+    counts[idx] += n;
+    min = value < min ? value : min;
+    max = value > max ? value : max;
+  }
+
+  void merge(const LogAggregateHistogram & h)
+  {
+    if (h.size > size)
+      grow(h.size);
+    for (int i = 0; i < h.size; i++)
+      counts[i] += h.counts[i];
+    min = h.min < min ? h.min : min;
+    max = h.max > max ? h.max : max;
+  }
+
+  void grow(int n)
+  {
+    int new_size = size ? size : SUB_BUCKET_HALF * 4;
+
+    while (new_size < n)
+      new_size *= 2;
+    counts = (uint32_t *) ats_realloc(counts, new_size * sizeof(uint32_t));
+    memset(counts + size, 0, (new_size - size) * sizeof(uint32_t));
+    size = new_size;
+  }
+
+  int64_t percentile(double p, int64_t total) const
+  {
+    int64_t target = (int64_t) ceil(p * total), seen = 0;
+
+    if (target == 0)
+      target = 1;
+    for (int i = 0; i < size; i++) {
+      seen += counts[i];
+      if (seen >= target) {
+        int64_t value = bucket_max(i);
+        return value < min ? min : (value > max ? max : value);
+      }
+    }
+    return 0;
+  }
+
+  static int bucket_index(int64_t value)
+  {
+    if (value < (1 << SUB_BUCKET_BITS))
+      return value < 0 ? 0 : (int) value;
+
+    // Keep the top SUB_BUCKET_BITS bits of the value.
+    int shift = (63 - __builtin_clzll(value)) - (SUB_BUCKET_BITS - 1);
+    return shift * SUB_BUCKET_HALF + (int) (value >> shift);
+  }
+
+  static int64_t bucket_max(int idx)
+  {
+    if (idx < 2 * SUB_BUCKET_HALF)
+      return idx;
+
+    int shift = idx / SUB_BUCKET_HALF - 1;
+    int64_t mantissa = idx - shift * SUB_BUCKET_HALF;
+    return ((mantissa + 1) << shift) - 1;
+  }
+};
+
+/*-------------------------------------------------------------------------
+  LogAggregateGroup
+
+  The entries of one group in an interval. The key is the entry marshalled
+  with the format's field list, with the aggregate fields zeroed, so it is
+  also the group's entry once the aggregate values are filled in.
+  -------------------------------------------------------------------------*/
+
+struct LogAggregateValue
+{
+  int64_t count;
+  int64_t value;                // sum, minimum, maximum, or first or last value
+  ink_hrtime when;              // when the first or last value was seen
+  LogAggregateHistogram *histogram;     // values of a percentile field
+};
+
+struct LogAggregateGroup
+{
+  LogAggregateGroup *next;      // hash chain, or list of collected groups
+  uint64_t hash;
+  unsigned key_len;
+  LogAggregateValue *values;    // one per aggregate field
+  unsigned *offsets;            // where each aggregate field goes in key
+  char *key;
+};
+
+struct LogAggregateShard
+{
+  ink_mutex mutex;
+  LogAggregateGroup **buckets;
+  int bucket_count;             // a power of two
+  int count;
+
+  LogAggregateShard():buckets(NULL), bucket_count(0), count(0)
+  {
+    ink_mutex_init(&mutex, "LogAggregateShard");
+  }
+
+  ~LogAggregateShard()
+  {
+    for (int i = 0; i < bucket_count; i++)
+      LogAggregate::free_groups(buckets[i]);
+    ats_free(buckets);
+    ink_mutex_destroy(&mutex);
+  }
+
+  LogAggregateGroup *find(uint64_t hash, const char *key, unsigned key_len)
+  {
+    if (bucket_count == 0)
+      return NULL;
+    for (LogAggregateGroup *g = buckets[hash & (bucket_count - 1)]; g; g = g->next) {
+      if (g->hash == hash && g->key_len == key_len && memcmp(g->key, key, key_len) == 0)
+        return g;
+    }
+    return NULL;
+  }
+
+  void insert(LogAggregateGroup * group)
+  {
+    if (count >= bucket_count) {
+      int new_count = bucket_count ? bucket_count * 2 : 16;
+      LogAggregateGroup **new_buckets = (LogAggregateGroup **) ats_malloc(new_count * sizeof(LogAggregateGroup *));
+
+      memset(new_buckets, 0, new_count * sizeof(LogAggregateGroup *));
+      for (int i = 0; i < bucket_count; i++) {
+        LogAggregateGroup *g, *next;
+        for (g = buckets[i]; g; g = next) {
+          next = g->next;
+          g->next = new_buckets[g->hash & (new_count - 1)];
+          new_buckets[g->hash & (new_count - 1)] = g;
+        }
+      }
+      ats_free(buckets);
+      buckets = new_buckets;
+      bucket_count = new_count;
+    }
+    group->next = buckets[group->hash & (bucket_count - 1)];
+    buckets[group->hash & (bucket_count - 1)] = group;
+    count++;
+  }
+
+  // Take all the groups out, as a list.
+  LogAggregateGroup *take()
+  {
+    LogAggregateGroup *list = NULL;
+
+    for (int i = 0; i < bucket_count; i++) {
+      LogAggregateGroup *g, *next;
+      for (g = buckets[i]; g; g = next) {
+        next = g->next;
+        g->next = list;
+        list = g;
+      }
+      buckets[i] = NULL;
+    }
+    count = 0;
+    return list;
+  }
+};
+
+static inline uint64_t
+log_aggregate_hash(const char *key, unsigned len)
+{
+  uint64_t hash = 14695981039346656037ULL;      // FNV-1a
+
+  for (unsigned i = 0; i < len; i++)
+    hash = (hash ^ (unsigned char) key[i]) * 1099511628211ULL;
+  return hash;
+}
+
+static inline bool
+is_percentile(LogField::Aggregate op)
+{
+  return op == LogField::eP50 || op == LogField::eP90 || op == LogField::eP95 || op == LogField::eP99;
+}
+
+static void
+update_value(LogAggregateValue * v, LogField::Aggregate op, int64_t value, ink_hrtime when)
+{
+  switch (op) {
+  case LogField::eFIRST:
+    if (v->count == 0 || when < v->when) {
+      v->value = value;
+      v->when = when;
+    }
+    break;
+  case LogField::eLAST:
+    if (v->count == 0 || when >= v->when) {
+      v->value = value;
+      v->when = when;
+    }
+    break;
+  case LogField::eMIN:
+    if (v->count == 0 || value < v->value)
+      v->value = value;
+    break;
+  case LogField::eMAX:
+    if (v->count == 0 || value > v->value)
+      v->value = value;
+    break;
+  case LogField::eSUM:
+  case LogField::eAVG:
+    v->value += value;
+    break;
+  default:
+    if (is_percentile(op)) {
+      if (v->histogram == NULL)
+        v->histogram = NEW(new LogAggregateHistogram);
+      v->histogram->add(value);
+    }
+    break;
+  }
+  v->count++;
+}
+
+static int64_t
+result_value(LogAggregateValue * v, LogField::Aggregate op)
+{
+  switch (op) {
+  case LogField::eCOUNT:
+    return v->count;
+  case LogField::eAVG:
+    return v->count ? v->value / v->count : 0;
+  case LogField::eP50:
+    return v->histogram ? v->histogram->percentile(0.50, v->count) : 0;
+  case LogField::eP90:
+    return v->histogram ? v->histogram->percentile(0.90, v->count) : 0;
+  case LogField::eP95:
+    return v->histogram ? v->histogram->percentile(0.95, v->count) : 0;
+  case LogField::eP99:
+    return v->histogram ? v->histogram->percentile(0.99, v->count) : 0;
+  default:
+    return v->value;
+  }
+}
+
+/*-------------------------------------------------------------------------
+  LogAggregate
+  -------------------------------------------------------------------------*/
+
+LogAggregate::LogAggregate(LogFieldList * field_list, long interval_sec, int max_groups)
+  : m_field_list(field_list),
+    m_key_count(0),
+    m_agg_count(0),
+    m_interval_sec(interval_sec > 0 ? interval_sec : 1),
+    m_max_groups(max_groups),
+    m_dropped(0)
+{
+  for (LogField *f = m_field_list->first(); f; f = m_field_list->next(f)) {
+    if (f->aggregate() == LogField::NO_AGGREGATE)
+      m_key_count++;
+    else
+      m_agg_count++;
+  }
+
+  // intervals end on multiples of the interval, like log rolling
+  m_interval_next = (LogUtils::timestamp() / m_interval_sec + 1) * m_interval_sec;
+
+  m_shard_count = eventProcessor.n_ethreads > 0 ? eventProcessor.n_ethreads : 1;
+  m_shards = new LogAggregateShard[m_shard_count];
+}
+
+LogAggregate::~LogAggregate()
+{
+  delete[]m_shards;
+}
+
+LogAggregateShard *
+LogAggregate::_shard()
+{
+  EThread *thread = this_ethread();
+
+  if (thread && thread->id >= 0)
+    return &m_shards[thread->id % m_shard_count];
+  return &m_shards[0];
+}
+
+LogAggregateGroup *
+LogAggregate::_new_group(uint64_t hash, const char *key, unsigned key_len, const unsigned *offsets)
+{
+  size_t values_len = m_agg_count * sizeof(LogAggregateValue);
+  size_t offsets_len = m_agg_count * sizeof(unsigned);
+  LogAggregateGroup *group = (LogAggregateGroup *) ats_malloc(sizeof(LogAggregateGroup) + values_len +
+                                                              offsets_len + key_len);
+
+  group->next = NULL;
+  group->hash = hash;
+  group->key_len = key_len;
+  group->values = (LogAggregateValue *) (group + 1);
+  group->offsets = (unsigned *) ((char *) group->values + values_len);
+  group->key = (char *) group->offsets + offsets_len;
+  memset(group->values, 0, values_len);
+  memcpy(group->offsets, offsets, offsets_len);
+  memcpy(group->key, key, key_len);
+  return group;
+}
+
+bool
+LogAggregate::add(LogAccess * lad)
+{
+  unsigned key_len = m_field_list->marshal_len(lad);
+  char *key = (char *) alloca(key_len);
+  int64_t *values = (int64_t *) alloca(m_agg_count * sizeof(int64_t));
+  unsigned *offsets = (unsigned *) alloca(m_agg_count * sizeof(unsigned));
+  long time_now = LogUtils::timestamp();
+  ink_hrtime when = ink_get_hrtime_internal();
+  unsigned offset = 0;
+  int i = 0;
+
+  // marshal_str only pads strings in DEBUG builds, and the padding is part
+  // of the key.
+  memset(key, 0, key_len);
+
+  // Marshal the entry, then pull the aggregate values back out of it so
+  // that only the group fields are left in the key.
+  for (LogField *f = m_field_list->first(); f; f = m_field_list->next(f)) {
+    char *data = key + offset;
+    unsigned len = f->marshal(lad, data);
+
+    if (f->aggregate() != LogField::NO_AGGREGATE) {
+      values[i] = f->is_time_field() ? time_now : *((int64_t *) data);
+      offsets[i++] = offset;
+      memset(data, 0, len);
+    }
+    offset += len;
+  }
+  ink_assert(offset <= key_len);
+  key_len = offset;
+
+  uint64_t hash = log_aggregate_hash(key, key_len);
+  LogAggregateShard *shard = _shard();
+
+  ink_mutex_acquire(&shard->mutex);
+  LogAggregateGroup *group = shard->find(hash, key, key_len);
+  if (group == NULL) {
+    // The same group may be on every thread, so only the merge can tell
+    // how many distinct groups there are.
+    if (shard->count >= m_max_groups) {
+      ink_mutex_release(&shard->mutex);
+      ink_atomic_increment(&m_dropped, 1);
+      return false;
+    }
+    group = _new_group(hash, key, key_len, offsets);
+    shard->insert(group);
+  }
+
+  i = 0;
+  for (LogField *f = m_field_list->first(); f; f = m_field_list->next(f)) {
+    if (f->aggregate() != LogField::NO_AGGREGATE) {
+      update_value(&group->values[i], f->aggregate(), values[i], when);
+      i++;
+    }
+  }
+  ink_mutex_release(&shard->mutex);
+  return true;
+}
+
+void
+LogAggregate::_merge(LogAggregateGroup * into, LogAggregateGroup * from)
+{
+  int i = 0;
+
+  for (LogField *f = m_field_list->first(); f; f = m_field_list->next(f)) {
+    LogField::Aggregate op = f->aggregate();
+
+    if (op == LogField::NO_AGGREGATE)
+      continue;
+
+    LogAggregateValue *a = &into->values[i], *b = &from->values[i];
+    i++;
+    if (b->count == 0)
+      continue;
+    switch (op) {
+    case LogField::eFIRST:
+    case LogField::eLAST:
+      if (a->count == 0 || (op == LogField::eFIRST ? b->when < a->when : b->when >= a->when)) {
+        a->value = b->value;
+        a->when = b->when;
+      }
+      break;
+    case LogField::eMIN:
+      if (a->count == 0 || b->value < a->value)
+        a->value = b->value;
+      break;
+    case LogField::eMAX:
+      if (a->count == 0 || b->value > a->value)
+        a->value = b->value;
+      break;
+    case LogField::eSUM:
+    case LogField::eAVG:
+      a->value += b->value;
+      break;
+    default:
+      if (b->histogram) {
+        if (a->histogram == NULL) {
+          a->histogram = b->histogram;
+          b->histogram = NULL;
+        } else {
+          a->histogram->merge(*b->histogram);
+        }
+      }
+      break;
+    }
+    a->count += b->count;
+  }
+}
+
+LogAggregateGroup *
+LogAggregate::collect(long time_now)
+{
+  if (time_now < m_interval_next)
+    return NULL;
+  m_interval_next = (time_now / m_interval_sec + 1) * m_interval_sec;
+
+  // The same group may have been added on several threads, merge them.
+  LogAggregateShard merged;
+  int dropped = 0;
+  for (int i = 0; i < m_shard_count; i++) {
+    ink_mutex_acquire(&m_shards[i].mutex);
+    LogAggregateGroup *g, *next, *list = m_shards[i].take();
+    ink_mutex_release(&m_shards[i].mutex);
+
+    for (g = list; g; g = next) {
+      next = g->next;
+      g->next = NULL;
+      LogAggregateGroup *same = merged.find(g->hash, g->key, g->key_len);
+      if (same) {
+        _merge(same, g);
+        free_groups(g);
+      } else if (merged.count < m_max_groups) {
+        merged.insert(g);
+      } else {
+        // every aggregate field counts every entry of the group
+        dropped += m_agg_count ? (int) g->values[0].count : 1;
+        free_groups(g);
+      }
+    }
+  }
+
+  dropped += ink_atomic_swap(&m_dropped, 0);
+  if (dropped) {
+    Warning("%d log entries were not aggregated because there were more than %d groups", dropped, m_max_groups);
+  }
+  return merged.take();
+}
+
+LogAggregateGroup *
+LogAggregate::next_group(LogAggregateGroup * group)
+{
+  return group->next;
+}
+
+unsigned
+LogAggregate::marshal_len(LogAggregateGroup * group)
+{
+  return group->key_len;
+}
+
+unsigned
+LogAggregate::marshal_group(LogAggregateGroup * group, char *buf)
+{
+  int i = 0;
+
+  memcpy(buf, group->key, group->key_len);
+  for (LogField *f = m_field_list->first(); f; f = m_field_list->next(f)) {
+    if (f->aggregate() != LogField::NO_AGGREGATE) {
+      LogAccess::marshal_int(buf + group->offsets[i], result_value(&group->values[i], f->aggregate()));
+      i++;
+    }
+  }
+  return group->key_len;
+}
+
+void
+LogAggregate::free_groups(LogAggregateGroup * groups)
+{
+  LogAggregateGroup *next;
+
+  for (; groups; groups = next) {
+    next = groups->next;
+    // the values are only known to the LogAggregate, but only percentile
+    // fields have a histogram
+    for (LogAggregateValue * v = groups->values; (unsigned *) v < groups->offsets; v++)
+      delete v->histogram;
+    ats_free(groups);
+  }
+}
+
+/*-------------------------------------------------------------------------
+  Regression tests
+  -------------------------------------------------------------------------*/
+
+class LogAggregateTestAccess:public LogAccess
+{
+public:
+  const char *method;
+  int64_t status;
+  int64_t bytes;
+  int64_t msec;
+
+  void init() { }
+  LogEntryType entry_type() { return LOG_ENTRY_HTTP; }
+
+  int marshal_client_req_http_method(char *buf)
+  {
+    // Like marshal_str in release builds, leave the padding alone, so the
+    // test does not depend on DEBUG.
+    if (buf)
+      memcpy(buf, method, ::strlen(method) + 1);
+    return LogAccess::strlen(method);
+  }
+
+  int marshal_proxy_resp_status_code(char *buf)
+  {
+    if (buf)
+      marshal_int(buf, status);
+    return INK_MIN_ALIGN;
+  }
+
+  int marshal_proxy_resp_squid_len(char *buf)
+  {
+    if (buf)
+      marshal_int(buf, bytes);
+    return INK_MIN_ALIGN;
+  }
+
+  int marshal_transfer_time_ms(char *buf)
+  {
+    if (buf)
+      marshal_int(buf, msec);
+    return INK_MIN_ALIGN;
+  }
+};
+
+REGRESSION_TEST(LogAggregate_GroupBy) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  LogFormat format("group_by", "%<cqhm> %<COUNT(*)> %<pssc> %<SUM(psql)> %<AVG(psql)> %<MIN(ttms)> "
+                   "%<MAX(ttms)> %<P50(ttms)> %<P99(ttms)>", 60);
+  LogAggregateTestAccess lad;
+  int added = 0;
+
+  box = REGRESSION_TEST_PASSED;
+  box.check(format.valid() && format.is_aggregate(), "format with group fields is not a valid aggregate");
+  if (!format.valid())
+    return;
+
+  LogAggregate agg(&format.m_field_list, 60, 3);
+
+  // GET 200 takes 1..1000ms, GET 404 and POST 200 a constant time.
+  lad.bytes = 100;
+  for (int i = 1; i <= 1000; i++) {
+    lad.method = "GET";
+    lad.status = 200;
+    lad.msec = i;
+    added += agg.add(&lad);
+    if (i % 10 == 0) {
+      lad.status = 404;
+      lad.msec = 5;
+      added += agg.add(&lad);
+      lad.method = "POST";
+      lad.status = 200;
+      lad.msec = 50;
+      added += agg.add(&lad);
+    }
+  }
+  lad.method = "HEAD";
+  box.check(!agg.add(&lad), "group over the limit was added");
+  box.check(added == 1200, "%d entries were aggregated", added);
+  box.check(agg.collect(LogUtils::timestamp()) == NULL, "interval ended early");
+
+  LogAggregateGroup *groups = agg.collect(LogUtils::timestamp() + 60);
+  int ngroups = 0;
+
+  for (LogAggregateGroup * g = groups; g; g = LogAggregate::next_group(g)) {
+    char buf[256];
+    char *p = buf;
+
+    box.check(agg.marshal_len(g) <= sizeof(buf) && agg.marshal_group(g, buf) == agg.marshal_len(g),
+              "group entry is %u bytes", agg.marshal_len(g));
+    const char *method = p;
+    p += LogAccess::strlen(method);
+    int64_t count = LogAccess::unmarshal_int(&p);
+    int64_t status = LogAccess::unmarshal_int(&p);
+    int64_t sum = LogAccess::unmarshal_int(&p);
+    int64_t avg = LogAccess::unmarshal_int(&p);
+    int64_t min = LogAccess::unmarshal_int(&p);
+    int64_t max = LogAccess::unmarshal_int(&p);
+    int64_t p50 = LogAccess::unmarshal_int(&p);
+    int64_t p99 = LogAccess::unmarshal_int(&p);
+
+    ngroups++;
+    box.check(sum == count * 100 && avg == 100, "%s %d sum %d avg %d", method, (int) status, (int) sum, (int) avg);
+    if (strcmp(method, "GET") == 0 && status == 200) {
+      box.check(count == 1000 && min == 1 && max == 1000, "GET 200 count %d min %d max %d", (int) count,
+                (int) min, (int) max);
+      box.check(p50 >= 500 && p50 <= 500 + 500 / 16 && p99 >= 990 && p99 <= 990 + 990 / 16,
+                "GET 200 p50 %d p99 %d", (int) p50, (int) p99);
+    } else if (strcmp(method, "GET") == 0 && status == 404) {
+      box.check(count == 100 && min == 5 && max == 5 && p50 == 5 && p99 == 5, "GET 404 count %d p50 %d",
+                (int) count, (int) p50);
+    } else {
+      box.check(strcmp(method, "POST") == 0 && status == 200 && count == 100 && p99 == 50,
+                "%s %d count %d p99 %d", method, (int) status, (int) count, (int) p99);
+    }
+  }
+  box.check(ngroups == 3, "%d groups collected", ngroups);
+  LogAggregate::free_groups(groups);
+
+  // the next interval starts empty, with room for new groups
+  box.check(agg.add(&lad), "group was not added in the next interval");
+  groups = agg.collect(LogUtils::timestamp() + 120);
+  box.check(groups && LogAggregate::next_group(groups) == NULL, "next interval does not hold one group");
+  LogAggregate::free_groups(groups);
+
+  // The limit is on distinct groups, not on the copies each thread keeps.
+  // Stand in for two event threads, each adding the same two groups and
+  // then one of its own, which the merge has no room for.
+  if (eventProcessor.n_ethreads < 2)
+    return;
+
+  static const char *methods[] = { "GET", "POST", "PUT", "HEAD" };
+  Thread *self = this_thread();
+
+  added = 0;
+  for (int n = 0; n < 2; n++) {
+    eventProcessor.all_ethreads[n]->set_specific();
+    for (int m = 0; m < 2; m++) {
+      lad.method = methods[m];
+      added += agg.add(&lad);
+    }
+    lad.method = methods[2 + n];
+    added += agg.add(&lad);
+  }
+  if (self)
+    self->set_specific();
+  else
+    ink_thread_setspecific(Thread::thread_data_key, NULL);
+
+  box.check(added == 6, "%d entries were aggregated on two threads", added);
+  groups = agg.collect(LogUtils::timestamp() + 180);
+  ngroups = 0;
+  for (LogAggregateGroup * g = groups; g; g = LogAggregate::next_group(g)) {
+    char buf[256];
+    char *p = buf;
+
+    agg.marshal_group(g, buf);
+    const char *method = p;
+    p += LogAccess::strlen(method);
+    int64_t count = LogAccess::unmarshal_int(&p);
+
+    ngroups++;
+    box.check(count == (strcmp(method, "GET") == 0 || strcmp(method, "POST") == 0 ? 2 : 1),
+              "%s count %d on two threads", method, (int) count);
+  }
+  box.check(ngroups == 3, "%d groups collected from two threads", ngroups);
+  LogAggregate::free_groups(groups);
+}
@@ -0,0 +1,91 @@
+/** @file
+
+  Grouped aggregation of log entries
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef LOG_AGGREGATE_H
+#define LOG_AGGREGATE_H
+
+#include "libts.h"
+
+class LogAccess;
+class LogField;
+class LogFieldList;
+struct LogAggregateGroup;
+struct LogAggregateShard;
+
+/*-------------------------------------------------------------------------
+  LogAggregate
+
+  Keeps the aggregate fields (COUNT, SUM, P99, ...) of a format over an
+  interval, instead of logging each entry. The other fields of the format
+  are the group key: entries with the same values for them are folded into
+  the same group, and one entry per group is written at the end of each
+  interval, much like a SQL GROUP BY. A format with only aggregate fields
+  has a single group.
+
+  Groups are kept per event thread so that threads don't contend on them,
+  and merged when the interval ends. Each thread keeps up to max_groups,
+  and the merge keeps max_groups distinct groups; the entries of the
+  others are counted as dropped.
+  -------------------------------------------------------------------------*/
+
+class LogAggregate
+{
+public:
+  LogAggregate(LogFieldList * field_list, long interval_sec, int max_groups);
+  ~LogAggregate();
+
+  // Fold the entry described by lad into its group. Returns false if the
+  // group could not be added because this thread already has max_groups.
+  bool add(LogAccess * lad);
+
+  // If the interval has ended by time_now, start a new one and return the
+  // groups of the one that ended, to be walked with next_group(),
+  // marshalled with marshal_group() and released with free_groups().
+  // Returns NULL otherwise, or if no entry was added in the interval.
+  LogAggregateGroup *collect(long time_now);
+  static LogAggregateGroup *next_group(LogAggregateGroup * group);
+  unsigned marshal_len(LogAggregateGroup * group);
+  unsigned marshal_group(LogAggregateGroup * group, char *buf);
+  static void free_groups(LogAggregateGroup * groups);
+
+private:
+  LogFieldList *m_field_list;
+  int m_key_count;              // non-aggregate fields of m_field_list
+  int m_agg_count;              // aggregate fields of m_field_list
+  long m_interval_sec;
+  long m_interval_next;
+  int m_max_groups;
+  volatile int m_dropped;       // entries not added in this interval
+  LogAggregateShard *m_shards;
+  int m_shard_count;
+
+  LogAggregateShard *_shard();
+  LogAggregateGroup *_new_group(uint64_t hash, const char *key, unsigned key_len, const unsigned *offsets);
+  void _merge(LogAggregateGroup * into, LogAggregateGroup * from);
+
+  // -- member functions not allowed --
+  LogAggregate(const LogAggregate &);
+  LogAggregate & operator=(const LogAggregate &);
+};
+
+#endif
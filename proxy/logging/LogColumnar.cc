@@ -0,0 +1,714 @@
+/** @file
+
+  Columnar encoding of LogBuffers
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "libts.h"
+
+#if TS_HAS_LIBZ
+#include <zlib.h>
+#endif
+
+#include "LogLimits.h"
+#include "LogAccess.h"
+#include "LogField.h"
+#include "LogBuffer.h"
+#include "LogColumnar.h"
+
+/*-------------------------------------------------------------------------
+  The body of a block is a count of columns followed by the columns, each
+  prefixed by its length in bytes:
+
+    header   the LogBufferHeader and its strings, up to data_offset
+    kinds    one ColumnKind per field
+    entries  timestamp delta, microseconds and tail length per entry
+    tail     bytes of each entry past its fields, e.g. text log lines
+
+  followed by a value and a data column per field. What goes in those
+  depends on the kind of the field:
+
+    INT, INT_DELTA  value or delta from the previous entry / unused
+    DINT            both values / unused
+    STRING          dictionary index / dictionary strings, by first use
+    IP              address family / address bytes
+    RAW             marshalled length / marshalled bytes
+
+  All numbers are LEB128 varints, with signed ones zigzag encoded first.
+  -------------------------------------------------------------------------*/
+
+enum ColumnKind
+{
+  COLUMN_INT = 0,
+  COLUMN_INT_DELTA,
+  COLUMN_DINT,
+  COLUMN_STRING,
+  COLUMN_IP,
+  COLUMN_RAW,
+  N_COLUMN_KINDS
+};
+
+enum
+{
+  COLUMN_HEADER = 0,
+  COLUMN_KINDS,
+  COLUMN_ENTRIES,
+  COLUMN_TAIL,
+  N_FIXED_COLUMNS
+};
+
+// Don't trust blocks that claim a body larger than this.
+static const uint32_t MAX_BLOCK_BODY = 64 * 1024 * 1024;
+
+static inline uint64_t
+zigzag(int64_t v)
+{
+  return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t
+unzigzag(uint64_t v)
+{
+  return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+struct ColumnWriter
+{
+  char *data;
+  size_t len;
+  size_t size;
+
+  ColumnWriter():data(NULL), len(0), size(0) { }
+  ~ColumnWriter() { ats_free(data); }
+
+  char *reserve(size_t n)
+  {
+    if (len + n > size) {
+      size = (size * 2 > len + n) ? size * 2 : len + n + 256;
+      data = (char *)ats_realloc(data, size);
+    }
+    return data + len;
+  }
+
+  void put_bytes(const void *bytes, size_t n)
+  {
+    if (n) {
+      memcpy(reserve(n), bytes, n);
+      len += n;
+    }
+  }
+
+  void put_varint(uint64_t v)
+  {
+    unsigned char *p = (unsigned char *)reserve(10);
+    unsigned char *start = p;
+    while (v >= 0x80) {
+      *p++ = (unsigned char)(v | 0x80);
+      v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    len += p - start;
+  }
+
+  void put_int(int64_t v) { put_varint(zigzag(v)); }
+};
+
+struct ColumnReader
+{
+  const unsigned char *pos;
+  const unsigned char *end;
+
+  ColumnReader():pos(NULL), end(NULL) { }
+
+  bool get_varint(uint64_t * v)
+  {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+      unsigned char b = *pos++;
+      result |= (uint64_t) (b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        *v = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool get_int(int64_t * v)
+  {
+    uint64_t u;
+    if (!get_varint(&u))
+      return false;
+    *v = unzigzag(u);
+    return true;
+  }
+
+  const char *get_bytes(uint64_t n)
+  {
+    if (n > (uint64_t) (end - pos))
+      return NULL;
+    const char *p = (const char *)pos;
+    pos += n;
+    return p;
+  }
+};
+
+// The strings seen so far in one column of a block, in an open addressed
+// table of indexes into strs.
+struct StringDictionary
+{
+  struct Entry
+  {
+    const char *str;
+    uint32_t len;
+    uint32_t hash;
+  };
+
+  Entry *strs;
+  int32_t *slots;
+  uint32_t mask;
+  uint32_t count;
+
+  StringDictionary():strs(NULL), slots(NULL), mask(0), count(0) { }
+  ~StringDictionary() {
+    ats_free(strs);
+    ats_free(slots);
+  }
+
+  void init(uint32_t max_strings)
+  {
+    uint32_t nslots = 16;
+    while (nslots < max_strings * 2)
+      nslots <<= 1;
+    strs = (Entry *)ats_malloc(max_strings * sizeof(Entry));
+    slots = (int32_t *)ats_malloc(nslots * sizeof(int32_t));
+    memset(slots, 0xff, nslots * sizeof(int32_t));
+    mask = nslots - 1;
+  }
+
+  // Return the index of str, adding it if it is new. *added tells which.
+  uint32_t lookup(const char *str, uint32_t len, bool * added)
+  {
+    uint32_t hash = 2166136261U;
+    for (uint32_t i = 0; i < len; ++i)
+      hash = (hash ^ (unsigned char)str[i]) * 16777619U;
+
+    uint32_t i = hash & mask;
+    while (slots[i] >= 0) {
+      Entry & e = strs[slots[i]];
+      if (e.hash == hash && e.len == len && memcmp(e.str, str, len) == 0) {
+        *added = false;
+        return slots[i];
+      }
+      i = (i + 1) & mask;
+    }
+
+    strs[count].str = str;
+    strs[count].len = len;
+    strs[count].hash = hash;
+    slots[i] = count;
+    *added = true;
+    return count++;
+  }
+};
+
+static ColumnKind
+column_kind(LogField * field)
+{
+  if (field->aggregate() != LogField::NO_AGGREGATE)
+    return COLUMN_INT;
+
+  switch (field->type()) {
+  case LogField::sINT:
+    return field->is_time_field() ? COLUMN_INT_DELTA : COLUMN_INT;
+  case LogField::dINT:
+    return COLUMN_DINT;
+  case LogField::IP:
+    return COLUMN_IP;
+  case LogField::STRING:
+    return field->is_plain_string() ? COLUMN_STRING : COLUMN_RAW;
+  default:
+    return COLUMN_RAW;
+  }
+}
+
+static inline int64_t
+read_int(const char *p)
+{
+  int64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// The slot an address of family takes in an entry and the offset and size
+// of the address within it.
+static int
+ip_layout(uint16_t family, int *addr_offset, int *addr_len)
+{
+  if (family == AF_INET) {
+    LogFieldIp4 ip4;
+    *addr_offset = (char *)&ip4._addr - (char *)&ip4;
+    *addr_len = sizeof(ip4._addr);
+    return INK_ALIGN_DEFAULT(sizeof(LogFieldIp4));
+  } else if (family == AF_INET6) {
+    LogFieldIp6 ip6;
+    *addr_offset = (char *)&ip6._addr - (char *)&ip6;
+    *addr_len = sizeof(ip6._addr);
+    return INK_ALIGN_DEFAULT(sizeof(LogFieldIp6));
+  }
+  *addr_offset = 0;
+  *addr_len = 0;
+  return INK_ALIGN_DEFAULT(sizeof(LogFieldIp));
+}
+
+#if TS_HAS_LIBZ
+// Each thread keeps its deflate state, since setting one up costs far more
+// than compressing a block.
+static __thread z_stream *block_deflater = NULL;
+static __thread int block_deflater_level = -1;
+
+static z_stream *
+get_block_deflater(int level)
+{
+  if (block_deflater && block_deflater_level != level) {
+    deflateEnd(block_deflater);
+    ats_free(block_deflater);
+    block_deflater = NULL;
+  }
+
+  if (!block_deflater) {
+    z_stream *z = (z_stream *)ats_malloc(sizeof(z_stream));
+    memset(z, 0, sizeof(z_stream));
+    if (deflateInit(z, level) != Z_OK) {
+      ats_free(z);
+      return NULL;
+    }
+    block_deflater = z;
+    block_deflater_level = level;
+  } else {
+    deflateReset(block_deflater);
+  }
+  return block_deflater;
+}
+#endif
+
+/*-------------------------------------------------------------------------
+  LogColumnar::encode
+  -------------------------------------------------------------------------*/
+
+LogColumnarHeader *
+LogColumnar::encode(LogBufferHeader * buffer, LogFieldList * fieldlist, int level)
+{
+  ink_assert(buffer != NULL);
+
+  if (buffer->version != LOG_SEGMENT_VERSION || buffer->data_offset < sizeof(LogBufferHeader) ||
+      buffer->data_offset > buffer->byte_count) {
+    return NULL;
+  }
+
+  unsigned nfields = fieldlist ? fieldlist->count() : 0;
+  unsigned ncolumns = N_FIXED_COLUMNS + 2 * nfields;
+  LogField **fields = (LogField **)alloca(sizeof(LogField *) * (nfields + 1));
+  ColumnKind *kinds = (ColumnKind *)alloca(sizeof(ColumnKind) * (nfields + 1));
+  int64_t *last = (int64_t *)alloca(sizeof(int64_t) * (nfields + 1));
+  ColumnWriter *columns = new ColumnWriter[ncolumns];
+  StringDictionary *dicts = new StringDictionary[nfields + 1];
+  char *scratch = NULL;
+  LogColumnarHeader *block = NULL;
+
+  unsigned i = 0;
+  for (LogField * f = fieldlist ? fieldlist->first() : NULL; f; f = fieldlist->next(f), ++i) {
+    fields[i] = f;
+    kinds[i] = column_kind(f);
+    last[i] = 0;
+    columns[COLUMN_KINDS].put_varint(kinds[i]);
+    if (kinds[i] == COLUMN_STRING)
+      dicts[i].init(buffer->entry_count);
+    else if (kinds[i] == COLUMN_RAW && !scratch)
+      scratch = (char *)ats_malloc(LOG_MAX_FORMATTED_LINE);
+  }
+
+  columns[COLUMN_HEADER].put_bytes(buffer, buffer->data_offset);
+
+  LogBufferIterator iter(buffer);
+  LogEntryHeader *entry;
+  int64_t last_timestamp = 0;
+  unsigned nentries = 0;
+
+  while ((entry = iter.next())) {
+    char *p = (char *)entry + sizeof(LogEntryHeader);
+    char *end = (char *)entry + entry->entry_len;
+
+    if (entry->entry_len < sizeof(LogEntryHeader) || end > (char *)buffer + buffer->byte_count)
+      goto Lfail;
+
+    for (i = 0; i < nfields; ++i) {
+      ColumnWriter & values = columns[N_FIXED_COLUMNS + 2 * i];
+      ColumnWriter & data = columns[N_FIXED_COLUMNS + 2 * i + 1];
+
+      switch (kinds[i]) {
+      case COLUMN_INT:
+        if (end - p < INK_MIN_ALIGN)
+          goto Lfail;
+        values.put_int(read_int(p));
+        p += INK_MIN_ALIGN;
+        break;
+
+      case COLUMN_INT_DELTA:
+        if (end - p < INK_MIN_ALIGN)
+          goto Lfail;
+        values.put_int(read_int(p) - last[i]);
+        last[i] = read_int(p);
+        p += INK_MIN_ALIGN;
+        break;
+
+      case COLUMN_DINT:
+        if (end - p < 2 * INK_MIN_ALIGN)
+          goto Lfail;
+        values.put_int(read_int(p));
+        values.put_int(read_int(p + INK_MIN_ALIGN));
+        p += 2 * INK_MIN_ALIGN;
+        break;
+
+      case COLUMN_STRING: {
+        char *nul = (char *)memchr(p, 0, end - p);
+        if (!nul || LogAccess::strlen(p) > end - p)
+          goto Lfail;
+        bool added;
+        uint32_t len = nul - p;
+        values.put_varint(dicts[i].lookup(p, len, &added));
+        if (added) {
+          data.put_varint(len);
+          data.put_bytes(p, len);
+        }
+        p += LogAccess::strlen(p);
+        break;
+      }
+
+      case COLUMN_IP: {
+        uint16_t family;
+        int addr_offset, addr_len;
+        if (end - p < (int) sizeof(LogFieldIp))
+          goto Lfail;
+        memcpy(&family, p + offsetof(LogFieldIp, _family), sizeof(family));
+        int slot = ip_layout(family, &addr_offset, &addr_len);
+        if (end - p < slot)
+          goto Lfail;
+        values.put_varint(family);
+        data.put_bytes(p + addr_offset, addr_len);
+        p += slot;
+        break;
+      }
+
+      case COLUMN_RAW: {
+        char *q = p;
+        if ((int) fields[i]->unmarshal(&q, scratch, LOG_MAX_FORMATTED_LINE) < 0 || q > end || q < p)
+          goto Lfail;
+        values.put_varint(q - p);
+        data.put_bytes(p, q - p);
+        p = q;
+        break;
+      }
+
+      default:
+        goto Lfail;
+      }
+    }
+
+    columns[COLUMN_ENTRIES].put_int(entry->timestamp - last_timestamp);
+    columns[COLUMN_ENTRIES].put_varint((uint32_t) entry->timestamp_usec);
+    columns[COLUMN_ENTRIES].put_varint(end - p);
+    columns[COLUMN_TAIL].put_bytes(p, end - p);
+    last_timestamp = entry->timestamp;
+    ++nentries;
+  }
+
+  {
+    ColumnWriter body;
+    body.put_varint(ncolumns);
+    for (i = 0; i < ncolumns; ++i) {
+      body.put_varint(columns[i].len);
+      body.put_bytes(columns[i].data, columns[i].len);
+    }
+
+    size_t stored_len = body.len;
+    uint32_t compression = NONE;
+
+#if TS_HAS_LIBZ
+    z_stream *z = level > 0 ? get_block_deflater(level) : NULL;
+    uLong zlen = compressBound(body.len);
+    block = (LogColumnarHeader *)ats_malloc(sizeof(LogColumnarHeader) + zlen);
+    if (z) {
+      z->next_in = (Bytef *)body.data;
+      z->avail_in = body.len;
+      z->next_out = (Bytef *)(block + 1);
+      z->avail_out = zlen;
+    }
+    if (z && deflate(z, Z_FINISH) == Z_STREAM_END && z->total_out < body.len) {
+      stored_len = z->total_out;
+      compression = DEFLATE;
+    } else {
+      memcpy(block + 1, body.data, body.len);
+    }
+#else
+    (void) level;
+    block = (LogColumnarHeader *)ats_malloc(sizeof(LogColumnarHeader) + body.len);
+    memcpy(block + 1, body.data, body.len);
+#endif
+
+    block->cookie = LOG_COLUMNAR_COOKIE;
+    block->version = LOG_COLUMNAR_VERSION;
+    block->byte_count = sizeof(LogColumnarHeader) + stored_len;
+    block->body_bytes = body.len;
+    block->buffer_bytes = buffer->byte_count;
+    block->entry_count = nentries;
+    block->low_timestamp = buffer->low_timestamp;
+    block->high_timestamp = buffer->high_timestamp;
+    block->compression = compression;
+    block->reserved = 0;
+  }
+
+Lfail:
+  ats_free(scratch);
+  delete[] dicts;
+  delete[] columns;
+  return block;
+}
+
+/*-------------------------------------------------------------------------
+  LogColumnar::decode
+  -------------------------------------------------------------------------*/
+
+LogBufferHeader *
+LogColumnar::decode(LogColumnarHeader * block)
+{
+  ink_assert(block != NULL);
+
+  if (block->cookie != LOG_COLUMNAR_COOKIE || block->version != LOG_COLUMNAR_VERSION ||
+      block->byte_count < sizeof(LogColumnarHeader) || block->body_bytes > MAX_BLOCK_BODY ||
+      block->buffer_bytes < sizeof(LogBufferHeader) || block->buffer_bytes > MAX_BLOCK_BODY ||
+      block->entry_count > block->buffer_bytes / sizeof(LogEntryHeader)) {
+    return NULL;
+  }
+
+  const char *body = (const char *)(block + 1);
+  size_t stored_len = block->byte_count - sizeof(LogColumnarHeader);
+  char *inflated = NULL;
+  char *out = NULL;
+  ColumnReader *columns = NULL;
+  StringDictionary *dicts = NULL;
+  ColumnKind *kinds = NULL;
+  uint64_t ncolumns = 0, nfields = 0;
+  uint32_t pos, i;
+  int64_t timestamp = 0;
+  int64_t *last = NULL;
+  ColumnReader reader;
+
+  switch (block->compression) {
+  case NONE:
+    if (stored_len != block->body_bytes)
+      return NULL;
+    break;
+#if TS_HAS_LIBZ
+  case DEFLATE: {
+    uLongf len = block->body_bytes;
+    inflated = (char *)ats_malloc(len);
+    if (uncompress((Bytef *)inflated, &len, (const Bytef *)body, stored_len) != Z_OK || len != block->body_bytes)
+      goto Lfail;
+    body = inflated;
+    break;
+  }
+#endif
+  default:
+    return NULL;
+  }
+
+  reader.pos = (const unsigned char *)body;
+  reader.end = reader.pos + block->body_bytes;
+  if (!reader.get_varint(&ncolumns) || ncolumns < N_FIXED_COLUMNS || (ncolumns - N_FIXED_COLUMNS) % 2 != 0 ||
+      ncolumns > block->body_bytes)
+    goto Lfail;
+
+  columns = new ColumnReader[ncolumns];
+  for (i = 0; i < ncolumns; ++i) {
+    uint64_t len;
+    const char *p;
+    if (!reader.get_varint(&len) || !(p = reader.get_bytes(len)))
+      goto Lfail;
+    columns[i].pos = (const unsigned char *)p;
+    columns[i].end = columns[i].pos + len;
+  }
+
+  nfields = (ncolumns - N_FIXED_COLUMNS) / 2;
+  kinds = new ColumnKind[nfields + 1];
+  last = new int64_t[nfields + 1];
+  dicts = new StringDictionary[nfields + 1];
+  for (i = 0; i < nfields; ++i) {
+    uint64_t kind;
+    if (!columns[COLUMN_KINDS].get_varint(&kind) || kind >= N_COLUMN_KINDS)
+      goto Lfail;
+    kinds[i] = (ColumnKind) kind;
+    last[i] = 0;
+    if (kinds[i] == COLUMN_STRING)
+      dicts[i].init(block->entry_count);
+  }
+
+  {
+    ColumnReader & hdr = columns[COLUMN_HEADER];
+    size_t hdr_len = hdr.end - hdr.pos;
+    if (hdr_len < sizeof(LogBufferHeader) || hdr_len > block->buffer_bytes)
+      goto Lfail;
+    out = (char *)ats_malloc(block->buffer_bytes);
+    memcpy(out, hdr.pos, hdr_len);
+    pos = hdr_len;
+    if (((LogBufferHeader *)out)->data_offset != hdr_len)
+      goto Lfail;
+  }
+
+  for (uint32_t n = 0; n < block->entry_count; ++n) {
+    uint32_t entry_pos = pos;
+    int64_t delta;
+    uint64_t usec, tail_len;
+    const char *tail;
+
+    if (block->buffer_bytes - pos < sizeof(LogEntryHeader))
+      goto Lfail;
+    pos += sizeof(LogEntryHeader);
+
+    for (i = 0; i < nfields; ++i) {
+      ColumnReader & values = columns[N_FIXED_COLUMNS + 2 * i];
+      ColumnReader & data = columns[N_FIXED_COLUMNS + 2 * i + 1];
+      uint32_t room = block->buffer_bytes - pos;
+      char *p = out + pos;
+
+      switch (kinds[i]) {
+      case COLUMN_INT:
+      case COLUMN_INT_DELTA: {
+        int64_t v;
+        if (room < INK_MIN_ALIGN || !values.get_int(&v))
+          goto Lfail;
+        if (kinds[i] == COLUMN_INT_DELTA)
+          v = last[i] += v;
+        memcpy(p, &v, sizeof(v));
+        pos += INK_MIN_ALIGN;
+        break;
+      }
+
+      case COLUMN_DINT: {
+        int64_t v1, v2;
+        if (room < 2 * INK_MIN_ALIGN || !values.get_int(&v1) || !values.get_int(&v2))
+          goto Lfail;
+        memcpy(p, &v1, sizeof(v1));
+        memcpy(p + INK_MIN_ALIGN, &v2, sizeof(v2));
+        pos += 2 * INK_MIN_ALIGN;
+        break;
+      }
+
+      case COLUMN_STRING: {
+        uint64_t index, len;
+        StringDictionary & dict = dicts[i];
+        if (!values.get_varint(&index) || index > dict.count)
+          goto Lfail;
+        if (index == dict.count) {
+          const char *s;
+          if (dict.count >= block->entry_count || !data.get_varint(&len) || !(s = data.get_bytes(len)))
+            goto Lfail;
+          dict.strs[dict.count].str = s;
+          dict.strs[dict.count].len = len;
+          dict.count++;
+        }
+        StringDictionary::Entry & e = dict.strs[index];
+        if (room < e.len + 1)
+          goto Lfail;
+        memcpy(p, e.str, e.len);
+        p[e.len] = 0;
+        uint32_t slot = LogAccess::strlen(p);
+        if (room < slot)
+          goto Lfail;
+        memset(p + e.len + 1, 0, slot - e.len - 1);
+        pos += slot;
+        break;
+      }
+
+      case COLUMN_IP: {
+        uint64_t family;
+        int addr_offset, addr_len;
+        const char *addr;
+        if (!values.get_varint(&family) || family > 0xffff)
+          goto Lfail;
+        uint32_t slot = ip_layout(family, &addr_offset, &addr_len);
+        if (room < slot || !(addr = data.get_bytes(addr_len)))
+          goto Lfail;
+        uint16_t f = family;
+        memset(p, 0, slot);
+        memcpy(p + offsetof(LogFieldIp, _family), &f, sizeof(f));
+        memcpy(p + addr_offset, addr, addr_len);
+        pos += slot;
+        break;
+      }
+
+      case COLUMN_RAW: {
+        uint64_t len;
+        const char *raw;
+        if (!values.get_varint(&len) || len > room || !(raw = data.get_bytes(len)))
+          goto Lfail;
+        memcpy(p, raw, len);
+        pos += len;
+        break;
+      }
+
+      default:
+        goto Lfail;
+      }
+    }
+
+    if (!columns[COLUMN_ENTRIES].get_int(&delta) || !columns[COLUMN_ENTRIES].get_varint(&usec) ||
+        !columns[COLUMN_ENTRIES].get_varint(&tail_len) || tail_len > block->buffer_bytes - pos ||
+        !(tail = columns[COLUMN_TAIL].get_bytes(tail_len)))
+      goto Lfail;
+    memcpy(out + pos, tail, tail_len);
+    pos += tail_len;
+
+    LogEntryHeader *entry = (LogEntryHeader *)(out + entry_pos);
+    timestamp += delta;
+    entry->timestamp = timestamp;
+    entry->timestamp_usec = (int32_t) usec;
+    entry->entry_len = pos - entry_pos;
+  }
+
+  ((LogBufferHeader *)out)->byte_count = pos;
+  ((LogBufferHeader *)out)->entry_count = block->entry_count;
+
+  ats_free(inflated);
+  delete[] columns;
+  delete[] kinds;
+  delete[] last;
+  delete[] dicts;
+  return (LogBufferHeader *)out;
+
+Lfail:
+  ats_free(out);
+  ats_free(inflated);
+  delete[] columns;
+  delete[] kinds;
+  delete[] last;
+  delete[] dicts;
+  return NULL;
+}
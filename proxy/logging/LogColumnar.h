@@ -0,0 +1,89 @@
+/** @file
+
+  Columnar encoding of LogBuffers
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef LOG_COLUMNAR_H
+#define LOG_COLUMNAR_H
+
+#include "libts.h"
+
+class LogFieldList;
+struct LogBufferHeader;
+
+#define LOG_COLUMNAR_COOKIE 0xc01face
+#define LOG_COLUMNAR_VERSION 1
+
+/*-------------------------------------------------------------------------
+  LogColumnarHeader
+
+  A columnar log file is a sequence of blocks, one per LogBuffer, each
+  starting with this header. The body of a block holds the entries of the
+  buffer one field at a time: integers as variable length deltas or values,
+  strings through a dictionary of the distinct values in the block, and the
+  whole body is deflated when zlib is available. The first eight bytes line
+  up with a LogBufferHeader, so readers can tell both kinds apart by their
+  cookie.
+  -------------------------------------------------------------------------*/
+
+struct LogColumnarHeader
+{
+  uint32_t cookie;              // LOG_COLUMNAR_COOKIE
+  uint32_t version;             // LOG_COLUMNAR_VERSION
+  uint32_t byte_count;          // bytes in the block, this header included
+  uint32_t body_bytes;          // bytes of the body once inflated
+  uint32_t buffer_bytes;        // byte_count of the encoded LogBuffer
+  uint32_t entry_count;         // number of entries in the block
+  uint32_t low_timestamp;       // lowest timestamp value of entries
+  uint32_t high_timestamp;      // highest timestamp value of entries
+  uint32_t compression;         // LogColumnar::Compression of the body
+  uint32_t reserved;
+};
+
+class LogColumnar
+{
+public:
+  enum Compression
+  {
+    NONE = 0,
+    DEFLATE
+  };
+
+  static const int DEFAULT_COMPRESSION_LEVEL = 1;
+
+  // Encode the LogBuffer in buffer, whose entries were marshalled from
+  // fieldlist, into a block. A NULL fieldlist stores the entries as opaque
+  // bytes, as is done for text logs. level is the zlib compression level
+  // of the body, 0 leaves it uncompressed. Returns the block, to be released
+  // with ats_free(), or NULL if the entries don't match fieldlist.
+  static LogColumnarHeader *encode(LogBufferHeader * buffer, LogFieldList * fieldlist,
+                                   int level = DEFAULT_COMPRESSION_LEVEL);
+
+  // Rebuild the LogBuffer that block was encoded from. Returns the buffer,
+  // to be released with ats_free(), or NULL if block is corrupt.
+  static LogBufferHeader *decode(LogColumnarHeader * block);
+
+private:
+  LogColumnar(const LogColumnar &);
+  LogColumnar & operator=(const LogColumnar &);
+};
+
+#endif
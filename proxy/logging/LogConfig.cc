@@ -54,6 +54,7 @@
 #include "LogFormat.h"
 #include "LogFile.h"
 #include "LogBuffer.h"
+#include "LogColumnar.h"
 #include "LogHost.h"
 #include "LogObject.h"
 #include "LogConfig.h"
@@ -104,6 +105,8 @@ LogConfig::setup_default_values()
 
   log_buffer_size = (int) (10 * LOG_KILOBYTE);
   max_secs_per_buffer = 5;
+  per_thread_buffers = true;
+  max_aggregate_groups = 10000;
   max_space_mb_for_logs = 100;
   max_space_mb_for_orphan_logs = 25;
   max_space_mb_headroom = 10;
@@ -184,6 +187,8 @@ LogConfig::setup_default_values()
 
   ascii_buffer_size = 4 * 9216;
   max_line_size = 9216;         // size of pipe buffer for SunOS 5.6
+  columnar_compression_level = LogColumnar::DEFAULT_COMPRESSION_LEVEL;
+  ascii_compression_level = 0;
 }
 
 void *
@@ -211,6 +216,13 @@ LogConfig::read_configuration_variables()
     max_secs_per_buffer = val;
   }
 
+  per_thread_buffers = LOG_ConfigReadInteger("proxy.config.log.per_thread_buffers") ? true : false;
+
+  val = (int) LOG_ConfigReadInteger("proxy.config.log.max_aggregate_groups");
+  if (val > 0) {
+    max_aggregate_groups = val;
+  }
+
   val = (int) LOG_ConfigReadInteger("proxy.config.log.max_space_mb_for_logs");
   if (val > 0) {
     max_space_mb_for_logs = val;
@@ -493,6 +505,22 @@ LogConfig::read_configuration_variables()
     max_line_size = val;
   }
 
+  val = (int) LOG_ConfigReadInteger("proxy.config.log.columnar_compression_level");
+  if (val >= 0 && val <= 9) {
+    columnar_compression_level = val;
+  }
+
+  val = (int) LOG_ConfigReadInteger("proxy.config.log.ascii_compression_level");
+  if (val >= 0 && val <= 9) {
+    ascii_compression_level = val;
+  }
+#if !TS_HAS_LIBZ
+  if (ascii_compression_level > 0) {
+    Warning("proxy.config.log.ascii_compression_level needs zlib, ASCII logs will not be compressed");
+    ascii_compression_level = 0;
+  }
+#endif
+
 /* The following variables are initialized after reading the     */
 /* variable values from records.config                           */
 
@@ -767,6 +795,8 @@ LogConfig::display(FILE * fd)
   fprintf(fd, "Config variables:\n");
   fprintf(fd, "   log_buffer_size = %d\n", log_buffer_size);
   fprintf(fd, "   max_secs_per_buffer = %d\n", max_secs_per_buffer);
+  fprintf(fd, "   per_thread_buffers = %d\n", per_thread_buffers);
+  fprintf(fd, "   max_aggregate_groups = %d\n", max_aggregate_groups);
   fprintf(fd, "   max_space_mb_for_logs = %d\n", max_space_mb_for_logs);
   fprintf(fd, "   max_space_mb_for_orphan_logs = %d\n", max_space_mb_for_orphan_logs);
   fprintf(fd, "   use_orphan_log_space_value = %d\n", use_orphan_log_space_value);
@@ -807,6 +837,8 @@ LogConfig::display(FILE * fd)
   fprintf(fd, "   rolling_size_mb = %d\n", rolling_size_mb);
   fprintf(fd, "   auto_delete_rolled_files = %d\n", auto_delete_rolled_files);
   fprintf(fd, "   sampling_frequency = %d\n", sampling_frequency);
+  fprintf(fd, "   columnar_compression_level = %d\n", columnar_compression_level);
+  fprintf(fd, "   ascii_compression_level = %d\n", ascii_compression_level);
   fprintf(fd, "   file_stat_frequency = %d\n", file_stat_frequency);
   fprintf(fd, "   space_used_frequency = %d\n", space_used_frequency);
 
@@ -945,7 +977,8 @@ LogConfig::create_pre_defined_objects_with_filter(const PreDefinedFormatInfoList
                             pdi->is_ascii ? ASCII_LOG : BINARY_LOG,
                             pdi->header, rolling_enabled,
                             collation_preproc_threads, rolling_interval_sec,
-                            rolling_offset_hr, rolling_size_mb));
+                            rolling_offset_hr, rolling_size_mb,
+                            ascii_compression_level));
 
     if (collation_mode == SEND_STD_FMTS || collation_mode == SEND_STD_AND_NON_XML_CUSTOM_FMTS) {
 
@@ -1220,6 +1253,9 @@ LogConfig::register_config_callbacks()
   // Note: variables that are not exposed in the UI are commented out
   //
   LOG_RegisterConfigUpdateFunc("proxy.config.log.log_buffer_size", &LogConfig::reconfigure, NULL);
+  LOG_RegisterConfigUpdateFunc("proxy.config.log.per_thread_buffers", &LogConfig::reconfigure, NULL);
+  LOG_RegisterConfigUpdateFunc("proxy.config.log.max_aggregate_groups", &LogConfig::reconfigure, NULL);
+  LOG_RegisterConfigUpdateFunc("proxy.config.log.ascii_compression_level", &LogConfig::reconfigure, NULL);
 //    LOG_RegisterConfigUpdateFunc ("proxy.config.log.max_secs_per_buffer",
 //                            &LogConfig::reconfigure, NULL);
   LOG_RegisterConfigUpdateFunc("proxy.config.log.max_space_mb_for_logs", &LogConfig::reconfigure, NULL);
@@ -1335,6 +1371,21 @@ do { \
                      "proxy.process.log.bytes_received_from_network",
                      RECD_INT, RECP_PERSISTENT, (int) log_stat_bytes_received_from_network_stat, RecRawStatSyncSum);
 
+  //
+  // compression of ASCII logs
+  //
+  RecRegisterRawStat(log_rsb, RECT_PROCESS,
+                     "proxy.process.log.bytes_before_compression",
+                     RECD_INT, RECP_PERSISTENT, (int) log_stat_bytes_before_compression_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(log_rsb, RECT_PROCESS,
+                     "proxy.process.log.bytes_after_compression",
+                     RECD_INT, RECP_PERSISTENT, (int) log_stat_bytes_after_compression_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(log_rsb, RECT_PROCESS,
+                     "proxy.process.log.compression_time_usec",
+                     RECD_INT, RECP_PERSISTENT, (int) log_stat_compression_time_stat, RecRawStatSyncSum);
+
   //
   // I/O
   //
@@ -2160,7 +2211,8 @@ LogConfig::read_xml_log_config(int from_memory)
         char *mode_str = mode.dequeue();
         file_type = (strncasecmp(mode_str, "bin", 3) == 0 ||
                      (mode_str[0] == 'b' && mode_str[1] == 0) ?
-                     BINARY_LOG : (strcasecmp(mode_str, "ascii_pipe") == 0 ? ASCII_PIPE : ASCII_LOG));
+                     BINARY_LOG : (strcasecmp(mode_str, "ascii_pipe") == 0 ? ASCII_PIPE :
+                                   (strcasecmp(mode_str, "columnar") == 0 ? COLUMNAR_LOG : ASCII_LOG)));
       }
       // rolling
       //
@@ -2186,7 +2238,8 @@ LogConfig::read_xml_log_config(int from_memory)
                                          collation_preproc_threads,
                                          obj_rolling_interval_sec,
                                          obj_rolling_offset_hr,
-                                         obj_rolling_size_mb));
+                                         obj_rolling_size_mb,
+                                         ascii_compression_level));
 
       // filters
       //
@@ -39,6 +39,9 @@ enum
   log_stat_bytes_written_to_disk_stat,
   log_stat_bytes_sent_to_network_stat,
   log_stat_bytes_received_from_network_stat,
+  log_stat_bytes_before_compression_stat,
+  log_stat_bytes_after_compression_stat,
+  log_stat_compression_time_stat,
   // Logging I/O
   log_stat_log_files_open_stat,
   log_stat_log_files_space_used_stat,
@@ -198,6 +201,8 @@ public:
 
   int log_buffer_size;
   int max_secs_per_buffer;
+  bool per_thread_buffers;
+  int max_aggregate_groups;
   int max_space_mb_for_logs;
   int max_space_mb_for_orphan_logs;
   int max_space_mb_headroom;
@@ -242,6 +247,8 @@ public:
 
   int ascii_buffer_size;
   int max_line_size;
+  int columnar_compression_level;
+  int ascii_compression_level;
 
   char *hostname;
   char *logfile_dir;
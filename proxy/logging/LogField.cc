@@ -62,6 +62,12 @@ const char *aggregate_names[] = {
   "AVG",
   "FIRST",
   "LAST",
+  "MIN",
+  "MAX",
+  "P50",
+  "P90",
+  "P95",
+  "P99",
   ""
 };
 
@@ -72,7 +78,7 @@ const char *aggregate_names[] = {
 // Generic field ctor
 LogField::LogField(const char *name, const char *symbol, Type type, MarshalFunc marshal, UnmarshalFunc unmarshal)
   : m_name(ats_strdup(name)), m_symbol(ats_strdup(symbol)), m_type(type), m_container(NO_CONTAINER), m_marshal_func(marshal),
-    m_unmarshal_func(unmarshal), m_unmarshal_func_map(NULL), m_agg_op(NO_AGGREGATE), m_agg_cnt(0), m_agg_val(0),
+    m_unmarshal_func(unmarshal), m_unmarshal_func_map(NULL), m_agg_op(NO_AGGREGATE),
     m_time_field(false), m_alias_map(0)
 {
   ink_assert(m_name != NULL);
@@ -89,7 +95,7 @@ LogField::LogField(const char *name, const char *symbol, Type type, MarshalFunc
 LogField::LogField(const char *name, const char *symbol, Type type,
                    MarshalFunc marshal, UnmarshalFuncWithMap unmarshal, Ptr<LogFieldAliasMap> map)
   : m_name(ats_strdup(name)), m_symbol(ats_strdup(symbol)), m_type(type), m_container(NO_CONTAINER), m_marshal_func(marshal),
-    m_unmarshal_func(NULL), m_unmarshal_func_map(unmarshal), m_agg_op(NO_AGGREGATE), m_agg_cnt(0), m_agg_val(0),
+    m_unmarshal_func(NULL), m_unmarshal_func_map(unmarshal), m_agg_op(NO_AGGREGATE),
     m_time_field(false), m_alias_map(map)
 {
   ink_assert(m_name != NULL);
@@ -108,7 +114,7 @@ LogField::LogField(const char *name, const char *symbol, Type type,
 LogField::LogField(const char *field, Container container)
   : m_name(ats_strdup(field)), m_symbol(ats_strdup(container_names[container])), m_type(LogField::STRING),
     m_container(container), m_marshal_func(NULL), m_unmarshal_func(NULL), m_unmarshal_func_map(NULL),
-    m_agg_op(NO_AGGREGATE), m_agg_cnt(0), m_agg_val(0), m_time_field(false), m_alias_map(0)
+    m_agg_op(NO_AGGREGATE), m_time_field(false), m_alias_map(0)
 {
   ink_assert(m_name != NULL);
   ink_assert(m_symbol != NULL);
@@ -151,7 +157,7 @@ LogField::LogField(const char *field, Container container)
 LogField::LogField(const LogField &rhs)
   : m_name(ats_strdup(rhs.m_name)), m_symbol(ats_strdup(rhs.m_symbol)), m_type(rhs.m_type), m_container(rhs.m_container),
     m_marshal_func(rhs.m_marshal_func), m_unmarshal_func(rhs.m_unmarshal_func), m_unmarshal_func_map(rhs.m_unmarshal_func_map),
-    m_agg_op(rhs.m_agg_op), m_agg_cnt(0), m_agg_val(0), m_time_field(rhs.m_time_field), m_alias_map(rhs.m_alias_map)
+    m_agg_op(rhs.m_agg_op), m_time_field(rhs.m_time_field), m_alias_map(rhs.m_alias_map)
 {
   ink_assert(m_name != NULL);
   ink_assert(m_symbol != NULL);
@@ -251,45 +257,6 @@ LogField::marshal(LogAccess *lad, char *buf)
   }
 }
 
-/*-------------------------------------------------------------------------
-  LogField::marshal_agg
-  -------------------------------------------------------------------------*/
-unsigned
-LogField::marshal_agg(char *buf)
-{
-  ink_assert(buf != NULL);
-  int64_t avg = 0;
-
-  switch (m_agg_op) {
-
-  case eCOUNT:
-    LogAccess::marshal_int(buf, m_agg_cnt);
-    break;
-
-  case eSUM:
-  case eFIRST:
-  case eLAST:
-    LogAccess::marshal_int(buf, m_agg_val);
-    break;
-
-  case eAVG:
-    if (m_agg_cnt) {
-      avg = m_agg_val / m_agg_cnt;
-    }
-    LogAccess::marshal_int(buf, avg);
-    break;
-
-  default:
-    Note("Cannot marshal aggregate field %s; " "invalid aggregate operator: %d", m_symbol, m_agg_op);
-    return 0;
-  }
-
-  m_agg_val = 0;
-  m_agg_cnt = 0;
-
-  return INK_MIN_ALIGN;
-}
-
 /*-------------------------------------------------------------------------
   LogField::unmarshal
 
@@ -306,6 +273,18 @@ LogField::unmarshal(char **buf, char *dest, int len)
   }
 }
 
+/*-------------------------------------------------------------------------
+  LogField::is_plain_string
+
+  Returns true if this field is marshalled as a single padded string, the
+  way LogAccess::marshal_str lays it down.
+  -------------------------------------------------------------------------*/
+bool
+LogField::is_plain_string()
+{
+  return m_type == STRING && m_alias_map == NULL && m_unmarshal_func == &(LogAccess::unmarshal_str);
+}
+
 /*-------------------------------------------------------------------------
   LogField::display
   -------------------------------------------------------------------------*/
@@ -351,39 +330,6 @@ LogField::set_aggregate_op(LogField::Aggregate agg_op)
 }
 
 
-void
-LogField::update_aggregate(int64_t val)
-{
-  switch (m_agg_op) {
-
-  case eCOUNT:
-  case eSUM:
-  case eAVG:
-    m_agg_val += val;
-    m_agg_cnt++;
-    break;
-
-  case eFIRST:
-    if (m_agg_cnt == 0) {
-      m_agg_val = val;
-      m_agg_cnt++;
-    }
-    break;
-
-  case eLAST:
-    m_agg_val = val;
-    m_agg_cnt++;
-    break;
-
-  default:
-    Note("Cannot update aggregate field; invalid operator %d", m_agg_op);
-    return;
-  }
-
-  Debug("log-agg", "Aggregate field %s updated with val %" PRId64", "
-        "new val = %" PRId64", cnt = %" PRId64"", m_symbol, val, m_agg_val, m_agg_cnt);
-}
-
 
 LogField::Container LogField::valid_container_name(char *name)
 {
@@ -520,18 +466,6 @@ LogFieldList::marshal(LogAccess *lad, char *buf)
   return bytes;
 }
 
-unsigned
-LogFieldList::marshal_agg(char *buf)
-{
-  char *ptr;
-  int bytes = 0;
-  for (LogField *f = first(); f; f = next(f)) {
-    ptr = &buf[bytes];
-    bytes += f->marshal_agg(ptr);
-  }
-  return bytes;
-}
-
 unsigned
 LogFieldList::count()
 {
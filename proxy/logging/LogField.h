@@ -86,6 +86,12 @@ public:
     eAVG,
     eFIRST,
     eLAST,
+    eMIN,
+    eMAX,
+    eP50,
+    eP90,
+    eP95,
+    eP99,
     N_AGGREGATES
   };
 
@@ -100,8 +106,8 @@ public:
 
   unsigned marshal_len(LogAccess * lad);
   unsigned marshal(LogAccess * lad, char *buf);
-  unsigned marshal_agg(char *buf);
   unsigned unmarshal(char **buf, char *dest, int len);
+  bool is_plain_string();
   void display(FILE * fd = stdout);
   bool operator==(LogField & rhs);
 
@@ -130,7 +136,6 @@ public:
   }
 
   void set_aggregate_op(Aggregate agg_op);
-  void update_aggregate(int64_t val);
 
   static Container valid_container_name(char *name);
   static Aggregate valid_aggregate_name(char *name);
@@ -145,8 +150,6 @@ private:
   UnmarshalFunc m_unmarshal_func;       // create a string of the data
   UnmarshalFuncWithMap m_unmarshal_func_map;
   Aggregate m_agg_op;
-  int64_t m_agg_cnt;
-  int64_t m_agg_val;
   bool m_time_field;
   Ptr<LogFieldAliasMap> m_alias_map; // map sINT <--> string
 
@@ -183,7 +186,6 @@ public:
   LogField *find_by_symbol(const char *symbol) const;
   unsigned marshal_len(LogAccess * lad);
   unsigned marshal(LogAccess * lad, char *buf);
-  unsigned marshal_agg(char *buf);
 
   LogField *first() const
   {
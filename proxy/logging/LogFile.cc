@@ -28,11 +28,15 @@
  ***************************************************************************/
 
 #include "libts.h"
+#include "TestBox.h"
 
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#if TS_HAS_LIBZ
+#include <zlib.h>
+#endif
 
 #include "Error.h"
 
@@ -44,6 +48,7 @@
 #include "LogFilter.h"
 #include "LogFormat.h"
 #include "LogBuffer.h"
+#include "LogColumnar.h"
 #include "LogFile.h"
 #include "LogHost.h"
 #include "LogObject.h"
@@ -86,13 +91,14 @@ static const int FILESIZE_SAFE_THRESHOLD_FACTOR = 10;
   -------------------------------------------------------------------------*/
 
 LogFile::LogFile(const char *name, const char *header, LogFileFormat format,
-                 uint64_t signature, size_t ascii_buffer_size, size_t max_line_size)
+                 uint64_t signature, size_t ascii_buffer_size, size_t max_line_size, int compression_level)
   : m_file_format(format),
     m_name(ats_strdup(name)),
     m_header(ats_strdup(header)),
     m_signature(signature),
     m_meta_info(NULL),
-    m_max_line_size(max_line_size)
+    m_max_line_size(max_line_size),
+    m_compression_level(format == ASCII_LOG ? compression_level : 0)
 {
   delete m_meta_info;
   m_meta_info = NULL;
@@ -120,6 +126,7 @@ LogFile::LogFile (const LogFile& copy)
     m_meta_info (NULL),
     m_ascii_buffer_size (copy.m_ascii_buffer_size),
     m_max_line_size (copy.m_max_line_size),
+    m_compression_level (copy.m_compression_level),
     m_fd (-1),
     m_start_time (0L),
     m_end_time (0L),
@@ -270,9 +277,24 @@ LogFile::open_file()
   // file.
   //
   if (!file_exists) {
-    if (m_file_format != BINARY_LOG && m_header != NULL) {
+    if (m_file_format != BINARY_LOG && m_file_format != COLUMNAR_LOG && m_header != NULL) {
       Debug("log-file", "writing header to LogFile %s", m_name);
-      writeln(m_header, strlen(m_header), m_fd, m_name);
+      if (m_compression_level > 0) {
+        int len = strlen(m_header);
+        char *line = (char *)ats_malloc(len + 1);
+        int compressed_len;
+
+        memcpy(line, m_header, len);
+        line[len++] = '\n';
+        char *compressed = compress_ascii(line, len, m_compression_level, &compressed_len);
+        if (compressed && ::write(m_fd, compressed, compressed_len) < 0) {
+          Warning("An error was encountered in writing to %s: %s.", m_name, strerror(errno));
+        }
+        free(compressed);
+        ats_free(line);
+      } else {
+        writeln(m_header, strlen(m_header), m_fd, m_name);
+      }
     }
   }
   // we use SUM_GLOBAL_DYN_STAT because INCREMENT_DYN_STAT
@@ -533,6 +555,9 @@ LogFile::preproc_and_try_delete(LogBuffer * lb)
   else if (m_file_format == ASCII_LOG || m_file_format == ASCII_PIPE) {
     write_ascii_logbuffer3(buffer_header);
   }
+  else if (m_file_format == COLUMNAR_LOG) {
+    write_columnar_logbuffer(lb);
+  }
   else {
     Note("Cannot write LogBuffer to LogFile %s; invalid file format: %d",
          m_name, m_file_format);
@@ -688,19 +713,170 @@ LogFile::write_ascii_logbuffer3(LogBufferHeader * buffer_header, char *alt_forma
         break;
     } while ((entry_header = iter.next()));
 
+    total_bytes += fmt_buf_bytes;
+
+    if (m_compression_level > 0) {
+      int compressed_len;
+      char *compressed = compress_ascii(ascii_buffer, fmt_buf_bytes, m_compression_level, &compressed_len);
+
+      if (compressed) {
+        free(ascii_buffer);
+        ascii_buffer = compressed;
+        fmt_buf_bytes = compressed_len;
+      } else {
+        Error("Failed to compress log entries for %s, have dropped (%d) bytes.", m_name, fmt_buf_bytes);
+        free(ascii_buffer);
+        continue;
+      }
+    }
+
     // send the buffer to flush thread
     //
     LogFlushData *flush_data = new LogFlushData(this, ascii_buffer, fmt_buf_bytes);
     ink_atomiclist_push(Log::flush_data_list, flush_data);
 
     Log::flush_notify->signal();
-
-    total_bytes += fmt_buf_bytes;
   }
 
   return total_bytes;
 }
 
+#if TS_HAS_LIBZ
+// Each preproc thread keeps its deflate state, like the columnar encoder.
+static __thread z_stream *gzip_deflater = NULL;
+static __thread int gzip_deflater_level = -1;
+
+static z_stream *
+get_gzip_deflater(int level)
+{
+  if (gzip_deflater && gzip_deflater_level != level) {
+    deflateEnd(gzip_deflater);
+    ats_free(gzip_deflater);
+    gzip_deflater = NULL;
+  }
+
+  if (!gzip_deflater) {
+    z_stream *z = (z_stream *)ats_malloc(sizeof(z_stream));
+    memset(z, 0, sizeof(z_stream));
+    // 16 more window bits write a gzip header and trailer
+    if (deflateInit2(z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      ats_free(z);
+      return NULL;
+    }
+    gzip_deflater = z;
+    gzip_deflater_level = level;
+  } else {
+    deflateReset(gzip_deflater);
+  }
+  return gzip_deflater;
+}
+
+static ink_hrtime
+thread_cpu_time()
+{
+  timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * HRTIME_SECOND + ts.tv_nsec * HRTIME_NSECOND;
+}
+#endif
+
+/*-------------------------------------------------------------------------
+  LogFile::compress_ascii
+
+  Compress len bytes of ascii log output into a gzip member of their own.
+  Each buffer of a compressed log is compressed by the preproc thread that
+  formats it, independently of the others, and the file is the sequence of
+  these members, which gzip and zcat read as a single stream. Returns the
+  member, to be released with free() like the ascii buffers, or NULL on
+  error.
+  -------------------------------------------------------------------------*/
+
+char *
+LogFile::compress_ascii(const char *data, int len, int level, int *compressed_len)
+{
+#if TS_HAS_LIBZ
+  ink_hrtime start = thread_cpu_time();
+  z_stream *z = get_gzip_deflater(level);
+
+  if (z == NULL) {
+    return NULL;
+  }
+
+  uLong bound = deflateBound(z, len);
+  char *out = (char *)malloc(bound);
+
+  if (out == NULL) {
+    return NULL;
+  }
+  z->next_in = (Bytef *)data;
+  z->avail_in = len;
+  z->next_out = (Bytef *)out;
+  z->avail_out = bound;
+  if (deflate(z, Z_FINISH) != Z_STREAM_END) {
+    free(out);
+    return NULL;
+  }
+  *compressed_len = (int)z->total_out;
+
+  LOG_SUM_GLOBAL_DYN_STAT(log_stat_bytes_before_compression_stat, len);
+  LOG_SUM_GLOBAL_DYN_STAT(log_stat_bytes_after_compression_stat, *compressed_len);
+  LOG_SUM_GLOBAL_DYN_STAT(log_stat_compression_time_stat, (thread_cpu_time() - start) / HRTIME_USECOND);
+  return out;
+#else
+  // proxy.config.log.ascii_compression_level is ignored without zlib
+  ink_assert(!"log compression requires zlib");
+  *compressed_len = 0;
+  return NULL;
+#endif
+}
+
+/*-------------------------------------------------------------------------
+  LogFile::write_columnar_logbuffer
+
+  Encode the given LogBuffer into a columnar block and send it to the flush
+  thread. Splitting the entries into columns needs the fields they were
+  marshalled from, which are those of the owning LogObject; entries of text
+  logs, or of buffers with some other fieldlist, are stored whole. A buffer
+  the encoder can't make sense of is written as is, since readers of
+  columnar logs take binary LogBuffers as well.
+  -------------------------------------------------------------------------*/
+
+int
+LogFile::write_columnar_logbuffer(LogBuffer * lb)
+{
+  LogBufferHeader *buffer_header = lb->header();
+  LogObject *owner = lb->get_owner();
+  LogFieldList *fieldlist = NULL;
+  char *fieldlist_str = buffer_header->fmt_fieldlist();
+  void *data;
+  int len;
+
+  if (buffer_header->format_type != TEXT_LOG && owner && fieldlist_str && owner->m_format->fieldlist() &&
+      strcmp(owner->m_format->fieldlist(), fieldlist_str) == 0) {
+    fieldlist = &owner->m_format->m_field_list;
+  }
+
+  LogColumnarHeader *block = LogColumnar::encode(buffer_header, fieldlist, Log::config->columnar_compression_level);
+
+  if (block) {
+    data = block;
+    len = block->byte_count;
+  } else {
+    Debug("log-file", "could not encode LogBuffer for %s; writing it in binary", m_name);
+    len = buffer_header->byte_count;
+    data = ats_malloc(len);
+    memcpy(data, buffer_header, len);
+  }
+
+  LogFlushData *flush_data = new LogFlushData(this, data, len);
+  ink_atomiclist_push(Log::flush_data_list, flush_data);
+
+  Log::flush_notify->signal();
+
+  return len;
+}
+
 /*-------------------------------------------------------------------------
   LogFile::writeln
 
@@ -901,3 +1077,64 @@ MetaInfo::_write_to_file()
   }
   close(fd);
 }
+
+/*-------------------------------------------------------------------------
+  Regression tests
+  -------------------------------------------------------------------------*/
+
+#if TS_HAS_LIBZ
+REGRESSION_TEST(LogFile_CompressAscii) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  TestBox box(t, pstatus);
+  const char *lines[] = { "1383340000.000 12 127.0.0.1 TCP_MISS/200 203 GET http://example.com/\n",
+                          "1383340001.000 3 127.0.0.1 TCP_HIT/200 1024 GET http://example.com/a.png\n" };
+  char *file = NULL;
+  int file_len = 0, text_len = 0;
+
+  box = REGRESSION_TEST_PASSED;
+
+  // a log file is made of one gzip member per buffer
+  for (int i = 0; i < 20; i++) {
+    const char *line = lines[i % 2];
+    int len = strlen(line), compressed_len;
+    char *member = LogFile::compress_ascii(line, len, 6, &compressed_len);
+
+    box.check(member != NULL, "could not compress buffer %d", i);
+    if (member == NULL) {
+      ats_free(file);
+      return;
+    }
+    file = (char *)ats_realloc(file, file_len + compressed_len);
+    memcpy(file + file_len, member, compressed_len);
+    file_len += compressed_len;
+    text_len += len;
+    free(member);
+  }
+
+  // and reads back as a single gzip stream
+  char *text = (char *)ats_malloc(text_len + 1);
+  z_stream z;
+  int out = 0, ret = Z_OK;
+
+  memset(&z, 0, sizeof(z));
+  inflateInit2(&z, 15 + 16);
+  z.next_in = (Bytef *)file;
+  z.avail_in = file_len;
+  while (z.avail_in > 0 && (ret == Z_OK || ret == Z_STREAM_END)) {
+    if (ret == Z_STREAM_END)
+      inflateReset(&z);
+    z.next_out = (Bytef *)text + out;
+    z.avail_out = text_len + 1 - out;
+    ret = inflate(&z, Z_NO_FLUSH);
+    out = text_len + 1 - z.avail_out;
+  }
+  inflateEnd(&z);
+
+  box.check(ret == Z_STREAM_END && out == text_len, "inflated %d of %d bytes, zlib status %d", out, text_len, ret);
+  for (int i = 0, off = 0; i < 20 && out == text_len; off += strlen(lines[i % 2]), i++) {
+    box.check(memcmp(text + off, lines[i % 2], strlen(lines[i % 2])) == 0, "line %d does not match", i);
+  }
+  ats_free(text);
+  ats_free(file);
+}
+#endif
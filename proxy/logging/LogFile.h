@@ -127,7 +127,7 @@ class LogFile:public LogBufferSink
 {
 public:
   LogFile(const char *name, const char *header, LogFileFormat format, uint64_t signature,
-          size_t ascii_buffer_size = 4 * 9216, size_t max_line_size = 9216);
+          size_t ascii_buffer_size = 4 * 9216, size_t max_line_size = 9216, int compression_level = 0);
   LogFile(const LogFile &);
   ~LogFile();
 
@@ -152,11 +152,14 @@ public:
 
   LogFileFormat get_format() const { return m_file_format; }
   const char *get_format_name() const {
-    return (m_file_format == BINARY_LOG ? "binary" : (m_file_format == ASCII_PIPE ? "ascii_pipe" : "ascii"));
+    return (m_file_format == BINARY_LOG ? "binary" : (m_file_format == ASCII_PIPE ? "ascii_pipe" :
+                                                      (m_file_format == COLUMNAR_LOG ? "columnar" : "ascii")));
   }
 
   static int write_ascii_logbuffer(LogBufferHeader * buffer_header, int fd, const char *path, char *alt_format = NULL);
   int write_ascii_logbuffer3(LogBufferHeader * buffer_header, char *alt_format = NULL);
+  int write_columnar_logbuffer(LogBuffer * lb);
+  static char *compress_ascii(const char *data, int len, int level, int *compressed_len);
   static bool rolled_logfile(char *file);
   static bool exists(const char *pathname);
 
@@ -183,6 +186,7 @@ public:
 
   size_t m_ascii_buffer_size;   // size of ascii buffer
   size_t m_max_line_size;       // size of longest log line (record)
+  int m_compression_level;      // gzip level of ascii output, 0 if none
 
   int m_fd;
   long m_start_time;
@@ -144,10 +144,6 @@ LogFormat::init_variables(const char *name, const char *fieldlist_str, const cha
     Note("Format for aggregate operators but no interval " "was specified");
     m_valid = false;
   } else {
-    if (m_aggregate) {
-      m_agg_marshal_space = (char *)ats_malloc(m_field_count * INK_MIN_ALIGN);
-    }
-
     if (m_name_str) {
       ats_free(m_name_str);
       m_name_str = NULL;
@@ -170,7 +166,6 @@ LogFormat::init_variables(const char *name, const char *fieldlist_str, const cha
 
     m_printf_str = ats_strdup(printf_str);
     m_interval_sec = interval_sec;
-    m_interval_next = LogUtils::timestamp();
 
     m_valid = true;
   }
@@ -187,8 +182,6 @@ LogFormat::init_variables(const char *name, const char *fieldlist_str, const cha
 
 LogFormat::LogFormat(LogFormatType type)
   : m_interval_sec(0),
-    m_interval_next(0),
-    m_agg_marshal_space(NULL),
     m_valid(false),
     m_name_str(NULL),
     m_name_id(0),
@@ -238,8 +231,6 @@ LogFormat::LogFormat(LogFormatType type)
 
 LogFormat::LogFormat(const char *name, const char *format_str, unsigned interval_sec)
   : m_interval_sec(0),
-    m_interval_next(0),
-    m_agg_marshal_space(NULL),
     m_valid(false),
     m_name_str(NULL),
     m_name_id(0),
@@ -264,8 +255,6 @@ LogFormat::LogFormat(const char *name, const char *format_str, unsigned interval
 //
 LogFormat::LogFormat(const char *name, const char *fieldlist_str, const char *printf_str, unsigned interval_sec)
   : m_interval_sec(0),
-    m_interval_next(0),
-    m_agg_marshal_space(NULL),
     m_valid(false),
     m_name_str(NULL),
     m_name_id(0),
@@ -288,8 +277,6 @@ LogFormat::LogFormat(const char *name, const char *fieldlist_str, const char *pr
 
 LogFormat::LogFormat(const LogFormat & rhs)
   : m_interval_sec(0),
-    m_interval_next(0),
-    m_agg_marshal_space(NULL),
     m_valid(rhs.m_valid),
     m_name_str(NULL),
     m_name_id(0),
@@ -320,7 +307,6 @@ LogFormat::~LogFormat()
   ats_free(m_name_str);
   ats_free(m_fieldlist_str);
   ats_free(m_printf_str);
-  ats_free(m_agg_marshal_space);
   ats_free(m_format_str);
   m_valid = false;
 }
@@ -432,7 +418,7 @@ LogFormat::format_from_specification(char *spec, char **file_name, char **file_h
   *file_name = ats_strdup(token);
 
   //
-  // Next should be the file type, either "ASCII" or "BINARY"
+  // Next should be the file type, either "ASCII", "BINARY" or "COLUMNAR"
   //
   token = tok.getNext();
   if (token == NULL) {
@@ -443,8 +429,10 @@ LogFormat::format_from_specification(char *spec, char **file_name, char **file_h
     *file_type = ASCII_LOG;
   } else if (!strcasecmp(token, "BINARY")) {
     *file_type = BINARY_LOG;
+  } else if (!strcasecmp(token, "COLUMNAR")) {
+    *file_type = COLUMNAR_LOG;
   } else {
-    Debug("log-format", "%s is not a valid file format (ASCII or BINARY)", token);
+    Debug("log-format", "%s is not a valid file format (ASCII, BINARY or COLUMNAR)", token);
     return NULL;
   }
 
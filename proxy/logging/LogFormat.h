@@ -83,8 +83,6 @@ private:
 public:
   LogFieldList m_field_list;
   long m_interval_sec;
-  long m_interval_next;
-  char *m_agg_marshal_space;
 
   static const char *const squid_format;        // pre defined formats
   static const char *const common_format;
@@ -39,30 +39,50 @@
 #include "Log.h"
 #include "LogObject.h"
 
+// Buffers are handed to the sink in the order they were queued. A buffer
+// which still has writers holds back the ones queued after it, so the
+// entries of a thread are never written out of order.
 size_t
 LogBufferManager::preproc_buffers(LogBufferSink *sink) {
   SList(LogBuffer, write_link) q(write_list.popall()), new_q;
   LogBuffer *b = NULL;
+
+  // write_list is a stack, reverse it to get the oldest buffer first
   while ((b = q.pop())) {
+    new_q.push(b);
+  }
+
+  ink_mutex_acquire(&_pending_mutex);
+  while ((b = new_q.pop())) {
+    if (_pending_tail) {
+      _pending_tail->write_link.next = b;
+    } else {
+      _pending_list.head = b;
+    }
+    _pending_tail = b;
+  }
+
+  int prepared = 0;
+  while ((b = _pending_list.head)) {
     if (b->m_references || b->m_state.s.num_writers) {
       // Still has outstanding references.
-      write_list.push(b);
-    } else if (_num_flush_buffers > FLUSH_ARRAY_SIZE) {
+      break;
+    }
+    _pending_list.pop();
+    if (b == _pending_tail) {
+      _pending_tail = NULL;
+    }
+    if (_num_flush_buffers > FLUSH_ARRAY_SIZE) {
       delete b;
-      ink_atomic_increment(&_num_flush_buffers, -1);
       Warning("Dropping log buffer, can't keep up.");
     } else {
-      new_q.push(b);
+      b->update_header_data();
+      sink->preproc_and_try_delete(b);
+      prepared++;
     }
-  }
-
-  int prepared = 0;
-  while ((b = new_q.pop())) {
-    b->update_header_data();
-    sink->preproc_and_try_delete(b);
     ink_atomic_increment(&_num_flush_buffers, -1);
-    prepared++;
   }
+  ink_mutex_release(&_pending_mutex);
 
   Debug("log-logbuffer", "prepared %d buffers", prepared);
   return prepared;
@@ -76,7 +96,8 @@ LogObject::LogObject(LogFormat *format, const char *log_dir,
                      const char *basename, LogFileFormat file_format,
                      const char *header, int rolling_enabled,
                      int flush_threads, int rolling_interval_sec,
-                     int rolling_offset_hr, int rolling_size_mb):
+                     int rolling_offset_hr, int rolling_size_mb,
+                     int compression_level):
       m_alt_filename (NULL),
       m_flags (0),
       m_signature (0),
@@ -86,7 +107,10 @@ LogObject::LogObject(LogFormat *format, const char *log_dir,
       m_rolling_size_mb (rolling_size_mb),
       m_last_roll_time(0),
       m_ref_count (0),
-      m_buffer_manager_idx(0)
+      m_thread_buffers(NULL),
+      m_thread_buffer_count(0),
+      m_buffer_manager_idx(0),
+      m_aggregate(NULL)
 {
     ink_assert (format != NULL);
     m_format = new LogFormat(*format);
@@ -94,6 +118,8 @@ LogObject::LogObject(LogFormat *format, const char *log_dir,
 
     if (file_format == BINARY_LOG) {
         m_flags |= BINARY;
+    } else if (file_format == COLUMNAR_LOG) {
+        m_flags |= COLUMNAR;
     } else if (file_format == ASCII_PIPE) {
 #ifdef ASCII_PIPE_FORMAT_SUPPORTED
         m_flags |= WRITES_TO_PIPE;
@@ -105,7 +131,11 @@ LogObject::LogObject(LogFormat *format, const char *log_dir,
 #endif
     }
 
-    generate_filenames(log_dir, basename, file_format);
+    // only ascii logs are compressed
+    if (file_format != ASCII_LOG) {
+        compression_level = 0;
+    }
+    generate_filenames(log_dir, basename, file_format, compression_level);
 
     // compute_signature is a static function
     m_signature = compute_signature(m_format, m_basename, m_flags);
@@ -116,11 +146,14 @@ LogObject::LogObject(LogFormat *format, const char *log_dir,
     m_logFile = NEW(new LogFile (m_filename, header, file_format,
                                  m_signature,
                                  Log::config->ascii_buffer_size,
-                                 Log::config->max_line_size));
+                                 Log::config->max_line_size,
+                                 compression_level));
 
     LogBuffer *b = NEW (new LogBuffer (this, Log::config->log_buffer_size));
     ink_assert(b);
     SET_FREELIST_POINTER_VERSION(m_log_buffer, b, 0);
+    _init_thread_buffers();
+    _init_aggregate();
 
     _setup_rolling(rolling_enabled, rolling_interval_sec, rolling_offset_hr, rolling_size_mb);
 
@@ -137,7 +170,11 @@ LogObject::LogObject(LogObject& rhs)
     m_flush_threads(rhs.m_flush_threads),
     m_rolling_interval_sec(rhs.m_rolling_interval_sec),
     m_last_roll_time(rhs.m_last_roll_time),
-    m_ref_count(0)
+    m_ref_count(0),
+    m_thread_buffers(NULL),
+    m_thread_buffer_count(0),
+    m_buffer_manager_idx(0),
+    m_aggregate(NULL)
 {
     m_format = new LogFormat(*(rhs.m_format));
     m_buffer_manager = new LogBufferManager[m_flush_threads];
@@ -165,6 +202,8 @@ LogObject::LogObject(LogObject& rhs)
     LogBuffer *b = NEW (new LogBuffer (this, Log::config->log_buffer_size));
     ink_assert(b);
     SET_FREELIST_POINTER_VERSION(m_log_buffer, b, 0);
+    _init_thread_buffers();
+    _init_aggregate();
 
     Debug("log-config", "exiting LogObject copy constructor, "
           "filename=%s this=%p", m_filename, this);
@@ -190,9 +229,38 @@ LogObject::~LogObject()
   ats_free(m_basename);
   ats_free(m_filename);
   ats_free(m_alt_filename);
+  delete m_aggregate;
   delete m_format;
   delete[] m_buffer_manager;
   delete (LogBuffer*)FREELIST_POINTER(m_log_buffer);
+  for (int i = 0; i < m_thread_buffer_count; i++) {
+    delete (LogBuffer*)FREELIST_POINTER(m_thread_buffers[i].buffer);
+  }
+  ats_memalign_free(m_thread_buffers);
+}
+
+void
+LogObject::_init_aggregate()
+{
+  if (m_format->is_aggregate()) {
+    m_aggregate = NEW(new LogAggregate(&m_format->m_field_list, m_format->m_interval_sec,
+                                       Log::config->max_aggregate_groups));
+  }
+}
+
+// Give each event thread a work buffer of its own, so that threads logging
+// to this object don't all compete for m_log_buffer. The buffers are only
+// allocated once a thread logs something.
+void
+LogObject::_init_thread_buffers()
+{
+  if (!Log::config->per_thread_buffers || eventProcessor.n_ethreads <= 0)
+    return;
+
+  m_thread_buffer_count = eventProcessor.n_ethreads;
+  m_thread_buffers = (LogThreadBuffer *) ats_memalign(sizeof(LogThreadBuffer),
+                                                      m_thread_buffer_count * sizeof(LogThreadBuffer));
+  memset(m_thread_buffers, 0, m_thread_buffer_count * sizeof(LogThreadBuffer));
 }
 
 //-----------------------------------------------------------------------------
@@ -206,9 +274,12 @@ LogObject::~LogObject()
 // 3.- if there is a '.' at the end of the name, then do not add an extension
 //     and remove the '.'. To have a dot at the end of the filename, specify
 //     two ('..').
+// 4.- add .gz to ascii logs when they are compressed, unless the name
+//     already ends with it
 //
 void
-LogObject::generate_filenames(const char *log_dir, const char *basename, LogFileFormat file_format)
+LogObject::generate_filenames(const char *log_dir, const char *basename, LogFileFormat file_format,
+                              int compression_level)
 {
   ink_assert(log_dir && basename);
 
@@ -240,13 +311,24 @@ LogObject::generate_filenames(const char *log_dir, const char *basename, LogFile
       ext = ASCII_PIPE_OBJECT_FILENAME_EXTENSION;
       ext_len = 5;
       break;
+    case COLUMNAR_LOG:
+      ext = COLUMNAR_LOG_OBJECT_FILENAME_EXTENSION;
+      ext_len = 5;
+      break;
     default:
       ink_assert(!"unknown file format");
     }
   }
 
+  const char *gz_ext = COMPRESSED_LOG_OBJECT_FILENAME_EXTENSION;
+  int gz_len = (int) strlen(gz_ext);
+  if (file_format != ASCII_LOG || compression_level == 0 ||
+      (ext_len == 0 && len >= gz_len && strncmp(&basename[len - gz_len], gz_ext, gz_len) == 0)) {
+    gz_len = 0;
+  }
+
   int dir_len = (int) strlen(log_dir);
-  int basename_len = len + ext_len + 1; // include null terminator
+  int basename_len = len + ext_len + gz_len + 1; // include null terminator
   int total_len = dir_len + 1 + basename_len;   // include '/'
 
   m_filename = (char *)ats_malloc(total_len);
@@ -261,6 +343,10 @@ LogObject::generate_filenames(const char *log_dir, const char *basename, LogFile
     memcpy(&m_filename[dir_len + len], ext, ext_len);
     memcpy(&m_basename[len], ext, ext_len);
   }
+  if (gz_len) {
+    memcpy(&m_filename[dir_len + len + ext_len], gz_ext, gz_len);
+    memcpy(&m_basename[len + ext_len], gz_ext, gz_len);
+  }
   m_filename[total_len - 1] = 0;
   m_basename[basename_len - 1] = 0;
 }
@@ -337,7 +423,8 @@ uint64_t LogObject::compute_signature(LogFormat * format, char *filename, unsign
     char *buffer = (char *)ats_malloc(buf_size);
 
     ink_string_concatenate_strings(buffer, fl, ps, filename, flags & LogObject::BINARY ? "B" :
-                                   (flags & LogObject::WRITES_TO_PIPE ? "P" : "A"), NULL);
+                                   (flags & LogObject::COLUMNAR ? "C" :
+                                    (flags & LogObject::WRITES_TO_PIPE ? "P" : "A")), NULL);
 
     INK_MD5 md5s;
 
@@ -380,7 +467,8 @@ LogObject::displayAsXML(FILE * fd, bool extended)
           "<LogObject>\n"
           "  <Mode        = \"%s\"/>\n"
           "  <Format      = \"%s\"/>\n"
-          "  <Filename    = \"%s\"/>\n", (m_flags & BINARY ? "binary" : "ascii"), m_format->name(), m_filename);
+          "  <Filename    = \"%s\"/>\n", (m_flags & BINARY ? "binary" : (m_flags & COLUMNAR ? "columnar" : "ascii")),
+          m_format->name(), m_filename);
 
   LogFilter *filter;
   for (filter = m_filter_list.first(); filter != NULL; filter = m_filter_list.next(filter)) {
@@ -396,8 +484,41 @@ LogObject::displayAsXML(FILE * fd, bool extended)
 }
 
 
+static inline bool
+log_buffer_cas(volatile head_p * slot, head_p old_h, head_p new_h)
+{
+#if TS_HAS_128BIT_CAS
+  return ink_atomic_cas((__int128_t*) &slot->data, old_h.data, new_h.data);
+#else
+  return ink_atomic_cas((int64_t *) &slot->data, old_h.data, new_h.data);
+#endif
+}
+
+// Return the work buffer the calling thread should log to. idx is set to
+// the flush queue its full buffers go to, -1 to spread them over all of
+// them. A thread always uses the same queue for its own buffer, so its
+// entries are flushed in order.
+volatile head_p *
+LogObject::_work_buffer(int *idx)
+{
+  EThread *thread = this_ethread();
+
+  if (m_thread_buffers && thread && thread->id >= 0) {
+    int i = thread->id % m_thread_buffer_count;
+
+    *idx = i % m_flush_threads;
+    return &m_thread_buffers[i].buffer;
+  }
+  *idx = -1;
+  return &m_log_buffer;
+}
+
+// Check out write_size bytes from the work buffer in slot. A NULL
+// write_offset instead marks the buffer full and replaces it, if it has
+// any entries and, when time_now is given, it has expired by then.
 LogBuffer *
-LogObject::_checkout_write(size_t * write_offset, size_t bytes_needed) {
+LogObject::_checkout_write(volatile head_p * slot, int idx, size_t * write_offset, size_t bytes_needed,
+                           long time_now) {
   LogBuffer::LB_ResultCode result_code;
   LogBuffer *buffer;
   LogBuffer *new_buffer;
@@ -408,18 +529,33 @@ LogObject::_checkout_write(size_t * write_offset, size_t bytes_needed) {
     // the pointer itself and add this to m_outstanding_references.
     head_p h;
     int result = 0;
+
+    // thread work buffers are created when first written to
+    INK_QUEUE_LD(h, *slot);
+    if (FREELIST_POINTER(h) == NULL) {
+      if (!write_offset)
+        return NULL;
+      new_buffer = NEW (new LogBuffer(this, Log::config->log_buffer_size));
+      head_p tmp_h;
+      SET_FREELIST_POINTER_VERSION(tmp_h, new_buffer, 0);
+      if (!log_buffer_cas(slot, h, tmp_h))
+        delete new_buffer;
+      continue;
+    }
+
     do {
-      INK_QUEUE_LD(h, m_log_buffer);
+      INK_QUEUE_LD(h, *slot);
       head_p new_h;
       SET_FREELIST_POINTER_VERSION(new_h, FREELIST_POINTER(h), FREELIST_VERSION(h) + 1);
-#if TS_HAS_128BIT_CAS
-       result = ink_atomic_cas((__int128_t*) &m_log_buffer.data, h.data, new_h.data);
-#else
-       result = ink_atomic_cas((int64_t *) &m_log_buffer.data, h.data, new_h.data);
-#endif
+      result = log_buffer_cas(slot, h, new_h);
     } while (!result);
     buffer = (LogBuffer*)FREELIST_POINTER(h);
-    result_code = buffer->checkout_write(write_offset, bytes_needed);
+    if (!write_offset && time_now && time_now <= buffer->expiration_time()) {
+      // not expired yet, leave it alone
+      result_code = LogBuffer::LB_OK;
+    } else {
+      result_code = buffer->checkout_write(write_offset, bytes_needed);
+    }
     bool decremented = false;
 
     switch (result_code) {
@@ -438,7 +574,7 @@ LogObject::_checkout_write(size_t * write_offset, size_t bytes_needed) {
       INK_WRITE_MEMORY_BARRIER;
       head_p old_h;
       do {
-        INK_QUEUE_LD(old_h, m_log_buffer);
+        INK_QUEUE_LD(old_h, *slot);
         if (FREELIST_POINTER(old_h) != FREELIST_POINTER(h)) {
           ink_atomic_increment(&buffer->m_references, -1);
 
@@ -449,19 +585,15 @@ LogObject::_checkout_write(size_t * write_offset, size_t bytes_needed) {
         }
         head_p tmp_h;
         SET_FREELIST_POINTER_VERSION(tmp_h, new_buffer, 0);
-#if TS_HAS_128BIT_CAS
-       result = ink_atomic_cas((__int128_t*) &m_log_buffer.data, old_h.data, tmp_h.data);
-#else
-       result = ink_atomic_cas((int64_t *) &m_log_buffer.data, old_h.data, tmp_h.data);
-#endif
+        result = log_buffer_cas(slot, old_h, tmp_h);
       } while (!result);
       if (FREELIST_POINTER(old_h) == FREELIST_POINTER(h)) {
         ink_atomic_increment(&buffer->m_references, FREELIST_VERSION(old_h) - 1);
 
-        int idx = m_buffer_manager_idx++ % m_flush_threads;
+        int flush_idx = idx < 0 ? m_buffer_manager_idx++ % m_flush_threads : idx;
         Debug("log-logbuffer", "adding buffer %d to flush list after checkout", buffer->get_id());
-        m_buffer_manager[idx].add_to_flush_queue(buffer);
-        Log::preproc_notify[idx].signal();
+        m_buffer_manager[flush_idx].add_to_flush_queue(buffer);
+        Log::preproc_notify[flush_idx].signal();
 
       }
       decremented = true;
@@ -488,16 +620,12 @@ LogObject::_checkout_write(size_t * write_offset, size_t bytes_needed) {
     if (!decremented) {
       head_p old_h;
       do {
-        INK_QUEUE_LD(old_h, m_log_buffer);
+        INK_QUEUE_LD(old_h, *slot);
         if (FREELIST_POINTER(old_h) != FREELIST_POINTER(h))
           break;
         head_p tmp_h;
         SET_FREELIST_POINTER_VERSION(tmp_h, FREELIST_POINTER(h), FREELIST_VERSION(old_h) - 1);
-#if TS_HAS_128BIT_CAS
-       result = ink_atomic_cas((__int128_t*) &m_log_buffer.data, old_h.data, tmp_h.data);
-#else
-       result = ink_atomic_cas((int64_t *) &m_log_buffer.data, old_h.data, tmp_h.data);
-#endif
+        result = log_buffer_cas(slot, old_h, tmp_h);
       } while (!result);
       if (FREELIST_POINTER(old_h) != FREELIST_POINTER(h))
         ink_atomic_increment(&buffer->m_references, -1);
@@ -510,6 +638,15 @@ LogObject::_checkout_write(size_t * write_offset, size_t bytes_needed) {
   return buffer;
 }
 
+void
+LogObject::force_new_buffer()
+{
+  _checkout_write(&m_log_buffer, -1, NULL, 0);
+  for (int i = 0; i < m_thread_buffer_count; i++) {
+    _checkout_write(&m_thread_buffers[i].buffer, i % m_flush_threads, NULL, 0);
+  }
+}
+
 
 int
 LogObject::log(LogAccess * lad, char *text_entry)
@@ -543,40 +680,15 @@ LogObject::log(LogAccess * lad, char *text_entry)
     return Log::SKIP;
   }
 
-  if (lad && m_format->is_aggregate()) {
-    // marshal the field data into the temp space provided by the
-    // LogFormat object for aggregate formats
-    if (m_format->m_agg_marshal_space == NULL) {
-      Note("No temp space to marshal aggregate fields into");
+  if (lad && m_aggregate) {
+    // entries of aggregate formats are only folded into their group here,
+    // the groups are logged by check_buffer_expiration()
+    if (!m_aggregate->add(lad)) {
       LOG_INCREMENT_DYN_STAT(log_stat_event_log_access_fail_stat);
       return Log::FAIL;
     }
-
-    long time_now = LogUtils::timestamp();
-    m_format->m_field_list.marshal(lad, m_format->m_agg_marshal_space);
-
-    // step through each of the fields and update the LogField object
-    // with the newly-marshalled data
-    LogFieldList *fl = &m_format->m_field_list;
-    char *data_ptr = m_format->m_agg_marshal_space;
-    LogField *f;
-    int64_t val;
-    for (f = fl->first(); f; f = fl->next(f)) {
-
-      // convert to host order to do computations
-      val = (f->is_time_field())? time_now : *((int64_t *) data_ptr);
-      f->update_aggregate(val);
-      data_ptr += INK_MIN_ALIGN;
-    }
-
-    if (time_now < m_format->m_interval_next) {
-      Debug("log-agg", "Time now = %ld, next agg = %ld; not time "
-            "for aggregate entry", time_now, m_format->m_interval_next);
-      return Log::LOG_OK;
-    }
-    // can easily compute bytes_needed because all fields are INTs
-    // and will use INK_MIN_ALIGN each
-    bytes_needed = m_format->field_count() * INK_MIN_ALIGN;
+    LOG_INCREMENT_DYN_STAT(log_stat_event_log_access_stat);
+    return Log::LOG_OK;
   } else if (lad) {
     bytes_needed = m_format->m_field_list.marshal_len(lad);
   } else if (text_entry) {
@@ -590,7 +702,9 @@ LogObject::log(LogAccess * lad, char *text_entry)
   }
   // Now try to place this entry in the current LogBuffer.
 
-  buffer = _checkout_write(&offset, bytes_needed);
+  int idx;
+  volatile head_p *slot = _work_buffer(&idx);
+  buffer = _checkout_write(slot, idx, &offset, bytes_needed);
 
   if (!buffer) {
     Note("Traffic Server is skipping the current log entry for %s because "
@@ -604,14 +718,7 @@ LogObject::log(LogAccess * lad, char *text_entry)
   // and the commit (checkin) the changes.
   //
 
-  if (lad && m_format->is_aggregate()) {
-    // the "real" entry data is contained in the LogField objects
-    // themselves, not in this lad.
-    bytes_used = m_format->m_field_list.marshal_agg(&(*buffer)[offset]);
-    ink_assert(bytes_needed >= bytes_used);
-    m_format->m_interval_next += m_format->m_interval_sec;
-    Debug("log-agg", "Aggregate entry created; next time is %ld", m_format->m_interval_next);
-  } else if (lad) {
+  if (lad) {
     bytes_used = m_format->m_field_list.marshal(lad, &(*buffer)[offset]);
     ink_assert(bytes_needed >= bytes_used);
   } else if (text_entry) {
@@ -783,10 +890,53 @@ LogObject::_roll_files(long last_roll_time, long time_now)
 void
 LogObject::check_buffer_expiration(long time_now)
 {
-  LogBuffer *b = (LogBuffer*)FREELIST_POINTER(m_log_buffer);
-  if (b && time_now > b->expiration_time()) {
-    force_new_buffer();
+  if (m_aggregate) {
+    _log_aggregates(time_now);
+  }
+  _checkout_write(&m_log_buffer, -1, NULL, 0, time_now);
+  for (int i = 0; i < m_thread_buffer_count; i++) {
+    _checkout_write(&m_thread_buffers[i].buffer, i % m_flush_threads, NULL, 0, time_now);
+  }
+}
+
+
+// Write one entry per group once the aggregation interval has ended. This
+// runs on the periodic task thread, which has no stats mutex.
+void
+LogObject::_log_aggregates(long time_now)
+{
+  LogAggregateGroup *groups = m_aggregate->collect(time_now);
+
+  if (groups == NULL) {
+    return;
+  }
+  if (Log::config->logging_space_exhausted && !writes_to_pipe() && m_logFile) {
+    Note("Traffic Server is skipping the aggregate entries for %s because logging space is exhausted", m_basename);
+    LogAggregate::free_groups(groups);
+    return;
   }
+
+  RefCounter counter(&m_ref_count);
+  int ngroups = 0;
+
+  for (LogAggregateGroup *g = groups; g; g = LogAggregate::next_group(g)) {
+    size_t offset = 0;
+    size_t bytes_needed = m_aggregate->marshal_len(g);
+    int idx;
+    volatile head_p *slot = _work_buffer(&idx);
+    LogBuffer *buffer = _checkout_write(slot, idx, &offset, bytes_needed);
+
+    if (!buffer) {
+      Note("Traffic Server is skipping an aggregate entry for %s because "
+           "its size (%zu) exceeds the maximum payload space in a log buffer", m_basename, bytes_needed);
+      continue;
+    }
+    m_aggregate->marshal_group(g, &(*buffer)[offset]);
+    buffer->checkin_write(offset);
+    ngroups++;
+  }
+  LogAggregate::free_groups(groups);
+  Debug("log-agg", "%d aggregate entries written for %s", ngroups, m_basename);
 }
 
 
@@ -1299,3 +1449,181 @@ LogObjectManager::transfer_objects(LogObjectManager & old_mgr)
     display();
   }
 }
+
+//-------------------------------------------------------------------------
+// Benchmark logging to a single object from many threads
+//-------------------------------------------------------------------------
+/* The threads share a fixed number of "<thread> <seq>" entries, which
+ * they log as fast as they can while a drain thread hands the full
+ * buffers to a sink, the way the preproc threads do.  The total is small
+ * enough that no buffer is dropped if the drain falls behind.  The sink
+ * counts the entries and, with per-thread buffers, checks that the
+ * entries of each thread arrive in the order they were logged.
+ */
+#define LOG_BENCH_MAX_THREADS 64
+
+class LogBenchSink : public LogFile
+{
+public:
+  LogBenchSink()
+    : LogFile("log_bench", NULL, ASCII_LOG, 0, Log::config->ascii_buffer_size, Log::config->max_line_size),
+      entries(0), out_of_order(0)
+  {
+    for (int i = 0; i < LOG_BENCH_MAX_THREADS; i++)
+      last_seq[i] = -1;
+  }
+
+  void preproc_and_try_delete(LogBuffer * lb)
+  {
+    LogBufferIterator iter(lb->header());
+    LogEntryHeader *entry;
+
+    while ((entry = iter.next())) {
+      char *end;
+      int thread = strtol((char *) entry + sizeof(LogEntryHeader), &end, 10);
+      int seq = strtol(end, NULL, 10);
+
+      entries++;
+      if (thread >= 0 && thread < LOG_BENCH_MAX_THREADS) {
+        if (seq <= last_seq[thread])
+          out_of_order++;
+        last_seq[thread] = seq;
+      }
+    }
+    delete lb;
+  }
+
+  int entries;
+  int out_of_order;
+  int last_seq[LOG_BENCH_MAX_THREADS];
+};
+
+struct LogBench
+{
+  TextLogObject *obj;
+  int id;
+  int loops;
+  volatile bool done;
+};
+
+static void *
+log_bench_writer(void *arg)
+{
+  LogBench *b = (LogBench *) arg;
+  EThread *thread = NEW(new EThread);
+
+  // pose as the event thread numbered id
+  thread->id = b->id;
+  thread->set_specific();
+  for (int i = 0; i < b->loops; i++)
+    b->obj->write("%d %d", b->id, i);
+  delete thread;
+  return NULL;
+}
+
+static void *
+log_bench_drain(void *arg)
+{
+  LogBench *b = (LogBench *) arg;
+
+  while (!b->done) {
+    size_t n = 0;
+
+    for (int i = 0; i < Log::collation_preproc_threads; i++)
+      n += b->obj->preproc_buffers(i);
+    if (n == 0)
+      usleep(1000);
+  }
+  return NULL;
+}
+
+REGRESSION_TEST(LogObject_ThreadContention) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  const int total = 256 * 1024;
+  bool per_thread_buffers = Log::config->per_thread_buffers;
+  int status = REGRESSION_TEST_PASSED;
+
+  for (int nthreads = 1; nthreads <= LOG_BENCH_MAX_THREADS; nthreads *= 4) {
+    int loops = total / nthreads;
+
+    for (int per_thread = 0; per_thread < 2; per_thread++) {
+      LogBench b[LOG_BENCH_MAX_THREADS], drain;
+      ink_thread tid[LOG_BENCH_MAX_THREADS], drain_tid;
+      LogBenchSink *sink = NEW(new LogBenchSink);
+
+      Log::config->per_thread_buffers = per_thread;
+      drain.obj = NEW(new TextLogObject("log_bench", Log::config->logfile_dir, false, NULL, 0,
+                                        Log::collation_preproc_threads));
+      Log::config->per_thread_buffers = per_thread_buffers;
+      delete drain.obj->m_logFile;
+      drain.obj->m_logFile = sink;
+      drain.done = false;
+      drain_tid = ink_thread_create(log_bench_drain, &drain);
+
+      ink_hrtime start = ink_get_hrtime_internal();
+      for (int i = 0; i < nthreads; i++) {
+        b[i].obj = drain.obj;
+        b[i].id = i;
+        b[i].loops = loops;
+        tid[i] = ink_thread_create(log_bench_writer, b + i);
+      }
+      for (int i = 0; i < nthreads; i++)
+        ink_thread_join(tid[i]);
+      ink_hrtime elapsed = ink_get_hrtime_internal() - start;
+
+      drain.done = true;
+      ink_thread_join(drain_tid);
+      drain.obj->force_new_buffer();
+      for (int i = 0; i < Log::collation_preproc_threads; i++)
+        drain.obj->preproc_buffers(i);
+
+      // rprintf() only knows %s and %d.
+      rprintf(t, "%d threads %s: %d entries in %d usecs, %d entries/sec\n", nthreads,
+              per_thread ? "per-thread buffers" : "shared buffer", nthreads * loops,
+              (int) ink_hrtime_to_usec(elapsed),
+              (int) ((double) nthreads * loops * HRTIME_SECOND / (elapsed ? elapsed : 1)));
+      if (sink->entries != nthreads * loops || (per_thread && sink->out_of_order))
+        status = REGRESSION_TEST_FAILED;
+      delete drain.obj;
+    }
+  }
+  *pstatus = status;
+}
+
+REGRESSION_TEST(LogObject_CompressedFilenames) (RegressionTest * t, int /* atype ATS_UNUSED */, int *pstatus)
+{
+  struct
+  {
+    const char *basename;
+    LogFileFormat file_format;
+    int compression_level;
+    const char *expected;
+  } cases[] = {
+    { "access", ASCII_LOG, 6, "access.log.gz" },
+    { "access.log", ASCII_LOG, 6, "access.log.gz" },
+    { "access.gz", ASCII_LOG, 6, "access.gz" },
+    { "access", ASCII_LOG, 0, "access.log" },
+    { "access", BINARY_LOG, 6, "access.blog" },
+    { "access", COLUMNAR_LOG, 6, "access.clog" },
+  };
+  LogFormat format("compressed_filenames", "%<chi> %<cqu>");
+  int status = REGRESSION_TEST_PASSED;
+
+  for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    LogObject obj(&format, "/tmp", cases[i].basename, cases[i].file_format, NULL, LogConfig::NO_ROLLING, 1,
+                  0, 0, 0, cases[i].compression_level);
+    int expected_level = cases[i].file_format == ASCII_LOG ? cases[i].compression_level : 0;
+
+    if (strcmp(obj.get_base_filename(), cases[i].expected) != 0) {
+      rprintf(t, "%s at level %d is named %s, expected %s\n", cases[i].basename, cases[i].compression_level,
+              obj.get_base_filename(), cases[i].expected);
+      status = REGRESSION_TEST_FAILED;
+    }
+    if (obj.m_logFile->m_compression_level != expected_level) {
+      rprintf(t, "%s is written at level %d, expected %d\n", obj.get_base_filename(),
+              obj.m_logFile->m_compression_level, expected_level);
+      status = REGRESSION_TEST_FAILED;
+    }
+  }
+  *pstatus = status;
+}
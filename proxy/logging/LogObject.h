@@ -35,6 +35,7 @@
 #include "LogBuffer.h"
 #include "LogAccess.h"
 #include "LogFilter.h"
+#include "LogAggregate.h"
 #include "SimpleTokenizer.h"
 
 /*-------------------------------------------------------------------------
@@ -52,6 +53,8 @@
 #define ASCII_LOG_OBJECT_FILENAME_EXTENSION ".log"
 #define BINARY_LOG_OBJECT_FILENAME_EXTENSION ".blog"
 #define ASCII_PIPE_OBJECT_FILENAME_EXTENSION ".pipe"
+#define COLUMNAR_LOG_OBJECT_FILENAME_EXTENSION ".clog"
+#define COMPRESSED_LOG_OBJECT_FILENAME_EXTENSION ".gz"
 
 #define FLUSH_ARRAY_SIZE (512*4)
 
@@ -69,10 +72,19 @@ class LogBufferManager
 {
   private:
     ASLL(LogBuffer, write_link) write_list;
+    SList(LogBuffer, write_link) _pending_list;  // oldest first, still being written
+    LogBuffer *_pending_tail;
+    ink_mutex _pending_mutex;
     int _num_flush_buffers;
 
   public:
-    LogBufferManager() : _num_flush_buffers(0) { }
+    LogBufferManager() : _pending_tail(NULL), _num_flush_buffers(0) {
+      ink_mutex_init(&_pending_mutex, "LogBufferManager");
+    }
+
+    ~LogBufferManager() {
+      ink_mutex_destroy(&_pending_mutex);
+    }
 
     void add_to_flush_queue(LogBuffer *buffer) {
       write_list.push(buffer);
@@ -82,6 +94,14 @@ class LogBufferManager
     size_t preproc_buffers(LogBufferSink *sink);
 };
 
+// The work buffer of an event thread, padded to a cache line so threads
+// logging to the same object don't write to each other's lines.
+union LogThreadBuffer
+{
+  volatile head_p buffer;
+  char pad[64];
+};
+
 class LogObject
 {
 public:
@@ -89,19 +109,21 @@ public:
   {
     BINARY = 1,
     REMOTE_DATA = 2,
-    WRITES_TO_PIPE = 4
+    WRITES_TO_PIPE = 4,
+    COLUMNAR = 8
   };
 
   // BINARY: log is written in binary format (rather than ascii)
   // REMOTE_DATA: object receives data from remote collation clients, so
   //              it should not be destroyed during a reconfiguration
   // WRITES_TO_PIPE: object writes to a named pipe rather than to a file
+  // COLUMNAR: log is written in columnar blocks (see LogColumnar.h)
 
   LogObject(LogFormat *format, const char *log_dir, const char *basename,
                  LogFileFormat file_format, const char *header,
                  int rolling_enabled, int flush_threads,
                  int rolling_interval_sec = 0, int rolling_offset_hr = 0,
-                 int rolling_size_mb = 0);
+                 int rolling_size_mb = 0, int compression_level = 0);
   LogObject(LogObject &);
   virtual ~LogObject();
 
@@ -190,9 +212,7 @@ public:
 
   const char *get_format_string() { return (m_format ? m_format->format_string() : "<none>"); }
 
-  void force_new_buffer() {
-    _checkout_write(NULL, 0);
-  }
+  void force_new_buffer();
 
   bool operator==(LogObject & rhs);
   int do_filesystem_checks();
@@ -229,14 +249,24 @@ private:
   int m_ref_count;
 
   volatile head_p m_log_buffer;     // current work buffer
+  LogThreadBuffer *m_thread_buffers;    // work buffer of each event thread,
+  // or NULL if all threads share m_log_buffer
+  int m_thread_buffer_count;
   unsigned m_buffer_manager_idx;
   LogBufferManager *m_buffer_manager;
+  LogAggregate *m_aggregate;    // groups of an aggregate format, or NULL
 
-  void generate_filenames(const char *log_dir, const char *basename, LogFileFormat file_format);
+  void generate_filenames(const char *log_dir, const char *basename, LogFileFormat file_format,
+                          int compression_level);
   void _setup_rolling(int rolling_enabled, int rolling_interval_sec, int rolling_offset_hr, int rolling_size_mb);
   int _roll_files(long interval_start, long interval_end);
 
-  LogBuffer *_checkout_write(size_t * write_offset, size_t write_size);
+  void _init_thread_buffers();
+  void _init_aggregate();
+  void _log_aggregates(long time_now);
+  volatile head_p *_work_buffer(int *idx);
+  LogBuffer *_checkout_write(volatile head_p * slot, int idx, size_t * write_offset, size_t write_size,
+                             long time_now = 0);
 
 private:
   // -- member functions not allowed --
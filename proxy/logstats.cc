@@ -32,6 +32,7 @@
 #include "LogStandalone.cc"
 
 #include "LogObject.h"
+#include "LogColumnar.h"
 #include "hdrs/HTTP.h"
 
 #include <math.h>
@@ -1667,6 +1668,59 @@ parse_log_buff(LogBufferHeader * buf_header, bool summary = false)
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Process a columnar block, the first bytes of which are already in buffer.
+int
+process_columnar_block(int in_fd, char *buffer, unsigned first_read_size, unsigned max_age)
+{
+  LogColumnarHeader *header = (LogColumnarHeader *)buffer;
+  unsigned second_read_size = sizeof(LogColumnarHeader) - first_read_size;
+  int nread;
+
+  nread = read(in_fd, &buffer[first_read_size], second_read_size);
+  if (nread != (int)second_read_size) {
+    Debug("logstats", "Failed to read columnar block header.");
+    return 1;
+  }
+
+  if (header->byte_count < sizeof(LogColumnarHeader) || header->byte_count > 16 * LOG_MEGABYTE) {
+    Debug("logstats", "Columnar block byte count [%u] is wrong.", header->byte_count);
+    return 1;
+  }
+
+  unsigned body_bytes = header->byte_count - sizeof(LogColumnarHeader);
+  char *block = (char *)ats_malloc(header->byte_count);
+
+  memcpy(block, header, sizeof(LogColumnarHeader));
+  nread = read(in_fd, block + sizeof(LogColumnarHeader), body_bytes);
+  if (nread != (int)body_bytes) {
+    Debug("logstats", "Failed to read columnar block body [%u bytes]", body_bytes);
+    ats_free(block);
+    return 1;
+  }
+
+  // Possibly skip too old entries (the entire block is skipped)
+  if (header->high_timestamp < max_age) {
+    Debug("logstats", "Skipping old block (age=%d, max=%d)", header->high_timestamp, max_age);
+    ats_free(block);
+    return 0;
+  }
+
+  LogBufferHeader *buf_header = LogColumnar::decode((LogColumnarHeader *)block);
+  int ret = 1;
+
+  ats_free(block);
+  if (buf_header) {
+    ret = parse_log_buff(buf_header, cl.summary != 0);
+    ats_free(buf_header);
+  } else {
+    Debug("logstats", "Failed to decode columnar block.");
+  }
+
+  return ret;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Process a file (FD)
 int
@@ -1701,7 +1755,7 @@ process_file(int in_fd, off_t offset, unsigned max_age)
           return 0;
         }
         // ensure that this is a valid logbuffer header
-        if (header->cookie && (LOG_SEGMENT_COOKIE == header->cookie)) {
+        if (header->cookie && (LOG_SEGMENT_COOKIE == header->cookie || LOG_COLUMNAR_COOKIE == header->cookie)) {
           offset = 0;
           break;
         }
@@ -1716,12 +1770,20 @@ process_file(int in_fd, off_t offset, unsigned max_age)
         return 0;
 
       // ensure that this is a valid logbuffer header
-      if (header->cookie != LOG_SEGMENT_COOKIE) {
+      if (header->cookie != LOG_SEGMENT_COOKIE && header->cookie != LOG_COLUMNAR_COOKIE) {
         Debug("logstats", "Invalid segment cookie (expected %d, got %d)", LOG_SEGMENT_COOKIE, header->cookie);
         return 1;
       }
     }
 
+    if (LOG_COLUMNAR_COOKIE == header->cookie) {
+      if (process_columnar_block(in_fd, buffer, first_read_size, max_age) != 0) {
+        Debug("logstats", "Failed to process columnar block.");
+        return 1;
+      }
+      continue;
+    }
+
     Debug("logstats", "LogBuffer version %d, current = %d", header->version, LOG_SEGMENT_VERSION);
     if (header->version != LOG_SEGMENT_VERSION)
       return 1;